@@ -54,7 +54,7 @@ typedef __uint128_t uint128_t;
 #define INDEX_ADDRESS_MAX ((uint128_t) 0xFFFFFFFFFFFFFFFF) << 64 | 0xFFFFFFFFFFFFFFFF
 #define INDEX_ADDRESS_MIN ((uint128_t) 0x0000000000000000) << 64 | 0x0000000000000000
 
-typedef uint16_t      mtn_index_partition_t;
+typedef uint16_t      mtn_index_partition_t; /* 0xFFFF is reserved and rejected with MTN_ERROR_BAD_PARAM */
 typedef uint128_t     mtn_index_address_t;
 
 /* 1MB max string size */
@@ -64,6 +64,27 @@ typedef uint128_t     mtn_index_address_t;
 #define MTN_OPT_DB_PATH 1 /* the path to store the DB files */
 #define MTN_OPT_LUA_PATH 2 /* the search path for lua packages */
 #define MTN_OPT_LUA_CPATH 3 /* the search path for shared libraries utilized by lua  */
+#define MTN_OPT_QUERY_THREADS 4 /* number of threads used to execute a single query, as a decimal string, defaults to 1 */
+#define MTN_OPT_QUERY_CACHE_SIZE 5 /* maximum number of query results to cache, as a decimal string, defaults to 0 */
+#define MTN_OPT_SUBEXPRESSION_CACHE_SIZE 6 /* maximum number of intermediate query results to cache, as a decimal string, defaults to 0 */
+#define MTN_OPT_SUBEXPRESSION_CACHE_TTL 7 /* milliseconds an intermediate query result is kept, as a decimal string, defaults to 1000 */
+#define MTN_OPT_TRIGRAM_VALUES 8 /* store the values of trigram and prefix indexed fields along with the indexes to verify regex and long prefix matches, "0" or "1", defaults to "1". A regex or long prefix query with a candidate row that was indexed without its value fails with MTN_ERROR_UNVERIFIED */
+#define MTN_OPT_TRIGRAM_FOLD 9 /* fold trigram indexed values and regex literals, "0" none, "1" case, "2" case and full width forms, defaults to "0" */
+#define MTN_OPT_ROW_DICTIONARY 10 /* map row ids to dense sequential ids per bucket before they are used as bit positions, "0" or "1", defaults to "0" */
+#define MTN_OPT_FORWARD_INDEX 11 /* keep the (field, value) pairs of every row to look them up by row id, "0" or "1", defaults to "0" */
+#define MTN_OPT_BACKEND 12 /* where indexes are stored, "leveldb" or "memory", defaults to "leveldb". With "memory" MTN_OPT_DB_PATH is an optional snapshot file */
+#define MTN_OPT_MEMORY_SHARDS 13 /* number of independently locked shards of the memory backend, as a decimal string, defaults to 16 */
+#define MTN_OPT_DELTA_LOG 14 /* append single bit writes to leveldb as small deltas folded into their segment when it is read, instead of rewriting the segment, "0" or "1", defaults to "0" */
+#define MTN_OPT_LEVELDB_CACHE_SIZE 15 /* bytes of the leveldb block cache, as a decimal string, defaults to the leveldb default of 8MB */
+#define MTN_OPT_LEVELDB_BLOOM_BITS 16 /* bits per key of the leveldb bloom filter, "0" disables it, as a decimal string, defaults to 10 */
+#define MTN_OPT_LEVELDB_WRITE_BUFFER_SIZE 17 /* bytes of the leveldb memtable, as a decimal string, defaults to the leveldb default of 4MB */
+#define MTN_OPT_LEVELDB_BLOCK_SIZE 18 /* uncompressed bytes of a leveldb block, as a decimal string, defaults to the leveldb default of 4KB */
+#define MTN_OPT_LEVELDB_COMPRESSION 19 /* compress leveldb blocks with snappy, "0" or "1", defaults to "1" */
+#define MTN_OPT_LEVELDB_SCAN_FILL_CACHE 20 /* whether blocks read by index scans are added to the block cache, "0" or "1", defaults to "1" */
+#define MTN_OPT_SCAN_THREADS 21 /* number of threads a leveldb scan of many indexes is split over, as a decimal string, defaults to 1 */
+#define MTN_OPT_CATALOG 22 /* keep a catalog of indexes so they are found again after a restart, "0" or "1", defaults to "0" */
+#define MTN_OPT_WARM_INDEXES 23 /* number of the most queried cataloged indexes read in the background at init, as a decimal string, defaults to 0 */
+#define MTN_OPT_COMPACT_CLEARS 24 /* compact the indexes written since the last compaction in the background after this many writes that clear bits, as a decimal string, defaults to 0 which only compacts when mutton_compact is called */
 
 /* Event Processing script types */
 #define MTN_SCRIPT_LUA 1
@@ -77,6 +98,8 @@ typedef uint128_t     mtn_index_address_t;
 #define MTN_ERROR_SCRIPT 5
 #define MTN_ERROR_UNKOWN_EVENT_TYPE 6
 #define MTN_ERROR_BAD_PARAM 7
+#define MTN_ERROR_BAD_QUERY 8
+#define MTN_ERROR_UNVERIFIED 9
 
 /**
  * Allocate a new libmutton context.
@@ -227,6 +250,73 @@ mutton_index_value_trigram(
     bool                  state,
     void**                status);
 
+/**
+ * Index a byte array for prefix queries for the given field and row. The
+ * first 16 bytes of the value make up its key, so (prefix ...) queries
+ * for up to 16 bytes are answered by the index alone.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the indexed field
+ * @param bucket_size size of the bucket array
+ * @param field indexed field
+ * @param field_size size of the field array
+ * @param value the byte array being indexed
+ * @param value_size the size of the value byte array
+ * @param who_or_what ID of the row which contains the indexed value
+ * @param state set the index value to true or false
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_index_value_prefix(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 value,
+    size_t                value_size,
+    mtn_index_address_t   who_or_what,
+    bool                  state,
+    void**                status);
+
+/**
+ * Index a byte array through the value dictionary of the given field and
+ * row. Every distinct value of the field is assigned the next dense id,
+ * which is the value the row is indexed under, so values never collide
+ * the way hashed values do. Query the field with (value "field" "str").
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the indexed field
+ * @param bucket_size size of the bucket array
+ * @param field indexed field
+ * @param field_size size of the field array
+ * @param value the byte array being indexed
+ * @param value_size the size of the value byte array
+ * @param who_or_what ID of the row which contains the indexed value
+ * @param state set the index value to true or false
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_index_value_string(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 value,
+    size_t                value_size,
+    mtn_index_address_t   who_or_what,
+    bool                  state,
+    void**                status);
+
 /**
  * Execute a query for the supplied bucket.
  *
@@ -266,6 +356,347 @@ mutton_query(
     size_t                query_size,
     void**                status);
 
+/**
+ * Parse and compile a query into a reusable plan for the supplied bucket.
+ *
+ * Index handles and regex trigram ranges are resolved once so that repeated executions only perform bitmap operations.
+ * A slice may contain parameter slots which are bound when the query is executed: (slice "a" (param 0))
+ *
+ * Note: Prepared queries must be freed using the supplied mutton_free_prepared_query function, and must not outlive the context.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the indexed field
+ * @param bucket_size size of the bucket array
+ * @param query query string
+ * @param query_size query string size
+ * @param prepared output pointer for the prepared query
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_prepare_query(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 query,
+    size_t                query_size,
+    void**                prepared,
+    void**                status);
+
+/**
+ * Execute a prepared query
+ *
+ * Note: the query result must be freed using the supplied mutton_free_query_result function. Its rows are read with mutton_query_result_count and mutton_query_result_rows.
+ * A prepared query may be executed from several threads at once, executions of the same prepared query wait for each other only while its indexes are looked up.
+ * Note: queries block writers. The result is a single point in time of every index the query reads, because the indexes are locked shared from lookup until the result, and any group counts, have been produced. Writes to those indexes wait for the whole evaluation, including regex verification. Writes to other indexes don't wait. Keep queries over hot indexes short, or run them on a context that isn't being written to.
+ *
+ * @param context allocated mutton context
+ * @param prepared prepared query
+ * @param params parameter ranges, two values (start, limit] per slot ordered by slot number
+ * @param params_size number of values in the params array
+ * @param result output pointer for the query result
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_execute_prepared(
+    void*                context,
+    void*                prepared,
+    mtn_index_address_t* params,
+    size_t               params_size,
+    void**               result,
+    void**               status);
+
+/**
+ * Get the number of rows in a query result
+ *
+ * @param result query result
+ *
+ * @return number of rows
+ */
+MUTTON_EXPORT uint64_t
+mutton_query_result_count(
+    void* result);
+
+/**
+ * Copy the rows of a query result in ascending order. Page through a result by passing the last row returned plus one as start.
+ *
+ * Note: with MTN_OPT_ROW_DICTIONARY set the rows are dense ids, mutton_row_ids maps them back to row ids.
+ *
+ * @param result query result
+ * @param start first row to return if it is in the result
+ * @param rows output array for the rows
+ * @param rows_size size of the rows array
+ *
+ * @return number of rows written, less than rows_size once the result is exhausted
+ */
+MUTTON_EXPORT size_t
+mutton_query_result_rows(
+    void*                result,
+    mtn_index_address_t  start,
+    mtn_index_address_t* rows,
+    size_t               rows_size);
+
+/**
+ * Map the rows of a query result back to the row ids they were indexed with. With MTN_OPT_ROW_DICTIONARY set rows are dense ids assigned per bucket, otherwise they are the row ids and are copied as they are.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace the query was run against
+ * @param bucket_size size of the bucket array
+ * @param rows rows returned by mutton_query_result_rows
+ * @param rows_size number of rows
+ * @param output output array for the row ids, at least rows_size long, may be rows
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull, MTN_ERROR_NOT_FOUND if a row has no row id
+ */
+MUTTON_EXPORT bool
+mutton_row_ids(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    mtn_index_address_t*  rows,
+    size_t                rows_size,
+    mtn_index_address_t*  output,
+    void**                status);
+
+/**
+ * Free the prepared query
+ *
+ * @param prepared prepared query
+ */
+MUTTON_EXPORT void
+mutton_free_prepared_query(
+    void* prepared);
+
+/**
+ * Free the query result
+ *
+ * @param result query result
+ */
+MUTTON_EXPORT void
+mutton_free_query_result(
+    void* result);
+
+/**
+ * Execute a prepared (group ...), (rgroup ...) or (top ...) query
+ *
+ * Note: like mutton_execute_prepared this blocks writes to the filter's indexes, and to the group field's index, until the counts are produced.
+ * Note: the group result must be freed using the supplied mutton_free_group_result function.
+ *
+ * @param context allocated mutton context
+ * @param prepared prepared query
+ * @param params parameter ranges, two values (start, limit] per slot ordered by slot number
+ * @param params_size number of values in the params array
+ * @param result output pointer for the (value, count) pairs
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_execute_prepared_group(
+    void*                context,
+    void*                prepared,
+    mtn_index_address_t* params,
+    size_t               params_size,
+    void**               result,
+    void**               status);
+
+/**
+ * Find the k values of a field with the most members of a query result
+ *
+ * Note: the group result must be freed using the supplied mutton_free_group_result function.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the indexed field
+ * @param bucket_size size of the bucket array
+ * @param field name of the field
+ * @param field_size size of the field array
+ * @param filter query result returned by mutton_execute_prepared
+ * @param k maximum number of values to return
+ * @param result output pointer for the (value, count) pairs, largest count first. Empty if the field was never indexed
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_top_k(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 filter,
+    size_t                k,
+    void**                result,
+    void**                status);
+
+/**
+ * Get the number of (value, count) pairs in a group result
+ *
+ * @param result group result
+ *
+ * @return number of pairs
+ */
+MUTTON_EXPORT size_t
+mutton_group_result_size(
+    void* result);
+
+/**
+ * Get a (value, count) pair from a group result
+ *
+ * @param result group result
+ * @param index position of the pair
+ * @param value output pointer for the value
+ * @param count output pointer for the number of members
+ *
+ * @return true if index is within the result
+ */
+MUTTON_EXPORT bool
+mutton_group_result_get(
+    void*                result,
+    size_t               index,
+    mtn_index_address_t* value,
+    uint64_t*            count);
+
+/**
+ * Free the group result
+ *
+ * @param result group result
+ */
+MUTTON_EXPORT void
+mutton_free_group_result(
+    void* result);
+
+/**
+ * Look up every (field, value) pair a row is indexed under with a single read. Values of string fields are their dictionary ids and values of prefix fields their keys, trigram indexed fields are left out.
+ *
+ * Note: the result is empty unless MTN_OPT_FORWARD_INDEX is set. It must be freed using the supplied mutton_free_row_values function.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the row
+ * @param bucket_size size of the bucket array
+ * @param who_or_what row id the values were indexed for
+ * @param result output pointer for the (field, value) pairs, ordered by field
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_row_values(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    mtn_index_address_t   who_or_what,
+    void**                result,
+    void**                status);
+
+/**
+ * Get the number of (field, value) pairs in a row values result
+ *
+ * @param result row values result
+ *
+ * @return number of pairs
+ */
+MUTTON_EXPORT size_t
+mutton_row_values_size(
+    void* result);
+
+/**
+ * Get a (field, value) pair from a row values result
+ *
+ * @param result row values result
+ * @param index position of the pair
+ * @param field output pointer for the field name, owned by the result
+ * @param field_size output pointer for the size of the field name
+ * @param value output pointer for the value
+ *
+ * @return true if index is within the result
+ */
+MUTTON_EXPORT bool
+mutton_row_values_get(
+    void*                result,
+    size_t               index,
+    void**               field,
+    size_t*              field_size,
+    mtn_index_address_t* value);
+
+/**
+ * Free the row values result
+ *
+ * @param result row values result
+ */
+MUTTON_EXPORT void
+mutton_free_row_values(
+    void* result);
+
+/**
+ * Drop the index segments left without any bits set by clears, from memory and from storage, and fold any bits written with MTN_OPT_DELTA_LOG into the segments of the loaded indexes
+ *
+ * @param context allocated mutton context
+ * @param reclaimed output pointer for the bytes of segment storage freed, may be NULL
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_compact(
+    void*     context,
+    uint64_t* reclaimed,
+    void**    status);
+
+/**
+ * Drop every index of the partition, with its value and row dictionaries and forward index
+ *
+ * Note: with the leveldb backend this reads and deletes every key of the partition, so it takes time in proportion to the partition's size.
+ *
+ * @param context allocated mutton context
+ * @param partition partition to drop
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_drop_partition(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void**                status);
+
+/**
+ * Drop the indexes of the bucket whose field name starts with prefix, with their value dictionaries
+ *
+ * Note: forward index records keep listing the dropped fields until their rows are indexed again. Every backend reads and deletes the keys of the bucket, so it takes time in proportion to the bucket's size.
+ *
+ * @param context allocated mutton context
+ * @param partition partition, used to create logical seperation between indexes and other data
+ * @param bucket bucket namespace for the indexed fields
+ * @param bucket_size size of the bucket array
+ * @param prefix prefix of the field names to drop, may not be NULL or empty, use mutton_drop_partition to drop every field
+ * @param prefix_size size of the prefix array
+ * @param status output pointer to status if error is encountered, NULL otherwise. If input value of status is not NULL it will be freed prior to being set.
+ *
+ * @return true if successfull
+ */
+MUTTON_EXPORT bool
+mutton_drop_fields(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 prefix,
+    size_t                prefix_size,
+    void**                status);
+
 /**
  * Register a script with the event proccessing system
  *
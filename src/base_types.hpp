@@ -73,6 +73,16 @@ namespace mtn {
         }
     };
 
+    struct index_address_hash_t
+    {
+        size_t
+        operator()(
+            const mtn_index_address_t a) const
+        {
+            return (size_t) ((uint64_t) a ^ ((uint64_t) (a >> 64) * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
 } // namespace mtn
 
 #endif // __MUTTON_BASE_TYPES_HPP_INCLUDED__
@@ -0,0 +1,60 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "encode.hpp"
+
+#include "catalog.hpp"
+
+#define MTN_CATALOG_VALUE_SIZE (sizeof(mtn_index_address_t) + sizeof(uint32_t) + sizeof(uint64_t))
+
+void
+mtn::catalog_t::encode(
+    const catalog_entry_t&    entry,
+    std::vector<mtn::byte_t>& output)
+{
+    output.resize(sizeof(uint64_t) + entry.values.size() * MTN_CATALOG_VALUE_SIZE);
+    mtn::byte_t* pos = mtn::encode_uint64(entry.hits, &output[0]);
+    for (std::vector<catalog_value_t>::const_iterator iter = entry.values.begin(); iter != entry.values.end(); ++iter) {
+        pos = mtn::encode_uint128(iter->value, pos);
+        pos = mtn::encode_uint32(iter->segments, pos);
+        pos = mtn::encode_uint64(iter->cardinality, pos);
+    }
+}
+
+bool
+mtn::catalog_t::decode(
+    const std::vector<mtn::byte_t>& input,
+    catalog_entry_t&                output)
+{
+    if (input.size() < sizeof(uint64_t) || (input.size() - sizeof(uint64_t)) % MTN_CATALOG_VALUE_SIZE != 0) {
+        return false;
+    }
+
+    mtn::decode_uint64(&input[0], &output.hits);
+    output.values.clear();
+    for (size_t pos = sizeof(uint64_t); pos < input.size(); pos += MTN_CATALOG_VALUE_SIZE) {
+        catalog_value_t value;
+        mtn::decode_uint128(&input[pos], &value.value);
+        mtn::decode_uint32(&input[pos + sizeof(mtn_index_address_t)], &value.segments);
+        mtn::decode_uint64(&input[pos + sizeof(mtn_index_address_t) + sizeof(uint32_t)], &value.cardinality);
+        output.values.push_back(value);
+    }
+    return true;
+}
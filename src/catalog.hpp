@@ -0,0 +1,92 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __MUTTON_CATALOG_HPP_INCLUDED__
+#define __MUTTON_CATALOG_HPP_INCLUDED__
+
+#include <vector>
+
+#include "base_types.hpp"
+
+namespace mtn {
+
+    struct catalog_value_t
+    {
+        mtn_index_address_t value;
+        uint32_t            segments;
+        uint64_t            cardinality;
+
+        catalog_value_t(
+            mtn_index_address_t value = 0,
+            uint32_t            segments = 0,
+            uint64_t            cardinality = 0) :
+            value(value),
+            segments(segments),
+            cardinality(cardinality)
+        {}
+    };
+
+    struct catalog_entry_t
+    {
+        mtn_index_partition_t        partition;
+        std::vector<mtn::byte_t>     bucket;
+        std::vector<mtn::byte_t>     field;
+        uint64_t                     hits;
+        std::vector<catalog_value_t> values;
+
+        catalog_entry_t() :
+            partition(0),
+            hits(0)
+        {}
+
+        catalog_entry_t(
+            mtn_index_partition_t           partition,
+            const std::vector<mtn::byte_t>& bucket,
+            const std::vector<mtn::byte_t>& field) :
+            partition(partition),
+            bucket(bucket),
+            field(field),
+            hits(0)
+        {}
+    };
+
+    // Which indexes exist, kept as one record per index so a context can
+    // find them at startup without scanning every segment. A record
+    // holds the number of times the index was looked up by queries,
+    // followed by the segment count and cardinality of every value as of
+    // the last time the context saved it. The partition, bucket and
+    // field are in the key of the record.
+    struct catalog_t
+    {
+        typedef std::vector<mtn::catalog_entry_t> entries_t;
+
+        static void
+        encode(const catalog_entry_t&    entry,
+               std::vector<mtn::byte_t>& output);
+
+        // false if the record is truncated
+        static bool
+        decode(const std::vector<mtn::byte_t>& input,
+               catalog_entry_t&                output);
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_CATALOG_HPP_INCLUDED__
@@ -20,9 +20,16 @@
 #ifndef __MUTTON_CONTEXT_HPP_INCLUDED__
 #define __MUTTON_CONTEXT_HPP_INCLUDED__
 
+#include <algorithm>
+#include <set>
 #include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/asio.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 #include <libcql/cql_future_connection.hpp>
@@ -34,11 +41,24 @@
 
 
 #include "base_types.hpp"
+#include "catalog.hpp"
+#include "encode.hpp"
+#include "forward_index.hpp"
 #include "index.hpp"
 #include "index_reader_writer.hpp"
+#include "query_cache.hpp"
+#include "row_dictionary.hpp"
 #include "status.hpp"
+#include "thread_pool.hpp"
+#include "trigram.hpp"
+#include "value_dictionary.hpp"
+#include "value_store.hpp"
 #include "lua.hpp"
 
+// number of mutexes forward index records are updated under, a row's
+// record always uses the same one
+#define MTN_FORWARD_INDEX_STRIPES 64
+
 struct client_functor_t
 {
 
@@ -66,17 +86,42 @@ namespace mtn {
     class context_t {
     public:
 
-        typedef std::vector<mtn::byte_t>                       index_key_t;
-        typedef boost::ptr_map<index_key_t, mtn::index_t>      index_container_t;
-        typedef std::map<int, std::vector<mtn::byte_t> >       options_container_t;
-        typedef boost::unordered_map<std::string, lua_state_t> lua_state_container_t;
+        typedef std::vector<mtn::byte_t>                            index_key_t;
+        typedef boost::ptr_map<index_key_t, mtn::index_t>           index_container_t;
+        typedef std::map<int, std::vector<mtn::byte_t> >            options_container_t;
+        typedef boost::unordered_map<std::string, lua_state_t>      lua_state_container_t;
+        typedef boost::unordered_map<const mtn::index_t*, uint64_t> version_container_t;
+        typedef boost::ptr_map<const mtn::index_t*, mtn::value_dictionary_t> dictionary_container_t;
+        typedef std::map<index_key_t, mtn::catalog_entry_t>         catalog_container_t;
 
         context_t(mtn::index_reader_writer_t* rw) :
             _rw(rw),
+            _drop_generation(0),
             _work(_io),
-            _io_thread(boost::bind(&boost::asio::io_service::run, &_io))
+            _io_thread(boost::bind(&boost::asio::io_service::run, &_io)),
+            _store_trigram_values(true),
+            _trigram_fold(mtn::MTN_TRIGRAM_FOLD_NONE),
+            _dense_rows(false),
+            _forward_index(false),
+            _catalog(false),
+            _prefetch_generation(0),
+            _compact_clears(0),
+            _clears(0),
+            _reclaimed(0)
         {}
 
+        ~context_t()
+        {
+            _io.stop();
+            _io_thread.join();
+
+            // there's no caller left to report a failure to, the records
+            // written by the last compaction are kept
+            if (_catalog) {
+                save_catalog();
+            }
+        }
+
         inline mtn::status_t
         set_opt(int         option,
                 const void* value,
@@ -100,10 +145,80 @@ namespace mtn {
             return true;
         }
 
+        // numeric options are supplied as decimal strings
+        bool
+        get_opt(int     option,
+                size_t& output)
+        {
+            std::string value;
+            if (!get_opt(option, value)) {
+                return false;
+            }
+
+            try {
+                output = boost::lexical_cast<size_t>(value);
+            }
+            catch (const boost::bad_lexical_cast&) {
+                return false;
+            }
+            return true;
+        }
+
         inline mtn::status_t
         init()
         {
-            return _rw->init(*this);
+            std::string backend;
+            if (get_opt(MTN_OPT_BACKEND, backend)) {
+                mtn::index_reader_writer_t* rw = mtn::index_reader_writer_t::create(backend);
+                if (!rw) {
+                    return mtn::status_t(MTN_ERROR_BAD_CONFIGURATION, "unknown backend");
+                }
+                _rw.reset(rw);
+            }
+
+            size_t query_threads = 1;
+            if (get_opt(MTN_OPT_QUERY_THREADS, query_threads) && query_threads > 1) {
+                _query_pool.reset(new mtn::thread_pool_t(query_threads));
+            }
+
+            size_t query_cache_size = 0;
+            if (get_opt(MTN_OPT_QUERY_CACHE_SIZE, query_cache_size) && query_cache_size > 0) {
+                _query_cache.reset(new mtn::query_cache_t(query_cache_size));
+            }
+
+            size_t store_trigram_values = 1;
+            get_opt(MTN_OPT_TRIGRAM_VALUES, store_trigram_values);
+            _store_trigram_values = store_trigram_values != 0;
+
+            size_t trigram_fold = mtn::MTN_TRIGRAM_FOLD_NONE;
+            get_opt(MTN_OPT_TRIGRAM_FOLD, trigram_fold);
+            if (trigram_fold > mtn::MTN_TRIGRAM_FOLD_CASE_WIDTH) {
+                return mtn::status_t(MTN_ERROR_BAD_CONFIGURATION, "unknown trigram fold mode");
+            }
+            _trigram_fold = static_cast<mtn::trigram_fold_enum>(trigram_fold);
+
+            size_t dense_rows = 0;
+            get_opt(MTN_OPT_ROW_DICTIONARY, dense_rows);
+            _dense_rows = dense_rows != 0;
+
+            size_t forward_index = 0;
+            get_opt(MTN_OPT_FORWARD_INDEX, forward_index);
+            _forward_index = forward_index != 0;
+
+            get_opt(MTN_OPT_COMPACT_CLEARS, _compact_clears);
+
+            size_t subexpression_cache_size = 0;
+            size_t subexpression_cache_ttl = 1000;
+            get_opt(MTN_OPT_SUBEXPRESSION_CACHE_TTL, subexpression_cache_ttl);
+            if (get_opt(MTN_OPT_SUBEXPRESSION_CACHE_SIZE, subexpression_cache_size) && subexpression_cache_size > 0) {
+                _subexpression_cache.reset(new mtn::query_cache_t(subexpression_cache_size, subexpression_cache_ttl));
+            }
+
+            mtn::status_t status = _rw->init(*this);
+            if (status) {
+                status = open_catalog();
+            }
+            return status;
 
             cql::cql_client_pool_t::cql_client_callback_t client_factory;
             // if (argc > 1) {
@@ -122,6 +237,28 @@ namespace mtn {
             return *_rw;
         }
 
+        // the index a query reads, counted as a hit in its catalog record
+        inline mtn::status_t
+        query_index(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& field,
+                    mtn::index_t**                  output)
+        {
+            index_key_t key;
+            key.reserve(bucket.size() + field.size());
+            key.insert(key.end(), bucket.begin(), bucket.end());
+            key.insert(key.end(), field.begin(), field.end());
+
+            {
+                boost::mutex::scoped_lock lock(_indexes_mutex);
+                catalog_container_t::iterator entry = _catalog_entries.find(key);
+                if (entry != _catalog_entries.end()) {
+                    ++entry->second.hits;
+                }
+            }
+            return get_index(partition, bucket, field, output);
+        }
+
         inline mtn::status_t
         get_index(mtn_index_partition_t,
                   const std::vector<mtn::byte_t>& bucket,
@@ -133,6 +270,8 @@ namespace mtn {
             key.insert(key.end(), bucket.begin(), bucket.end());
             key.insert(key.end(), field.begin(), field.end());
 
+            boost::mutex::scoped_lock lock(_indexes_mutex);
+            catalog_container_t::iterator entry = _catalog_entries.find(key);
             mtn::status_t status;
             index_container_t::iterator iter = _indexes.find(key);
             if (iter != _indexes.end()) {
@@ -140,6 +279,10 @@ namespace mtn {
                 return status;
             }
 
+            if (entry != _catalog_entries.end()) {
+                return load_index(lock, key, entry->second, output);
+            }
+
             status.library = true;
             status.code = MTN_ERROR_NOT_FOUND;
             status.message = "index not found";
@@ -164,11 +307,16 @@ namespace mtn {
                      FieldIterator         field_end,
                      mtn::index_t**        output)
         {
+            if (partition == MTN_DICTIONARY_PARTITION) {
+                return mtn::status_t(MTN_ERROR_BAD_PARAM, "partition is reserved");
+            }
+
             index_key_t key;
             key.reserve(std::distance(bucket_begin, bucket_end) + std::distance(field_begin, field_end));
             key.insert(key.end(), bucket_begin, bucket_end);
             key.insert(key.end(), field_begin, field_end);
 
+            boost::mutex::scoped_lock lock(_indexes_mutex);
             mtn::status_t status;
             index_container_t::iterator iter = _indexes.find(key);
             if (iter != _indexes.end()) {
@@ -178,6 +326,30 @@ namespace mtn {
                 return status;
             }
 
+            // only an index found in the persisted catalog has anything
+            // to read from the backend, a new one is cataloged and starts
+            // out empty like it would without the catalog
+            if (_catalog) {
+                catalog_container_t::iterator entry = _catalog_entries.find(key);
+                if (entry != _catalog_entries.end()) {
+                    mtn::index_t* index = NULL;
+                    status = load_index(lock, key, entry->second, &index);
+                    if (status && output) {
+                        *output = index;
+                    }
+                    return status;
+                }
+
+                mtn::catalog_entry_t created(partition,
+                                             std::vector<mtn::byte_t>(bucket_begin, bucket_end),
+                                             std::vector<mtn::byte_t>(field_begin, field_end));
+                status = _rw->write_catalog(created);
+                if (!status) {
+                    return status;
+                }
+                _catalog_entries.insert(std::make_pair(key, created));
+            }
+
             std::pair<index_container_t::iterator, bool> insert_result
                 = _indexes.insert(key, new mtn::index_t(partition, bucket_begin, bucket_end, field_begin, field_end));
 
@@ -216,10 +388,27 @@ namespace mtn {
                     mtn_index_address_t   who_or_what,
                     bool                  state)
         {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
             mtn::index_t* index = NULL;
             mtn::status_t create_status = create_index(partition, bucket_begin, bucket_end, field_begin, field_end, &index);
             if (create_status && index) {
-                return index->index_value(*_rw, value, who_or_what, state);
+                mtn_index_address_t bit = 0;
+                bool found = false;
+                create_status = row_bit(partition, bucket_begin, bucket_end, who_or_what, state, bit, found);
+                if (!create_status || !found) {
+                    return create_status;
+                }
+
+                // the forward index only records a value once its bit is
+                // written, it's updated under the index's lock so it
+                // follows the bits in the order they were written
+                begin_write(index);
+                create_status = index->index_value(*_rw, value, bit, state);
+                if (create_status) {
+                    create_status = update_forward_index(partition, bucket_begin, bucket_end, field_begin, field_end, value, who_or_what, state);
+                }
+                end_write(index, !state);
+                return compact_due(create_status);
             }
             return create_status;
         }
@@ -249,14 +438,282 @@ namespace mtn {
                             mtn_index_address_t   who_or_what,
                             bool                  state)
         {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
             mtn::index_t* index = NULL;
             mtn::status_t create_status = create_index(partition, bucket_begin, bucket_end, field_begin, field_end, &index);
             if (create_status && index) {
-                return index->index_value_trigram(*_rw, first, last, who_or_what, state);
+                mtn_index_address_t bit = 0;
+                bool found = false;
+                create_status = row_bit(partition, bucket_begin, bucket_end, who_or_what, state, bit, found);
+                if (!create_status || !found) {
+                    return create_status;
+                }
+
+                begin_write(index);
+                if (_store_trigram_values) {
+                    create_status = mtn::value_store_t::update(*_rw, *index, bit, std::string(first, last), state);
+                    if (!create_status) {
+                        end_write(index, false);
+                        return create_status;
+                    }
+                }
+                create_status = index->index_value_trigram(*_rw, first, last, bit, state, _trigram_fold);
+                end_write(index, !state);
+                return compact_due(create_status);
             }
             return create_status;
         }
 
+        template<class ValueIterator>
+        inline mtn::status_t
+        index_value_prefix(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           const std::vector<mtn::byte_t>& field,
+                           ValueIterator                   first,
+                           ValueIterator                   last,
+                           mtn_index_address_t             who_or_what,
+                           bool                            state)
+        {
+            return index_value_prefix(partition, bucket.begin(), bucket.end(), field.begin(), field.end(), first, last, who_or_what, state);
+        }
+
+        template<class BucketIterator, class FieldIterator, class ValueIterator>
+        inline mtn::status_t
+        index_value_prefix(mtn_index_partition_t partition,
+                           BucketIterator        bucket_begin,
+                           BucketIterator        bucket_end,
+                           FieldIterator         field_begin,
+                           FieldIterator         field_end,
+                           ValueIterator         first,
+                           ValueIterator         last,
+                           mtn_index_address_t   who_or_what,
+                           bool                  state)
+        {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            mtn::index_t* index = NULL;
+            mtn::status_t create_status = create_index(partition, bucket_begin, bucket_end, field_begin, field_end, &index);
+            if (create_status && index) {
+                mtn_index_address_t bit = 0;
+                bool found = false;
+                create_status = row_bit(partition, bucket_begin, bucket_end, who_or_what, state, bit, found);
+                if (!create_status || !found) {
+                    return create_status;
+                }
+
+                std::string value(first, last);
+                begin_write(index);
+
+                // only values as long as the key can share it with a
+                // longer prefix, the rest never need to be verified
+                if (_store_trigram_values && value.size() >= MTN_PREFIX_KEY_BYTES) {
+                    create_status = mtn::value_store_t::update(*_rw, *index, bit, value, state);
+                    if (!create_status) {
+                        end_write(index, false);
+                        return create_status;
+                    }
+                }
+                create_status = index->index_value_prefix(*_rw, value.begin(), value.end(), bit, state);
+                if (create_status) {
+                    create_status = update_forward_index(partition, bucket_begin, bucket_end, field_begin, field_end, mtn::prefix_t::to_key(value.begin(), value.end()), who_or_what, state);
+                }
+                end_write(index, !state);
+                return compact_due(create_status);
+            }
+            return create_status;
+        }
+
+        template<class ValueIterator>
+        inline mtn::status_t
+        index_value_string(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           const std::vector<mtn::byte_t>& field,
+                           ValueIterator                   first,
+                           ValueIterator                   last,
+                           mtn_index_address_t             who_or_what,
+                           bool                            state)
+        {
+            return index_value_string(partition, bucket.begin(), bucket.end(), field.begin(), field.end(), first, last, who_or_what, state);
+        }
+
+        // index the dictionary id of the value, a new value is given the
+        // next id of the field and the pair is written to the backend
+        template<class BucketIterator, class FieldIterator, class ValueIterator>
+        inline mtn::status_t
+        index_value_string(mtn_index_partition_t partition,
+                           BucketIterator        bucket_begin,
+                           BucketIterator        bucket_end,
+                           FieldIterator         field_begin,
+                           FieldIterator         field_end,
+                           ValueIterator         first,
+                           ValueIterator         last,
+                           mtn_index_address_t   who_or_what,
+                           bool                  state)
+        {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            mtn::index_t* index = NULL;
+            mtn::status_t status = create_index(partition, bucket_begin, bucket_end, field_begin, field_end, &index);
+            if (!status || !index) {
+                return status;
+            }
+
+            mtn::value_dictionary_t* dictionary = NULL;
+            status = value_dictionary(index, &dictionary);
+            if (!status) {
+                return status;
+            }
+
+            mtn_index_address_t bit = 0;
+            bool found = false;
+            status = row_bit(partition, bucket_begin, bucket_end, who_or_what, state, bit, found);
+            if (!status || !found) {
+                return status;
+            }
+
+            // the dictionary is read by queries along with the index, so
+            // it's only changed while the index is locked
+            begin_write(index);
+            std::string value(first, last);
+            mtn::value_dictionary_t::id_t id = 0;
+            bool indexed = state || dictionary->find(value, id);
+            if (state) {
+                bool added = false;
+                status = dictionary->insert(value, id, &added);
+                if (status && added) {
+                    status = _rw->write_value_dictionary(partition, index->bucket(), index->field(), id, value);
+                }
+            }
+
+            // a value that was never indexed has no bit to clear
+            if (status && indexed) {
+                status = index->index_value(*_rw, id, bit, state);
+            }
+
+            if (status && indexed) {
+                status = update_forward_index(partition, bucket_begin, bucket_end, field_begin, field_end, id, who_or_what, state);
+            }
+            end_write(index, !state && indexed);
+            return compact_due(status);
+        }
+
+        // the dictionary of the string values of the index, read from the
+        // backend the first time it's used
+        inline mtn::status_t
+        value_dictionary(const mtn::index_t*       index,
+                         mtn::value_dictionary_t** output)
+        {
+            boost::mutex::scoped_lock lock(_indexes_mutex);
+            dictionary_container_t::iterator iter = _dictionaries.find(index);
+            if (iter != _dictionaries.end()) {
+                *output = iter->second;
+                return mtn::status_t();
+            }
+
+            std::auto_ptr<mtn::value_dictionary_t> dictionary(new mtn::value_dictionary_t());
+            mtn::status_t status = _rw->read_value_dictionary(index->partition(), index->bucket(), index->field(), *dictionary);
+            if (status) {
+                *output = dictionary.get();
+                const mtn::index_t* key = index;
+                _dictionaries.insert(key, dictionary);
+            }
+            return status;
+        }
+
+        // the dense ids of the row ids of the bucket, read from the backend
+        // the first time it's used. The dictionary stays put for as long
+        // as the caller holds the drop mutex.
+        inline mtn::status_t
+        row_dictionary(mtn_index_partition_t           partition,
+                       const std::vector<mtn::byte_t>& bucket,
+                       mtn::row_dictionary_t**         output)
+        {
+            row_dictionary_key_t key(partition, bucket);
+            boost::mutex::scoped_lock lock(_row_dictionaries_mutex);
+            row_dictionary_container_t::iterator iter = _row_dictionaries.find(key);
+            if (iter != _row_dictionaries.end()) {
+                *output = iter->second;
+                return mtn::status_t();
+            }
+
+            std::auto_ptr<mtn::row_dictionary_t> dictionary(new mtn::row_dictionary_t());
+            mtn::status_t status = _rw->read_row_dictionary(partition, bucket, *dictionary);
+            if (status) {
+                *output = dictionary.get();
+                _row_dictionaries.insert(key, dictionary);
+            }
+            return status;
+        }
+
+        // the row ids of the bits set in a query result
+        inline mtn::status_t
+        rows(mtn_index_partition_t             partition,
+             const std::vector<mtn::byte_t>&   bucket,
+             const mtn::index_slice_t&         slice,
+             std::vector<mtn_index_address_t>& output)
+        {
+            std::vector<mtn_index_address_t> bits;
+            slice.rows(bits);
+            if (bits.empty()) {
+                return mtn::status_t();
+            }
+
+            size_t offset = output.size();
+            output.resize(offset + bits.size());
+            mtn::status_t status = row_ids(partition, bucket, &bits[0], bits.size(), &output[offset]);
+            if (!status) {
+                output.resize(offset);
+            }
+            return status;
+        }
+
+        // the row id of every bit of the bucket, the bits themselves unless
+        // MTN_OPT_ROW_DICTIONARY is set. output may be bits.
+        inline mtn::status_t
+        row_ids(mtn_index_partition_t           partition,
+                const std::vector<mtn::byte_t>& bucket,
+                const mtn_index_address_t*      bits,
+                size_t                          size,
+                mtn_index_address_t*            output)
+        {
+            if (!_dense_rows) {
+                std::copy(bits, bits + size, output);
+                return mtn::status_t();
+            }
+
+            mtn::row_dictionary_t* dictionary = NULL;
+            mtn::status_t status = row_dictionary(partition, bucket, &dictionary);
+            for (size_t i = 0; i < size && status; ++i) {
+                if (!dictionary->row(bits[i], output[i])) {
+                    return mtn::status_t(MTN_ERROR_NOT_FOUND, "bit has no row id");
+                }
+            }
+            return status;
+        }
+
+        // every (field, value) pair the row is indexed under, empty unless
+        // MTN_OPT_FORWARD_INDEX is set. Values of string fields are their
+        // dictionary ids and values of prefix fields their keys, trigram
+        // indexed fields are left out.
+        inline mtn::status_t
+        row_values(mtn_index_partition_t            partition,
+                   const std::vector<mtn::byte_t>&  bucket,
+                   mtn_index_address_t              who_or_what,
+                   mtn::forward_index_t::entries_t& output)
+        {
+            std::vector<mtn::byte_t> record;
+            mtn::status_t status = _rw->read_forward_index(partition, bucket, who_or_what, record);
+            if (status && !mtn::forward_index_t::decode(record, output)) {
+                return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "forward index record is truncated");
+            }
+            return status;
+        }
+
+        // whether row ids are mapped to dense ids, MTN_OPT_ROW_DICTIONARY
+        inline bool
+        dense_rows() const
+        {
+            return _dense_rows;
+        }
+
         inline void
         register_lua_script(const char* event_name,
                             size_t      event_name_size,
@@ -308,15 +765,591 @@ namespace mtn {
             return false;
         }
 
+        // pool used to evaluate a single query over several offset
+        // ranges at once, NULL unless MTN_OPT_QUERY_THREADS > 1
+        inline mtn::thread_pool_t*
+        query_pool()
+        {
+            return _query_pool.get();
+        }
+
+        // how trigram indexed values and regex literals are folded
+        inline mtn::trigram_fold_enum
+        trigram_fold() const
+        {
+            return _trigram_fold;
+        }
+
+        // NULL unless MTN_OPT_QUERY_CACHE_SIZE > 0
+        inline mtn::query_cache_t*
+        query_cache()
+        {
+            return _query_cache.get();
+        }
+
+        // intermediate results of query sub-trees, NULL unless
+        // MTN_OPT_SUBEXPRESSION_CACHE_SIZE > 0
+        inline mtn::query_cache_t*
+        subexpression_cache()
+        {
+            return _subexpression_cache.get();
+        }
+
+        // incremented by every write made through the context, read with
+        // the index's lock held. Used to tell whether a cached result read
+        // from the index is stale
+        inline uint64_t
+        index_version(const mtn::index_t* index) const
+        {
+            boost::mutex::scoped_lock lock(_versions_mutex);
+            version_container_t::const_iterator iter = _versions.find(index);
+            return iter == _versions.end() ? 0 : iter->second;
+        }
+
+        // incremented by every drop, index and dictionary pointers taken
+        // before it changed may have been freed
+        inline uint64_t
+        drop_generation() const
+        {
+            return _drop_generation;
+        }
+
+        // held exclusively by drops, and shared by writes and queries for
+        // as long as they use the index pointers they looked up
+        inline boost::shared_mutex&
+        drop_mutex()
+        {
+            return _drop_mutex;
+        }
+
+        // drop the segments left with no bits set by clears made through
+        // the context, from memory and from the backend, and fold the
+        // bits the backend logged apart into the segments of every loaded
+        // index. output, if not NULL, is set to the bytes of segment
+        // storage this freed. With MTN_OPT_CATALOG the catalog records are
+        // written afterwards.
+        inline mtn::status_t
+        compact(uint64_t* output)
+        {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            std::vector<mtn::index_t*> indexes;
+            {
+                boost::mutex::scoped_lock lock(_indexes_mutex);
+                for (index_container_t::iterator iter = _indexes.begin(); iter != _indexes.end(); ++iter) {
+                    indexes.push_back(iter->second);
+                }
+            }
+            {
+                boost::mutex::scoped_lock lock(_versions_mutex);
+                _written.clear();
+            }
+
+            mtn::status_t status = compact_indexes(indexes, output);
+            if (status && _catalog) {
+                status = save_catalog();
+            }
+            return status;
+        }
+
+        // remove every index of the partition from the context and the
+        // backend, along with the partition's dictionaries and forward
+        // index
+        inline mtn::status_t
+        drop_partition(mtn_index_partition_t partition)
+        {
+            boost::unique_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            mtn::status_t status = _rw->drop_partition(partition);
+            if (!status) {
+                return status;
+            }
+            forget_indexes(partition, NULL, NULL);
+
+            boost::mutex::scoped_lock lock(_row_dictionaries_mutex);
+            row_dictionary_container_t::iterator iter = _row_dictionaries.begin();
+            while (iter != _row_dictionaries.end()) {
+                if (iter->first.first == partition) {
+                    _row_dictionaries.erase(iter++);
+                }
+                else {
+                    ++iter;
+                }
+            }
+            return status;
+        }
+
+        // remove the indexes of the bucket whose field starts with prefix
+        // from the context and the backend. The prefix may not be empty.
+        // Forward index records still list the dropped fields until their
+        // rows are written again.
+        inline mtn::status_t
+        drop_fields(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& prefix)
+        {
+            if (prefix.empty()) {
+                return mtn::status_t(MTN_ERROR_BAD_PARAM, "empty field prefix, use drop_partition to drop everything");
+            }
+
+            boost::unique_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            mtn::status_t status = _rw->drop_fields(partition, bucket, prefix);
+            if (status) {
+                forget_indexes(partition, &bucket, &prefix);
+            }
+            return status;
+        }
+
+        // bytes of segment storage freed by every compaction of the context
+        inline uint64_t
+        reclaimed() const
+        {
+            boost::mutex::scoped_lock lock(_versions_mutex);
+            return _reclaimed;
+        }
+
     private:
+        typedef std::pair<mtn_index_partition_t, std::vector<mtn::byte_t> > row_dictionary_key_t;
+
+        // the index is locked exclusively from begin_write to end_write,
+        // queries reading it wait for the write to finish and the other
+        // way around
+        inline void
+        begin_write(mtn::index_t* index)
+        {
+            index->mutex().lock();
+        }
+
+        // cleared counts the write towards MTN_OPT_COMPACT_CLEARS, the
+        // index is compacted along with the next due compaction
+        inline void
+        end_write(mtn::index_t* index,
+                  bool          cleared)
+        {
+            {
+                boost::mutex::scoped_lock lock(_versions_mutex);
+                ++_versions[index];
+                _written.insert(index);
+                if (cleared) {
+                    ++_clears;
+                }
+            }
+            index->mutex().unlock();
+        }
+
+        // drop the empty segments of the indexes and fold their deltas,
+        // the caller holds the drop lock. The indexes are locked like for
+        // a write, but no bit changes so their versions are left alone.
+        // Indexes left over by a failure are compacted the next time.
+        inline mtn::status_t
+        compact_indexes(const std::vector<mtn::index_t*>& indexes,
+                        uint64_t*                         output)
+        {
+            uint64_t reclaimed = 0;
+            mtn::status_t status;
+            std::vector<mtn::index_t*>::const_iterator iter = indexes.begin();
+            for (; status && iter != indexes.end(); ++iter) {
+                boost::unique_lock<boost::shared_mutex> lock((*iter)->mutex());
+                status = (*iter)->compact(*_rw, reclaimed);
+                if (status) {
+                    status = _rw->fold_deltas((*iter)->partition(), (*iter)->bucket(), (*iter)->field());
+                }
+            }
+
+            {
+                boost::mutex::scoped_lock lock(_versions_mutex);
+                _reclaimed += reclaimed;
+                if (!status) {
+                    _written.insert(iter - 1, indexes.end());
+                }
+            }
+
+            if (output) {
+                *output = reclaimed;
+            }
+            return status;
+        }
+
+        // runs on the io thread, compacts the indexes written since the
+        // last compaction and saves the catalog. There's no caller to hand
+        // a failure to.
+        void
+        compact_written()
+        {
+            boost::shared_lock<boost::shared_mutex> drop_lock(_drop_mutex);
+            std::vector<mtn::index_t*> indexes;
+            {
+                boost::mutex::scoped_lock lock(_versions_mutex);
+                indexes.assign(_written.begin(), _written.end());
+                _written.clear();
+            }
+
+            if (compact_indexes(indexes, NULL) && _catalog) {
+                save_catalog();
+            }
+        }
+
+        // the status of a write, compaction is started in the background
+        // when it was the last of MTN_OPT_COMPACT_CLEARS writes that
+        // cleared bits
+        inline mtn::status_t
+        compact_due(const mtn::status_t& status)
+        {
+            if (!status || _compact_clears == 0) {
+                return status;
+            }
+
+            {
+                boost::mutex::scoped_lock lock(_versions_mutex);
+                if (_clears < _compact_clears) {
+                    return status;
+                }
+                _clears = 0;
+            }
+            _io.post(boost::bind(&context_t::compact_written, this));
+            return status;
+        }
+
+        // read the catalog when MTN_OPT_CATALOG is set, and start reading
+        // the MTN_OPT_WARM_INDEXES most looked up indexes in the background
+        inline mtn::status_t
+        open_catalog()
+        {
+            size_t catalog = 0;
+            get_opt(MTN_OPT_CATALOG, catalog);
+            if (catalog == 0) {
+                return mtn::status_t();
+            }
+
+            mtn::catalog_t::entries_t entries;
+            mtn::status_t status = _rw->read_catalog(entries);
+            if (!status) {
+                return status;
+            }
+            _catalog = true;
+
+            for (mtn::catalog_t::entries_t::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+                index_key_t key(iter->bucket);
+                key.insert(key.end(), iter->field.begin(), iter->field.end());
+                _catalog_entries.insert(std::make_pair(key, *iter));
+            }
+
+            size_t warm_indexes = 0;
+            get_opt(MTN_OPT_WARM_INDEXES, warm_indexes);
+            std::stable_sort(entries.begin(), entries.end(), more_hits);
+            if (entries.size() > warm_indexes) {
+                entries.resize(warm_indexes);
+            }
+
+            // one handler per index so the destructor doesn't wait on
+            // more than the read in progress. They all read one snapshot
+            // when the backend has them, so the warmed indexes are of the
+            // same point in time whichever order the reads land in
+            boost::shared_ptr<mtn::index_reader_writer_t> view(_rw->snapshot());
+            for (mtn::catalog_t::entries_t::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+                _io.post(boost::bind(&context_t::prefetch_index, this, *iter, view, _prefetch_generation));
+            }
+            return status;
+        }
+
+        static bool
+        more_hits(const mtn::catalog_entry_t& a,
+                  const mtn::catalog_entry_t& b)
+        {
+            return a.hits > b.hits;
+        }
+
+        // runs on the io thread, the index is adopted by the first
+        // get_index or create_index that asks for it. Reads started before
+        // the last drop are discarded.
+        void
+        prefetch_index(const mtn::catalog_entry_t&                          entry,
+                       const boost::shared_ptr<mtn::index_reader_writer_t>& view,
+                       uint64_t                                             generation)
+        {
+            mtn::index_reader_writer_t& rw = view ? *view : *_rw;
+            mtn::index_t* index = NULL;
+            if (!rw.read_index(entry.partition, entry.bucket, entry.field, &index)) {
+                return;
+            }
+
+            index_key_t key(entry.bucket);
+            key.insert(key.end(), entry.field.begin(), entry.field.end());
+            std::auto_ptr<mtn::index_t> owned(index);
+            boost::mutex::scoped_lock lock(_prefetch_mutex);
+            if (generation == _prefetch_generation) {
+                _prefetched.insert(key, owned);
+            }
+        }
+
+        // whether a drop of the partition, or of the fields of bucket
+        // starting with prefix if bucket isn't NULL, covers the index
+        static bool
+        dropped(mtn_index_partition_t           index_partition,
+                const std::vector<mtn::byte_t>& index_bucket,
+                const std::vector<mtn::byte_t>& index_field,
+                mtn_index_partition_t           partition,
+                const std::vector<mtn::byte_t>* bucket,
+                const std::vector<mtn::byte_t>* prefix)
+        {
+            return index_partition == partition
+                && (!bucket
+                    || (index_bucket == *bucket
+                        && index_field.size() >= prefix->size()
+                        && std::equal(prefix->begin(), prefix->end(), index_field.begin())));
+        }
+
+        // let go of everything held for the dropped indexes. Cached query
+        // results are cleared since a new index may reuse a dropped
+        // index's address and version.
+        inline void
+        forget_indexes(mtn_index_partition_t           partition,
+                       const std::vector<mtn::byte_t>* bucket,
+                       const std::vector<mtn::byte_t>* prefix)
+        {
+            {
+                boost::mutex::scoped_lock lock(_prefetch_mutex);
+                ++_prefetch_generation;
+                index_container_t::iterator iter = _prefetched.begin();
+                while (iter != _prefetched.end()) {
+                    const mtn::index_t* index = iter->second;
+                    if (dropped(index->partition(), index->bucket(), index->field(), partition, bucket, prefix)) {
+                        _prefetched.erase(iter++);
+                    }
+                    else {
+                        ++iter;
+                    }
+                }
+            }
+
+            boost::mutex::scoped_lock indexes_lock(_indexes_mutex);
+            index_container_t::iterator iter = _indexes.begin();
+            while (iter != _indexes.end()) {
+                const mtn::index_t* index = iter->second;
+                if (!dropped(index->partition(), index->bucket(), index->field(), partition, bucket, prefix)) {
+                    ++iter;
+                    continue;
+                }
+
+                {
+                    boost::mutex::scoped_lock lock(_versions_mutex);
+                    _versions.erase(index);
+                    _written.erase(iter->second);
+                }
+                _dictionaries.erase(index);
+                _indexes.erase(iter++);
+            }
+
+            catalog_container_t::iterator entry = _catalog_entries.begin();
+            while (entry != _catalog_entries.end()) {
+                if (dropped(entry->second.partition, entry->second.bucket, entry->second.field, partition, bucket, prefix)) {
+                    _catalog_entries.erase(entry++);
+                }
+                else {
+                    ++entry;
+                }
+            }
+
+            ++_drop_generation;
+            if (_query_cache.get()) {
+                _query_cache->clear();
+            }
+            if (_subexpression_cache.get()) {
+                _subexpression_cache->clear();
+            }
+        }
+
+        // a cataloged index that hasn't been used since init, the prefetched
+        // copy if the io thread got to it first. lock holds _indexes_mutex,
+        // it's let go while the index is read from the backend so lookups
+        // of other indexes don't wait for the scan, and held again on
+        // return. If another thread loaded the index meanwhile its copy is
+        // used. The caller holds the drop lock, no drop can run while the
+        // lock is let go.
+        inline mtn::status_t
+        load_index(boost::mutex::scoped_lock& lock,
+                   index_key_t&               key,
+                   mtn::catalog_entry_t       entry,
+                   mtn::index_t**             output)
+        {
+            std::auto_ptr<mtn::index_t> index;
+            {
+                boost::mutex::scoped_lock prefetch_lock(_prefetch_mutex);
+                index_container_t::iterator iter = _prefetched.find(key);
+                if (iter != _prefetched.end()) {
+                    index.reset(_prefetched.release(iter).release());
+                }
+            }
+
+            if (!index.get()) {
+                mtn::index_t* read = NULL;
+                lock.unlock();
+                mtn::status_t status = _rw->read_index(entry.partition, entry.bucket, entry.field, &read);
+                lock.lock();
+                if (!status) {
+                    return status;
+                }
+                index.reset(read);
+
+                index_container_t::iterator iter = _indexes.find(key);
+                if (iter != _indexes.end()) {
+                    *output = iter->second;
+                    return status;
+                }
+            }
+
+            *output = index.get();
+            _indexes.insert(key, index);
+            return mtn::status_t();
+        }
+
+        // record the hits of every cataloged index, and the values of the
+        // ones that were loaded. The caller holds the drop lock, each
+        // loaded index is read under its shared lock like for a query.
+        inline mtn::status_t
+        save_catalog()
+        {
+            std::vector<std::pair<mtn::catalog_entry_t, mtn::index_t*> > entries;
+            {
+                boost::mutex::scoped_lock lock(_indexes_mutex);
+                for (catalog_container_t::iterator iter = _catalog_entries.begin(); iter != _catalog_entries.end(); ++iter) {
+                    index_container_t::iterator loaded = _indexes.find(iter->first);
+                    entries.push_back(std::make_pair(iter->second, loaded != _indexes.end() ? loaded->second : NULL));
+                }
+            }
+
+            mtn::status_t status;
+            for (size_t i = 0; status && i < entries.size(); ++i) {
+                mtn::catalog_entry_t& entry = entries[i].first;
+                mtn::index_t* index = entries[i].second;
+                if (index) {
+                    boost::shared_lock<boost::shared_mutex> lock(index->mutex());
+                    entry.values.clear();
+                    for (mtn::index_t::iterator slice = index->begin(); slice != index->end(); ++slice) {
+                        entry.values.push_back(mtn::catalog_value_t(slice->first,
+                                                                    slice->second->size(),
+                                                                    index->cardinality(slice)));
+                    }
+                }
+                status = _rw->write_catalog(entry);
+            }
+            return status;
+        }
+
+        typedef boost::ptr_map<row_dictionary_key_t, mtn::row_dictionary_t>  row_dictionary_container_t;
+
+        // the bit of who_or_what, its dense id when row ids are mapped. A
+        // row which is cleared but was never mapped has no bit to clear
+        template<class BucketIterator>
+        inline mtn::status_t
+        row_bit(mtn_index_partition_t partition,
+                BucketIterator        bucket_begin,
+                BucketIterator        bucket_end,
+                mtn_index_address_t   who_or_what,
+                bool                  state,
+                mtn_index_address_t&  output,
+                bool&                 found)
+        {
+            if (!_dense_rows) {
+                output = who_or_what;
+                found = true;
+                return mtn::status_t();
+            }
+
+            std::vector<mtn::byte_t> bucket(bucket_begin, bucket_end);
+            mtn::row_dictionary_t* dictionary = NULL;
+            mtn::status_t status = row_dictionary(partition, bucket, &dictionary);
+            if (!status) {
+                return status;
+            }
+
+            mtn::row_dictionary_t::id_t id = 0;
+            if (!state) {
+                found = dictionary->find(who_or_what, id);
+                output = id;
+                return status;
+            }
+
+            bool added = false;
+            status = dictionary->insert(who_or_what, id, &added);
+            if (status && added) {
+                status = _rw->write_row_dictionary(partition, bucket, id, who_or_what);
+            }
+            found = status;
+            output = id;
+            return status;
+        }
+
+        // add or remove the pair from the row's forward index record
+        template<class BucketIterator, class FieldIterator>
+        inline mtn::status_t
+        update_forward_index(mtn_index_partition_t partition,
+                             BucketIterator        bucket_begin,
+                             BucketIterator        bucket_end,
+                             FieldIterator         field_begin,
+                             FieldIterator         field_end,
+                             mtn_index_address_t   value,
+                             mtn_index_address_t   who_or_what,
+                             bool                  state)
+        {
+            if (!_forward_index) {
+                return mtn::status_t();
+            }
+
+            // writes to different fields of the row hold different index
+            // locks, the record is read and written back under its stripe
+            std::vector<mtn::byte_t> bucket(bucket_begin, bucket_end);
+            size_t stripe = mtn::index_address_hash_t()(who_or_what);
+            boost::hash_combine(stripe, boost::hash_range(bucket.begin(), bucket.end()));
+            boost::mutex::scoped_lock lock(_forward_index_mutexes[stripe % MTN_FORWARD_INDEX_STRIPES]);
+
+            mtn::forward_index_t::entries_t entries;
+            mtn::status_t status = row_values(partition, bucket, who_or_what, entries);
+            if (!status) {
+                return status;
+            }
+
+            mtn::forward_entry_t entry(field_begin, field_end, value);
+            if (state ? !entries.insert(entry).second : entries.erase(entry) == 0) {
+                return status;
+            }
+
+            std::vector<mtn::byte_t> record;
+            mtn::forward_index_t::encode(entries, record);
+            return _rw->write_forward_index(partition, bucket, who_or_what, record);
+        }
+
         std::auto_ptr<mtn::index_reader_writer_t> _rw;
         lua_state_container_t                     _lua_state;
         index_container_t                         _indexes;
+        version_container_t                       _versions;
+        mutable boost::mutex                      _versions_mutex;
+        boost::mutex                              _indexes_mutex;
+        uint64_t                                  _drop_generation;
+        boost::shared_mutex                       _drop_mutex;
+        dictionary_container_t                    _dictionaries;
+        row_dictionary_container_t                _row_dictionaries;
+        boost::mutex                              _row_dictionaries_mutex;
         options_container_t                       _options;
         boost::asio::io_service                   _io;
         boost::asio::io_service::work             _work;
         boost::thread                             _io_thread;
         std::auto_ptr<cql::cql_client_pool_t>     _cql_pool;
+        std::auto_ptr<mtn::thread_pool_t>         _query_pool;
+        std::auto_ptr<mtn::query_cache_t>         _query_cache;
+        std::auto_ptr<mtn::query_cache_t>         _subexpression_cache;
+        bool                                      _store_trigram_values;
+        mtn::trigram_fold_enum                    _trigram_fold;
+        bool                                      _dense_rows;
+        bool                                      _forward_index;
+        boost::mutex                              _forward_index_mutexes[MTN_FORWARD_INDEX_STRIPES];
+        bool                                      _catalog;
+        catalog_container_t                       _catalog_entries;
+        index_container_t                         _prefetched;
+        boost::mutex                              _prefetch_mutex;
+        uint64_t                                  _prefetch_generation;
+        size_t                                    _compact_clears;
+        size_t                                    _clears;
+        uint64_t                                  _reclaimed;
+        std::set<mtn::index_t*>                   _written;
     };
 
 } // namespace mtn
@@ -23,6 +23,7 @@
 #include <vector>
 #include <machine/endian.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "base_types.hpp"
 
@@ -31,6 +32,19 @@
 #define __STDC_LIMIT_MACROS
 #endif // __STDC_LIMIT_MACROS
 
+// keys of the value and row dictionaries, the forward index, stored
+// values and the catalog start with this partition, it can't be used for
+// indexes
+#define MTN_DICTIONARY_PARTITION 0xFFFF
+#define MTN_DICTIONARY_VALUES 'v'
+#define MTN_DICTIONARY_ROWS 'r'
+#define MTN_DICTIONARY_FORWARD 'f'
+#define MTN_DICTIONARY_CATALOG 'c'
+#define MTN_DICTIONARY_STORED 's'
+
+// size of an encoded bit delta
+#define MTN_BIT_DELTA_SIZE (sizeof(uint16_t) + sizeof(mtn::byte_t))
+
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 #define ntohlll(x) ((((uint128_t) ntohll(x)) << 64) | ntohll(x >> 64))
 #define htonlll(x) ntohlll(x)
@@ -211,6 +225,250 @@ namespace mtn {
         encode_index_key(partition, bucket, bucket_size, field, field_size, value, offset, &output[0]);
     }
 
+    inline size_t
+    get_value_dictionary_key_size(uint16_t bucket_size,
+                                  uint16_t field_size)
+    {
+        return sizeof(uint16_t)
+            + sizeof(mtn::byte_t)
+            + sizeof(uint16_t)
+            + sizeof(bucket_size) + bucket_size
+            + sizeof(field_size) + field_size
+            + sizeof(uint32_t);
+    }
+
+    inline void
+    encode_value_dictionary_key(uint16_t                  partition,
+                                const mtn::byte_t*        bucket,
+                                uint16_t                  bucket_size,
+                                const mtn::byte_t*        field,
+                                uint16_t                  field_size,
+                                uint32_t                  id,
+                                std::vector<mtn::byte_t>& output)
+    {
+        output.resize(get_value_dictionary_key_size(bucket_size, field_size));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = MTN_DICTIONARY_VALUES;
+        pos = encode_parition(partition, pos);
+        pos = encode_bytes(bucket, bucket_size, pos);
+        pos = encode_bytes(field, field_size, pos);
+        encode_uint32(id, pos);
+    }
+
+    inline size_t
+    get_row_dictionary_key_size(uint16_t bucket_size)
+    {
+        return sizeof(uint16_t)
+            + sizeof(mtn::byte_t)
+            + sizeof(uint16_t)
+            + sizeof(bucket_size) + bucket_size
+            + sizeof(uint32_t);
+    }
+
+    inline void
+    encode_row_dictionary_key(uint16_t                  partition,
+                              const mtn::byte_t*        bucket,
+                              uint16_t                  bucket_size,
+                              uint32_t                  id,
+                              std::vector<mtn::byte_t>& output)
+    {
+        output.resize(get_row_dictionary_key_size(bucket_size));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = MTN_DICTIONARY_ROWS;
+        pos = encode_parition(partition, pos);
+        pos = encode_bytes(bucket, bucket_size, pos);
+        encode_uint32(id, pos);
+    }
+
+    inline size_t
+    get_forward_index_key_size(uint16_t bucket_size)
+    {
+        return sizeof(uint16_t)
+            + sizeof(mtn::byte_t)
+            + sizeof(uint16_t)
+            + sizeof(bucket_size) + bucket_size
+            + sizeof(mtn_index_address_t);
+    }
+
+    inline void
+    encode_forward_index_key(uint16_t                  partition,
+                             const mtn::byte_t*        bucket,
+                             uint16_t                  bucket_size,
+                             mtn_index_address_t       row,
+                             std::vector<mtn::byte_t>& output)
+    {
+        output.resize(get_forward_index_key_size(bucket_size));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = MTN_DICTIONARY_FORWARD;
+        pos = encode_parition(partition, pos);
+        pos = encode_bytes(bucket, bucket_size, pos);
+        encode_uint128(row, pos);
+    }
+
+    inline size_t
+    get_stored_values_key_size(uint16_t bucket_size,
+                               uint16_t field_size)
+    {
+        return sizeof(uint16_t)
+            + sizeof(mtn::byte_t)
+            + sizeof(uint16_t)
+            + sizeof(bucket_size) + bucket_size
+            + sizeof(field_size) + field_size
+            + sizeof(mtn_index_address_t);
+    }
+
+    inline void
+    encode_stored_values_key(uint16_t                  partition,
+                             const mtn::byte_t*        bucket,
+                             uint16_t                  bucket_size,
+                             const mtn::byte_t*        field,
+                             uint16_t                  field_size,
+                             mtn_index_address_t       row,
+                             std::vector<mtn::byte_t>& output)
+    {
+        output.resize(get_stored_values_key_size(bucket_size, field_size));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = MTN_DICTIONARY_STORED;
+        pos = encode_parition(partition, pos);
+        pos = encode_bytes(bucket, bucket_size, pos);
+        pos = encode_bytes(field, field_size, pos);
+        encode_uint128(row, pos);
+    }
+
+    inline size_t
+    get_catalog_key_size(uint16_t bucket_size,
+                         uint16_t field_size)
+    {
+        return sizeof(uint16_t)
+            + sizeof(mtn::byte_t)
+            + sizeof(uint16_t)
+            + sizeof(bucket_size) + bucket_size
+            + sizeof(field_size) + field_size;
+    }
+
+    inline void
+    encode_catalog_key(uint16_t                  partition,
+                       const mtn::byte_t*        bucket,
+                       uint16_t                  bucket_size,
+                       const mtn::byte_t*        field,
+                       uint16_t                  field_size,
+                       std::vector<mtn::byte_t>& output)
+    {
+        output.resize(get_catalog_key_size(bucket_size, field_size));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = MTN_DICTIONARY_CATALOG;
+        pos = encode_parition(partition, pos);
+        pos = encode_bytes(bucket, bucket_size, pos);
+        encode_bytes(field, field_size, pos);
+    }
+
+    // append bytes prefixed with their size, as they are in keys
+    inline void
+    append_bytes(const mtn::byte_t*        input,
+                 uint16_t                  input_size,
+                 std::vector<mtn::byte_t>& output)
+    {
+        size_t pos = output.size();
+        output.resize(pos + sizeof(uint16_t) + input_size);
+        encode_bytes(input, input_size, &output[pos]);
+    }
+
+    // the first bytes of every dictionary key of the kind for the partition
+    inline void
+    encode_dictionary_prefix(mtn::byte_t               kind,
+                             uint16_t                  partition,
+                             std::vector<mtn::byte_t>& output)
+    {
+        output.resize(sizeof(uint16_t) + sizeof(mtn::byte_t) + sizeof(uint16_t));
+        mtn::byte_t* pos = encode_parition(MTN_DICTIONARY_PARTITION, &output[0]);
+        *pos++ = kind;
+        encode_parition(partition, pos);
+    }
+
+    // whether the size prefixed field at the start of input begins with
+    // prefix, false if input is too short to hold the field
+    inline bool
+    field_has_prefix(const mtn::byte_t*              input,
+                     size_t                          input_size,
+                     const std::vector<mtn::byte_t>& prefix)
+    {
+        if (input_size < sizeof(uint16_t)) {
+            return false;
+        }
+        mtn::byte_t* field = NULL;
+        uint16_t field_size = 0;
+        decode_bytes(input, &field, &field_size);
+        return field_size <= input_size - sizeof(uint16_t)
+            && field_size >= prefix.size()
+            && (prefix.empty() || memcmp(field, &prefix[0], prefix.size()) == 0);
+    }
+
+    // false unless input is a whole catalog key
+    inline bool
+    decode_catalog_key(const mtn::byte_t* input,
+                       size_t             input_size,
+                       uint16_t*          partition,
+                       mtn::byte_t**      bucket,
+                       uint16_t*          bucket_size,
+                       mtn::byte_t**      field,
+                       uint16_t*          field_size)
+    {
+        const mtn::byte_t* end = input + input_size;
+        const mtn::byte_t* pos = input + sizeof(uint16_t) + sizeof(mtn::byte_t);
+        if (input_size < get_catalog_key_size(0, 0) || input[sizeof(uint16_t)] != MTN_DICTIONARY_CATALOG) {
+            return false;
+        }
+        pos = decode_parition(pos, partition);
+        if (end - pos < (ptrdiff_t) sizeof(uint16_t)) {
+            return false;
+        }
+        pos = decode_bytes(pos, bucket, bucket_size);
+        if (end - pos < (ptrdiff_t) sizeof(uint16_t)) {
+            return false;
+        }
+        pos = decode_bytes(pos, field, field_size);
+        return pos == end;
+    }
+
+    // a single bit write, the position of the bit within its segment
+    // followed by its state
+    inline mtn::byte_t*
+    encode_bit_delta(uint16_t     position,
+                     bool         state,
+                     mtn::byte_t* output)
+    {
+        output = encode_uint16(position, output);
+        *output++ = state ? 1 : 0;
+        return output;
+    }
+
+    inline mtn::byte_t*
+    decode_bit_delta(const mtn::byte_t* input,
+                     uint16_t*          position,
+                     bool*              state)
+    {
+        mtn::byte_t* output = decode_uint16(input, position);
+        *state = *output++ != 0;
+        return output;
+    }
+
+    inline void
+    apply_bit_delta(const mtn::byte_t*     input,
+                    mtn::index_segment_ptr segment)
+    {
+        uint16_t position = 0;
+        bool state = false;
+        decode_bit_delta(input, &position, &state);
+
+        uint64_t mask = 1ULL << (position & 0x3F);
+        if (state) {
+            segment[(position >> 6) % MTN_INDEX_SEGMENT_LENGTH] |= mask;
+        }
+        else {
+            segment[(position >> 6) % MTN_INDEX_SEGMENT_LENGTH] &= ~mask;
+        }
+    }
+
 } // namespace mtn
 
 #endif // __MUTTON_ENCODE_HPP_INCLUDED__
@@ -0,0 +1,67 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "encode.hpp"
+
+#include "forward_index.hpp"
+
+void
+mtn::forward_index_t::encode(
+    const entries_t&          entries,
+    std::vector<mtn::byte_t>& output)
+{
+    size_t size = 0;
+    for (entries_t::const_iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+        size += sizeof(uint16_t) + iter->field.size() + sizeof(mtn_index_address_t);
+    }
+
+    output.resize(size);
+    mtn::byte_t* pos = output.empty() ? NULL : &output[0];
+    for (entries_t::const_iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+        pos = mtn::encode_bytes(iter->field.empty() ? NULL : &iter->field[0], iter->field.size(), pos);
+        pos = mtn::encode_uint128(iter->value, pos);
+    }
+}
+
+bool
+mtn::forward_index_t::decode(
+    const std::vector<mtn::byte_t>& input,
+    entries_t&                      output)
+{
+    size_t pos = 0;
+    while (pos < input.size()) {
+        uint16_t field_size = 0;
+        if (input.size() - pos < sizeof(uint16_t)) {
+            return false;
+        }
+        mtn::decode_uint16(&input[pos], &field_size);
+        pos += sizeof(uint16_t);
+
+        if (input.size() - pos < field_size + sizeof(mtn_index_address_t)) {
+            return false;
+        }
+
+        mtn::forward_entry_t entry;
+        entry.field.assign(input.begin() + pos, input.begin() + pos + field_size);
+        mtn::decode_uint128(&input[pos + field_size], &entry.value);
+        pos += field_size + sizeof(mtn_index_address_t);
+        output.insert(output.end(), entry);
+    }
+    return true;
+}
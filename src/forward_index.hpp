@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_FORWARD_INDEX_HPP_INCLUDED__
+#define __MUTTON_FORWARD_INDEX_HPP_INCLUDED__
+
+#include <set>
+#include <vector>
+
+#include "base_types.hpp"
+
+namespace mtn {
+
+    struct forward_entry_t
+    {
+        std::vector<mtn::byte_t> field;
+        mtn_index_address_t      value;
+
+        forward_entry_t() :
+            value(0)
+        {}
+
+        template<class FieldIterator>
+        forward_entry_t(
+            FieldIterator       field_begin,
+            FieldIterator       field_end,
+            mtn_index_address_t value) :
+            field(field_begin, field_end),
+            value(value)
+        {}
+
+        friend bool
+        operator<(const forward_entry_t& a,
+                  const forward_entry_t& b)
+        {
+            if (a.field != b.field) {
+                return a.field < b.field;
+            }
+            return mtn::index_address_comparator_t()(a.value, b.value);
+        }
+
+        friend bool
+        operator==(const forward_entry_t& a,
+                   const forward_entry_t& b)
+        {
+            return a.field == b.field && a.value == b.value;
+        }
+    };
+
+    // The (field, value) pairs a row is indexed under, kept as a single
+    // record per row so that every value of a row is read with one seek
+    // instead of probing the slices of every field. Records are the
+    // pairs in order, each a length prefixed field and a 128 bit value.
+    struct forward_index_t
+    {
+        typedef std::set<mtn::forward_entry_t> entries_t;
+
+        static void
+        encode(const entries_t&          entries,
+               std::vector<mtn::byte_t>& output);
+
+        // false if the record is truncated
+        static bool
+        decode(const std::vector<mtn::byte_t>& input,
+               entries_t&                      output);
+    };
+
+    // the pairs of a row as they're handed to C callers, in order
+    typedef std::vector<mtn::forward_entry_t> forward_result_t;
+
+} // namespace mtn
+
+#endif // __MUTTON_FORWARD_INDEX_HPP_INCLUDED__
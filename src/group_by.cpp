@@ -0,0 +1,135 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <queue>
+
+#include "index.hpp"
+#include "index_slice.hpp"
+
+#include "group_by.hpp"
+
+struct group_count_comparator_t
+{
+    group_count_comparator_t(
+        bool reverse) :
+        reverse(reverse)
+    {}
+
+    inline bool
+    operator()(const mtn::group_count_t& a,
+               const mtn::group_count_t& b) const
+    {
+        if (a.second != b.second) {
+            return reverse ? a.second < b.second : a.second > b.second;
+        }
+        return a.first < b.first;
+    }
+
+    bool reverse;
+};
+
+void
+mtn::group_by(
+    mtn::index_t&             index,
+    const mtn::index_slice_t& filter,
+    bool                      reverse,
+    mtn::group_result_t&      output)
+{
+    for (mtn::index_t::iterator iter = index.begin(); iter != index.end(); ++iter) {
+        uint64_t count = mtn::index_slice_t::intersection_count(*iter->second, filter);
+        if (count > 0) {
+            output.push_back(mtn::group_count_t(iter->first, count));
+        }
+    }
+    std::sort(output.begin(), output.end(), group_count_comparator_t(reverse));
+}
+
+struct top_k_candidate_t
+{
+    top_k_candidate_t(
+        uint64_t               bound,
+        mtn::index_t::iterator iter) :
+        bound(bound),
+        iter(iter)
+    {}
+
+    inline bool
+    operator<(const top_k_candidate_t& other) const
+    {
+        return bound > other.bound;
+    }
+
+    uint64_t               bound;
+    mtn::index_t::iterator iter;
+};
+
+void
+mtn::top_k(
+    mtn::index_t&             index,
+    const mtn::index_slice_t& filter,
+    size_t                    k,
+    mtn::group_result_t&      output)
+{
+    if (k == 0) {
+        return;
+    }
+
+    uint64_t filter_count = filter.count();
+    std::vector<top_k_candidate_t> candidates;
+    candidates.reserve(index.size());
+    for (mtn::index_t::iterator iter = index.begin(); iter != index.end(); ++iter) {
+        uint64_t bound = std::min(index.cardinality(iter), filter_count);
+        if (bound > 0) {
+            candidates.push_back(top_k_candidate_t(bound, iter));
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end());
+
+    // the best k so far, the worst of them on top
+    group_count_comparator_t better(false);
+    std::priority_queue<mtn::group_count_t, std::vector<mtn::group_count_t>, group_count_comparator_t> best(better);
+
+    std::vector<top_k_candidate_t>::iterator iter = candidates.begin();
+    for (; iter != candidates.end(); ++iter) {
+        if (best.size() == k && iter->bound < best.top().second) {
+            break;
+        }
+
+        uint64_t count = mtn::index_slice_t::intersection_count(*iter->iter->second, filter);
+        if (count == 0) {
+            continue;
+        }
+
+        mtn::group_count_t candidate(iter->iter->first, count);
+        if (best.size() < k) {
+            best.push(candidate);
+        }
+        else if (better(candidate, best.top())) {
+            best.pop();
+            best.push(candidate);
+        }
+    }
+
+    size_t offset = output.size();
+    for (; !best.empty(); best.pop()) {
+        output.push_back(best.top());
+    }
+    std::reverse(output.begin() + offset, output.end());
+}
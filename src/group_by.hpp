@@ -0,0 +1,59 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_GROUP_BY_HPP_INCLUDED__
+#define __MUTTON_GROUP_BY_HPP_INCLUDED__
+
+#include <utility>
+#include <vector>
+
+#include "base_types.hpp"
+
+namespace mtn {
+
+    class index_t;
+    class index_slice_t;
+
+    typedef std::pair<mtn_index_address_t, uint64_t> group_count_t;
+    typedef std::vector<group_count_t>                group_result_t;
+
+    // Count the members of filter for every value of index. Counts are
+    // taken by intersecting and popcounting segment by segment so no per
+    // group slice is built. Values with no members are left out, the
+    // output is ordered by descending count or ascending when reverse,
+    // ties are ordered by value.
+    void
+    group_by(mtn::index_t&             index,
+             const mtn::index_slice_t& filter,
+             bool                      reverse,
+             mtn::group_result_t&      output);
+
+    // The k values of index with the most members of filter, in the same
+    // order as group_by. Values are visited in order of their cached
+    // cardinality which bounds their count, and the scan stops as soon
+    // as no remaining value can beat the k-th best count so far.
+    void
+    top_k(mtn::index_t&             index,
+          const mtn::index_slice_t& filter,
+          size_t                    k,
+          mtn::group_result_t&      output);
+
+} // namespace mtn
+
+#endif // __MUTTON_GROUP_BY_HPP_INCLUDED__
@@ -17,6 +17,10 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "index_reader_writer.hpp"
 #include "range.hpp"
 #include "index.hpp"
 
@@ -101,8 +105,55 @@ mtn::index_t::index_value(mtn::index_reader_writer_t& rw,
         iter = insert(value, new mtn::index_slice_t(_partition, _bucket, _field, value)).first;
     }
 
-    iter->second->bit(rw, who_or_what, state);
-    return mtn::status_t(); // XXX TODO better error handling
+    forget_cardinality(value);
+    if (!state) {
+        _cleared.insert(value);
+    }
+    return iter->second->bit(rw, who_or_what, state);
+}
+
+mtn::status_t
+mtn::index_t::read_segments(mtn::index_reader_writer_t&       rw,
+                            std::vector<mtn_index_address_t>& values,
+                            mtn_index_address_t               who_or_what)
+{
+    mtn_index_address_t offset = who_or_what >> 11; // div by 2048
+    std::sort(values.begin(), values.end(), mtn::index_address_comparator_t());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    std::vector<mtn_index_address_t> missing;
+    for (std::vector<mtn_index_address_t>::const_iterator value = values.begin(); value != values.end(); ++value) {
+        mtn::index_t::iterator iter = _index.find(*value);
+        if (iter == _index.end() || iter->second->find(offset) == iter->second->end()) {
+            missing.push_back(*value);
+        }
+    }
+
+    // a single segment is left to the slice to read
+    if (missing.size() < 2) {
+        return mtn::status_t();
+    }
+
+    boost::ptr_vector<mtn::index_slice_t::index_node_t> nodes;
+    std::vector<mtn::index_segment_ptr> segments;
+    for (size_t i = 0; i < missing.size(); ++i) {
+        nodes.push_back(new mtn::index_slice_t::index_node_t(offset));
+        segments.push_back(nodes.back().segment);
+    }
+
+    mtn::status_t status = rw.read_segments(_partition, _bucket, _field, missing, offset, segments);
+    if (!status) {
+        return status;
+    }
+
+    for (size_t i = missing.size(); i > 0; --i) {
+        mtn::index_t::iterator iter = _index.find(missing[i - 1]);
+        if (iter == _index.end()) {
+            iter = insert(missing[i - 1], new mtn::index_slice_t(_partition, _bucket, _field, missing[i - 1])).first;
+        }
+        iter->second->insert(iter->second->lower_bound(offset), nodes.pop_back().release());
+    }
+    return status;
 }
 
 mtn::status_t
@@ -141,3 +192,46 @@ mtn::index_t::partition() const
 {
     return _partition;
 }
+
+uint64_t
+mtn::index_t::cardinality(
+    mtn::index_t::iterator position)
+{
+    {
+        boost::mutex::scoped_lock lock(_cardinality_mutex);
+        mtn::index_t::cardinality_container::const_iterator iter = _cardinality.find(position->first);
+        if (iter != _cardinality.end()) {
+            return iter->second;
+        }
+    }
+
+    // count without the lock, concurrent queries counting the same
+    // value store the same result
+    uint64_t count = position->second->count();
+    boost::mutex::scoped_lock lock(_cardinality_mutex);
+    _cardinality.insert(std::make_pair(position->first, count));
+    return count;
+}
+
+mtn::status_t
+mtn::index_t::compact(mtn::index_reader_writer_t& rw,
+                      uint64_t&                   reclaimed)
+{
+    mtn::status_t status;
+    mtn::index_t::value_container::iterator value = _cleared.begin();
+    while (status && value != _cleared.end()) {
+        mtn::index_t::iterator iter = _index.find(*value);
+        if (iter != _index.end()) {
+            status = iter->second->compact(rw, reclaimed);
+            if (status && iter->second->size() == 0) {
+                forget_cardinality(*value);
+                _index.erase(iter);
+            }
+        }
+
+        if (status) {
+            _cleared.erase(value++);
+        }
+    }
+    return status;
+}
@@ -20,14 +20,18 @@
 #ifndef __MUTTON_INDEX_HPP_INCLUDED__
 #define __MUTTON_INDEX_HPP_INCLUDED__
 
+#include <map>
 #include <set>
 #include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "base_types.hpp"
 #include "index_slice.hpp"
 #include "status.hpp"
+#include "prefix.hpp"
 #include "trigram.hpp"
 
 namespace mtn {
@@ -41,6 +45,8 @@ namespace mtn {
     public:
         typedef mtn::index_slice_t type;
         typedef boost::ptr_map<mtn_index_address_t, mtn::index_slice_t, mtn::index_address_comparator_t> index_container;
+        typedef std::map<mtn_index_address_t, uint64_t, mtn::index_address_comparator_t>                cardinality_container;
+        typedef std::set<mtn_index_address_t, mtn::index_address_comparator_t>                          value_container;
         typedef index_container::iterator iterator;
 
         index_t(mtn_index_partition_t           partition,
@@ -90,13 +96,22 @@ namespace mtn {
                             InputIterator               first,
                             InputIterator               last,
                             mtn_index_address_t         who_or_what,
-                            bool                        state)
+                            bool                        state,
+                            mtn::trigram_fold_enum      fold = MTN_TRIGRAM_FOLD_NONE)
         {
             mtn::status_t status;
-            std::set<mtn_index_address_t> trigrams;
-            mtn::trigram_t::to_trigrams(first, last, trigrams);
+            mtn::trigram_container trigrams;
+            mtn::trigram_t::to_trigrams(first, last, trigrams, fold);
+
+            // every trigram sets the same row, so its segments share an
+            // offset and the ones not in memory yet are read in one pass
+            std::vector<mtn_index_address_t> values(trigrams.begin(), trigrams.end());
+            status = read_segments(rw, values, who_or_what);
+            if (!status) {
+                return status;
+            }
 
-            std::set<mtn_index_address_t>::iterator iter = trigrams.begin();
+            mtn::trigram_container::iterator iter = trigrams.begin();
             for (; iter != trigrams.end(); ++iter) {
                 status = index_value(rw, *iter, who_or_what, state);
                 if (!status) {
@@ -106,6 +121,17 @@ namespace mtn {
             return status;
         }
 
+        template<class InputIterator>
+        inline mtn::status_t
+        index_value_prefix(mtn::index_reader_writer_t& rw,
+                           InputIterator               first,
+                           InputIterator               last,
+                           mtn_index_address_t         who_or_what,
+                           bool                        state)
+        {
+            return index_value(rw, mtn::prefix_t::to_key(first, last), who_or_what, state);
+        }
+
         mtn::status_t
         indexed_value(mtn::index_reader_writer_t& rw,
                       mtn_index_address_t         value,
@@ -120,6 +146,19 @@ namespace mtn {
         mtn_index_partition_t
         partition() const;
 
+        // number of bits set in the slice for a value, cached until the
+        // value is next written through index_value or replaced. Safe to
+        // call from concurrent queries.
+        uint64_t
+        cardinality(iterator position);
+
+        // compact the slices of the values that had bits cleared through
+        // index_value since the last compaction, the slices left without
+        // segments are dropped
+        mtn::status_t
+        compact(mtn::index_reader_writer_t& rw,
+                uint64_t&                   reclaimed);
+
         inline const std::vector<mtn::byte_t>&
         bucket() const
         {
@@ -138,6 +177,12 @@ namespace mtn {
             return _index.find(a);
         }
 
+        inline iterator
+        lower_bound(mtn_index_address_t a)
+        {
+            return _index.lower_bound(a);
+        }
+
         inline iterator
         begin()
         {
@@ -154,12 +199,15 @@ namespace mtn {
         insert(mtn_index_address_t value,
                index_slice_t*      slice)
         {
+            forget_cardinality(value);
             return _index.insert(value, slice);
         }
 
         inline void
         clear()
         {
+            forget_cardinality();
+            _cleared.clear();
             _index.clear();
         }
 
@@ -167,12 +215,16 @@ namespace mtn {
         erase(iterator first,
               iterator last)
         {
+            forget_cardinality();
+            _cleared.clear();
             _index.erase(first, last);
         }
 
         inline void
         erase(iterator position)
         {
+            forget_cardinality(position->first);
+            _cleared.erase(position->first);
             _index.erase(position);
         }
 
@@ -182,8 +234,41 @@ namespace mtn {
             return _index.size();
         }
 
+        // held exclusively by the context for every write to the index
+        // and shared by a query for as long as it reads it
+        inline boost::shared_mutex&
+        mutex()
+        {
+            return _mutex;
+        }
+
     private:
+        // read the segments holding the row into the slices of the values
+        // which don't have them yet
+        mtn::status_t
+        read_segments(mtn::index_reader_writer_t&       rw,
+                      std::vector<mtn_index_address_t>& values,
+                      mtn_index_address_t               who_or_what);
+
+        inline void
+        forget_cardinality(mtn_index_address_t value)
+        {
+            boost::mutex::scoped_lock lock(_cardinality_mutex);
+            _cardinality.erase(value);
+        }
+
+        inline void
+        forget_cardinality()
+        {
+            boost::mutex::scoped_lock lock(_cardinality_mutex);
+            _cardinality.clear();
+        }
+
         index_container          _index;
+        cardinality_container    _cardinality;
+        boost::mutex             _cardinality_mutex;
+        boost::shared_mutex      _mutex;
+        value_container          _cleared;
         mtn_index_partition_t    _partition;
         std::vector<mtn::byte_t> _bucket;
         std::vector<mtn::byte_t> _field;
@@ -0,0 +1,49 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "index_reader_writer.hpp"
+#include "index_reader_writer_leveldb.hpp"
+#include "index_reader_writer_memory.hpp"
+
+mtn::index_reader_writer_t*
+mtn::index_reader_writer_t::create(const std::string& name)
+{
+    if (name == "leveldb") {
+        return new mtn::index_reader_writer_leveldb_t();
+    }
+    else if (name == "memory") {
+        return new mtn::index_reader_writer_memory_t();
+    }
+    return NULL;
+}
+
+mtn::status_t
+mtn::index_reader_writer_t::read_segments(mtn_index_partition_t                      partition,
+                                          const std::vector<mtn::byte_t>&            bucket,
+                                          const std::vector<mtn::byte_t>&            field,
+                                          const std::vector<mtn_index_address_t>&    values,
+                                          mtn_index_address_t                        offset,
+                                          const std::vector<mtn::index_segment_ptr>& output)
+{
+    mtn::status_t status;
+    for (size_t i = 0; i < values.size() && status; ++i) {
+        status = read_segment(partition, bucket, field, values[i], offset, output[i]);
+    }
+    return status;
+}
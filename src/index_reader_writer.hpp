@@ -20,9 +20,12 @@
 #ifndef __MUTTON_INDEX_READER_WRITER_HPP_INCLUDED__
 #define __MUTTON_INDEX_READER_WRITER_HPP_INCLUDED__
 
+#include <string>
+#include <vector>
 #include <boost/ptr_container/ptr_map.hpp>
 
 #include "base_types.hpp"
+#include "catalog.hpp"
 #include "status.hpp"
 
 namespace mtn {
@@ -30,6 +33,8 @@ namespace mtn {
     class context_t;
     class index_t;
     class index_slice_t;
+    class row_dictionary_t;
+    class value_dictionary_t;
 
     class index_reader_writer_t
     {
@@ -42,6 +47,10 @@ namespace mtn {
         ~index_reader_writer_t()
         {}
 
+        // a backend by its MTN_OPT_BACKEND name, NULL if there is none
+        static index_reader_writer_t*
+        create(const std::string& name);
+
         virtual mtn::status_t
         init(mtn::context_t& context) = 0;
 
@@ -74,6 +83,26 @@ namespace mtn {
                      mtn_index_address_t             offset,
                      mtn::index_segment_ptr          output) = 0;
 
+        // read the segment at offset of every value, the values are
+        // sorted and unique and output holds a buffer for each of them.
+        // Missing segments read as zeros.
+        virtual mtn::status_t
+        read_segments(mtn_index_partition_t                      partition,
+                      const std::vector<mtn::byte_t>&            bucket,
+                      const std::vector<mtn::byte_t>&            field,
+                      const std::vector<mtn_index_address_t>&    values,
+                      mtn_index_address_t                        offset,
+                      const std::vector<mtn::index_segment_ptr>& output);
+
+        // a read only view of the store as it is now, reads through it
+        // don't see later writes. NULL if the backend can't pin a view.
+        // The caller owns the view and frees it before the store.
+        virtual index_reader_writer_t*
+        snapshot()
+        {
+            return NULL;
+        }
+
         virtual mtn::status_t
         estimateSize(mtn_index_partition_t           partition,
                      const std::vector<mtn::byte_t>& bucket,
@@ -88,6 +117,118 @@ namespace mtn {
                       mtn_index_address_t             value,
                       mtn_index_address_t             offset,
                       index_segment_ptr input) = 0;
+
+        // set or clear one bit, position is within the segment and input
+        // is the segment with the bit already applied. Backends that can
+        // merge a single bit into the stored segment don't need input.
+        virtual mtn::status_t
+        write_bit(mtn_index_partition_t           partition,
+                  const std::vector<mtn::byte_t>& bucket,
+                  const std::vector<mtn::byte_t>& field,
+                  mtn_index_address_t             value,
+                  mtn_index_address_t             offset,
+                  uint16_t                        /* position */,
+                  bool                            /* state */,
+                  index_segment_ptr               input)
+        {
+            return write_segment(partition, bucket, field, value, offset, input);
+        }
+
+        // remove the segment and every bit written to it, it reads as
+        // zeros afterwards
+        virtual mtn::status_t
+        delete_segment(mtn_index_partition_t           partition,
+                       const std::vector<mtn::byte_t>& bucket,
+                       const std::vector<mtn::byte_t>& field,
+                       mtn_index_address_t             value,
+                       mtn_index_address_t             offset) = 0;
+
+        // load every value persisted for the field into the dictionary
+        virtual mtn::status_t
+        read_value_dictionary(mtn_index_partition_t           partition,
+                              const std::vector<mtn::byte_t>& bucket,
+                              const std::vector<mtn::byte_t>& field,
+                              mtn::value_dictionary_t&        output) = 0;
+
+        virtual mtn::status_t
+        write_value_dictionary(mtn_index_partition_t           partition,
+                               const std::vector<mtn::byte_t>& bucket,
+                               const std::vector<mtn::byte_t>& field,
+                               uint32_t                        id,
+                               const std::string&              value) = 0;
+
+        // load every row id mapping persisted for the bucket
+        virtual mtn::status_t
+        read_row_dictionary(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn::row_dictionary_t&          output) = 0;
+
+        virtual mtn::status_t
+        write_row_dictionary(mtn_index_partition_t           partition,
+                             const std::vector<mtn::byte_t>& bucket,
+                             uint32_t                        id,
+                             mtn_index_address_t             row) = 0;
+
+        // the encoded forward index record of the row, empty if it has none
+        virtual mtn::status_t
+        read_forward_index(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output) = 0;
+
+        // an empty record removes the row from the forward index
+        virtual mtn::status_t
+        write_forward_index(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input) = 0;
+
+        // the encoded values stored for the row of a trigram or prefix
+        // index, empty if it has none
+        virtual mtn::status_t
+        read_stored_values(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           const std::vector<mtn::byte_t>& field,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output) = 0;
+
+        // an empty record removes the row's values
+        virtual mtn::status_t
+        write_stored_values(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            const std::vector<mtn::byte_t>& field,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input) = 0;
+
+        // fold bits the backend logged apart from the segments of the
+        // index back into them, called when the context compacts it
+        virtual mtn::status_t
+        fold_deltas(mtn_index_partition_t,
+                    const std::vector<mtn::byte_t>&,
+                    const std::vector<mtn::byte_t>&)
+        {
+            return mtn::status_t();
+        }
+
+        // remove every index of the partition, with its dictionaries,
+        // forward index, stored values and catalog records
+        virtual mtn::status_t
+        drop_partition(mtn_index_partition_t partition) = 0;
+
+        // remove the indexes of the bucket whose field starts with prefix,
+        // with their value dictionaries, stored values and catalog records
+        virtual mtn::status_t
+        drop_fields(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& prefix) = 0;
+
+        // append every index recorded in the catalog to output
+        virtual mtn::status_t
+        read_catalog(mtn::catalog_t::entries_t& output) = 0;
+
+        // replaces the catalog record of the entry's index
+        virtual mtn::status_t
+        write_catalog(const mtn::catalog_entry_t& entry) = 0;
     };
 
 } // namespace mtn
@@ -17,24 +17,194 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <vector>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <leveldb/write_batch.h>
+
 #include "context.hpp"
 #include "encode.hpp"
 #include "index.hpp"
 #include "index_slice.hpp"
 #include "index_reader_writer_leveldb.hpp"
+#include "row_dictionary.hpp"
+#include "thread_pool.hpp"
+#include "value_dictionary.hpp"
+
+#define MTN_SCAN_RANGES_PER_THREAD 4
+#define MTN_SCAN_SAMPLES_PER_RANGE 16
+#define MTN_SCAN_SPLIT_DEPTH 3
+#define MTN_DROP_BATCH_SIZE 4096
+#define MTN_FOLD_BATCH_SIZE 4096
+#define MTN_DELTA_SEQUENCE_BLOCK 65536
+#define MTN_DICTIONARY_DELTA_SEQUENCE 'd'
+
+// delta keys are the key of their segment followed by a sequence number
+inline static bool
+is_delta_key(size_t   key_size,
+             uint16_t bucket_size,
+             uint16_t field_size)
+{
+    return key_size == mtn::get_index_key_size(0, bucket_size, field_size, 0, 0) + sizeof(uint64_t);
+}
+
+// the key of the highest delta sequence number handed out so far
+inline static leveldb::Slice
+delta_sequence_key(mtn::byte_t* output)
+{
+    *mtn::encode_parition(MTN_DICTIONARY_PARTITION, output) = MTN_DICTIONARY_DELTA_SEQUENCE;
+    return leveldb::Slice(reinterpret_cast<char*>(output), sizeof(uint16_t) + sizeof(mtn::byte_t));
+}
+
+// the segment right before position if it has the offset, deltas sort
+// after their segment. Otherwise a zeroed segment is inserted at position
+// for deltas of a segment that was never written whole.
+inline static mtn::index_segment_ptr
+delta_segment(mtn::index_slice_t&           slice,
+              mtn::index_slice_t::iterator& position,
+              mtn_index_address_t           offset)
+{
+    if (position != slice.begin()) {
+        mtn::index_slice_t::iterator previous = position;
+        --previous;
+        if (previous->offset == offset) {
+            return previous->segment;
+        }
+    }
+
+    mtn::index_slice_t::index_node_t* node = new mtn::index_slice_t::index_node_t(offset);
+    node->zero();
+    position = slice.insert(position, node);
+    ++position;
+    return node->segment;
+}
+
+// the first bytes of key after the prefix shared with the other end of
+// the range, as a number so the range can be cut into even steps
+inline static uint64_t
+key_position(const std::string& key,
+             size_t             prefix)
+{
+    uint64_t output = 0;
+    for (size_t i = prefix; i < prefix + sizeof(uint64_t); ++i) {
+        output = (output << 8) | (i < key.size() ? static_cast<mtn::byte_t>(key[i]) : 0);
+    }
+    return output;
+}
+
+struct mtn::index_reader_writer_leveldb_t::scan_task_t
+{
+    scan_task_t(
+        mtn::index_reader_writer_leveldb_t&          rw,
+        const leveldb::ReadOptions&                  options,
+        const std::string&                           start,
+        const std::string&                           stop,
+        mtn::index_reader_writer_t::index_container& output,
+        mtn::status_t&                               status) :
+        rw(&rw),
+        options(options),
+        start(&start),
+        stop(&stop),
+        output(&output),
+        status(&status)
+    {}
+
+    void
+    operator()()
+    {
+        *status = rw->scan_indexes(options, *start, *stop, *output);
+    }
+
+    mtn::index_reader_writer_leveldb_t*          rw;
+    leveldb::ReadOptions                         options;
+    const std::string*                           start;
+    const std::string*                           stop;
+    mtn::index_reader_writer_t::index_container* output;
+    mtn::status_t*                               status;
+};
+
+// move the slices of input to the end of the matching slices in output,
+// the ranges were scanned in key order so the result is the same as a
+// single scan
+static void
+merge_indexes(mtn::index_reader_writer_t::index_container& input,
+              mtn::index_reader_writer_t::index_container& output)
+{
+    mtn::index_reader_writer_t::index_container::iterator index = input.begin();
+    for (; index != input.end(); ++index) {
+        std::vector<mtn::byte_t> key(index->first);
+        mtn::index_t* target = output.insert(key,
+                                             new mtn::index_t(index->second->partition(),
+                                                              index->second->bucket(),
+                                                              index->second->field())).first->second;
+
+        for (mtn::index_t::iterator slice = index->second->begin(); slice != index->second->end(); ++slice) {
+            mtn::index_t::iterator target_slice = target->find(slice->first);
+            if (target_slice == target->end()) {
+                target_slice = target->insert(slice->first,
+                                              new mtn::index_slice_t(slice->second->partition(),
+                                                                     slice->second->bucket(),
+                                                                     slice->second->field(),
+                                                                     slice->first)).first;
+            }
+            target_slice->second->transfer(*slice->second);
+        }
+    }
+}
+
+// a snapshot shares the database of the store it was taken from, and
+// would race it for delta sequence numbers
+inline static mtn::status_t
+read_only()
+{
+    return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "leveldb snapshots are read only");
+}
 
 mtn::index_reader_writer_leveldb_t::index_reader_writer_leveldb_t() :
     _db(NULL),
+    _block_cache(NULL),
+    _filter_policy(NULL),
+    _snapshot(NULL),
     _read_options(),
-    _write_options()
+    _scan_options(),
+    _write_options(),
+    _delta_log(false),
+    _delta_sequence(0),
+    _delta_sequence_limit(0),
+    _scan_pool()
 {}
 
+mtn::index_reader_writer_leveldb_t::index_reader_writer_leveldb_t(const index_reader_writer_leveldb_t& store,
+                                                                  const leveldb::Snapshot*             snapshot) :
+    _db(store._db),
+    _block_cache(NULL),
+    _filter_policy(NULL),
+    _snapshot(snapshot),
+    _read_options(store._read_options),
+    _scan_options(store._scan_options),
+    _write_options(store._write_options),
+    _delta_log(store._delta_log),
+    _delta_sequence(0),
+    _delta_sequence_limit(0),
+    _scan_pool(store._scan_pool)
+{
+    _read_options.snapshot = _snapshot;
+    _scan_options.snapshot = _snapshot;
+}
+
 mtn::index_reader_writer_leveldb_t::~index_reader_writer_leveldb_t()
 {
+    if (_snapshot) {
+        _db->ReleaseSnapshot(_snapshot);
+        return;
+    }
+
+    // the cache and filter policy must outlive the database
     if (_db) {
         delete _db;
     }
+    delete _block_cache;
+    delete _filter_policy;
 }
 
 mtn::status_t
@@ -45,17 +215,77 @@ mtn::index_reader_writer_leveldb_t::init(mtn::context_t& context)
         return mtn::status_t(MTN_ERROR_BAD_CONFIGURATION, "no database path was specified");
     }
 
+    size_t delta_log = 0;
+    context.get_opt(MTN_OPT_DELTA_LOG, delta_log);
+    _delta_log = delta_log != 0;
+
     leveldb::Options options;
     options.create_if_missing = true;
+
+    size_t cache_size = 0;
+    if (context.get_opt(MTN_OPT_LEVELDB_CACHE_SIZE, cache_size) && cache_size > 0) {
+        _block_cache = leveldb::NewLRUCache(cache_size);
+        options.block_cache = _block_cache;
+    }
+
+    size_t bloom_bits = 10;
+    context.get_opt(MTN_OPT_LEVELDB_BLOOM_BITS, bloom_bits);
+    if (bloom_bits > 0) {
+        _filter_policy = leveldb::NewBloomFilterPolicy(bloom_bits);
+        options.filter_policy = _filter_policy;
+    }
+
+    context.get_opt(MTN_OPT_LEVELDB_WRITE_BUFFER_SIZE, options.write_buffer_size);
+    context.get_opt(MTN_OPT_LEVELDB_BLOCK_SIZE, options.block_size);
+
+    size_t compression = 1;
+    context.get_opt(MTN_OPT_LEVELDB_COMPRESSION, compression);
+    options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+
+    // scans can read whole buckets, keeping them out of the cache
+    // leaves it to the segments read by writes
+    size_t scan_fill_cache = 1;
+    context.get_opt(MTN_OPT_LEVELDB_SCAN_FILL_CACHE, scan_fill_cache);
+    _scan_options.fill_cache = scan_fill_cache != 0;
+
+    size_t scan_threads = 1;
+    if (context.get_opt(MTN_OPT_SCAN_THREADS, scan_threads) && scan_threads > 1) {
+        _scan_pool.reset(new mtn::thread_pool_t(scan_threads));
+    }
+
     leveldb::Status status = leveldb::DB::Open(options, path, &_db);
 
     if (!status.ok()) {
         return mtn::status_t(MTN_ERROR_UNKOWN, status.ToString(), false, true);
     }
 
+    // deltas of a segment are applied in sequence order. Sequence
+    // numbers are reserved in blocks and the end of the last block is
+    // persisted before any of it is used, so numbers handed out after a
+    // restart are past every delta already written.
+    mtn::byte_t key[sizeof(uint16_t) + sizeof(mtn::byte_t)];
+    std::string limit;
+    status = _db->Get(_read_options, delta_sequence_key(key), &limit);
+    if (status.ok() && limit.size() == sizeof(uint64_t)) {
+        mtn::decode_uint64(reinterpret_cast<const mtn::byte_t*>(limit.data()), &_delta_sequence);
+        _delta_sequence_limit = _delta_sequence;
+    }
+    else if (!status.ok() && !status.IsNotFound()) {
+        return mtn::status_t(MTN_ERROR_UNKOWN, status.ToString(), false, true);
+    }
+
     return mtn::status_t();
 }
 
+mtn::index_reader_writer_t*
+mtn::index_reader_writer_leveldb_t::snapshot()
+{
+    if (!_db) {
+        return NULL;
+    }
+    return new mtn::index_reader_writer_leveldb_t(*this, _db->GetSnapshot());
+}
+
 mtn::status_t
 mtn::index_reader_writer_leveldb_t::read_index(mtn_index_partition_t           partition,
                                                const std::vector<mtn::byte_t>& bucket,
@@ -63,11 +293,12 @@ mtn::index_reader_writer_leveldb_t::read_index(mtn_index_partition_t           p
                                                mtn::index_t**                  output)
 {
     mtn::index_reader_writer_t::index_container container;
-    mtn::status_t status = read_indexes(partition, bucket, field, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), container);
+    mtn::status_t status = read_indexes(partition, bucket, field, bucket, field, container);
 
     if (status) {
-        if (!container.empty()) {
-            *output = container.release(container.begin()).release();
+        mtn::index_reader_writer_t::index_container::iterator iter = container.find(field);
+        if (iter != container.end()) {
+            *output = container.release(iter).release();
         }
         else {
             *output = new mtn::index_t(partition, bucket, field);
@@ -99,13 +330,59 @@ mtn::index_reader_writer_leveldb_t::read_indexes(mtn_index_partition_t
     leveldb::Slice start_slice(reinterpret_cast<char*>(&start_key[0]), start_key.size());
     leveldb::Slice stop_slice(reinterpret_cast<char*>(&stop_key[0]), stop_key.size());
 
+    if (!_scan_pool || _scan_pool->size() < 2) {
+        return scan_indexes(_scan_options, start_slice, stop_slice, output);
+    }
+
+    // every range reads the same point in time, a snapshot view already
+    // has one pinned
+    leveldb::ReadOptions options = _scan_options;
+    if (!options.snapshot) {
+        options.snapshot = _db->GetSnapshot();
+    }
+
+    std::vector<std::string> boundaries;
+    split_scan(options, start_key, stop_key, _scan_pool->size() * MTN_SCAN_RANGES_PER_THREAD, boundaries);
+
+    boost::ptr_vector<mtn::index_reader_writer_t::index_container> results;
+    std::vector<mtn::status_t> statuses(boundaries.size() - 1);
+    std::vector<mtn::thread_pool_t::task_t> tasks;
+    for (size_t i = 0; i + 1 < boundaries.size(); ++i) {
+        results.push_back(new mtn::index_reader_writer_t::index_container());
+        tasks.push_back(scan_task_t(*this, options, boundaries[i], boundaries[i + 1], results.back(), statuses[i]));
+    }
+    mtn::status_t status = _scan_pool->execute(tasks);
+
+    if (options.snapshot != _scan_options.snapshot) {
+        _db->ReleaseSnapshot(options.snapshot);
+    }
+
+    if (!status) {
+        return status;
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!statuses[i]) {
+            return statuses[i];
+        }
+        merge_indexes(results[i], output);
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::scan_indexes(const leveldb::ReadOptions&                  options,
+                                                 const leveldb::Slice&                        start_slice,
+                                                 const leveldb::Slice&                        stop_slice,
+                                                 mtn::index_reader_writer_t::index_container& output)
+{
     std::vector<mtn::byte_t> current_bucket;
     std::vector<mtn::byte_t> current_field;
     mtn::index_t* current_index = NULL;
     mtn::index_slice_t* current_slice = NULL;
     mtn_index_address_t current_slice_value = INDEX_ADDRESS_MAX;
 
-    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(options));
     for (iter->Seek(start_slice);
          iter->Valid() && iter->key().compare(stop_slice) < 0;
          iter->Next())
@@ -118,7 +395,6 @@ mtn::index_reader_writer_leveldb_t::read_indexes(mtn_index_partition_t
         mtn_index_address_t temp_value       = 0;
         mtn_index_address_t offset           = 0;
 
-        assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
         mtn::decode_index_key(
             reinterpret_cast<const mtn::byte_t*>(iter->key().data()),
             &temp_partition,
@@ -164,11 +440,151 @@ mtn::index_reader_writer_leveldb_t::read_indexes(mtn_index_partition_t
                 current_slice_value = temp_value;
             }
         }
+
+        if (is_delta_key(iter->key().size(), temp_bucket_size, temp_field_size)) {
+            mtn::index_slice_t::iterator position = current_slice->end();
+            mtn::apply_bit_delta(reinterpret_cast<const mtn::byte_t*>(iter->value().data()),
+                                 delta_segment(*current_slice, position, offset));
+            continue;
+        }
+
+        assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
         current_slice->insert(current_slice->end(), new mtn::index_slice_t::index_node_t(offset, (const index_segment_ptr) iter->value().data()));
     }
     return mtn::status_t(); // XXX TODO better error handling
 }
 
+void
+mtn::index_reader_writer_leveldb_t::cut_scan(leveldb::Iterator&        iter,
+                                             const std::string&        start,
+                                             const std::string&        stop,
+                                             size_t                    count,
+                                             size_t                    depth,
+                                             std::vector<std::string>& output)
+{
+    // cut between the keys actually there, the ends of the range are
+    // usually far wider than the data
+    iter.Seek(start);
+    if (count < 2 || !iter.Valid() || iter.key().compare(stop) >= 0) {
+        return;
+    }
+    std::string first = iter.key().ToString();
+
+    iter.Seek(stop);
+    if (iter.Valid()) {
+        iter.Prev();
+    }
+    else {
+        iter.SeekToLast();
+    }
+    if (!iter.Valid() || iter.key().compare(first) <= 0) {
+        return;
+    }
+    std::string last = iter.key().ToString();
+
+    size_t prefix = 0;
+    while (prefix < first.size() && prefix < last.size() && first[prefix] == last[prefix]) {
+        ++prefix;
+    }
+
+    // cut the keys into even steps and weigh them by their size on disk,
+    // data still in the memtable has no size so steps weigh the same
+    // until it is flushed
+    uint64_t low = key_position(first, prefix);
+    uint64_t high = key_position(last, prefix);
+    size_t samples = std::min<uint64_t>(count * MTN_SCAN_SAMPLES_PER_RANGE, high - low);
+    if (samples < 2) {
+        return;
+    }
+
+    std::vector<std::string> steps;
+    steps.push_back(start);
+    uint64_t step = (high - low) / samples;
+    for (size_t i = 1; i < samples; ++i) {
+        std::string key(first.begin(), first.begin() + prefix);
+        uint64_t position = low + step * i;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            key.push_back(static_cast<char>((position >> shift) & 0xFF));
+        }
+        steps.push_back(key);
+    }
+    steps.push_back(stop);
+
+    std::vector<leveldb::Range> ranges;
+    for (size_t i = 0; i + 1 < steps.size(); ++i) {
+        ranges.push_back(leveldb::Range(steps[i], steps[i + 1]));
+    }
+    std::vector<uint64_t> sizes(ranges.size(), 0);
+    _db->GetApproximateSizes(&ranges[0], ranges.size(), &sizes[0]);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        total += sizes[i];
+    }
+    if (total == 0) {
+        std::fill(sizes.begin(), sizes.end(), 1);
+        total = sizes.size();
+    }
+
+    // a step holding several cuts is cut again on its own
+    uint64_t weight = 0;
+    size_t cuts = 0;
+    for (size_t i = 0; i + 1 < sizes.size() && cuts + 1 < count; ++i) {
+        weight += sizes[i];
+        size_t inside = std::min<size_t>(weight * count / total, count - 1) - cuts;
+        if (inside > 1 && depth > 0) {
+            cut_scan(iter, steps[i], steps[i + 1], inside + 1, depth - 1, output);
+        }
+        if (inside > 0) {
+            output.push_back(steps[i + 1]);
+        }
+        cuts += inside;
+    }
+}
+
+void
+mtn::index_reader_writer_leveldb_t::split_scan(const leveldb::ReadOptions&     options,
+                                               const std::vector<mtn::byte_t>& start_key,
+                                               const std::vector<mtn::byte_t>& stop_key,
+                                               size_t                          count,
+                                               std::vector<std::string>&       output)
+{
+    std::string start(start_key.begin(), start_key.end());
+    std::string stop(stop_key.begin(), stop_key.end());
+    output.push_back(start);
+
+    std::vector<std::string> cuts;
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(options));
+    cut_scan(*iter, start, stop, count, MTN_SCAN_SPLIT_DEPTH, cuts);
+
+    // move every cut back to the key of the segment found there, so a
+    // segment and its deltas are always read by the same range
+    for (std::vector<std::string>::iterator cut = cuts.begin(); cut != cuts.end(); ++cut) {
+        iter->Seek(*cut);
+        if (!iter->Valid() || iter->key().compare(stop) >= 0) {
+            break;
+        }
+
+        uint16_t            partition   = 0;
+        mtn::byte_t*        bucket      = NULL;
+        uint16_t            bucket_size = 0;
+        mtn::byte_t*        field       = NULL;
+        uint16_t            field_size  = 0;
+        mtn_index_address_t value       = 0;
+        mtn_index_address_t offset      = 0;
+        mtn::decode_index_key(reinterpret_cast<const mtn::byte_t*>(iter->key().data()),
+                              &partition, &bucket, &bucket_size, &field, &field_size, &value, &offset);
+
+        std::vector<mtn::byte_t> key;
+        encode_index_key(partition, bucket, bucket_size, field, field_size, value, offset, key);
+        std::string boundary(key.begin(), key.end());
+        if (boundary > output.back()) {
+            output.push_back(boundary);
+        }
+    }
+    output.push_back(stop);
+}
+
 mtn::status_t
 mtn::index_reader_writer_leveldb_t::read_index_slice(mtn_index_partition_t           partition,
                                                      const std::vector<mtn::byte_t>& bucket,
@@ -184,7 +600,7 @@ mtn::index_reader_writer_leveldb_t::read_index_slice(mtn_index_partition_t
 
     mtn::index_slice_t::iterator insert_iter = output.begin();
 
-    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_scan_options));
     for (iter->Seek(start_slice);
          iter->Valid() && memcmp(iter->key().data(), &stop_key[0], MTN_INDEX_SEGMENT_SIZE) < 0;
          iter->Next())
@@ -197,9 +613,17 @@ mtn::index_reader_writer_leveldb_t::read_index_slice(mtn_index_partition_t
         mtn_index_address_t temp_value       = 0;
         mtn_index_address_t offset           = 0;
 
-        assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
         mtn::decode_index_key(reinterpret_cast<const mtn::byte_t*>(iter->key().data()), &temp_partition, &temp_bucket, &temp_bucket_size, &temp_field, &temp_field_size, &temp_value, &offset);
+
+        if (is_delta_key(iter->key().size(), temp_bucket_size, temp_field_size)) {
+            mtn::apply_bit_delta(reinterpret_cast<const mtn::byte_t*>(iter->value().data()),
+                                 delta_segment(output, insert_iter, offset));
+            continue;
+        }
+
+        assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
         insert_iter = output.insert(insert_iter, new mtn::index_slice_t::index_node_t(offset, (const index_segment_ptr) iter->value().data()));
+        ++insert_iter;
     }
     return mtn::status_t(); // XXX TODO better error handling
 }
@@ -216,16 +640,112 @@ mtn::index_reader_writer_leveldb_t::read_segment(mtn_index_partition_t
     encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), value, offset, key);
     leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
 
+    memset(output, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    // without deltas a point read is all it takes, and doesn't pay for
+    // an iterator over every level of the database
+    if (!_delta_log) {
+        std::string segment;
+        leveldb::Status db_status = _db->Get(_read_options, key_slice, &segment);
+
+        mtn::status_t status;
+        if (db_status.ok()) {
+            assert(segment.size() == MTN_INDEX_SEGMENT_SIZE);
+            memcpy(output, segment.data(), MTN_INDEX_SEGMENT_SIZE);
+        }
+        else if (!db_status.IsNotFound()) {
+            status.local_storage = true;
+            status.code = -1;
+            status.message = db_status.ToString();
+        }
+        return status;
+    }
+
     std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
     iter->Seek(key_slice);
     if (iter->Valid() && iter->key() == key_slice) {
         assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
         memcpy(output, iter->value().data(), MTN_INDEX_SEGMENT_SIZE);
+        iter->Next();
     }
-    else {
-        memset(output, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    // fold the deltas into the segment and replace them with it
+    leveldb::WriteBatch batch;
+    bool folded = false;
+    for (;
+         iter->Valid() && iter->key().starts_with(key_slice) && is_delta_key(iter->key().size(), bucket.size(), field.size());
+         iter->Next())
+    {
+        mtn::apply_bit_delta(reinterpret_cast<const mtn::byte_t*>(iter->value().data()), output);
+        batch.Delete(iter->key());
+        folded = true;
     }
-    return mtn::status_t();
+
+    // a snapshot can't fold, newer writes may have replaced the segment
+    if (!folded || _snapshot) {
+        return mtn::status_t();
+    }
+
+    batch.Put(key_slice, leveldb::Slice(reinterpret_cast<char*>(output), MTN_INDEX_SEGMENT_SIZE));
+    leveldb::Status db_status = _db->Write(_write_options, &batch);
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_segments(mtn_index_partition_t                      partition,
+                                                  const std::vector<mtn::byte_t>&            bucket,
+                                                  const std::vector<mtn::byte_t>&            field,
+                                                  const std::vector<mtn_index_address_t>&    values,
+                                                  mtn_index_address_t                        offset,
+                                                  const std::vector<mtn::index_segment_ptr>& output)
+{
+    std::vector<mtn::byte_t> key;
+
+    // the keys are sorted, one iterator walks forward through all of them
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    for (size_t i = 0; i < values.size(); ++i) {
+        mtn::index_segment_ptr segment = output[i];
+        memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+
+        encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), values[i], offset, key);
+        leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+        // after the previous segment the iterator is already at the
+        // first key past it, which is where a seek would land unless
+        // there are keys in between
+        if (i == 0 || (iter->Valid() && iter->key().compare(key_slice) < 0)) {
+            iter->Seek(key_slice);
+        }
+
+        if (iter->Valid() && iter->key() == key_slice) {
+            assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
+            memcpy(segment, iter->value().data(), MTN_INDEX_SEGMENT_SIZE);
+            iter->Next();
+        }
+
+        // deltas are applied but left in place, fold_deltas folds them
+        for (;
+             _delta_log && iter->Valid() && iter->key().starts_with(key_slice) && is_delta_key(iter->key().size(), bucket.size(), field.size());
+             iter->Next())
+        {
+            mtn::apply_bit_delta(reinterpret_cast<const mtn::byte_t*>(iter->value().data()), segment);
+        }
+    }
+
+    mtn::status_t status;
+    if (!iter->status().ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = iter->status().ToString();
+    }
+    return status;
 }
 
 mtn::status_t
@@ -236,11 +756,124 @@ mtn::index_reader_writer_leveldb_t::write_segment(mtn_index_partition_t
                                                   mtn_index_address_t             offset,
                                                   mtn::index_segment_ptr          input)
 {
+    if (_snapshot) {
+        return read_only();
+    }
+
     std::vector<mtn::byte_t> key;
     encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), value, offset, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    // the whole segment supersedes every delta written before it
+    leveldb::WriteBatch batch;
+    if (_delta_log) {
+        std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+        for (iter->Seek(key_slice); iter->Valid() && iter->key().starts_with(key_slice); iter->Next()) {
+            if (is_delta_key(iter->key().size(), bucket.size(), field.size())) {
+                batch.Delete(iter->key());
+            }
+        }
+    }
+    batch.Put(key_slice, leveldb::Slice(reinterpret_cast<char*>(input), MTN_INDEX_SEGMENT_SIZE));
+    leveldb::Status db_status = _db->Write(_write_options, &batch);
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::delete_segment(mtn_index_partition_t           partition,
+                                                   const std::vector<mtn::byte_t>& bucket,
+                                                   const std::vector<mtn::byte_t>& field,
+                                                   mtn_index_address_t             value,
+                                                   mtn_index_address_t             offset)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), value, offset, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    // the segment and its deltas share the segment key as a prefix
+    leveldb::WriteBatch batch;
+    batch.Delete(key_slice);
+    if (_delta_log) {
+        std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+        for (iter->Seek(key_slice); iter->Valid() && iter->key().starts_with(key_slice); iter->Next()) {
+            if (is_delta_key(iter->key().size(), bucket.size(), field.size())) {
+                batch.Delete(iter->key());
+            }
+        }
+    }
+    leveldb::Status db_status = _db->Write(_write_options, &batch);
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_bit(mtn_index_partition_t           partition,
+                                              const std::vector<mtn::byte_t>& bucket,
+                                              const std::vector<mtn::byte_t>& field,
+                                              mtn_index_address_t             value,
+                                              mtn_index_address_t             offset,
+                                              uint16_t                        position,
+                                              bool                            state,
+                                              mtn::index_segment_ptr          input)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    if (!_delta_log) {
+        return write_segment(partition, bucket, field, value, offset, input);
+    }
+
+    uint64_t sequence = 0;
+    {
+        boost::mutex::scoped_lock lock(_delta_mutex);
+        if (_delta_sequence == _delta_sequence_limit) {
+            mtn::byte_t limit_key[sizeof(uint16_t) + sizeof(mtn::byte_t)];
+            mtn::byte_t limit[sizeof(uint64_t)];
+            mtn::encode_uint64(_delta_sequence_limit + MTN_DELTA_SEQUENCE_BLOCK, limit);
+
+            leveldb::Status db_status = _db->Put(_write_options,
+                                                 delta_sequence_key(limit_key),
+                                                 leveldb::Slice(reinterpret_cast<char*>(limit), sizeof(limit)));
+            if (!db_status.ok()) {
+                mtn::status_t status;
+                status.local_storage = true;
+                status.code = -1;
+                status.message = db_status.ToString();
+                return status;
+            }
+            _delta_sequence_limit += MTN_DELTA_SEQUENCE_BLOCK;
+        }
+        sequence = _delta_sequence++;
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), value, offset, key);
+    key.resize(key.size() + sizeof(uint64_t));
+    mtn::encode_uint64(sequence, &key[key.size() - sizeof(uint64_t)]);
+
+    mtn::byte_t delta[MTN_BIT_DELTA_SIZE];
+    mtn::encode_bit_delta(position, state, delta);
     leveldb::Status db_status = _db->Put(_write_options,
                                          leveldb::Slice(reinterpret_cast<char*>(&key[0]), key.size()),
-                                         leveldb::Slice(reinterpret_cast<char*>(input), MTN_INDEX_SEGMENT_SIZE));
+                                         leveldb::Slice(reinterpret_cast<char*>(delta), sizeof(delta)));
 
     mtn::status_t status;
     if (!db_status.ok()) {
@@ -268,3 +901,504 @@ mtn::index_reader_writer_leveldb_t::estimateSize(mtn_index_partition_t
     _db->GetApproximateSizes(&range, 1, output);
     return mtn::status_t();
 }
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_value_dictionary(mtn_index_partition_t           partition,
+                                                          const std::vector<mtn::byte_t>& bucket,
+                                                          const std::vector<mtn::byte_t>& field,
+                                                          mtn::value_dictionary_t&        output)
+{
+    std::vector<mtn::byte_t> start_key;
+    encode_value_dictionary_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), 0, start_key);
+    leveldb::Slice start_slice(reinterpret_cast<char*>(&start_key[0]), start_key.size());
+
+    // every key of the field shares everything up to the id
+    size_t prefix_size = start_key.size() - sizeof(uint32_t);
+
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    for (iter->Seek(start_slice);
+         iter->Valid() && iter->key().size() == start_key.size() && memcmp(iter->key().data(), &start_key[0], prefix_size) == 0;
+         iter->Next())
+    {
+        uint32_t id = 0;
+        mtn::decode_uint32(reinterpret_cast<const mtn::byte_t*>(iter->key().data()) + prefix_size, &id);
+
+        mtn::value_dictionary_t::id_t assigned = 0;
+        mtn::status_t status = output.insert(iter->value().ToString(), assigned);
+        if (!status) {
+            return status;
+        }
+
+        if (assigned != id) {
+            return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "value dictionary ids are not dense");
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_value_dictionary(mtn_index_partition_t           partition,
+                                                           const std::vector<mtn::byte_t>& bucket,
+                                                           const std::vector<mtn::byte_t>& field,
+                                                           uint32_t                        id,
+                                                           const std::string&              value)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_value_dictionary_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), id, key);
+    leveldb::Status db_status = _db->Put(_write_options,
+                                         leveldb::Slice(reinterpret_cast<char*>(&key[0]), key.size()),
+                                         leveldb::Slice(value));
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_row_dictionary(mtn_index_partition_t           partition,
+                                                        const std::vector<mtn::byte_t>& bucket,
+                                                        mtn::row_dictionary_t&          output)
+{
+    std::vector<mtn::byte_t> start_key;
+    encode_row_dictionary_key(partition, &bucket[0], bucket.size(), 0, start_key);
+    leveldb::Slice start_slice(reinterpret_cast<char*>(&start_key[0]), start_key.size());
+
+    size_t prefix_size = start_key.size() - sizeof(uint32_t);
+
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    for (iter->Seek(start_slice);
+         iter->Valid() && iter->key().size() == start_key.size() && memcmp(iter->key().data(), &start_key[0], prefix_size) == 0;
+         iter->Next())
+    {
+        assert(iter->value().size() == sizeof(mtn_index_address_t));
+        uint32_t id = 0;
+        mtn_index_address_t row = 0;
+        mtn::decode_uint32(reinterpret_cast<const mtn::byte_t*>(iter->key().data()) + prefix_size, &id);
+        mtn::decode_uint128(reinterpret_cast<const mtn::byte_t*>(iter->value().data()), &row);
+
+        mtn::row_dictionary_t::id_t assigned = 0;
+        mtn::status_t status = output.insert(row, assigned);
+        if (!status) {
+            return status;
+        }
+
+        if (assigned != id) {
+            return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "row dictionary ids are not dense");
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_row_dictionary(mtn_index_partition_t           partition,
+                                                         const std::vector<mtn::byte_t>& bucket,
+                                                         uint32_t                        id,
+                                                         mtn_index_address_t             row)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_row_dictionary_key(partition, &bucket[0], bucket.size(), id, key);
+
+    mtn::byte_t value[sizeof(mtn_index_address_t)];
+    mtn::encode_uint128(row, value);
+    leveldb::Status db_status = _db->Put(_write_options,
+                                         leveldb::Slice(reinterpret_cast<char*>(&key[0]), key.size()),
+                                         leveldb::Slice(reinterpret_cast<char*>(value), sizeof(value)));
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_forward_index(mtn_index_partition_t           partition,
+                                                       const std::vector<mtn::byte_t>& bucket,
+                                                       mtn_index_address_t             row,
+                                                       std::vector<mtn::byte_t>&       output)
+{
+    std::vector<mtn::byte_t> key;
+    encode_forward_index_key(partition, &bucket[0], bucket.size(), row, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    output.clear();
+    std::string value;
+    leveldb::Status db_status = _db->Get(_read_options, key_slice, &value);
+
+    mtn::status_t status;
+    if (db_status.ok()) {
+        output.assign(value.begin(), value.end());
+    }
+    else if (!db_status.IsNotFound()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_forward_index(mtn_index_partition_t           partition,
+                                                        const std::vector<mtn::byte_t>& bucket,
+                                                        mtn_index_address_t             row,
+                                                        const std::vector<mtn::byte_t>& input)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_forward_index_key(partition, &bucket[0], bucket.size(), row, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    leveldb::Status db_status;
+    if (input.empty()) {
+        db_status = _db->Delete(_write_options, key_slice);
+    }
+    else {
+        db_status = _db->Put(_write_options,
+                             key_slice,
+                             leveldb::Slice(reinterpret_cast<const char*>(&input[0]), input.size()));
+    }
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_stored_values(mtn_index_partition_t           partition,
+                                                       const std::vector<mtn::byte_t>& bucket,
+                                                       const std::vector<mtn::byte_t>& field,
+                                                       mtn_index_address_t             row,
+                                                       std::vector<mtn::byte_t>&       output)
+{
+    std::vector<mtn::byte_t> key;
+    encode_stored_values_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), row, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    output.clear();
+    std::string value;
+    leveldb::Status db_status = _db->Get(_read_options, key_slice, &value);
+
+    mtn::status_t status;
+    if (db_status.ok()) {
+        output.assign(value.begin(), value.end());
+    }
+    else if (!db_status.IsNotFound()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_stored_values(mtn_index_partition_t           partition,
+                                                        const std::vector<mtn::byte_t>& bucket,
+                                                        const std::vector<mtn::byte_t>& field,
+                                                        mtn_index_address_t             row,
+                                                        const std::vector<mtn::byte_t>& input)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    encode_stored_values_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), row, key);
+    leveldb::Slice key_slice(reinterpret_cast<char*>(&key[0]), key.size());
+
+    leveldb::Status db_status;
+    if (input.empty()) {
+        db_status = _db->Delete(_write_options, key_slice);
+    }
+    else {
+        db_status = _db->Put(_write_options,
+                             key_slice,
+                             leveldb::Slice(reinterpret_cast<const char*>(&input[0]), input.size()));
+    }
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::drop_partition(mtn_index_partition_t partition)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    if (partition == MTN_DICTIONARY_PARTITION) {
+        return mtn::status_t(MTN_ERROR_BAD_PARAM, "the dictionary partition can't be dropped");
+    }
+
+    std::vector<mtn::byte_t> prefix(sizeof(uint16_t));
+    mtn::encode_parition(partition, &prefix[0]);
+    mtn::status_t status = delete_prefix(prefix, NULL);
+
+    const mtn::byte_t kinds[] = { MTN_DICTIONARY_VALUES, MTN_DICTIONARY_ROWS, MTN_DICTIONARY_FORWARD, MTN_DICTIONARY_STORED, MTN_DICTIONARY_CATALOG };
+    for (size_t i = 0; status && i < sizeof(kinds); ++i) {
+        mtn::encode_dictionary_prefix(kinds[i], partition, prefix);
+        status = delete_prefix(prefix, NULL);
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::drop_fields(mtn_index_partition_t           partition,
+                                                const std::vector<mtn::byte_t>& bucket,
+                                                const std::vector<mtn::byte_t>& field_prefix)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    if (partition == MTN_DICTIONARY_PARTITION) {
+        return mtn::status_t(MTN_ERROR_BAD_PARAM, "the dictionary partition can't be dropped");
+    }
+
+    std::vector<mtn::byte_t> prefix(sizeof(uint16_t));
+    mtn::encode_parition(partition, &prefix[0]);
+    mtn::append_bytes(&bucket[0], bucket.size(), prefix);
+    mtn::status_t status = delete_prefix(prefix, &field_prefix);
+
+    const mtn::byte_t kinds[] = { MTN_DICTIONARY_VALUES, MTN_DICTIONARY_STORED, MTN_DICTIONARY_CATALOG };
+    for (size_t i = 0; status && i < sizeof(kinds); ++i) {
+        mtn::encode_dictionary_prefix(kinds[i], partition, prefix);
+        mtn::append_bytes(&bucket[0], bucket.size(), prefix);
+        status = delete_prefix(prefix, &field_prefix);
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::fold_deltas(mtn_index_partition_t           partition,
+                                                const std::vector<mtn::byte_t>& bucket,
+                                                const std::vector<mtn::byte_t>& field)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    if (!_delta_log) {
+        return mtn::status_t();
+    }
+
+    // every key of the index starts with the partition, bucket and field
+    std::vector<mtn::byte_t> prefix;
+    encode_index_key(partition, &bucket[0], bucket.size(), &field[0], field.size(), 0, 0, prefix);
+    prefix.resize(prefix.size() - 2 * sizeof(mtn_index_address_t));
+    leveldb::Slice prefix_slice(reinterpret_cast<char*>(&prefix[0]), prefix.size());
+
+    leveldb::WriteBatch batch;
+    size_t batched = 0;
+    leveldb::Status db_status;
+
+    // a segment sorts right before its deltas, it's the base they're
+    // applied to unless the deltas are all there is
+    std::string segment_key;
+    mtn::index_segment_t segment;
+    bool folded = false;
+
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_scan_options));
+    for (iter->Seek(prefix_slice); db_status.ok() && iter->Valid() && iter->key().starts_with(prefix_slice); iter->Next()) {
+        bool delta = is_delta_key(iter->key().size(), bucket.size(), field.size());
+        leveldb::Slice key_slice(iter->key().data(), iter->key().size() - (delta ? sizeof(uint64_t) : 0));
+
+        if (key_slice != leveldb::Slice(segment_key)) {
+            if (folded) {
+                batch.Put(segment_key, leveldb::Slice(reinterpret_cast<char*>(segment), MTN_INDEX_SEGMENT_SIZE));
+                ++batched;
+            }
+            if (batched >= MTN_FOLD_BATCH_SIZE) {
+                db_status = _db->Write(_write_options, &batch);
+                batch.Clear();
+                batched = 0;
+            }
+
+            segment_key = key_slice.ToString();
+            memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+            folded = false;
+        }
+
+        if (!delta) {
+            assert(iter->value().size() == MTN_INDEX_SEGMENT_SIZE);
+            memcpy(segment, iter->value().data(), MTN_INDEX_SEGMENT_SIZE);
+            continue;
+        }
+
+        mtn::apply_bit_delta(reinterpret_cast<const mtn::byte_t*>(iter->value().data()), segment);
+        batch.Delete(iter->key());
+        ++batched;
+        folded = true;
+    }
+
+    if (db_status.ok() && folded) {
+        batch.Put(segment_key, leveldb::Slice(reinterpret_cast<char*>(segment), MTN_INDEX_SEGMENT_SIZE));
+        ++batched;
+    }
+
+    if (db_status.ok() && batched > 0) {
+        db_status = _db->Write(_write_options, &batch);
+    }
+
+    if (db_status.ok()) {
+        db_status = iter->status();
+    }
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::delete_prefix(const std::vector<mtn::byte_t>& prefix,
+                                                  const std::vector<mtn::byte_t>* field_prefix)
+{
+    leveldb::Slice prefix_slice(reinterpret_cast<const char*>(&prefix[0]), prefix.size());
+    std::string first;
+    std::string last;
+
+    leveldb::WriteBatch batch;
+    size_t batched = 0;
+    leveldb::Status db_status;
+
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_scan_options));
+    for (iter->Seek(prefix_slice);
+         db_status.ok() && iter->Valid() && iter->key().starts_with(prefix_slice);
+         iter->Next())
+    {
+        if (field_prefix
+            && !mtn::field_has_prefix(reinterpret_cast<const mtn::byte_t*>(iter->key().data()) + prefix.size(),
+                                      iter->key().size() - prefix.size(),
+                                      *field_prefix))
+        {
+            continue;
+        }
+
+        if (first.empty()) {
+            first = iter->key().ToString();
+        }
+        last = iter->key().ToString();
+
+        batch.Delete(iter->key());
+        if (++batched == MTN_DROP_BATCH_SIZE) {
+            db_status = _db->Write(_write_options, &batch);
+            batch.Clear();
+            batched = 0;
+        }
+    }
+
+    if (db_status.ok() && batched > 0) {
+        db_status = _db->Write(_write_options, &batch);
+    }
+
+    // leveldb has no range deletion, compacting the range is what
+    // gives the space of the deleted keys back
+    if (db_status.ok() && !first.empty()) {
+        leveldb::Slice first_slice(first);
+        leveldb::Slice last_slice(last);
+        _db->CompactRange(&first_slice, &last_slice);
+    }
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::read_catalog(mtn::catalog_t::entries_t& output)
+{
+    mtn::byte_t prefix[sizeof(uint16_t) + sizeof(mtn::byte_t)];
+    *mtn::encode_parition(MTN_DICTIONARY_PARTITION, prefix) = MTN_DICTIONARY_CATALOG;
+    leveldb::Slice prefix_slice(reinterpret_cast<char*>(prefix), sizeof(prefix));
+
+    std::auto_ptr<leveldb::Iterator> iter(_db->NewIterator(_read_options));
+    for (iter->Seek(prefix_slice);
+         iter->Valid() && iter->key().starts_with(prefix_slice);
+         iter->Next())
+    {
+        uint16_t     partition   = 0;
+        mtn::byte_t* bucket      = NULL;
+        uint16_t     bucket_size = 0;
+        mtn::byte_t* field       = NULL;
+        uint16_t     field_size  = 0;
+
+        std::vector<mtn::byte_t> value(iter->value().data(), iter->value().data() + iter->value().size());
+        mtn::catalog_entry_t entry;
+        if (!mtn::decode_catalog_key(reinterpret_cast<const mtn::byte_t*>(iter->key().data()),
+                                     iter->key().size(),
+                                     &partition,
+                                     &bucket,
+                                     &bucket_size,
+                                     &field,
+                                     &field_size)
+            || !mtn::catalog_t::decode(value, entry))
+        {
+            return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "corrupt catalog record");
+        }
+
+        entry.partition = partition;
+        entry.bucket.assign(bucket, bucket + bucket_size);
+        entry.field.assign(field, field + field_size);
+        output.push_back(entry);
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_leveldb_t::write_catalog(const mtn::catalog_entry_t& entry)
+{
+    if (_snapshot) {
+        return read_only();
+    }
+
+    std::vector<mtn::byte_t> key;
+    std::vector<mtn::byte_t> value;
+    encode_catalog_key(entry.partition, &entry.bucket[0], entry.bucket.size(), &entry.field[0], entry.field.size(), key);
+    mtn::catalog_t::encode(entry, value);
+
+    leveldb::Status db_status = _db->Put(_write_options,
+                                         leveldb::Slice(reinterpret_cast<char*>(&key[0]), key.size()),
+                                         leveldb::Slice(reinterpret_cast<char*>(&value[0]), value.size()));
+
+    mtn::status_t status;
+    if (!db_status.ok()) {
+        status.local_storage = true;
+        status.code = -1;
+        status.message = db_status.ToString();
+    }
+    return status;
+}
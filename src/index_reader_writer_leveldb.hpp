@@ -20,13 +20,18 @@
 #ifndef __MUTTON_INDEX_READER_WRITER_LEVELDB_HPP_INCLUDED__
 #define __MUTTON_INDEX_READER_WRITER_LEVELDB_HPP_INCLUDED__
 
+#include <leveldb/cache.h>
 #include <leveldb/db.h>
+#include <leveldb/filter_policy.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include "index_reader_writer.hpp"
 
 namespace mtn {
 
     class index_slice_t;
     class context_t;
+    class thread_pool_t;
 
     class index_reader_writer_leveldb_t :
         public index_reader_writer_t
@@ -41,6 +46,11 @@ namespace mtn {
         mtn::status_t
         init(mtn::context_t& context);
 
+        // reads see the database as it was when the snapshot was taken,
+        // writes are refused
+        mtn::index_reader_writer_t*
+        snapshot();
+
         mtn::status_t
         write_segment(mtn_index_partition_t           partition,
                       const std::vector<mtn::byte_t>& bucket,
@@ -49,6 +59,27 @@ namespace mtn {
                       mtn_index_address_t             offset,
                       mtn::index_segment_ptr          input);
 
+        mtn::status_t
+        delete_segment(mtn_index_partition_t           partition,
+                       const std::vector<mtn::byte_t>& bucket,
+                       const std::vector<mtn::byte_t>& field,
+                       mtn_index_address_t             value,
+                       mtn_index_address_t             offset);
+
+        // with MTN_OPT_DELTA_LOG the bit is appended as a delta, keyed by
+        // the segment key and a sequence number so it sorts right after
+        // the segment. Deltas are applied by every read and folded into
+        // the segment by read_segment and fold_deltas.
+        mtn::status_t
+        write_bit(mtn_index_partition_t           partition,
+                  const std::vector<mtn::byte_t>& bucket,
+                  const std::vector<mtn::byte_t>& field,
+                  mtn_index_address_t             value,
+                  mtn_index_address_t             offset,
+                  uint16_t                        position,
+                  bool                            state,
+                  mtn::index_segment_ptr          input);
+
         mtn::status_t
         read_indexes(mtn_index_partition_t                        partition,
                      const std::vector<mtn::byte_t>&              start_bucket,
@@ -78,6 +109,15 @@ namespace mtn {
                      mtn_index_address_t             offset,
                      mtn::index_segment_ptr          output);
 
+        // one iterator walks forward over the sorted keys
+        mtn::status_t
+        read_segments(mtn_index_partition_t                      partition,
+                      const std::vector<mtn::byte_t>&            bucket,
+                      const std::vector<mtn::byte_t>&            field,
+                      const std::vector<mtn_index_address_t>&    values,
+                      mtn_index_address_t                        offset,
+                      const std::vector<mtn::index_segment_ptr>& output);
+
         mtn::status_t
         estimateSize(mtn_index_partition_t           partition,
                      const std::vector<mtn::byte_t>& bucket,
@@ -85,10 +125,130 @@ namespace mtn {
                      mtn_index_address_t             value,
                      uint64_t*                       output);
 
+        mtn::status_t
+        read_value_dictionary(mtn_index_partition_t           partition,
+                              const std::vector<mtn::byte_t>& bucket,
+                              const std::vector<mtn::byte_t>& field,
+                              mtn::value_dictionary_t&        output);
+
+        mtn::status_t
+        write_value_dictionary(mtn_index_partition_t           partition,
+                               const std::vector<mtn::byte_t>& bucket,
+                               const std::vector<mtn::byte_t>& field,
+                               uint32_t                        id,
+                               const std::string&              value);
+
+        mtn::status_t
+        read_row_dictionary(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn::row_dictionary_t&          output);
+
+        mtn::status_t
+        write_row_dictionary(mtn_index_partition_t           partition,
+                             const std::vector<mtn::byte_t>& bucket,
+                             uint32_t                        id,
+                             mtn_index_address_t             row);
+
+        mtn::status_t
+        read_forward_index(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output);
+
+        mtn::status_t
+        write_forward_index(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input);
+
+        // fold every delta of the index into its segment, the segments
+        // read by read_indexes and read_index_slice are otherwise never
+        // folded
+        mtn::status_t
+        fold_deltas(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& field);
+
+        mtn::status_t
+        read_stored_values(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           const std::vector<mtn::byte_t>& field,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output);
+
+        mtn::status_t
+        write_stored_values(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            const std::vector<mtn::byte_t>& field,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input);
+
+        mtn::status_t
+        drop_partition(mtn_index_partition_t partition);
+
+        mtn::status_t
+        drop_fields(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& prefix);
+
+        mtn::status_t
+        read_catalog(mtn::catalog_t::entries_t& output);
+
+        mtn::status_t
+        write_catalog(const mtn::catalog_entry_t& entry);
+
     private:
-        leveldb::DB*          _db;
-        leveldb::ReadOptions  _read_options;
-        leveldb::WriteOptions _write_options;
+        struct scan_task_t;
+
+        // a view of store at snapshot, store must outlive it
+        index_reader_writer_leveldb_t(const index_reader_writer_leveldb_t& store,
+                                      const leveldb::Snapshot*             snapshot);
+
+        // delete every key starting with prefix. With field_prefix only
+        // the keys where prefix is followed by a field that starts with it.
+        // LevelDB has no range delete, every key is read and deleted.
+        mtn::status_t
+        delete_prefix(const std::vector<mtn::byte_t>& prefix,
+                      const std::vector<mtn::byte_t>* field_prefix);
+
+        // decode every index key in [start, stop) into output
+        mtn::status_t
+        scan_indexes(const leveldb::ReadOptions&                  options,
+                     const leveldb::Slice&                        start,
+                     const leveldb::Slice&                        stop,
+                     mtn::index_reader_writer_t::index_container& output);
+
+        // keys cutting [start, stop) into at most count ranges of about
+        // the same size on disk, starting with start and ending with stop
+        void
+        split_scan(const leveldb::ReadOptions&     options,
+                   const std::vector<mtn::byte_t>& start,
+                   const std::vector<mtn::byte_t>& stop,
+                   size_t                          count,
+                   std::vector<std::string>&       output);
+
+        // append keys cutting [start, stop) into count ranges, steps
+        // holding more than one cut are cut again up to depth times
+        void
+        cut_scan(leveldb::Iterator&        iter,
+                 const std::string&        start,
+                 const std::string&        stop,
+                 size_t                    count,
+                 size_t                    depth,
+                 std::vector<std::string>& output);
+
+        leveldb::DB*                           _db;
+        leveldb::Cache*                        _block_cache;
+        const leveldb::FilterPolicy*           _filter_policy;
+        const leveldb::Snapshot*               _snapshot;
+        leveldb::ReadOptions                   _read_options;
+        leveldb::ReadOptions                   _scan_options;
+        leveldb::WriteOptions                  _write_options;
+        bool                                   _delta_log;
+        uint64_t                               _delta_sequence;
+        uint64_t                               _delta_sequence_limit;
+        boost::mutex                           _delta_mutex;
+        boost::shared_ptr<mtn::thread_pool_t>  _scan_pool;
     };
 
 } // namespace mtn
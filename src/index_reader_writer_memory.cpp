@@ -0,0 +1,849 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <boost/functional/hash.hpp>
+
+#include "context.hpp"
+#include "encode.hpp"
+#include "index.hpp"
+#include "index_reader_writer_memory.hpp"
+#include "row_dictionary.hpp"
+#include "value_dictionary.hpp"
+
+// Snapshots are the magic followed by records of a 32 bit key size, the
+// key, a 32 bit value size and the value. Keys and values are the ones
+// the LevelDB backend would store.
+#define MTN_MEMORY_SNAPSHOT_MAGIC "mtnm0001"
+#define MTN_MEMORY_SNAPSHOT_MAGIC_SIZE 8
+
+namespace {
+
+    void
+    write_record(std::ofstream&                  stream,
+                 const std::vector<mtn::byte_t>& key,
+                 const void*                     value,
+                 uint32_t                        value_size)
+    {
+        mtn::byte_t size[sizeof(uint32_t)];
+        mtn::encode_uint32(key.size(), size);
+        stream.write(reinterpret_cast<const char*>(size), sizeof(size));
+        stream.write(reinterpret_cast<const char*>(&key[0]), key.size());
+        mtn::encode_uint32(value_size, size);
+        stream.write(reinterpret_cast<const char*>(size), sizeof(size));
+        stream.write(static_cast<const char*>(value), value_size);
+    }
+
+    // the next key or value of the snapshot, false if it's truncated
+    bool
+    read_field(const std::vector<mtn::byte_t>& input,
+               size_t&                         pos,
+               const mtn::byte_t**             output,
+               uint32_t*                       output_size)
+    {
+        if (input.size() - pos < sizeof(uint32_t)) {
+            return false;
+        }
+        mtn::decode_uint32(&input[pos], output_size);
+        pos += sizeof(uint32_t);
+
+        if (input.size() - pos < *output_size) {
+            return false;
+        }
+        *output = &input[pos];
+        pos += *output_size;
+        return true;
+    }
+
+    // bucket bytes of a dictionary key, false if they overrun the key
+    bool
+    read_bytes(const mtn::byte_t*        key,
+               size_t                    key_size,
+               size_t&                   pos,
+               std::vector<mtn::byte_t>& output)
+    {
+        if (key_size - pos < sizeof(uint16_t)) {
+            return false;
+        }
+        mtn::byte_t* bytes = NULL;
+        uint16_t size = 0;
+        mtn::decode_bytes(key + pos, &bytes, &size);
+        pos += sizeof(uint16_t);
+
+        if (key_size - pos < size) {
+            return false;
+        }
+        output.assign(bytes, bytes + size);
+        pos += size;
+        return true;
+    }
+
+    bool
+    has_prefix(const std::vector<mtn::byte_t>& field,
+               const std::vector<mtn::byte_t>& prefix)
+    {
+        return field.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), field.begin());
+    }
+
+    mtn::status_t
+    snapshot_error(const std::string& path,
+                   const std::string& message)
+    {
+        return mtn::status_t(MTN_ERROR_UNKOWN, path + ": " + message, false, true);
+    }
+
+} // namespace
+
+mtn::index_reader_writer_memory_t::index_reader_writer_memory_t(size_t shard_count)
+{
+    for (size_t i = 0; i < std::max<size_t>(shard_count, 1); ++i) {
+        _shards.push_back(new shard_t());
+    }
+}
+
+mtn::index_reader_writer_memory_t::~index_reader_writer_memory_t()
+{
+    if (!_path.empty()) {
+        snapshot(_path);
+    }
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::init(mtn::context_t& context)
+{
+    size_t shard_count = _shards.size();
+    if (context.get_opt(MTN_OPT_MEMORY_SHARDS, shard_count) && shard_count != _shards.size()) {
+        _shards.clear();
+        for (size_t i = 0; i < std::max<size_t>(shard_count, 1); ++i) {
+            _shards.push_back(new shard_t());
+        }
+    }
+
+    std::string path;
+    if (!context.get_opt(MTN_OPT_DB_PATH, path)) {
+        return mtn::status_t();
+    }
+
+    // only snapshot on destruction once an existing snapshot was loaded,
+    // a file that fails to load is never overwritten
+    mtn::status_t status;
+    if (std::ifstream(path.c_str(), std::ios::binary)) {
+        status = load(path);
+    }
+
+    if (status) {
+        _path = path;
+    }
+    return status;
+}
+
+mtn::index_reader_writer_memory_t::shard_t&
+mtn::index_reader_writer_memory_t::shard(mtn_index_partition_t           partition,
+                                         const std::vector<mtn::byte_t>& bucket)
+{
+    size_t hash = boost::hash_range(bucket.begin(), bucket.end());
+    boost::hash_combine(hash, partition);
+    return _shards[hash % _shards.size()];
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_segment(mtn_index_partition_t           partition,
+                                                 const std::vector<mtn::byte_t>& bucket,
+                                                 const std::vector<mtn::byte_t>& field,
+                                                 mtn_index_address_t             value,
+                                                 mtn_index_address_t             offset,
+                                                 mtn::index_segment_ptr          input)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    mtn::index_slice_t& slice = find_slice(s, partition, bucket, field, value);
+    mtn::index_slice_t::iterator node = slice.lower_bound(offset);
+    if (node != slice.end() && node->offset == offset) {
+        memcpy(node->segment, input, MTN_INDEX_SEGMENT_SIZE);
+    }
+    else {
+        slice.insert(node, new mtn::index_slice_t::index_node_t(offset, input));
+    }
+    return mtn::status_t();
+}
+
+mtn::index_slice_t&
+mtn::index_reader_writer_memory_t::find_slice(shard_t&                        s,
+                                              mtn_index_partition_t           partition,
+                                              const std::vector<mtn::byte_t>& bucket,
+                                              const std::vector<mtn::byte_t>& field,
+                                              mtn_index_address_t             value)
+{
+    index_key_t key(partition, bucket, field, value);
+    slice_container::iterator iter = s.slices.lower_bound(key);
+    if (iter == s.slices.end() || key < iter->first) {
+        iter = s.slices.insert(iter, key, new mtn::index_slice_t(partition, bucket, field, value));
+    }
+    return *iter->second;
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::delete_segment(mtn_index_partition_t           partition,
+                                                  const std::vector<mtn::byte_t>& bucket,
+                                                  const std::vector<mtn::byte_t>& field,
+                                                  mtn_index_address_t             value,
+                                                  mtn_index_address_t             offset)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    slice_container::iterator iter = s.slices.find(index_key_t(partition, bucket, field, value));
+    if (iter == s.slices.end()) {
+        return mtn::status_t();
+    }
+
+    mtn::index_slice_t::iterator node = iter->second->find(offset);
+    if (node != iter->second->end()) {
+        iter->second->erase(node);
+    }
+
+    if (iter->second->begin() == iter->second->end()) {
+        s.slices.erase(iter);
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_indexes(mtn_index_partition_t                        partition,
+                                                const std::vector<mtn::byte_t>&              start_bucket,
+                                                const std::vector<mtn::byte_t>&              start_field,
+                                                const std::vector<mtn::byte_t>&              end_bucket,
+                                                const std::vector<mtn::byte_t>&              end_field,
+                                                mtn::index_reader_writer_t::index_container& output)
+{
+    // like LevelDB an empty end reads to the end of the partition
+    bool bounded = !end_bucket.empty() && !end_field.empty();
+    index_key_t start_key(partition, start_bucket, start_field, 0);
+    index_key_t end_key(partition, end_bucket, end_field, INDEX_ADDRESS_MAX);
+
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        boost::mutex::scoped_lock lock(_shards[i].mutex);
+
+        slice_container::iterator iter = _shards[i].slices.lower_bound(start_key);
+        for (;
+             iter != _shards[i].slices.end()
+                 && iter->first.partition == partition
+                 && (!bounded || !(end_key < iter->first));
+             ++iter)
+        {
+            if (iter->second->begin() == iter->second->end()) {
+                continue;
+            }
+
+            mtn::index_reader_writer_t::index_container::iterator index_iter = output.find(iter->first.field);
+            if (index_iter == output.end()) {
+                std::vector<mtn::byte_t> key(iter->first.field);
+                index_iter = output.insert(key, new mtn::index_t(partition, iter->first.bucket, iter->first.field)).first;
+            }
+            index_iter->second->insert(iter->first.value, new mtn::index_slice_t(*iter->second));
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_index(mtn_index_partition_t           partition,
+                                              const std::vector<mtn::byte_t>& bucket,
+                                              const std::vector<mtn::byte_t>& field,
+                                              mtn::index_t**                  output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    *output = new mtn::index_t(partition, bucket, field);
+    slice_container::iterator iter = s.slices.lower_bound(index_key_t(partition, bucket, field, 0));
+    for (;
+         iter != s.slices.end()
+             && iter->first.partition == partition
+             && iter->first.bucket == bucket
+             && iter->first.field == field;
+         ++iter)
+    {
+        if (iter->second->begin() != iter->second->end()) {
+            (*output)->insert(iter->first.value, new mtn::index_slice_t(*iter->second));
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_index_slice(mtn_index_partition_t           partition,
+                                                    const std::vector<mtn::byte_t>& bucket,
+                                                    const std::vector<mtn::byte_t>& field,
+                                                    mtn_index_address_t             value,
+                                                    mtn::index_slice_t&             output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    slice_container::iterator iter = s.slices.find(index_key_t(partition, bucket, field, value));
+    if (iter != s.slices.end()) {
+        output = *iter->second;
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_segment(mtn_index_partition_t           partition,
+                                                const std::vector<mtn::byte_t>& bucket,
+                                                const std::vector<mtn::byte_t>& field,
+                                                mtn_index_address_t             value,
+                                                mtn_index_address_t             offset,
+                                                mtn::index_segment_ptr          output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    slice_container::iterator iter = s.slices.find(index_key_t(partition, bucket, field, value));
+    if (iter != s.slices.end()) {
+        mtn::index_slice_t::iterator node = iter->second->find(offset);
+        if (node != iter->second->end()) {
+            memcpy(output, node->segment, MTN_INDEX_SEGMENT_SIZE);
+            return mtn::status_t();
+        }
+    }
+    memset(output, 0, MTN_INDEX_SEGMENT_SIZE);
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::estimateSize(mtn_index_partition_t           partition,
+                                                const std::vector<mtn::byte_t>& bucket,
+                                                const std::vector<mtn::byte_t>& field,
+                                                mtn_index_address_t             value,
+                                                uint64_t*                       output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    slice_container::iterator iter = s.slices.find(index_key_t(partition, bucket, field, value));
+    *output = iter != s.slices.end() ? iter->second->size() * MTN_INDEX_SEGMENT_SIZE : 0;
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_value_dictionary(mtn_index_partition_t           partition,
+                                                         const std::vector<mtn::byte_t>& bucket,
+                                                         const std::vector<mtn::byte_t>& field,
+                                                         mtn::value_dictionary_t&        output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    dictionary_container::iterator iter = s.dictionaries.find(index_key_t(partition, bucket, field, 0));
+    if (iter != s.dictionaries.end()) {
+        for (size_t i = 0; i < iter->second.size(); ++i) {
+            mtn::value_dictionary_t::id_t id = 0;
+            mtn::status_t status = output.insert(iter->second[i], id);
+            if (!status) {
+                return status;
+            }
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_value_dictionary(mtn_index_partition_t           partition,
+                                                          const std::vector<mtn::byte_t>& bucket,
+                                                          const std::vector<mtn::byte_t>& field,
+                                                          uint32_t                        id,
+                                                          const std::string&              value)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    std::vector<std::string>& values = s.dictionaries[index_key_t(partition, bucket, field, 0)];
+    values.resize(std::max<size_t>(values.size(), id + 1));
+    values[id] = value;
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_row_dictionary(mtn_index_partition_t           partition,
+                                                       const std::vector<mtn::byte_t>& bucket,
+                                                       mtn::row_dictionary_t&          output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    row_dictionary_container::iterator iter = s.row_dictionaries.find(bucket_key_t(partition, bucket));
+    if (iter != s.row_dictionaries.end()) {
+        for (size_t i = 0; i < iter->second.size(); ++i) {
+            mtn::row_dictionary_t::id_t id = 0;
+            mtn::status_t status = output.insert(iter->second[i], id);
+            if (!status) {
+                return status;
+            }
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_row_dictionary(mtn_index_partition_t           partition,
+                                                        const std::vector<mtn::byte_t>& bucket,
+                                                        uint32_t                        id,
+                                                        mtn_index_address_t             row)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    std::vector<mtn_index_address_t>& rows = s.row_dictionaries[bucket_key_t(partition, bucket)];
+    rows.resize(std::max<size_t>(rows.size(), id + 1));
+    rows[id] = row;
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_forward_index(mtn_index_partition_t           partition,
+                                                      const std::vector<mtn::byte_t>& bucket,
+                                                      mtn_index_address_t             row,
+                                                      std::vector<mtn::byte_t>&       output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    forward_index_container::iterator iter = s.forward_index.find(row_key_t(bucket_key_t(partition, bucket), row));
+    if (iter != s.forward_index.end()) {
+        output = iter->second;
+    }
+    else {
+        output.clear();
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_forward_index(mtn_index_partition_t           partition,
+                                                       const std::vector<mtn::byte_t>& bucket,
+                                                       mtn_index_address_t             row,
+                                                       const std::vector<mtn::byte_t>& input)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    row_key_t key(bucket_key_t(partition, bucket), row);
+    if (input.empty()) {
+        s.forward_index.erase(key);
+    }
+    else {
+        s.forward_index[key] = input;
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_stored_values(mtn_index_partition_t           partition,
+                                                      const std::vector<mtn::byte_t>& bucket,
+                                                      const std::vector<mtn::byte_t>& field,
+                                                      mtn_index_address_t             row,
+                                                      std::vector<mtn::byte_t>&       output)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    stored_value_container::iterator iter = s.stored_values.find(index_key_t(partition, bucket, field, row));
+    if (iter != s.stored_values.end()) {
+        output = iter->second;
+    }
+    else {
+        output.clear();
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_stored_values(mtn_index_partition_t           partition,
+                                                       const std::vector<mtn::byte_t>& bucket,
+                                                       const std::vector<mtn::byte_t>& field,
+                                                       mtn_index_address_t             row,
+                                                       const std::vector<mtn::byte_t>& input)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    index_key_t key(partition, bucket, field, row);
+    if (input.empty()) {
+        s.stored_values.erase(key);
+    }
+    else {
+        s.stored_values[key] = input;
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::drop_partition(mtn_index_partition_t partition)
+{
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        shard_t& s = _shards[i];
+        boost::mutex::scoped_lock lock(s.mutex);
+
+        for (slice_container::iterator iter = s.slices.begin(); iter != s.slices.end();) {
+            if (iter->first.partition == partition) {
+                s.slices.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        for (dictionary_container::iterator iter = s.dictionaries.begin(); iter != s.dictionaries.end();) {
+            if (iter->first.partition == partition) {
+                s.dictionaries.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        for (row_dictionary_container::iterator iter = s.row_dictionaries.begin(); iter != s.row_dictionaries.end();) {
+            if (iter->first.first == partition) {
+                s.row_dictionaries.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        for (forward_index_container::iterator iter = s.forward_index.begin(); iter != s.forward_index.end();) {
+            if (iter->first.first.first == partition) {
+                s.forward_index.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        for (stored_value_container::iterator iter = s.stored_values.begin(); iter != s.stored_values.end();) {
+            if (iter->first.partition == partition) {
+                s.stored_values.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+
+        for (catalog_container::iterator iter = s.catalog.begin(); iter != s.catalog.end();) {
+            if (iter->first.partition == partition) {
+                s.catalog.erase(iter++);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::drop_fields(mtn_index_partition_t           partition,
+                                               const std::vector<mtn::byte_t>& bucket,
+                                               const std::vector<mtn::byte_t>& prefix)
+{
+    shard_t& s = shard(partition, bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    // the bucket's keys are contiguous, starting with the empty field
+    index_key_t start(partition, bucket, std::vector<mtn::byte_t>(), 0);
+
+    for (slice_container::iterator iter = s.slices.lower_bound(start);
+         iter != s.slices.end() && iter->first.partition == partition && iter->first.bucket == bucket;)
+    {
+        if (has_prefix(iter->first.field, prefix)) {
+            s.slices.erase(iter++);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    for (dictionary_container::iterator iter = s.dictionaries.lower_bound(start);
+         iter != s.dictionaries.end() && iter->first.partition == partition && iter->first.bucket == bucket;)
+    {
+        if (has_prefix(iter->first.field, prefix)) {
+            s.dictionaries.erase(iter++);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    for (stored_value_container::iterator iter = s.stored_values.lower_bound(start);
+         iter != s.stored_values.end() && iter->first.partition == partition && iter->first.bucket == bucket;)
+    {
+        if (has_prefix(iter->first.field, prefix)) {
+            s.stored_values.erase(iter++);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    for (catalog_container::iterator iter = s.catalog.lower_bound(start);
+         iter != s.catalog.end() && iter->first.partition == partition && iter->first.bucket == bucket;)
+    {
+        if (has_prefix(iter->first.field, prefix)) {
+            s.catalog.erase(iter++);
+        }
+        else {
+            ++iter;
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::read_catalog(mtn::catalog_t::entries_t& output)
+{
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        shard_t& s = _shards[i];
+        boost::mutex::scoped_lock lock(s.mutex);
+
+        for (catalog_container::iterator iter = s.catalog.begin(); iter != s.catalog.end(); ++iter) {
+            mtn::catalog_entry_t entry(iter->first.partition, iter->first.bucket, iter->first.field);
+            if (!mtn::catalog_t::decode(iter->second, entry)) {
+                return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "corrupt catalog record");
+            }
+            output.push_back(entry);
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::write_catalog(const mtn::catalog_entry_t& entry)
+{
+    shard_t& s = shard(entry.partition, entry.bucket);
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    mtn::catalog_t::encode(entry, s.catalog[index_key_t(entry.partition, entry.bucket, entry.field, 0)]);
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::snapshot(const std::string& path)
+{
+    std::string temp_path = path + ".tmp";
+    std::ofstream stream(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        return snapshot_error(temp_path, "couldn't open the snapshot for writing");
+    }
+    stream.write(MTN_MEMORY_SNAPSHOT_MAGIC, MTN_MEMORY_SNAPSHOT_MAGIC_SIZE);
+
+    std::vector<mtn::byte_t> key;
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        shard_t& s = _shards[i];
+        boost::mutex::scoped_lock lock(s.mutex);
+
+        for (slice_container::iterator iter = s.slices.begin(); iter != s.slices.end(); ++iter) {
+            const index_key_t& k = iter->first;
+            mtn::index_slice_t::iterator node = iter->second->begin();
+            for (; node != iter->second->end(); ++node) {
+                encode_index_key(k.partition, &k.bucket[0], k.bucket.size(), &k.field[0], k.field.size(), k.value, node->offset, key);
+                write_record(stream, key, node->segment, MTN_INDEX_SEGMENT_SIZE);
+            }
+        }
+
+        for (dictionary_container::iterator iter = s.dictionaries.begin(); iter != s.dictionaries.end(); ++iter) {
+            const index_key_t& k = iter->first;
+            for (size_t id = 0; id < iter->second.size(); ++id) {
+                encode_value_dictionary_key(k.partition, &k.bucket[0], k.bucket.size(), &k.field[0], k.field.size(), id, key);
+                write_record(stream, key, iter->second[id].data(), iter->second[id].size());
+            }
+        }
+
+        for (row_dictionary_container::iterator iter = s.row_dictionaries.begin(); iter != s.row_dictionaries.end(); ++iter) {
+            const bucket_key_t& k = iter->first;
+            for (size_t id = 0; id < iter->second.size(); ++id) {
+                mtn::byte_t row[sizeof(mtn_index_address_t)];
+                mtn::encode_uint128(iter->second[id], row);
+                encode_row_dictionary_key(k.first, &k.second[0], k.second.size(), id, key);
+                write_record(stream, key, row, sizeof(row));
+            }
+        }
+
+        for (forward_index_container::iterator iter = s.forward_index.begin(); iter != s.forward_index.end(); ++iter) {
+            const row_key_t& k = iter->first;
+            encode_forward_index_key(k.first.first, &k.first.second[0], k.first.second.size(), k.second, key);
+            write_record(stream, key, &iter->second[0], iter->second.size());
+        }
+
+        for (stored_value_container::iterator iter = s.stored_values.begin(); iter != s.stored_values.end(); ++iter) {
+            const index_key_t& k = iter->first;
+            encode_stored_values_key(k.partition, &k.bucket[0], k.bucket.size(), &k.field[0], k.field.size(), k.value, key);
+            write_record(stream, key, &iter->second[0], iter->second.size());
+        }
+
+        for (catalog_container::iterator iter = s.catalog.begin(); iter != s.catalog.end(); ++iter) {
+            const index_key_t& k = iter->first;
+            encode_catalog_key(k.partition, &k.bucket[0], k.bucket.size(), &k.field[0], k.field.size(), key);
+            write_record(stream, key, &iter->second[0], iter->second.size());
+        }
+    }
+
+    stream.close();
+    if (!stream || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        return snapshot_error(path, "couldn't write the snapshot");
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::index_reader_writer_memory_t::load(const std::string& path)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if (!stream) {
+        return snapshot_error(path, "couldn't open the snapshot");
+    }
+    std::vector<mtn::byte_t> input((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    if (input.size() < MTN_MEMORY_SNAPSHOT_MAGIC_SIZE
+        || memcmp(&input[0], MTN_MEMORY_SNAPSHOT_MAGIC, MTN_MEMORY_SNAPSHOT_MAGIC_SIZE) != 0)
+    {
+        return snapshot_error(path, "not a snapshot");
+    }
+
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        boost::mutex::scoped_lock lock(_shards[i].mutex);
+        _shards[i].slices.clear();
+        _shards[i].dictionaries.clear();
+        _shards[i].row_dictionaries.clear();
+        _shards[i].forward_index.clear();
+        _shards[i].stored_values.clear();
+        _shards[i].catalog.clear();
+    }
+
+    mtn::status_t status;
+    size_t pos = MTN_MEMORY_SNAPSHOT_MAGIC_SIZE;
+    while (pos < input.size() && status) {
+        const mtn::byte_t* key = NULL;
+        const mtn::byte_t* value = NULL;
+        uint32_t key_size = 0;
+        uint32_t value_size = 0;
+        if (!read_field(input, pos, &key, &key_size)
+            || !read_field(input, pos, &value, &value_size)
+            || key_size < sizeof(uint16_t) + sizeof(mtn::byte_t))
+        {
+            return snapshot_error(path, "snapshot is truncated");
+        }
+
+        uint16_t partition = 0;
+        mtn::decode_parition(key, &partition);
+
+        if (partition != MTN_DICTIONARY_PARTITION) {
+            if (key_size < get_index_key_size(0, 0, 0, 0, 0) || value_size != MTN_INDEX_SEGMENT_SIZE) {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            size_t key_pos = sizeof(uint16_t);
+            std::vector<mtn::byte_t> bucket;
+            std::vector<mtn::byte_t> field;
+            if (!read_bytes(key, key_size, key_pos, bucket)
+                || !read_bytes(key, key_size, key_pos, field)
+                || key_size - key_pos != 2 * sizeof(mtn_index_address_t))
+            {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+
+            mtn_index_address_t slice_value = 0;
+            mtn_index_address_t offset = 0;
+            mtn::decode_uint128(key + key_pos, &slice_value);
+            mtn::decode_uint128(key + key_pos + sizeof(mtn_index_address_t), &offset);
+
+            mtn::index_segment_t segment;
+            memcpy(segment, value, MTN_INDEX_SEGMENT_SIZE);
+            status = write_segment(partition, bucket, field, slice_value, offset, segment);
+            continue;
+        }
+
+        mtn::byte_t kind = key[sizeof(uint16_t)];
+        size_t key_pos = sizeof(uint16_t) + sizeof(mtn::byte_t);
+        std::vector<mtn::byte_t> bucket;
+        if (key_size - key_pos < sizeof(uint16_t)) {
+            return snapshot_error(path, "snapshot is truncated");
+        }
+        mtn::decode_parition(key + key_pos, &partition);
+        key_pos += sizeof(uint16_t);
+        if (!read_bytes(key, key_size, key_pos, bucket)) {
+            return snapshot_error(path, "snapshot is truncated");
+        }
+
+        if (kind == MTN_DICTIONARY_VALUES) {
+            std::vector<mtn::byte_t> field;
+            if (!read_bytes(key, key_size, key_pos, field) || key_size - key_pos != sizeof(uint32_t)) {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            uint32_t id = 0;
+            mtn::decode_uint32(key + key_pos, &id);
+            status = write_value_dictionary(partition, bucket, field, id, std::string(value, value + value_size));
+        }
+        else if (kind == MTN_DICTIONARY_ROWS) {
+            if (key_size - key_pos != sizeof(uint32_t) || value_size != sizeof(mtn_index_address_t)) {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            uint32_t id = 0;
+            mtn_index_address_t row = 0;
+            mtn::decode_uint32(key + key_pos, &id);
+            mtn::decode_uint128(value, &row);
+            status = write_row_dictionary(partition, bucket, id, row);
+        }
+        else if (kind == MTN_DICTIONARY_FORWARD) {
+            if (key_size - key_pos != sizeof(mtn_index_address_t)) {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            mtn_index_address_t row = 0;
+            mtn::decode_uint128(key + key_pos, &row);
+            status = write_forward_index(partition, bucket, row, std::vector<mtn::byte_t>(value, value + value_size));
+        }
+        else if (kind == MTN_DICTIONARY_STORED) {
+            std::vector<mtn::byte_t> field;
+            if (!read_bytes(key, key_size, key_pos, field) || key_size - key_pos != sizeof(mtn_index_address_t)) {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            mtn_index_address_t row = 0;
+            mtn::decode_uint128(key + key_pos, &row);
+            status = write_stored_values(partition, bucket, field, row, std::vector<mtn::byte_t>(value, value + value_size));
+        }
+        else if (kind == MTN_DICTIONARY_CATALOG) {
+            mtn::catalog_entry_t entry(partition, bucket, std::vector<mtn::byte_t>());
+            if (!read_bytes(key, key_size, key_pos, entry.field)
+                || key_size != key_pos
+                || !mtn::catalog_t::decode(std::vector<mtn::byte_t>(value, value + value_size), entry))
+            {
+                return snapshot_error(path, "snapshot is truncated");
+            }
+            status = write_catalog(entry);
+        }
+        else {
+            return snapshot_error(path, "unknown snapshot record");
+        }
+    }
+    return status;
+}
@@ -0,0 +1,265 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_INDEX_READER_WRITER_MEMORY_HPP_INCLUDED__
+#define __MUTTON_INDEX_READER_WRITER_MEMORY_HPP_INCLUDED__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "index_reader_writer.hpp"
+#include "index_slice.hpp"
+
+#define MTN_MEMORY_DEFAULT_SHARDS 16
+
+namespace mtn {
+
+    class context_t;
+
+    // Keeps every index in memory, for data that doesn't need to outlive
+    // the process. Keys are spread over shards by partition and bucket,
+    // each shard has its own lock so writers to different buckets don't
+    // contend. If MTN_OPT_DB_PATH is set it names a snapshot file, loaded
+    // by init and written by snapshot and when the backend is destroyed.
+    class index_reader_writer_memory_t :
+        public index_reader_writer_t,
+        private boost::noncopyable
+    {
+
+    public:
+
+        index_reader_writer_memory_t(size_t shard_count = MTN_MEMORY_DEFAULT_SHARDS);
+
+        ~index_reader_writer_memory_t();
+
+        mtn::status_t
+        init(mtn::context_t& context);
+
+        // write every shard to path, replacing the file once it is complete
+        mtn::status_t
+        snapshot(const std::string& path);
+
+        // replace the contents of every shard with the snapshot at path
+        mtn::status_t
+        load(const std::string& path);
+
+        mtn::status_t
+        write_segment(mtn_index_partition_t           partition,
+                      const std::vector<mtn::byte_t>& bucket,
+                      const std::vector<mtn::byte_t>& field,
+                      mtn_index_address_t             value,
+                      mtn_index_address_t             offset,
+                      mtn::index_segment_ptr          input);
+
+        mtn::status_t
+        delete_segment(mtn_index_partition_t           partition,
+                       const std::vector<mtn::byte_t>& bucket,
+                       const std::vector<mtn::byte_t>& field,
+                       mtn_index_address_t             value,
+                       mtn_index_address_t             offset);
+
+        mtn::status_t
+        read_indexes(mtn_index_partition_t                        partition,
+                     const std::vector<mtn::byte_t>&              start_bucket,
+                     const std::vector<mtn::byte_t>&              start_field,
+                     const std::vector<mtn::byte_t>&              end_bucket,
+                     const std::vector<mtn::byte_t>&              end_field,
+                     mtn::index_reader_writer_t::index_container& output);
+
+        mtn::status_t
+        read_index(mtn_index_partition_t           partition,
+                   const std::vector<mtn::byte_t>& bucket,
+                   const std::vector<mtn::byte_t>& field,
+                   mtn::index_t**                  output);
+
+        mtn::status_t
+        read_index_slice(mtn_index_partition_t           partition,
+                         const std::vector<mtn::byte_t>& bucket,
+                         const std::vector<mtn::byte_t>& field,
+                         mtn_index_address_t             value,
+                         mtn::index_slice_t&             output);
+
+        mtn::status_t
+        read_segment(mtn_index_partition_t           partition,
+                     const std::vector<mtn::byte_t>& bucket,
+                     const std::vector<mtn::byte_t>& field,
+                     mtn_index_address_t             value,
+                     mtn_index_address_t             offset,
+                     mtn::index_segment_ptr          output);
+
+        mtn::status_t
+        estimateSize(mtn_index_partition_t           partition,
+                     const std::vector<mtn::byte_t>& bucket,
+                     const std::vector<mtn::byte_t>& field,
+                     mtn_index_address_t             value,
+                     uint64_t*                       output);
+
+        mtn::status_t
+        read_value_dictionary(mtn_index_partition_t           partition,
+                              const std::vector<mtn::byte_t>& bucket,
+                              const std::vector<mtn::byte_t>& field,
+                              mtn::value_dictionary_t&        output);
+
+        mtn::status_t
+        write_value_dictionary(mtn_index_partition_t           partition,
+                               const std::vector<mtn::byte_t>& bucket,
+                               const std::vector<mtn::byte_t>& field,
+                               uint32_t                        id,
+                               const std::string&              value);
+
+        mtn::status_t
+        read_row_dictionary(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn::row_dictionary_t&          output);
+
+        mtn::status_t
+        write_row_dictionary(mtn_index_partition_t           partition,
+                             const std::vector<mtn::byte_t>& bucket,
+                             uint32_t                        id,
+                             mtn_index_address_t             row);
+
+        mtn::status_t
+        read_forward_index(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output);
+
+        mtn::status_t
+        write_forward_index(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input);
+
+        mtn::status_t
+        read_stored_values(mtn_index_partition_t           partition,
+                           const std::vector<mtn::byte_t>& bucket,
+                           const std::vector<mtn::byte_t>& field,
+                           mtn_index_address_t             row,
+                           std::vector<mtn::byte_t>&       output);
+
+        mtn::status_t
+        write_stored_values(mtn_index_partition_t           partition,
+                            const std::vector<mtn::byte_t>& bucket,
+                            const std::vector<mtn::byte_t>& field,
+                            mtn_index_address_t             row,
+                            const std::vector<mtn::byte_t>& input);
+
+        mtn::status_t
+        drop_partition(mtn_index_partition_t partition);
+
+        mtn::status_t
+        drop_fields(mtn_index_partition_t           partition,
+                    const std::vector<mtn::byte_t>& bucket,
+                    const std::vector<mtn::byte_t>& prefix);
+
+        mtn::status_t
+        read_catalog(mtn::catalog_t::entries_t& output);
+
+        mtn::status_t
+        write_catalog(const mtn::catalog_entry_t& entry);
+
+        inline size_t
+        shard_count() const
+        {
+            return _shards.size();
+        }
+
+    private:
+
+        struct index_key_t
+        {
+            mtn_index_partition_t    partition;
+            std::vector<mtn::byte_t> bucket;
+            std::vector<mtn::byte_t> field;
+            mtn_index_address_t      value;
+
+            index_key_t(mtn_index_partition_t           partition,
+                        const std::vector<mtn::byte_t>& bucket,
+                        const std::vector<mtn::byte_t>& field,
+                        mtn_index_address_t             value) :
+                partition(partition),
+                bucket(bucket),
+                field(field),
+                value(value)
+            {}
+
+            friend bool
+            operator<(const index_key_t& a,
+                      const index_key_t& b)
+            {
+                if (a.partition != b.partition) {
+                    return a.partition < b.partition;
+                }
+                if (a.bucket != b.bucket) {
+                    return a.bucket < b.bucket;
+                }
+                if (a.field != b.field) {
+                    return a.field < b.field;
+                }
+                return a.value < b.value;
+            }
+        };
+
+        typedef std::pair<mtn_index_partition_t, std::vector<mtn::byte_t> > bucket_key_t;
+        typedef std::pair<bucket_key_t, mtn_index_address_t>                row_key_t;
+        typedef boost::ptr_map<index_key_t, mtn::index_slice_t>             slice_container;
+        typedef std::map<index_key_t, std::vector<std::string> >            dictionary_container;
+        typedef std::map<bucket_key_t, std::vector<mtn_index_address_t> >   row_dictionary_container;
+        typedef std::map<row_key_t, std::vector<mtn::byte_t> >              forward_index_container;
+        typedef std::map<index_key_t, std::vector<mtn::byte_t> >            catalog_container;
+        // keyed by the row in place of the value
+        typedef std::map<index_key_t, std::vector<mtn::byte_t> >            stored_value_container;
+
+        struct shard_t :
+            boost::noncopyable
+        {
+            boost::mutex             mutex;
+            slice_container          slices;
+            dictionary_container     dictionaries;
+            row_dictionary_container row_dictionaries;
+            forward_index_container  forward_index;
+            stored_value_container   stored_values;
+            catalog_container        catalog;
+        };
+
+        shard_t&
+        shard(mtn_index_partition_t           partition,
+              const std::vector<mtn::byte_t>& bucket);
+
+        // the slice of the value, made empty if there is none. The shard
+        // must be locked.
+        mtn::index_slice_t&
+        find_slice(shard_t&                        s,
+                   mtn_index_partition_t           partition,
+                   const std::vector<mtn::byte_t>& bucket,
+                   const std::vector<mtn::byte_t>& field,
+                   mtn_index_address_t             value);
+
+        boost::ptr_vector<shard_t> _shards;
+        std::string                _path;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_INDEX_READER_WRITER_MEMORY_HPP_INCLUDED__
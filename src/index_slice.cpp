@@ -17,6 +17,8 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <memory>
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
@@ -51,7 +53,7 @@ set_bit(
         input[bucket_index] |= 1ULL << bit_offset;
     }
     else {
-        input[bucket_index] &= 0ULL << bit_offset;
+        input[bucket_index] &= ~(1ULL << bit_offset);
     }
 }
 
@@ -77,6 +79,17 @@ segment_intersection(
     }
 }
 
+inline void
+segment_symmetric_difference(
+    mtn::index_segment_ptr a,
+    mtn::index_segment_ptr b,
+    mtn::index_segment_ptr o)
+{
+    for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+        o[i] = a[i] ^ b[i];
+    }
+}
+
 inline void
 segment_invert(
     mtn::index_segment_ptr a,
@@ -87,6 +100,41 @@ segment_invert(
     }
 }
 
+inline uint64_t
+segment_count(
+    const uint64_t* a)
+{
+    uint64_t output = 0;
+    for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+        output += __builtin_popcountll(a[i]);
+    }
+    return output;
+}
+
+inline bool
+segment_empty(
+    const uint64_t* a)
+{
+    for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+        if (a[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline uint64_t
+segment_intersection_count(
+    const uint64_t* a,
+    const uint64_t* b)
+{
+    uint64_t output = 0;
+    for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+        output += __builtin_popcountll(a[i] & b[i]);
+    }
+    return output;
+}
+
 inline mtn::index_slice_t::iterator
 find_insertion_point(
     mtn::index_slice_t::iterator begin,
@@ -124,18 +172,20 @@ get_intersection_output_node(
         else if (output_iter->offset == offset) {
             return output_iter;
         }
-        else if (output_iter->offset < offset) {
+        else {
             output_iter = output.erase(output_iter);
         }
-        ++output_iter;
     }
 }
 
+typedef void (*segment_operation_t)(mtn::index_segment_ptr, mtn::index_segment_ptr, mtn::index_segment_ptr);
+
 inline mtn::status_t
-union_behavior(
+merge_behavior(
     mtn::index_slice_t& a_index,
     mtn::index_slice_t& b_index,
-    mtn::index_slice_t& output)
+    mtn::index_slice_t& output,
+    segment_operation_t operation)
 {
 
     mtn::index_slice_t::iterator a_iter = a_index.begin();
@@ -174,13 +224,13 @@ union_behavior(
         }
         else if (a_iter->offset == b_iter->offset) {
             output_iter = get_union_output_node(output, output_iter, b_iter->offset);
-            segment_union(a_iter->segment, b_iter->segment, output_iter->segment);
+            operation(a_iter->segment, b_iter->segment, output_iter->segment);
             ++a_iter;
             ++b_iter;
         }
         else {
             std::stringstream message;
-            message << "shit's gone crazy in index union: "
+            message << "shit's gone crazy in index merge: "
                     << a_iter->offset
                     << ":" << b_iter->offset
                     << ":" << output_iter->offset;
@@ -191,6 +241,24 @@ union_behavior(
     return mtn::status_t();
 }
 
+inline mtn::status_t
+union_behavior(
+    mtn::index_slice_t& a_index,
+    mtn::index_slice_t& b_index,
+    mtn::index_slice_t& output)
+{
+    return merge_behavior(a_index, b_index, output, segment_union);
+}
+
+inline mtn::status_t
+symmetric_difference_behavior(
+    mtn::index_slice_t& a_index,
+    mtn::index_slice_t& b_index,
+    mtn::index_slice_t& output)
+{
+    return merge_behavior(a_index, b_index, output, segment_symmetric_difference);
+}
+
 inline mtn::status_t
 intersection_behavior(
     mtn::index_slice_t& a_index,
@@ -286,8 +354,9 @@ mtn::index_slice_t::index_slice_t(
 {}
 
 mtn::index_slice_t::index_slice_t(
-    const mtn::index_slice_t::index_slice_t& other)  :
+    const mtn::index_slice_t& other)  :
     _partition(other.partition()),
+    _bucket(other.bucket()),
     _field(other.field()),
     _value(other.value())
 {
@@ -296,6 +365,74 @@ mtn::index_slice_t::index_slice_t(
     }
 }
 
+uint64_t
+mtn::index_slice_t::count() const
+{
+    uint64_t output = 0;
+    for (mtn::index_slice_t::const_iterator iter = cbegin(); iter != cend(); ++iter) {
+        output += segment_count(iter->segment);
+    }
+    return output;
+}
+
+void
+mtn::index_slice_t::rows(
+    std::vector<mtn_index_address_t>& output) const
+{
+    for (mtn::index_slice_t::const_iterator iter = cbegin(); iter != cend(); ++iter) {
+        for (size_t i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+            for (uint64_t word = iter->segment[i]; word; word &= word - 1) {
+                output.push_back((iter->offset << 11) | (i << 6) | __builtin_ctzll(word));
+            }
+        }
+    }
+}
+
+size_t
+mtn::index_slice_t::rows(
+    mtn_index_address_t  start,
+    mtn_index_address_t* output,
+    size_t               output_size) const
+{
+    size_t written = 0;
+    for (mtn::index_slice_t::const_iterator iter = lower_bound(start >> 11); iter != cend() && written < output_size; ++iter) {
+        for (size_t i = 0; i < MTN_INDEX_SEGMENT_LENGTH && written < output_size; ++i) {
+            for (uint64_t word = iter->segment[i]; word && written < output_size; word &= word - 1) {
+                mtn_index_address_t row = (iter->offset << 11) | (i << 6) | __builtin_ctzll(word);
+                if (row >= start) {
+                    output[written++] = row;
+                }
+            }
+        }
+    }
+    return written;
+}
+
+uint64_t
+mtn::index_slice_t::intersection_count(
+    const mtn::index_slice_t& a_index,
+    const mtn::index_slice_t& b_index)
+{
+    uint64_t output = 0;
+    mtn::index_slice_t::const_iterator a_iter = a_index.cbegin();
+    mtn::index_slice_t::const_iterator b_iter = b_index.cbegin();
+
+    while (a_iter != a_index.cend() && b_iter != b_index.cend()) {
+        if (a_iter->offset < b_iter->offset) {
+            ++a_iter;
+        }
+        else if (b_iter->offset < a_iter->offset) {
+            ++b_iter;
+        }
+        else {
+            output += segment_intersection_count(a_iter->segment, b_iter->segment);
+            ++a_iter;
+            ++b_iter;
+        }
+    }
+    return output;
+}
+
 void
 mtn::index_slice_t::invert()
 {
@@ -317,6 +454,9 @@ mtn::index_slice_t::execute(
     else if (operation == MTN_INDEX_OP_UNION) {
         return union_behavior(a_index, b_index, output);
     }
+    else if (operation == MTN_INDEX_OP_SYMMETRIC_DIFFERENCE) {
+        return symmetric_difference_behavior(a_index, b_index, output);
+    }
     return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "unkown/unsupported index operation");
 }
 
@@ -331,21 +471,49 @@ mtn::index_slice_t::bit(
     mtn_index_partition_t bit_offset    = 0;
     get_address(bit, &segment, &segment_index, &bit_offset);
 
-    mtn::index_slice_t::iterator it = find_insertion_point(begin(), end(), segment);
+    mtn::index_slice_t::iterator it = lower_bound(segment);
 
     mtn::status_t status;
     if (it == end() || it->offset != segment) {
-        it = mtn::index_slice_t::iterator(_index_slice.insert(it.base(), new index_node_t(segment)));
-        status = rw.read_segment(_partition, _bucket, _field, _value, segment, it->segment);
+        std::auto_ptr<index_node_t> node(new index_node_t(segment));
+        status = rw.read_segment(_partition, _bucket, _field, _value, segment, node->segment);
+        if (!status) {
+            return status;
+        }
+        it = insert(it, node.release());
     }
 
     if (status) {
         set_bit(it->segment, segment_index, bit_offset, state);
-        status = rw.write_segment(_partition, _bucket, _field, _value, segment, it->segment);
+        status = rw.write_bit(_partition, _bucket, _field, _value, segment, (segment_index << 6) | bit_offset, state, it->segment);
     }
     return status;
 }
 
+mtn::status_t
+mtn::index_slice_t::compact(
+    mtn::index_reader_writer_t& rw,
+    uint64_t&                   reclaimed)
+{
+    mtn::index_slice_t::iterator it = begin();
+    while (it != end()) {
+        if (!segment_empty(it->segment)) {
+            ++it;
+            continue;
+        }
+
+        // the node stays until the backend has let go of the segment, so
+        // a failed delete is retried by the next compaction
+        mtn::status_t status = rw.delete_segment(_partition, _bucket, _field, _value, it->offset);
+        if (!status) {
+            return status;
+        }
+        it = erase(it);
+        reclaimed += MTN_INDEX_SEGMENT_SIZE;
+    }
+    return mtn::status_t();
+}
+
 bool
 mtn::index_slice_t::bit(
     mtn_index_address_t bit)
@@ -355,9 +523,8 @@ mtn::index_slice_t::bit(
     mtn_index_partition_t bit_offset    = 0;
     get_address(bit, &segment, &segment_index, &bit_offset);
 
-    mtn::index_slice_t::iterator it = find_insertion_point(begin(), end(), segment);
-
-    if (it == end() || it->offset != segment) {
+    mtn::index_slice_t::iterator it = find(segment);
+    if (it == end()) {
         return false;
     }
     return (it->segment[segment_index] & 1ULL << bit_offset);
@@ -367,10 +534,16 @@ mtn::index_slice_t&
 mtn::index_slice_t::operator=(
     const index_slice_t& other)
 {
+    if (this == &other) {
+        return *this;
+    }
+
+    _bucket = other.bucket();
     _field = other.field();
     _partition = other.partition();
     _value = other.value();
 
+    _index_slice.clear();
     for (mtn::index_slice_t::const_iterator iter = other.cbegin(); iter != other.cend(); ++iter) {
         _index_slice.insert(_index_slice.end(), new mtn::index_slice_t::index_node_t(*iter));
     }
@@ -22,7 +22,7 @@
 
 #include <string>
 #include <vector>
-#include <boost/ptr_container/ptr_list.hpp>
+#include <boost/ptr_container/ptr_set.hpp>
 
 #include "base_types.hpp"
 #include "status.hpp"
@@ -50,8 +50,18 @@ namespace mtn {
             zero();
         };
 
+        struct index_node_comparator_t
+        {
+            inline bool
+            operator()(const index_node_t& a,
+                       const index_node_t& b) const
+            {
+                return mtn::index_address_comparator_t()(a.offset, b.offset);
+            }
+        };
+
         typedef mtn::index_slice_t::index_node_t type;
-        typedef boost::ptr_list<mtn::index_slice_t::index_node_t> slice_container;
+        typedef boost::ptr_set<mtn::index_slice_t::index_node_t, index_node_comparator_t> slice_container;
         typedef slice_container::iterator iterator;
         typedef slice_container::const_iterator const_iterator;
 
@@ -74,6 +84,26 @@ namespace mtn {
         void
         invert();
 
+        // number of bits set
+        uint64_t
+        count() const;
+
+        // the position of every bit set, in order
+        void
+        rows(std::vector<mtn_index_address_t>& output) const;
+
+        // the positions of up to output_size bits set at or after start,
+        // in order, returns how many were written
+        size_t
+        rows(mtn_index_address_t  start,
+             mtn_index_address_t* output,
+             size_t               output_size) const;
+
+        // number of bits set in both slices, without building the intersection
+        static uint64_t
+        intersection_count(const index_slice_t& a_index,
+                           const index_slice_t& b_index);
+
         static mtn::status_t
         execute(index_operation_enum operation,
                 index_slice_t&       a_index,
@@ -88,6 +118,12 @@ namespace mtn {
         bool
         bit(mtn_index_address_t bit);
 
+        // drop the segments with no bits set from the slice and the
+        // store, adding the bytes they held to reclaimed
+        mtn::status_t
+        compact(mtn::index_reader_writer_t& rw,
+                uint64_t&                   reclaimed);
+
         mtn::index_slice_t&
         operator=(const index_slice_t& other);
 
@@ -139,6 +175,8 @@ namespace mtn {
             return _index_slice.cend();
         }
 
+        // segments are kept ordered by offset, pos is only a hint. A
+        // segment already in the slice is kept and value is freed.
         inline iterator
         insert(iterator      pos,
                index_node_t* value)
@@ -146,6 +184,26 @@ namespace mtn {
             return _index_slice.insert(pos, value);
         }
 
+        // the segment at offset, end() if the slice doesn't hold it
+        inline iterator
+        find(mtn_index_address_t offset)
+        {
+            return _index_slice.find(index_node_t(offset));
+        }
+
+        // the first segment at or after offset
+        inline iterator
+        lower_bound(mtn_index_address_t offset)
+        {
+            return _index_slice.lower_bound(index_node_t(offset));
+        }
+
+        inline const_iterator
+        lower_bound(mtn_index_address_t offset) const
+        {
+            return _index_slice.lower_bound(index_node_t(offset));
+        }
+
         inline void
         clear()
         {
@@ -171,6 +229,14 @@ namespace mtn {
             return _index_slice.size();
         }
 
+        // move every segment of other onto the end of this slice,
+        // other must only contain offsets greater than ours
+        inline void
+        transfer(index_slice_t& other)
+        {
+            _index_slice.transfer(other._index_slice);
+        }
+
     private:
         slice_container          _index_slice;
         mtn_index_partition_t    _partition;
@@ -140,6 +140,172 @@ lua_mutton_index_value_trigram(
     return 0;
 }
 
+int
+lua_mutton_index_value_prefix(
+    lua_State* L)
+{
+    if (!lua_islightuserdata(L, 1)) {
+        luaL_argerror(L, 1, "expected a mutton context");
+        return 0;
+    }
+    mtn::context_t* context = static_cast<mtn::context_t*>(lua_touserdata(L, 1));
+
+	mtn_index_partition_t partition = luaL_checkint(L, 2);
+
+    luaL_checkany(L, 3);
+    size_t bucket_size = 0;
+    const char* bucket = luaL_checklstring(L, 3, &bucket_size);
+
+    luaL_checkany(L, 4);
+    size_t field_size = 0;
+    const char* field = luaL_checklstring(L, 4, &field_size);
+
+    luaL_checkany(L, 5);
+    size_t value_size = 0;
+    const char* value = lua_tolstring(L, 5, &value_size);
+    if (!value) {
+        luaL_argerror(L, 6, "nil value");
+        return 0;
+    }
+
+    luaL_checkany(L, 6);
+    size_t who_or_what_size = 0;
+    const char* who_or_what = lua_tolstring(L, 6, &who_or_what_size);
+    if (who_or_what_size > sizeof(mtn_index_address_t)) {
+        std::string error_msg = (boost::format("max of 16 bytes expected, got %1%") % who_or_what_size).str();
+        luaL_argerror(L, 6, error_msg.c_str());
+        return 0;
+    }
+
+    luaL_checkany(L, 7);
+    bool state = lua_toboolean(L, 7);
+
+    mtn::status_t status
+        = context->index_value_prefix(partition,
+                                      bucket,
+                                      bucket + bucket_size,
+                                      field,
+                                      field + field_size,
+                                      value,
+                                      value + value_size,
+                                      *reinterpret_cast<const mtn_index_address_t*>(who_or_what),
+                                      state);
+
+    if (!status) {
+        luaL_error(L, status.message.c_str());
+    }
+    return 0;
+}
+
+int
+lua_mutton_index_value_string(
+    lua_State* L)
+{
+    if (!lua_islightuserdata(L, 1)) {
+        luaL_argerror(L, 1, "expected a mutton context");
+        return 0;
+    }
+    mtn::context_t* context = static_cast<mtn::context_t*>(lua_touserdata(L, 1));
+
+	mtn_index_partition_t partition = luaL_checkint(L, 2);
+
+    luaL_checkany(L, 3);
+    size_t bucket_size = 0;
+    const char* bucket = luaL_checklstring(L, 3, &bucket_size);
+
+    luaL_checkany(L, 4);
+    size_t field_size = 0;
+    const char* field = luaL_checklstring(L, 4, &field_size);
+
+    luaL_checkany(L, 5);
+    size_t value_size = 0;
+    const char* value = lua_tolstring(L, 5, &value_size);
+    if (!value) {
+        luaL_argerror(L, 6, "nil value");
+        return 0;
+    }
+
+    luaL_checkany(L, 6);
+    size_t who_or_what_size = 0;
+    const char* who_or_what = lua_tolstring(L, 6, &who_or_what_size);
+    if (who_or_what_size > sizeof(mtn_index_address_t)) {
+        std::string error_msg = (boost::format("max of 16 bytes expected, got %1%") % who_or_what_size).str();
+        luaL_argerror(L, 6, error_msg.c_str());
+        return 0;
+    }
+
+    luaL_checkany(L, 7);
+    bool state = lua_toboolean(L, 7);
+
+    mtn::status_t status
+        = context->index_value_string(partition,
+                                      bucket,
+                                      bucket + bucket_size,
+                                      field,
+                                      field + field_size,
+                                      value,
+                                      value + value_size,
+                                      *reinterpret_cast<const mtn_index_address_t*>(who_or_what),
+                                      state);
+
+    if (!status) {
+        luaL_error(L, status.message.c_str());
+    }
+    return 0;
+}
+
+// returns an array of {field, value} tables, the value as the 16 bytes of
+// its address like the values passed to mutton_index_value
+int
+lua_mutton_row_values(
+    lua_State* L)
+{
+    if (!lua_islightuserdata(L, 1)) {
+        luaL_argerror(L, 1, "expected a mutton context");
+        return 0;
+    }
+    mtn::context_t* context = static_cast<mtn::context_t*>(lua_touserdata(L, 1));
+
+	mtn_index_partition_t partition = luaL_checkint(L, 2);
+
+    luaL_checkany(L, 3);
+    size_t bucket_size = 0;
+    const char* bucket = luaL_checklstring(L, 3, &bucket_size);
+
+    luaL_checkany(L, 4);
+    size_t who_or_what_size = 0;
+    const char* who_or_what = lua_tolstring(L, 4, &who_or_what_size);
+    if (who_or_what_size > sizeof(mtn_index_address_t)) {
+        std::string error_msg = (boost::format("max of 16 bytes expected, got %1%") % who_or_what_size).str();
+        luaL_argerror(L, 4, error_msg.c_str());
+        return 0;
+    }
+
+    mtn::forward_index_t::entries_t entries;
+    mtn::status_t status
+        = context->row_values(partition,
+                              std::vector<mtn::byte_t>(bucket, bucket + bucket_size),
+                              *reinterpret_cast<const mtn_index_address_t*>(who_or_what),
+                              entries);
+
+    if (!status) {
+        luaL_error(L, status.message.c_str());
+        return 0;
+    }
+
+    lua_newtable(L);
+    int i = 1;
+    for (mtn::forward_index_t::entries_t::const_iterator iter = entries.begin(); iter != entries.end(); ++iter, ++i) {
+        lua_newtable(L);
+        lua_pushlstring(L, reinterpret_cast<const char*>(iter->field.empty() ? NULL : &iter->field[0]), iter->field.size());
+        lua_setfield(L, -2, "field");
+        lua_pushlstring(L, reinterpret_cast<const char*>(&iter->value), sizeof(mtn_index_address_t));
+        lua_setfield(L, -2, "value");
+        lua_rawseti(L, -2, i);
+    }
+    return 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // Lua helper functions
@@ -152,6 +318,9 @@ register_functions(
 {
     lua_register(L, "mutton_index_value", lua_mutton_index_value);
     lua_register(L, "mutton_index_value_trigram", lua_mutton_index_value_trigram);
+    lua_register(L, "mutton_index_value_prefix", lua_mutton_index_value_prefix);
+    lua_register(L, "mutton_index_value_string", lua_mutton_index_value_string);
+    lua_register(L, "mutton_row_values", lua_mutton_row_values);
 
     return 0; // figure out how to check for errors
 }
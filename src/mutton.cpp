@@ -18,13 +18,16 @@
 */
 
 #include "context.hpp"
+#include "encode.hpp"
 #include "lua.hpp"
 #include "index_reader_writer_leveldb.hpp"
+#include "prepared_query.hpp"
 #include "libmutton/mutton.h"
 
 #define CHECK_NULL(__param__, __outstatus__) if (!__param__) { *__outstatus__ = new mtn::status_t(MTN_ERROR_BAD_PARAM, "null parameter"); return false; }
 #define CHECK_SIZE(__size__, __outstatus__) if (__size__ > MTN_MAX_STRING_SIZE) { *__outstatus__ = new mtn::status_t(MTN_ERROR_BAD_PARAM, "string size greater than the allowed maximum"); return false; }
 #define CHECK_STRING(__param__, __size__, __outstatus__) CHECK_NULL(__param__, __outstatus__); CHECK_SIZE(__size__, __outstatus__);
+#define CHECK_PARTITION(__partition__, __outstatus__) if (__partition__ == MTN_DICTIONARY_PARTITION) { *__outstatus__ = new mtn::status_t(MTN_ERROR_BAD_PARAM, "partition is reserved"); return false; }
 
 
 inline static bool
@@ -122,6 +125,7 @@ mutton_index_value(
     void**                status)
 {
     CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
     CHECK_STRING(bucket, bucket_size, status);
     CHECK_STRING(field, field_size, status);
 
@@ -152,6 +156,7 @@ mutton_index_value_trigram(
     void**                status)
 {
     CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
     CHECK_STRING(bucket, bucket_size, status);
     CHECK_STRING(field, field_size, status);
     CHECK_STRING(value, value_size, status);
@@ -169,6 +174,72 @@ mutton_index_value_trigram(
                                            state));
 }
 
+bool
+mutton_index_value_prefix(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 value,
+    size_t                value_size,
+    mtn_index_address_t   who_or_what,
+    bool                  state,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_STRING(field, field_size, status);
+    CHECK_STRING(value, value_size, status);
+
+    return set_error(status,
+                     static_cast<mtn::context_t*>(context)
+                     ->index_value_prefix(partition,
+                                          static_cast<unsigned char*>(bucket),
+                                          static_cast<unsigned char*>(bucket) + bucket_size,
+                                          static_cast<unsigned char*>(field),
+                                          static_cast<unsigned char*>(field) + field_size,
+                                          static_cast<unsigned char*>(value),
+                                          static_cast<unsigned char*>(value) + value_size,
+                                          who_or_what,
+                                          state));
+}
+
+bool
+mutton_index_value_string(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 value,
+    size_t                value_size,
+    mtn_index_address_t   who_or_what,
+    bool                  state,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_STRING(field, field_size, status);
+    CHECK_STRING(value, value_size, status);
+
+    return set_error(status,
+                     static_cast<mtn::context_t*>(context)
+                     ->index_value_string(partition,
+                                          static_cast<unsigned char*>(bucket),
+                                          static_cast<unsigned char*>(bucket) + bucket_size,
+                                          static_cast<unsigned char*>(field),
+                                          static_cast<unsigned char*>(field) + field_size,
+                                          static_cast<unsigned char*>(value),
+                                          static_cast<unsigned char*>(value) + value_size,
+                                          who_or_what,
+                                          state));
+}
+
 bool
 mutton_query(
     void*                 context,
@@ -180,6 +251,7 @@ mutton_query(
     void**                status)
 {
     CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
     CHECK_STRING(bucket, bucket_size, status);
     CHECK_STRING(query, query_size, status);
 
@@ -195,6 +267,363 @@ mutton_query(
     return false;
 }
 
+bool
+mutton_prepare_query(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 query,
+    size_t                query_size,
+    void**                prepared,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_NULL(prepared, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_STRING(query, query_size, status);
+
+    mtn::prepared_query_t* output = NULL;
+    bool result = set_error(status,
+                            mtn::prepared_query_t::prepare(
+                                partition,
+                                *static_cast<mtn::context_t*>(context),
+                                std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(bucket), static_cast<mtn::byte_t*>(bucket) + bucket_size),
+                                std::string(static_cast<char*>(query), query_size),
+                                &output));
+    if (result) {
+        *prepared = output;
+    }
+    return result;
+}
+
+bool
+mutton_execute_prepared(
+    void*                context,
+    void*                prepared,
+    mtn_index_address_t* params,
+    size_t               params_size,
+    void**               result,
+    void**               status)
+{
+    CHECK_NULL(context, status);
+    CHECK_NULL(prepared, status);
+    CHECK_NULL(result, status);
+    if (params_size % 2 != 0) {
+        *status = new mtn::status_t(MTN_ERROR_BAD_PARAM, "params must be supplied as (start, limit) pairs");
+        return false;
+    }
+
+    std::vector<mtn::range_t> ranges;
+    ranges.reserve(params_size / 2);
+    for (size_t i = 0; i + 1 < params_size; i += 2) {
+        ranges.push_back(mtn::range_t(params[i], params[i + 1]));
+    }
+
+    std::auto_ptr<mtn::index_slice_t> output(new mtn::index_slice_t());
+    bool success = set_error(status,
+                             static_cast<mtn::prepared_query_t*>(prepared)
+                             ->execute(ranges.empty() ? NULL : &ranges[0],
+                                       ranges.size(),
+                                       *output));
+    if (success) {
+        *result = output.release();
+    }
+    return success;
+}
+
+uint64_t
+mutton_query_result_count(
+    void* result)
+{
+    return result ? static_cast<mtn::index_slice_t*>(result)->count() : 0;
+}
+
+size_t
+mutton_query_result_rows(
+    void*                result,
+    mtn_index_address_t  start,
+    mtn_index_address_t* rows,
+    size_t               rows_size)
+{
+    if (!result || !rows) {
+        return 0;
+    }
+    return static_cast<mtn::index_slice_t*>(result)->rows(start, rows, rows_size);
+}
+
+bool
+mutton_row_ids(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    mtn_index_address_t*  rows,
+    size_t                rows_size,
+    mtn_index_address_t*  output,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_NULL(rows, status);
+    CHECK_NULL(output, status);
+
+    boost::shared_lock<boost::shared_mutex> drop_lock(static_cast<mtn::context_t*>(context)->drop_mutex());
+    return set_error(status,
+                     static_cast<mtn::context_t*>(context)
+                     ->row_ids(partition,
+                               std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(bucket), static_cast<mtn::byte_t*>(bucket) + bucket_size),
+                               rows,
+                               rows_size,
+                               output));
+}
+
+void
+mutton_free_prepared_query(
+    void* prepared)
+{
+    delete static_cast<mtn::prepared_query_t*>(prepared);
+}
+
+void
+mutton_free_query_result(
+    void* result)
+{
+    delete static_cast<mtn::index_slice_t*>(result);
+}
+
+bool
+mutton_execute_prepared_group(
+    void*                context,
+    void*                prepared,
+    mtn_index_address_t* params,
+    size_t               params_size,
+    void**               result,
+    void**               status)
+{
+    CHECK_NULL(context, status);
+    CHECK_NULL(prepared, status);
+    CHECK_NULL(result, status);
+    if (params_size % 2 != 0) {
+        *status = new mtn::status_t(MTN_ERROR_BAD_PARAM, "params must be supplied as (start, limit) pairs");
+        return false;
+    }
+
+    std::vector<mtn::range_t> ranges;
+    ranges.reserve(params_size / 2);
+    for (size_t i = 0; i + 1 < params_size; i += 2) {
+        ranges.push_back(mtn::range_t(params[i], params[i + 1]));
+    }
+
+    std::auto_ptr<mtn::group_result_t> output(new mtn::group_result_t());
+    bool success = set_error(status,
+                             static_cast<mtn::prepared_query_t*>(prepared)
+                             ->execute_group(ranges.empty() ? NULL : &ranges[0],
+                                             ranges.size(),
+                                             *output));
+    if (success) {
+        *result = output.release();
+    }
+    return success;
+}
+
+bool
+mutton_top_k(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 field,
+    size_t                field_size,
+    void*                 filter,
+    size_t                k,
+    void**                result,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_STRING(field, field_size, status);
+    CHECK_NULL(filter, status);
+    CHECK_NULL(result, status);
+
+    boost::shared_lock<boost::shared_mutex> drop_lock(static_cast<mtn::context_t*>(context)->drop_mutex());
+    mtn::index_t* index = NULL;
+    mtn::status_t index_status = static_cast<mtn::context_t*>(context)
+        ->query_index(partition,
+                      std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(bucket), static_cast<mtn::byte_t*>(bucket) + bucket_size),
+                      std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(field), static_cast<mtn::byte_t*>(field) + field_size),
+                      &index);
+
+    // a field that was never indexed has no values, like a group query
+    if (!index_status && index_status.code == MTN_ERROR_NOT_FOUND) {
+        *result = new mtn::group_result_t();
+        return true;
+    }
+
+    bool success = set_error(status, index_status);
+    if (success) {
+        boost::shared_lock<boost::shared_mutex> index_lock(index->mutex());
+        std::auto_ptr<mtn::group_result_t> output(new mtn::group_result_t());
+        mtn::top_k(*index, *static_cast<mtn::index_slice_t*>(filter), k, *output);
+        *result = output.release();
+    }
+    return success;
+}
+
+size_t
+mutton_group_result_size(
+    void* result)
+{
+    return result ? static_cast<mtn::group_result_t*>(result)->size() : 0;
+}
+
+bool
+mutton_group_result_get(
+    void*                result,
+    size_t               index,
+    mtn_index_address_t* value,
+    uint64_t*            count)
+{
+    if (!result || index >= static_cast<mtn::group_result_t*>(result)->size()) {
+        return false;
+    }
+
+    const mtn::group_count_t& pair = (*static_cast<mtn::group_result_t*>(result))[index];
+    if (value) {
+        *value = pair.first;
+    }
+    if (count) {
+        *count = pair.second;
+    }
+    return true;
+}
+
+void
+mutton_free_group_result(
+    void* result)
+{
+    delete static_cast<mtn::group_result_t*>(result);
+}
+
+bool
+mutton_row_values(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    mtn_index_address_t   who_or_what,
+    void**                result,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_NULL(result, status);
+
+    mtn::forward_index_t::entries_t entries;
+    bool success = set_error(status,
+                             static_cast<mtn::context_t*>(context)
+                             ->row_values(partition,
+                                          std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(bucket), static_cast<mtn::byte_t*>(bucket) + bucket_size),
+                                          who_or_what,
+                                          entries));
+    if (success) {
+        *result = new mtn::forward_result_t(entries.begin(), entries.end());
+    }
+    return success;
+}
+
+size_t
+mutton_row_values_size(
+    void* result)
+{
+    return result ? static_cast<mtn::forward_result_t*>(result)->size() : 0;
+}
+
+bool
+mutton_row_values_get(
+    void*                result,
+    size_t               index,
+    void**               field,
+    size_t*              field_size,
+    mtn_index_address_t* value)
+{
+    if (!result || index >= static_cast<mtn::forward_result_t*>(result)->size()) {
+        return false;
+    }
+
+    mtn::forward_entry_t& entry = (*static_cast<mtn::forward_result_t*>(result))[index];
+    if (field) {
+        *field = entry.field.empty() ? NULL : &entry.field[0];
+    }
+    if (field_size) {
+        *field_size = entry.field.size();
+    }
+    if (value) {
+        *value = entry.value;
+    }
+    return true;
+}
+
+void
+mutton_free_row_values(
+    void* result)
+{
+    delete static_cast<mtn::forward_result_t*>(result);
+}
+
+bool
+mutton_compact(
+    void*     context,
+    uint64_t* reclaimed,
+    void**    status)
+{
+    CHECK_NULL(context, status);
+    return set_error(status, static_cast<mtn::context_t*>(context)->compact(reclaimed));
+}
+
+bool
+mutton_drop_partition(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    return set_error(status, static_cast<mtn::context_t*>(context)->drop_partition(partition));
+}
+
+bool
+mutton_drop_fields(
+    void*                 context,
+    mtn_index_partition_t partition,
+    void*                 bucket,
+    size_t                bucket_size,
+    void*                 prefix,
+    size_t                prefix_size,
+    void**                status)
+{
+    CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
+    CHECK_STRING(bucket, bucket_size, status);
+    CHECK_STRING(prefix, prefix_size, status);
+
+    // an empty prefix would match every field of the bucket
+    if (prefix_size == 0) {
+        *status = new mtn::status_t(MTN_ERROR_BAD_PARAM, "empty field prefix, use mutton_drop_partition to drop everything");
+        return false;
+    }
+
+    return set_error(status,
+                     static_cast<mtn::context_t*>(context)
+                     ->drop_fields(partition,
+                                   std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(bucket), static_cast<mtn::byte_t*>(bucket) + bucket_size),
+                                   std::vector<mtn::byte_t>(static_cast<mtn::byte_t*>(prefix), static_cast<mtn::byte_t*>(prefix) + prefix_size)));
+}
+
 bool
 mutton_register_script(
     void*  context,
@@ -252,6 +681,7 @@ mutton_process_event(
     void**                status)
 {
     CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
     CHECK_STRING(event_name, event_name_size, status);
     CHECK_STRING(buffer, buffer_size, status);
 
@@ -278,6 +708,7 @@ mutton_process_event_bucketed(
     void**                status)
 {
     CHECK_NULL(context, status);
+    CHECK_PARTITION(partition, status);
     CHECK_STRING(bucket, bucket_size, status);
     CHECK_STRING(event_name, event_name_size, status);
     CHECK_STRING(buffer, buffer_size, status);
@@ -21,9 +21,12 @@
 #define __MUTTON_NAIVE_QUERY_PLANNER_HPP_INCLUDED__
 
 #include "context.hpp"
+#include "group_by.hpp"
 #include "index.hpp"
 #include "index_slice.hpp"
 #include "query_ops.hpp"
+#include "regex_filter.hpp"
+#include "regex_query.hpp"
 
 namespace mtn {
 
@@ -51,14 +54,18 @@ namespace mtn {
             boost::static_visitor<void>
         {
             range_visitor_t(
-                const std::string&         field,
-                bool                       invert,
-                std::vector<mtn::range_t>& ranges,
-                std::vector<regex_node_t>& regexes) :
+                const std::string&          field,
+                bool                        invert,
+                std::vector<mtn::range_t>&  ranges,
+                std::vector<regex_node_t>&  regexes,
+                std::vector<mtn::prefix_t>& prefixes,
+                std::vector<std::string>&   values) :
                 field(field),
                 invert(invert),
                 ranges(ranges),
-                regexes(regexes)
+                regexes(regexes),
+                prefixes(prefixes),
+                values(values)
             {}
 
             void
@@ -104,16 +111,40 @@ namespace mtn {
             }
 
             void
-            operator()(mtn::regex_t r)
+            operator()(const mtn::param_t&)
+            {
+                throw "unbound query parameter";
+            }
+
+            void
+            operator()(const mtn::regex_t& r)
             {
-                mtn::regex_t::to_ranges(r, ranges);
                 regexes.push_back(regex_node_t(field, invert, r));
             }
 
-            const std::string&         field;
-            bool                       invert;
-            std::vector<mtn::range_t>& ranges;
-            std::vector<regex_node_t>& regexes;
+            void
+            operator()(const mtn::prefix_t& p)
+            {
+                if (p.exact()) {
+                    ranges.push_back(p.to_range());
+                }
+                else {
+                    prefixes.push_back(p);
+                }
+            }
+
+            void
+            operator()(const mtn::value_t& v)
+            {
+                values.push_back(v.value);
+            }
+
+            const std::string&          field;
+            bool                        invert;
+            std::vector<mtn::range_t>&  ranges;
+            std::vector<regex_node_t>&  regexes;
+            std::vector<mtn::prefix_t>& prefixes;
+            std::vector<std::string>&   values;
         };
 
         naive_query_planner_t(
@@ -164,6 +195,10 @@ namespace mtn {
                     break;
                 }
                 mtn::index_slice_t temp_slice = boost::apply_visitor(*this, *iter);
+                if (iter == o.children.begin()) {
+                    result = temp_slice;
+                    continue;
+                }
                 _status = mtn::index_slice_t::execute(MTN_INDEX_OP_INTERSECTION, temp_slice, result, result);
             }
             return result;
@@ -197,11 +232,25 @@ namespace mtn {
             return temp_slice;
         }
 
+        // returns the filter result, the per value counts are left in groups()
         mtn::index_slice_t
         operator()(
-            const mtn::op_group&)
+            const mtn::op_group& o)
         {
-            throw "XXX TODO fix me";
+            mtn::index_slice_t result = boost::apply_visitor(*this, o.child);
+            if (!_status) {
+                return result;
+            }
+
+            mtn::index_t* index = NULL;
+            _status = _context.query_index(_partition, _bucket, std::vector<mtn::byte_t>(o.index.begin(), o.index.end()), &index);
+            if (_status && o.limit > 0) {
+                mtn::top_k(*index, result, o.limit, _groups);
+            }
+            else if (_status) {
+                mtn::group_by(*index, result, o.reverse, _groups);
+            }
+            return result;
         }
 
         mtn::index_slice_t
@@ -218,6 +267,27 @@ namespace mtn {
             throw "shouldn't happen";
         }
 
+        mtn::index_slice_t
+        operator()(
+            const mtn::param_t&)
+        {
+            throw "shouldn't happen";
+        }
+
+        mtn::index_slice_t
+        operator()(
+            const mtn::prefix_t&)
+        {
+            throw "shouldn't happen";
+        }
+
+        mtn::index_slice_t
+        operator()(
+            const mtn::value_t&)
+        {
+            throw "shouldn't happen";
+        }
+
         mtn::index_slice_t
         operator()(
             const mtn::op_slice& o)
@@ -228,7 +298,7 @@ namespace mtn {
             }
 
             mtn::index_t* index = NULL;
-            _status = _context.get_index(_partition, _bucket, o.to_vector(), &index);
+            _status = _context.query_index(_partition, _bucket, o.to_vector(), &index);
             if (!_status) {
                 return result;
             }
@@ -238,17 +308,50 @@ namespace mtn {
             }
             else {
                 std::vector<mtn::range_t> ranges;
-                range_visitor_t visitor(o.index, _invert, ranges, _regexes);
+                std::vector<mtn::prefix_t> prefixes;
+                std::vector<std::string> values;
+                range_visitor_t visitor(o.index, _invert, ranges, _regexes, prefixes, values);
+                size_t regex_begin = _regexes.size();
 
                 mtn::op_slice::const_iterator iter = o.values.begin();
                 for (; iter != o.values.end(); ++iter) {
                     boost::apply_visitor(visitor, *iter);
                 }
 
-                index->slice(&ranges[0],
-                             ranges.size(),
-                             MTN_INDEX_OP_UNION,
-                             result);
+                if (!values.empty()) {
+                    _status = value_ranges(*index, values, ranges);
+                    if (!_status) {
+                        return result;
+                    }
+                }
+
+                if (!ranges.empty()) {
+                    index->slice(&ranges[0],
+                                 ranges.size(),
+                                 MTN_INDEX_OP_UNION,
+                                 result);
+                }
+
+                // every regex is narrowed down by its own tree of trigram
+                // slices, the candidates are then checked against the values
+                for (size_t i = regex_begin; i < _regexes.size() && _status; ++i) {
+                    mtn::index_slice_t candidates = regex_slice(*index, o.index, _regexes[i].regex);
+                    if (_status) {
+                        _status = mtn::index_slice_t::execute(MTN_INDEX_OP_UNION, candidates, result, result);
+                    }
+                }
+
+                // prefixes longer than the key share a slice with every value
+                // starting with the same leading bytes
+                for (size_t i = 0; i < prefixes.size() && _status; ++i) {
+                    mtn::range_t range = prefixes[i].to_range();
+                    mtn::index_slice_t candidates;
+                    index->slice(&range, 1, MTN_INDEX_OP_UNION, candidates);
+                    _status = mtn::verify_regex(_context.index_reader_writer(), index, std::vector<mtn::regex_t>(1, prefixes[i].to_regex()), _context.query_pool(), candidates);
+                    if (_status) {
+                        _status = mtn::index_slice_t::execute(MTN_INDEX_OP_UNION, candidates, result, result);
+                    }
+                }
             }
             return result;
         }
@@ -259,13 +362,58 @@ namespace mtn {
             return _status;
         }
 
+        inline const mtn::group_result_t&
+        groups()
+        {
+            return _groups;
+        }
+
     private:
+        mtn::index_slice_t
+        regex_slice(
+            mtn::index_t&       index,
+            const std::string&  field,
+            const mtn::regex_t& regex)
+        {
+            mtn::expr query;
+            _status = mtn::regex_query(field, regex, _context.trigram_fold(), query);
+            if (!_status) {
+                return mtn::index_slice_t();
+            }
+
+            mtn::index_slice_t result = boost::apply_visitor(*this, query);
+            if (_status) {
+                _status = mtn::verify_regex(_context.index_reader_writer(), &index, std::vector<mtn::regex_t>(1, regex), _context.query_pool(), result);
+            }
+            return result;
+        }
+
+        // the slice of every dictionary value is the one keyed by its id,
+        // values which were never indexed have no slice to read
+        mtn::status_t
+        value_ranges(
+            const mtn::index_t&             index,
+            const std::vector<std::string>& values,
+            std::vector<mtn::range_t>&      output)
+        {
+            mtn::value_dictionary_t* dictionary = NULL;
+            mtn::status_t status = _context.value_dictionary(&index, &dictionary);
+            for (size_t i = 0; i < values.size() && status; ++i) {
+                mtn::value_dictionary_t::id_t id = 0;
+                if (dictionary->find(values[i], id)) {
+                    output.push_back(mtn::range_t(id, ((mtn_index_address_t) id) + 1));
+                }
+            }
+            return status;
+        }
+
         bool                      _invert;
         mtn::status_t             _status;
         mtn_index_partition_t     _partition;
         mtn::context_t&           _context;
         std::vector<mtn::byte_t>  _bucket;
         std::vector<regex_node_t> _regexes;
+        mtn::group_result_t       _groups;
     };
 
 } // namespace mtn
@@ -0,0 +1,98 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_PREFIX_HPP_INCLUDED__
+#define __MUTTON_PREFIX_HPP_INCLUDED__
+
+#include <algorithm>
+#include <string>
+#include <re2/re2.h>
+
+#include "base_types.hpp"
+#include "range.hpp"
+#include "regex.hpp"
+
+// leading bytes of a value which make up its prefix index key
+#define MTN_PREFIX_KEY_BYTES 16
+
+namespace mtn {
+
+    // A value is prefix indexed under its first MTN_PREFIX_KEY_BYTES
+    // bytes, big endian and zero padded, so the order of the keys is the
+    // lexicographic order of the values. Every value starting with a
+    // prefix falls in one contiguous range of keys. Longer prefixes only
+    // narrow down the candidates by their leading bytes and have to be
+    // verified against the stored values.
+    struct prefix_t
+    {
+        std::string value;
+
+        prefix_t() :
+            value("")
+        {}
+
+        prefix_t(
+            const std::string& value) :
+            value(value)
+        {}
+
+        template<class InputIterator>
+        static inline mtn_index_address_t
+        to_key(InputIterator first,
+               InputIterator last)
+        {
+            mtn_index_address_t output = 0;
+            size_t length = 0;
+            for (; first != last && length < MTN_PREFIX_KEY_BYTES; ++first, ++length) {
+                output = (output << 8) | (mtn::byte_t) *first;
+            }
+            return length == 0 ? output : output << (8 * (MTN_PREFIX_KEY_BYTES - length));
+        }
+
+        inline mtn::range_t
+        to_range() const
+        {
+            if (value.empty()) {
+                return mtn::range_t(INDEX_ADDRESS_MIN, INDEX_ADDRESS_MAX);
+            }
+
+            // the limit of a prefix of all 0xFF bytes is past the last key
+            size_t length = std::min<size_t>(value.size(), MTN_PREFIX_KEY_BYTES);
+            mtn_index_address_t start = to_key(value.begin(), value.end());
+            mtn_index_address_t limit = start + (((mtn_index_address_t) 1) << (8 * (MTN_PREFIX_KEY_BYTES - length)));
+            return mtn::range_t(start, limit == 0 ? (INDEX_ADDRESS_MAX) : limit);
+        }
+
+        // whether the key range holds exactly the values with this prefix
+        inline bool
+        exact() const
+        {
+            return value.size() <= MTN_PREFIX_KEY_BYTES;
+        }
+
+        inline mtn::regex_t
+        to_regex() const
+        {
+            return mtn::regex_t("^" + RE2::QuoteMeta(value));
+        }
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_PREFIX_HPP_INCLUDED__
@@ -0,0 +1,1031 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "context.hpp"
+#include "index.hpp"
+#include "query_parser.hpp"
+#include "query_printer.hpp"
+#include "regex_filter.hpp"
+#include "regex_query.hpp"
+#include "segment_cursor.hpp"
+
+#include "prepared_query.hpp"
+
+#define MTN_QUERY_RANGES_PER_THREAD 4
+
+typedef mtn::prepared_query_t::plan_node_t plan_node_t;
+
+// a shared lock on every index a query reads, held while it's
+// evaluated so no write lands in the middle. They're taken in address
+// order so two queries and the writers waiting on them can't deadlock
+struct read_lock_t :
+    boost::noncopyable
+{
+    read_lock_t(
+        const std::set<mtn::index_t*>& indexes) :
+        indexes(indexes)
+    {
+        for (std::set<mtn::index_t*>::iterator iter = this->indexes.begin(); iter != this->indexes.end(); ++iter) {
+            (*iter)->mutex().lock_shared();
+        }
+    }
+
+    ~read_lock_t()
+    {
+        for (std::set<mtn::index_t*>::iterator iter = indexes.begin(); iter != indexes.end(); ++iter) {
+            (*iter)->mutex().unlock_shared();
+        }
+    }
+
+    std::set<mtn::index_t*> indexes;
+};
+
+// held exclusively while an execution resolves the plan, then shared
+// with other executions of the same query while the plan is evaluated
+struct plan_lock_t :
+    boost::noncopyable
+{
+    plan_lock_t(
+        boost::shared_mutex& mutex) :
+        mutex(mutex),
+        shared(false)
+    {
+        mutex.lock();
+    }
+
+    void
+    share()
+    {
+        mutex.unlock_and_lock_shared();
+        shared = true;
+    }
+
+    ~plan_lock_t()
+    {
+        if (shared) {
+            mutex.unlock_shared();
+        }
+        else {
+            mutex.unlock();
+        }
+    }
+
+    boost::shared_mutex& mutex;
+    bool                 shared;
+};
+
+struct mtn::prepared_query_t::range_task_t
+{
+    range_task_t(
+        mtn::prepared_query_t& query,
+        const mtn::range_t*    params,
+        mtn_index_address_t    start,
+        mtn_index_address_t    limit,
+        const memo_container&  memo,
+        mtn::index_slice_t&    output) :
+        query(&query),
+        params(params),
+        memo(&memo),
+        start(start),
+        limit(limit),
+        output(&output)
+    {}
+
+    void
+    operator()()
+    {
+        query->materialize(params, *memo, start, limit, *output);
+    }
+
+    mtn::prepared_query_t* query;
+    const mtn::range_t*    params;
+    const memo_container*  memo;
+    mtn_index_address_t    start;
+    mtn_index_address_t    limit;
+    mtn::index_slice_t*    output;
+};
+
+struct plan_value_visitor_t :
+    boost::static_visitor<void>
+{
+    plan_value_visitor_t(
+        plan_node_t&                node,
+        std::vector<mtn::prefix_t>& prefixes,
+        size_t&                     param_count,
+        mtn::status_t&              status) :
+        node(node),
+        prefixes(prefixes),
+        param_count(param_count),
+        status(status)
+    {}
+
+    void
+    operator()(const mtn::range_t& r)
+    {
+        node.ranges.push_back(r);
+    }
+
+    void
+    operator()(const mtn::regex_t& r)
+    {
+        node.regexes.push_back(r);
+    }
+
+    void
+    operator()(const mtn::param_t& p)
+    {
+        node.params.push_back(p.slot);
+        param_count = std::max(param_count, p.slot + 1);
+    }
+
+    void
+    operator()(const mtn::prefix_t& p)
+    {
+        if (p.exact()) {
+            node.ranges.push_back(p.to_range());
+        }
+        else {
+            prefixes.push_back(p);
+        }
+    }
+
+    void
+    operator()(const mtn::value_t& v)
+    {
+        node.values.push_back(v.value);
+    }
+
+    template<class T>
+    void
+    operator()(const T&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "slice values must be a range, regex, prefix, value or param");
+    }
+
+    plan_node_t&                node;
+    std::vector<mtn::prefix_t>& prefixes;
+    size_t&                     param_count;
+    mtn::status_t&              status;
+};
+
+struct plan_compiler_t :
+    boost::static_visitor<plan_node_t*>
+{
+    plan_compiler_t(
+        mtn::trigram_fold_enum fold,
+        size_t&                param_count,
+        mtn::status_t&         status) :
+        fold(fold),
+        param_count(param_count),
+        status(status)
+    {}
+
+    plan_node_t*
+    operator()(const mtn::op_and& o)
+    {
+        return canonical(compile(mtn::prepared_query_t::MTN_PLAN_AND, o.children.begin(), o.children.end()), o);
+    }
+
+    plan_node_t*
+    operator()(const mtn::op_or& o)
+    {
+        return canonical(compile(mtn::prepared_query_t::MTN_PLAN_OR, o.children.begin(), o.children.end()), o);
+    }
+
+    plan_node_t*
+    operator()(const mtn::op_xor& o)
+    {
+        return canonical(compile(mtn::prepared_query_t::MTN_PLAN_XOR, o.children.begin(), o.children.end()), o);
+    }
+
+    plan_node_t*
+    operator()(const mtn::op_not& o)
+    {
+        std::auto_ptr<plan_node_t> node(new plan_node_t(mtn::prepared_query_t::MTN_PLAN_NOT));
+        plan_node_t* child = boost::apply_visitor(*this, o.child);
+        if (!child) {
+            return NULL;
+        }
+        node->children.push_back(child);
+        return canonical(node.release(), o);
+    }
+
+    plan_node_t*
+    operator()(const mtn::op_slice& o)
+    {
+        std::auto_ptr<plan_node_t> node(new plan_node_t(mtn::prepared_query_t::MTN_PLAN_SLICE));
+        node->field = o.to_vector();
+        node->all = o.values.empty();
+
+        std::vector<mtn::prefix_t> prefixes;
+        plan_value_visitor_t visitor(*node, prefixes, param_count, status);
+        mtn::op_slice::const_iterator iter = o.values.begin();
+        for (; iter != o.values.end() && status; ++iter) {
+            boost::apply_visitor(visitor, *iter);
+        }
+
+        if (!status) {
+            return NULL;
+        }
+
+        if (node->regexes.empty() && prefixes.empty()) {
+            return canonical(node.release(), o);
+        }
+
+        // ranges, params and short prefixes are read as one slice, every
+        // regex and long prefix is verified on its own and they are all
+        // unioned
+        std::vector<mtn::regex_t> regexes;
+        regexes.swap(node->regexes);
+
+        std::auto_ptr<plan_node_t> any(new plan_node_t(mtn::prepared_query_t::MTN_PLAN_OR));
+        if (!node->ranges.empty() || !node->params.empty() || !node->values.empty()) {
+            mtn::op_slice ranges;
+            ranges.index = o.index;
+            for (iter = o.values.begin(); iter != o.values.end(); ++iter) {
+                const mtn::prefix_t* prefix = boost::get<mtn::prefix_t>(&*iter);
+                if (!boost::get<mtn::regex_t>(&*iter) && (!prefix || prefix->exact())) {
+                    ranges.values.push_back(*iter);
+                }
+            }
+            any->children.push_back(canonical(node.release(), ranges));
+        }
+
+        for (std::vector<mtn::regex_t>::iterator regex = regexes.begin(); regex != regexes.end(); ++regex) {
+            plan_node_t* child = compile_regex(o.index, *regex);
+            if (!child) {
+                return NULL;
+            }
+            any->children.push_back(child);
+        }
+
+        for (std::vector<mtn::prefix_t>::iterator prefix = prefixes.begin(); prefix != prefixes.end(); ++prefix) {
+            plan_node_t* child = compile_prefix(o.index, *prefix);
+            if (!child) {
+                return NULL;
+            }
+            any->children.push_back(child);
+        }
+
+        if (any->children.size() == 1) {
+            return any->children.release(any->children.begin()).release();
+        }
+        return canonical(any.release(), o);
+    }
+
+    plan_node_t*
+    operator()(const mtn::op_group&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "group queries can not be prepared");
+        return NULL;
+    }
+
+    plan_node_t*
+    operator()(const mtn::range_t&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "range must be contained within a slice");
+        return NULL;
+    }
+
+    plan_node_t*
+    operator()(const mtn::regex_t&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "regex must be contained within a slice");
+        return NULL;
+    }
+
+    plan_node_t*
+    operator()(const mtn::param_t&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "param must be contained within a slice");
+        return NULL;
+    }
+
+    plan_node_t*
+    operator()(const mtn::prefix_t&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "prefix must be contained within a slice");
+        return NULL;
+    }
+
+    plan_node_t*
+    operator()(const mtn::value_t&)
+    {
+        status = mtn::status_t(MTN_ERROR_BAD_QUERY, "value must be contained within a slice");
+        return NULL;
+    }
+
+    template<class T>
+    plan_node_t*
+    canonical(plan_node_t* node,
+              const T&     o)
+    {
+        if (node) {
+            node->canonical = mtn::query_printer_t()(o);
+        }
+        return node;
+    }
+
+    // the trigram tree of the regex, its result is checked against the
+    // stored values before being read by the rest of the plan
+    plan_node_t*
+    compile_regex(const std::string&  field,
+                  const mtn::regex_t& regex)
+    {
+        mtn::expr query;
+        status = mtn::regex_query(field, regex, fold, query);
+        if (!status) {
+            return NULL;
+        }
+
+        std::auto_ptr<plan_node_t> node(boost::apply_visitor(*this, query));
+        if (!node.get()) {
+            return NULL;
+        }
+
+        mtn::op_slice slice;
+        slice.index = field;
+        slice.values.push_back(regex);
+
+        node->verify = true;
+        node->field = slice.to_vector();
+        node->regexes.push_back(regex);
+        status = mtn::compile_regexes(node->regexes, node->compiled);
+        if (!status) {
+            return NULL;
+        }
+        return canonical(node.release(), slice);
+    }
+
+    // the slice of every value sharing the leading bytes of the prefix,
+    // checked against the stored values
+    plan_node_t*
+    compile_prefix(const std::string&   field,
+                   const mtn::prefix_t& prefix)
+    {
+        mtn::op_slice slice;
+        slice.index = field;
+        slice.values.push_back(prefix);
+
+        std::auto_ptr<plan_node_t> node(new plan_node_t(mtn::prepared_query_t::MTN_PLAN_SLICE));
+        node->verify = true;
+        node->field = slice.to_vector();
+        node->ranges.push_back(prefix.to_range());
+        node->regexes.push_back(prefix.to_regex());
+        status = mtn::compile_regexes(node->regexes, node->compiled);
+        if (!status) {
+            return NULL;
+        }
+        return canonical(node.release(), slice);
+    }
+
+    template<class Iterator>
+    plan_node_t*
+    compile(mtn::prepared_query_t::plan_node_type_enum type,
+            Iterator                                   it,
+            Iterator                                   end)
+    {
+        std::auto_ptr<plan_node_t> node(new plan_node_t(type));
+        for (; it != end; ++it) {
+            plan_node_t* child = boost::apply_visitor(*this, *it);
+            if (!child) {
+                return NULL;
+            }
+            node->children.push_back(child);
+        }
+        return node.release();
+    }
+
+    mtn::trigram_fold_enum fold;
+    size_t&                param_count;
+    mtn::status_t&         status;
+};
+
+mtn::prepared_query_t::prepared_query_t(
+    mtn_index_partition_t           partition,
+    mtn::context_t&                 context,
+    const std::vector<mtn::byte_t>& bucket) :
+    _partition(partition),
+    _context(context),
+    _bucket(bucket),
+    _param_count(0),
+    _drop_generation(0),
+    _grouped(false),
+    _group_reverse(false),
+    _group_limit(0)
+{}
+
+mtn::status_t
+mtn::prepared_query_t::prepare(
+    mtn_index_partition_t           partition,
+    mtn::context_t&                 context,
+    const std::vector<mtn::byte_t>& bucket,
+    const std::string&              query,
+    mtn::prepared_query_t**         output)
+{
+    std::string::const_iterator f(query.begin());
+    std::string::const_iterator l(query.end());
+    mtn::query_parser_t<std::string::const_iterator> parser;
+
+    mtn::expr parsed;
+    try {
+        if (!qi::phrase_parse(f, l, parser, qi::space, parsed) || f != l) {
+            return mtn::status_t(MTN_ERROR_BAD_QUERY, "could not parse query");
+        }
+    }
+    catch (const qi::expectation_failure<std::string::const_iterator>&) {
+        return mtn::status_t(MTN_ERROR_BAD_QUERY, "could not parse query");
+    }
+
+    std::auto_ptr<mtn::prepared_query_t> prepared(new mtn::prepared_query_t(partition, context, bucket));
+    mtn::status_t status = prepared->prepare(parsed);
+    if (status) {
+        *output = prepared.release();
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::prepared_query_t::prepare(
+    const mtn::expr& query)
+{
+    // a group may only wrap the whole query, the plan is its filter
+    const mtn::op_group* group = boost::get<mtn::op_group>(&query);
+
+    mtn::status_t status;
+    size_t param_count = 0;
+    plan_compiler_t compiler(_context.trigram_fold(), param_count, status);
+    std::auto_ptr<plan_node_t> root(boost::apply_visitor(compiler, group ? group->child : query));
+
+    if (status) {
+        // indexes which don't exist yet resolve without an error and are
+        // looked up again on execution, anything else fails the prepare
+        boost::shared_lock<boost::shared_mutex> drop_lock(_context.drop_mutex());
+        _drop_generation = _context.drop_generation();
+        status = resolve(*root);
+    }
+
+    if (status) {
+        mark_shared(*root);
+        collect_slots(*root);
+        _root = root;
+        _param_count = param_count;
+        _canonical = boost::apply_visitor(mtn::query_printer_t(), query);
+        _grouped = group != NULL;
+        if (group) {
+            _group_field.assign(group->index.begin(), group->index.end());
+            _group_reverse = group->reverse;
+            _group_limit = group->limit;
+        }
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::prepared_query_t::resolve(
+    plan_node_t& node)
+{
+    mtn::status_t status;
+    // a field nobody has indexed yet reads as an empty slice, it's
+    // looked up again on every execution until the index exists
+    if ((node.type == MTN_PLAN_SLICE || node.verify) && !node.index) {
+        status = _context.query_index(_partition, _bucket, node.field, &node.index);
+        if (!status && status.code == MTN_ERROR_NOT_FOUND) {
+            node.index = NULL;
+            status = mtn::status_t();
+        }
+    }
+
+    if (!node.values.empty() && node.index && !node.dictionary) {
+        status = _context.value_dictionary(node.index, &node.dictionary);
+    }
+
+    plan_node_t::iterator iter = node.children.begin();
+    for (; iter != node.children.end(); ++iter) {
+        mtn::status_t child_status = resolve(*iter);
+        if (!child_status) {
+            status = child_status;
+        }
+    }
+    return status;
+}
+
+void
+mtn::prepared_query_t::unresolve(
+    plan_node_t& node)
+{
+    node.index = NULL;
+    node.dictionary = NULL;
+
+    plan_node_t::iterator iter = node.children.begin();
+    for (; iter != node.children.end(); ++iter) {
+        unresolve(*iter);
+    }
+}
+
+mtn::status_t
+mtn::prepared_query_t::validate(
+    size_t param_count)
+{
+    if (!_root.get()) {
+        return mtn::status_t(MTN_ERROR_BAD_QUERY, "query has not been prepared");
+    }
+
+    if (param_count < _param_count) {
+        std::stringstream message;
+        message << "query requires " << _param_count << " params, " << param_count << " supplied";
+        return mtn::status_t(MTN_ERROR_BAD_PARAM, message.str());
+    }
+
+    // a drop since the plan was resolved may have freed its indexes
+    if (_drop_generation != _context.drop_generation()) {
+        _drop_generation = _context.drop_generation();
+        unresolve(*_root);
+    }
+
+    // every index must be resolved before cursors are built, the
+    // plan is only read from once ranges are being evaluated
+    return resolve(*_root);
+}
+
+mtn::status_t
+mtn::prepared_query_t::execute(
+    const mtn::range_t* params,
+    size_t              param_count,
+    mtn::index_slice_t& output)
+{
+    boost::shared_lock<boost::shared_mutex> drop_lock(_context.drop_mutex());
+    plan_lock_t plan_lock(_plan_mutex);
+    mtn::status_t status = validate(param_count);
+    if (!status) {
+        return status;
+    }
+
+    std::set<mtn::index_t*> indexes;
+    collect_indexes(*_root, indexes);
+    plan_lock.share();
+    read_lock_t lock(indexes);
+    return evaluate_cached(params, output);
+}
+
+mtn::status_t
+mtn::prepared_query_t::evaluate_cached(
+    const mtn::range_t* params,
+    mtn::index_slice_t& output)
+{
+    mtn::query_cache_t* cache = _context.query_cache();
+    mtn::query_cache_t::versions_t versions;
+    collect_versions(*_root, versions);
+
+    mtn::status_t status;
+    std::string key;
+    if (cache) {
+        key = cache_key(*_root, params);
+        if (cache->lookup(key, versions, output)) {
+            return status;
+        }
+    }
+
+    mtn::index_slice_t result;
+    status = evaluate(params, result);
+    if (!status) {
+        return status;
+    }
+
+    if (cache) {
+        cache->insert(key, versions, result);
+    }
+    output.transfer(result);
+    return status;
+}
+
+mtn::status_t
+mtn::prepared_query_t::execute_group(
+    const mtn::range_t*  params,
+    size_t               param_count,
+    mtn::group_result_t& output)
+{
+    if (!_grouped) {
+        return mtn::status_t(MTN_ERROR_BAD_QUERY, "query is not a group query");
+    }
+
+    boost::shared_lock<boost::shared_mutex> drop_lock(_context.drop_mutex());
+    plan_lock_t plan_lock(_plan_mutex);
+    mtn::status_t status = validate(param_count);
+    if (!status) {
+        return status;
+    }
+
+    mtn::index_t* index = NULL;
+    status = _context.query_index(_partition, _bucket, _group_field, &index);
+    if (!status && status.code == MTN_ERROR_NOT_FOUND) {
+        return mtn::status_t();
+    }
+    else if (!status) {
+        return status;
+    }
+
+    // the counts are read at the same point in time as the filter
+    std::set<mtn::index_t*> indexes;
+    collect_indexes(*_root, indexes);
+    indexes.insert(index);
+    plan_lock.share();
+    read_lock_t lock(indexes);
+
+    mtn::index_slice_t filter;
+    status = evaluate_cached(params, filter);
+    if (status && _group_limit > 0) {
+        mtn::top_k(*index, filter, _group_limit, output);
+    }
+    else if (status) {
+        mtn::group_by(*index, filter, _group_reverse, output);
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::prepared_query_t::evaluate(
+    const mtn::range_t* params,
+    mtn::index_slice_t& output)
+{
+    // shared sub-trees are computed up front over the whole offset
+    // space, ranges only ever read from the memo
+    memo_container memo;
+    mtn::status_t status = memoize(*_root, params, true, memo);
+    if (!status) {
+        return status;
+    }
+
+    mtn::thread_pool_t* pool = _context.query_pool();
+    std::vector<mtn_index_address_t> starts;
+    if (pool) {
+        split(params, pool->size() * MTN_QUERY_RANGES_PER_THREAD, starts);
+    }
+
+    if (starts.size() < 2) {
+        materialize(params, memo, INDEX_ADDRESS_MIN, INDEX_ADDRESS_MAX, output);
+        return status;
+    }
+
+    boost::ptr_vector<mtn::index_slice_t> results;
+    std::vector<mtn::thread_pool_t::task_t> tasks;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        results.push_back(new mtn::index_slice_t());
+        mtn_index_address_t limit = i + 1 < starts.size() ? starts[i + 1] : INDEX_ADDRESS_MAX;
+        tasks.push_back(range_task_t(*this, params, starts[i], limit, memo, results.back()));
+    }
+    status = pool->execute(tasks);
+    if (!status) {
+        return status;
+    }
+
+    for (boost::ptr_vector<mtn::index_slice_t>::iterator iter = results.begin(); iter != results.end(); ++iter) {
+        output.transfer(*iter);
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::prepared_query_t::memoize(
+    plan_node_t&        node,
+    const mtn::range_t* params,
+    bool                root,
+    memo_container&     memo)
+{
+    mtn::status_t status;
+    if (memo.find(node.canonical) != memo.end()) {
+        return status;
+    }
+
+    plan_node_t::iterator iter = node.children.begin();
+    for (; iter != node.children.end() && status; ++iter) {
+        status = memoize(*iter, params, false, memo);
+    }
+
+    // the root is materialized by the caller and cached as a whole,
+    // regex slices are always memoized so they can be verified
+    mtn::query_cache_t* cache = _context.subexpression_cache();
+    bool cached = cache && node.type != MTN_PLAN_SLICE && !root;
+    if (!status || !(node.verify || cached || (node.shared && !root))) {
+        return status;
+    }
+
+    std::auto_ptr<mtn::index_slice_t> result(new mtn::index_slice_t());
+    std::string key;
+    mtn::query_cache_t::versions_t versions;
+    if (cached) {
+        key = cache_key(node, params);
+        collect_versions(node, versions);
+        if (cache->lookup(key, versions, *result)) {
+            std::string memo_key(node.canonical);
+            memo.insert(memo_key, result.release());
+            return status;
+        }
+    }
+
+    std::auto_ptr<mtn::segment_cursor_t> cursor(this->cursor(node, params, memo));
+    mtn::materialize(*cursor, *result);
+
+    if (node.verify) {
+        status = mtn::verify_regex(_context.index_reader_writer(), node.index, node.compiled, _context.query_pool(), *result);
+        if (!status) {
+            return status;
+        }
+    }
+
+    if (cached) {
+        cache->insert(key, versions, *result);
+    }
+
+    std::string memo_key(node.canonical);
+    memo.insert(memo_key, result.release());
+    return status;
+}
+
+void
+mtn::prepared_query_t::mark_shared(
+    plan_node_t& root)
+{
+    std::map<std::string, size_t> counts;
+    std::vector<plan_node_t*> stack(1, &root);
+    while (!stack.empty()) {
+        plan_node_t* node = stack.back();
+        stack.pop_back();
+        ++counts[node->canonical];
+
+        for (plan_node_t::iterator iter = node->children.begin(); iter != node->children.end(); ++iter) {
+            stack.push_back(&*iter);
+        }
+    }
+
+    // only the highest node of a repeated sub-tree is memoized, its
+    // descendants are read once while building it. Bare slices are
+    // cheap to read directly and are never marked.
+    stack.assign(1, &root);
+    while (!stack.empty()) {
+        plan_node_t* node = stack.back();
+        stack.pop_back();
+        node->shared = node->type != MTN_PLAN_SLICE && counts[node->canonical] > 1;
+        if (node->shared) {
+            continue;
+        }
+
+        for (plan_node_t::iterator iter = node->children.begin(); iter != node->children.end(); ++iter) {
+            stack.push_back(&*iter);
+        }
+    }
+}
+
+std::string
+mtn::prepared_query_t::cache_key(
+    const plan_node_t&  node,
+    const mtn::range_t* params) const
+{
+    std::stringstream key;
+    key << _partition << " " << std::string(_bucket.begin(), _bucket.end()) << " " << node.canonical;
+    for (std::vector<size_t>::const_iterator iter = node.slots.begin(); iter != node.slots.end(); ++iter) {
+        key << " " << *iter << "=" << mtn::query_printer_t()(params[*iter]);
+    }
+    return key.str();
+}
+
+void
+mtn::prepared_query_t::collect_slots(
+    plan_node_t& node)
+{
+    std::set<size_t> slots(node.params.begin(), node.params.end());
+    for (plan_node_t::iterator iter = node.children.begin(); iter != node.children.end(); ++iter) {
+        collect_slots(*iter);
+        slots.insert(iter->slots.begin(), iter->slots.end());
+    }
+    node.slots.assign(slots.begin(), slots.end());
+}
+
+void
+mtn::prepared_query_t::collect_versions(
+    const plan_node_t&              node,
+    mtn::query_cache_t::versions_t& output) const
+{
+    if (node.type == MTN_PLAN_SLICE) {
+        output.push_back(mtn::query_cache_t::version_t(node.index, _context.index_version(node.index)));
+        return;
+    }
+
+    plan_node_t::const_iterator iter = node.children.begin();
+    for (; iter != node.children.end(); ++iter) {
+        collect_versions(*iter, output);
+    }
+}
+
+void
+mtn::prepared_query_t::collect_indexes(
+    const plan_node_t&       node,
+    std::set<mtn::index_t*>& output) const
+{
+    if (node.index) {
+        output.insert(node.index);
+    }
+
+    plan_node_t::const_iterator iter = node.children.begin();
+    for (; iter != node.children.end(); ++iter) {
+        collect_indexes(*iter, output);
+    }
+}
+
+mtn::status_t
+mtn::prepared_query_t::execute(
+    const mtn::range_t* params,
+    size_t              param_count,
+    mtn_index_address_t start,
+    mtn_index_address_t limit,
+    mtn::index_slice_t& output)
+{
+    boost::shared_lock<boost::shared_mutex> drop_lock(_context.drop_mutex());
+    plan_lock_t plan_lock(_plan_mutex);
+    mtn::status_t status = validate(param_count);
+    if (!status) {
+        return status;
+    }
+
+    std::set<mtn::index_t*> indexes;
+    collect_indexes(*_root, indexes);
+    plan_lock.share();
+    read_lock_t lock(indexes);
+
+    memo_container memo;
+    status = memoize(*_root, params, true, memo);
+    if (status) {
+        materialize(params, memo, start, limit, output);
+    }
+    return status;
+}
+
+void
+mtn::prepared_query_t::materialize(
+    const mtn::range_t*   params,
+    const memo_container& memo,
+    mtn_index_address_t   start,
+    mtn_index_address_t   limit,
+    mtn::index_slice_t&   output)
+{
+    std::auto_ptr<mtn::segment_cursor_t> root(cursor(*_root, params, memo));
+    mtn::materialize(*root, start, limit, output);
+}
+
+void
+mtn::prepared_query_t::split(
+    const mtn::range_t*               params,
+    size_t                            count,
+    std::vector<mtn_index_address_t>& output)
+{
+    std::set<mtn::index_slice_t*> slices;
+    collect_slices(*_root, params, slices);
+
+    // the largest slice is a decent sample of where the segments are,
+    // cut at its quantiles so every range has a similar amount of work
+    mtn::index_slice_t* largest = NULL;
+    for (std::set<mtn::index_slice_t*>::iterator iter = slices.begin(); iter != slices.end(); ++iter) {
+        if (!largest || (*iter)->size() > largest->size()) {
+            largest = *iter;
+        }
+    }
+
+    if (!largest || largest->size() < 2 || count < 2) {
+        return;
+    }
+
+    size_t step = std::max<size_t>(largest->size() / count, 1);
+    output.push_back(INDEX_ADDRESS_MIN);
+
+    size_t position = 0;
+    mtn::index_slice_t::const_iterator iter = largest->cbegin();
+    for (; iter != largest->cend(); ++iter, ++position) {
+        if (position > 0 && position % step == 0) {
+            output.push_back(iter->offset);
+        }
+    }
+}
+
+void
+mtn::prepared_query_t::collect_slices(
+    plan_node_t&                   node,
+    const mtn::range_t*            params,
+    std::set<mtn::index_slice_t*>& output)
+{
+    if (node.type != MTN_PLAN_SLICE) {
+        plan_node_t::iterator iter = node.children.begin();
+        for (; iter != node.children.end(); ++iter) {
+            collect_slices(*iter, params, output);
+        }
+        return;
+    }
+
+    if (!node.index) {
+        return;
+    }
+
+    if (node.all) {
+        for (mtn::index_t::iterator iter = node.index->begin(); iter != node.index->end(); ++iter) {
+            output.insert(iter->second);
+        }
+        return;
+    }
+
+    std::vector<mtn::range_t> ranges(node.ranges);
+    for (std::vector<size_t>::const_iterator iter = node.params.begin(); iter != node.params.end(); ++iter) {
+        ranges.push_back(params[*iter]);
+    }
+
+    for (std::vector<std::string>::const_iterator iter = node.values.begin(); iter != node.values.end(); ++iter) {
+        mtn::value_dictionary_t::id_t id = 0;
+        if (node.dictionary->find(*iter, id)) {
+            ranges.push_back(mtn::range_t(id, ((mtn_index_address_t) id) + 1));
+        }
+    }
+
+    for (std::vector<mtn::range_t>::const_iterator range = ranges.begin(); range != ranges.end(); ++range) {
+        mtn::index_t::iterator iter = node.index->lower_bound(range->start);
+        for (; iter != node.index->end() && iter->first < range->limit; ++iter) {
+            output.insert(iter->second);
+        }
+    }
+}
+
+mtn::segment_cursor_t*
+mtn::prepared_query_t::cursor(
+    plan_node_t&          node,
+    const mtn::range_t*   params,
+    const memo_container& memo)
+{
+    memo_container::const_iterator memoized = memo.find(node.canonical);
+    if (memoized != memo.end()) {
+        return new mtn::slice_cursor_t(*memoized->second);
+    }
+
+    std::auto_ptr<mtn::composite_cursor_t> output;
+
+    switch (node.type) {
+    case MTN_PLAN_SLICE:
+        return slice_cursor(node, params);
+
+    case MTN_PLAN_NOT:
+        return new mtn::not_cursor_t(cursor(node.children.front(), params, memo));
+
+    case MTN_PLAN_AND:
+        output.reset(new mtn::and_cursor_t());
+        break;
+
+    case MTN_PLAN_OR:
+        output.reset(new mtn::merge_cursor_t(MTN_INDEX_OP_UNION));
+        break;
+
+    case MTN_PLAN_XOR:
+        output.reset(new mtn::merge_cursor_t(MTN_INDEX_OP_SYMMETRIC_DIFFERENCE));
+        break;
+    }
+
+    plan_node_t::iterator iter = node.children.begin();
+    for (; iter != node.children.end(); ++iter) {
+        output->add(cursor(*iter, params, memo));
+    }
+    return output.release();
+}
+
+mtn::segment_cursor_t*
+mtn::prepared_query_t::slice_cursor(
+    plan_node_t&        node,
+    const mtn::range_t* params)
+{
+    // trigram ranges frequently overlap, only scan each slice once
+    std::set<mtn::index_slice_t*> slices;
+    collect_slices(node, params, slices);
+
+    if (slices.size() == 1) {
+        return new mtn::slice_cursor_t(**slices.begin());
+    }
+
+    std::auto_ptr<mtn::merge_cursor_t> output(new mtn::merge_cursor_t(MTN_INDEX_OP_UNION));
+    for (std::set<mtn::index_slice_t*>::iterator iter = slices.begin(); iter != slices.end(); ++iter) {
+        output->add(new mtn::slice_cursor_t(**iter));
+    }
+    return output.release();
+}
@@ -0,0 +1,331 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_PREPARED_QUERY_HPP_INCLUDED__
+#define __MUTTON_PREPARED_QUERY_HPP_INCLUDED__
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "base_types.hpp"
+#include "group_by.hpp"
+#include "index_slice.hpp"
+#include "query_cache.hpp"
+#include "query_ops.hpp"
+#include "range.hpp"
+#include "regex.hpp"
+#include "regex_filter.hpp"
+#include "status.hpp"
+
+namespace mtn {
+
+    class context_t;
+    class index_t;
+    class segment_cursor_t;
+    class value_dictionary_t;
+
+    // A query which has been parsed and compiled once into a tree of
+    // physical operators. Index handles are resolved and regex trigram
+    // ranges are computed at prepare time so that repeated executions
+    // only pay for the bitmap operations. Ranges written as (param N)
+    // are left as slots which are bound on every call to execute.
+    //
+    // Execution builds a pipeline of segment cursors from the plan, the
+    // result is produced one segment at a time and only the root is
+    // materialized. When the context has a query pool the offset space
+    // is split into several ranges per thread, each range is evaluated
+    // by its own pipeline and the per range results are concatenated.
+    //
+    // Results are served from the context's query cache when one is
+    // configured, keyed by the canonical query text and bound params.
+    //
+    // Sub-trees which occur more than once in a query are evaluated once
+    // and every occurrence reads the memoized slice. When the context
+    // has a subexpression cache every interior node is memoized there as
+    // well, so filters shared by queries run close together in time are
+    // only computed by the first of them.
+    //
+    // The indexes an execution reads are locked shared from the time
+    // they are looked up until the result is produced, writes to them
+    // wait for the query and the query waits for writes in progress.
+    // Writes to indexes the query doesn't read aren't held up. Queries
+    // read the slices in memory where writes change them in place, and
+    // a versioned copy of every slice would double the memory and the
+    // write cost, so a long query over a hot index stalls its writers
+    // instead. A leveldb snapshot only pins what's read from the store,
+    // it's used for the warm prefetch rather than for queries.
+    //
+    // Fields which haven't been indexed yet read as empty slices and are
+    // looked up again on every execution until their index exists.
+    // Executions may run on several threads at once, each one holds the
+    // plan exclusively while its indexes are resolved and then shares it
+    // with the others while it's evaluated.
+    //
+    // String values are looked up in the field's value dictionary on
+    // every execution, so values indexed after the query was prepared
+    // are found as well.
+    //
+    // Slices made up only of regexes are over inclusive, the trigram
+    // candidates are memoized and every row is checked against the
+    // value it was indexed with before being used by the rest of the
+    // plan.
+    class prepared_query_t :
+        boost::noncopyable
+    {
+    public:
+
+        enum plan_node_type_enum {
+            MTN_PLAN_SLICE = 0,
+            MTN_PLAN_AND = 1,
+            MTN_PLAN_OR = 2,
+            MTN_PLAN_XOR = 3,
+            MTN_PLAN_NOT = 4
+        };
+
+        struct plan_node_t :
+            boost::noncopyable
+        {
+            typedef boost::ptr_vector<plan_node_t>   children_container;
+            typedef children_container::iterator       iterator;
+            typedef children_container::const_iterator const_iterator;
+
+            plan_node_t(
+                plan_node_type_enum type) :
+                type(type),
+                all(false),
+                shared(false),
+                verify(false),
+                index(NULL),
+                dictionary(NULL)
+            {}
+
+            plan_node_type_enum       type;
+            bool                      all;
+            bool                      shared;
+            bool                      verify;
+            std::string               canonical;
+            std::vector<mtn::byte_t>  field;
+            mtn::index_t*             index;
+            std::vector<mtn::range_t> ranges;
+            std::vector<size_t>       params;
+            // every param slot read by the sub-tree, sorted, the
+            // sub-tree's cache key holds only their values
+            std::vector<size_t>       slots;
+            std::vector<mtn::regex_t> regexes;
+            compiled_regex_container  compiled;
+            std::vector<std::string>  values;
+            mtn::value_dictionary_t*  dictionary;
+            children_container        children;
+        };
+
+        prepared_query_t(
+            mtn_index_partition_t           partition,
+            mtn::context_t&                 context,
+            const std::vector<mtn::byte_t>& bucket);
+
+        static mtn::status_t
+        prepare(
+            mtn_index_partition_t           partition,
+            mtn::context_t&                 context,
+            const std::vector<mtn::byte_t>& bucket,
+            const std::string&              query,
+            mtn::prepared_query_t**         output);
+
+        mtn::status_t
+        prepare(
+            const mtn::expr& query);
+
+        mtn::status_t
+        execute(
+            const mtn::range_t* params,
+            size_t              param_count,
+            mtn::index_slice_t& output);
+
+        // only produce the segments with offsets in [start, limit)
+        mtn::status_t
+        execute(
+            const mtn::range_t* params,
+            size_t              param_count,
+            mtn_index_address_t start,
+            mtn_index_address_t limit,
+            mtn::index_slice_t& output);
+
+        // for (group ...), (rgroup ...) and (top ...) queries, count the
+        // filter result for every value of the group field
+        mtn::status_t
+        execute_group(
+            const mtn::range_t*  params,
+            size_t               param_count,
+            mtn::group_result_t& output);
+
+        inline size_t
+        param_count() const
+        {
+            return _param_count;
+        }
+
+        inline const plan_node_t*
+        root() const
+        {
+            return _root.get();
+        }
+
+        inline mtn_index_partition_t
+        partition() const
+        {
+            return _partition;
+        }
+
+        inline const std::vector<mtn::byte_t>&
+        bucket() const
+        {
+            return _bucket;
+        }
+
+        inline const std::string&
+        canonical() const
+        {
+            return _canonical;
+        }
+
+        inline bool
+        grouped() const
+        {
+            return _grouped;
+        }
+
+    private:
+        typedef boost::ptr_map<std::string, mtn::index_slice_t> memo_container;
+
+        struct range_task_t;
+
+        mtn::status_t
+        evaluate(
+            const mtn::range_t* params,
+            mtn::index_slice_t& output);
+
+        // evaluate through the query cache, the caller holds the locks
+        // of the plan's indexes
+        mtn::status_t
+        evaluate_cached(
+            const mtn::range_t* params,
+            mtn::index_slice_t& output);
+
+        mtn::status_t
+        memoize(
+            plan_node_t&        node,
+            const mtn::range_t* params,
+            bool                root,
+            memo_container&     memo);
+
+        void
+        mark_shared(
+            plan_node_t& root);
+
+        // the cache key of the sub-tree for the values bound to the
+        // slots it reads
+        std::string
+        cache_key(
+            const plan_node_t&  node,
+            const mtn::range_t* params) const;
+
+        void
+        collect_slots(
+            plan_node_t& node);
+
+        void
+        collect_versions(
+            const plan_node_t&              node,
+            mtn::query_cache_t::versions_t& output) const;
+
+        void
+        collect_indexes(
+            const plan_node_t&       node,
+            std::set<mtn::index_t*>& output) const;
+
+        // resolve the plan for an execution, the caller holds the drop
+        // lock and the plan mutex exclusively
+        mtn::status_t
+        validate(
+            size_t param_count);
+
+        void
+        split(
+            const mtn::range_t*               params,
+            size_t                            count,
+            std::vector<mtn_index_address_t>& output);
+
+        void
+        collect_slices(
+            plan_node_t&                   node,
+            const mtn::range_t*            params,
+            std::set<mtn::index_slice_t*>& output);
+
+        void
+        materialize(
+            const mtn::range_t*   params,
+            const memo_container& memo,
+            mtn_index_address_t   start,
+            mtn_index_address_t   limit,
+            mtn::index_slice_t&   output);
+
+        mtn::segment_cursor_t*
+        cursor(
+            plan_node_t&          node,
+            const mtn::range_t*   params,
+            const memo_container& memo);
+
+        mtn::segment_cursor_t*
+        slice_cursor(
+            plan_node_t&        node,
+            const mtn::range_t* params);
+
+        mtn::status_t
+        resolve(
+            plan_node_t& node);
+
+        // forget the indexes and dictionaries of the plan, to be resolved
+        // again
+        void
+        unresolve(
+            plan_node_t& node);
+
+        mtn_index_partition_t      _partition;
+        mtn::context_t&            _context;
+        std::vector<mtn::byte_t>   _bucket;
+        std::auto_ptr<plan_node_t> _root;
+        size_t                     _param_count;
+        uint64_t                   _drop_generation;
+        boost::shared_mutex        _plan_mutex;
+        std::string                _canonical;
+        bool                       _grouped;
+        std::vector<mtn::byte_t>   _group_field;
+        bool                       _group_reverse;
+        size_t                     _group_limit;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_PREPARED_QUERY_HPP_INCLUDED__
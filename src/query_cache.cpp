@@ -0,0 +1,106 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "query_cache.hpp"
+
+mtn::query_cache_t::query_cache_t(
+    size_t capacity,
+    size_t max_age) :
+    _capacity(capacity),
+    _max_age(max_age)
+{}
+
+bool
+mtn::query_cache_t::lookup(
+    const std::string&  key,
+    const versions_t&   versions,
+    mtn::index_slice_t& output)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    entry_container::iterator iter = _entries.find(key);
+    if (iter == _entries.end()) {
+        return false;
+    }
+
+    if (iter->second->versions != versions
+        || (_max_age > 0 && iter->second->expires < boost::get_system_time())) {
+        erase(iter);
+        return false;
+    }
+
+    _lru.splice(_lru.begin(), _lru, iter->second->lru);
+
+    const mtn::index_slice_t& result = iter->second->result;
+    for (mtn::index_slice_t::const_iterator node = result.cbegin(); node != result.cend(); ++node) {
+        output.insert(output.end(), new mtn::index_slice_t::index_node_t(*node));
+    }
+    return true;
+}
+
+void
+mtn::query_cache_t::insert(
+    const std::string&        key,
+    const versions_t&         versions,
+    const mtn::index_slice_t& result)
+{
+    if (_capacity == 0) {
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+
+    entry_container::iterator iter = _entries.find(key);
+    if (iter != _entries.end()) {
+        erase(iter);
+    }
+
+    while (_entries.size() >= _capacity) {
+        erase(_entries.find(_lru.back()));
+    }
+
+    std::string entry_key(key);
+    boost::system_time expires = boost::get_system_time() + boost::posix_time::milliseconds(_max_age);
+    iter = _entries.insert(entry_key, new entry_t(versions, result, expires)).first;
+    _lru.push_front(key);
+    iter->second->lru = _lru.begin();
+}
+
+void
+mtn::query_cache_t::clear()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _entries.clear();
+    _lru.clear();
+}
+
+size_t
+mtn::query_cache_t::size()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _entries.size();
+}
+
+void
+mtn::query_cache_t::erase(
+    entry_container::iterator iter)
+{
+    _lru.erase(iter->second->lru);
+    _entries.erase(iter);
+}
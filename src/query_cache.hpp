@@ -0,0 +1,117 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_QUERY_CACHE_HPP_INCLUDED__
+#define __MUTTON_QUERY_CACHE_HPP_INCLUDED__
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include "index_slice.hpp"
+
+namespace mtn {
+
+    class index_t;
+
+    // Bounded LRU cache of query results. Every entry records the write
+    // version of each index the query read at the time it was executed,
+    // an entry is only served while all of those versions are unchanged
+    // so a write to any referenced index invalidates it. A non zero
+    // max_age additionally expires entries that many milliseconds after
+    // they were inserted.
+    class query_cache_t :
+        boost::noncopyable
+    {
+    public:
+        typedef std::pair<const mtn::index_t*, uint64_t> version_t;
+        typedef std::vector<version_t>                   versions_t;
+
+        query_cache_t(size_t capacity,
+                      size_t max_age = 0);
+
+        // append the cached result to output, false on a miss
+        bool
+        lookup(const std::string&  key,
+               const versions_t&   versions,
+               mtn::index_slice_t& output);
+
+        void
+        insert(const std::string&        key,
+               const versions_t&         versions,
+               const mtn::index_slice_t& result);
+
+        void
+        clear();
+
+        size_t
+        size();
+
+        inline size_t
+        capacity() const
+        {
+            return _capacity;
+        }
+
+        inline size_t
+        max_age() const
+        {
+            return _max_age;
+        }
+
+    private:
+        typedef std::list<std::string> lru_container;
+
+        struct entry_t :
+            boost::noncopyable
+        {
+            entry_t(const versions_t&         versions,
+                    const mtn::index_slice_t& result,
+                    boost::system_time        expires) :
+                versions(versions),
+                result(result),
+                expires(expires)
+            {}
+
+            versions_t              versions;
+            mtn::index_slice_t      result;
+            boost::system_time      expires;
+            lru_container::iterator lru;
+        };
+
+        typedef boost::ptr_map<std::string, entry_t> entry_container;
+
+        void
+        erase(entry_container::iterator iter);
+
+        entry_container _entries;
+        lru_container   _lru;
+        boost::mutex    _mutex;
+        size_t          _capacity;
+        size_t          _max_age;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_QUERY_CACHE_HPP_INCLUDED__
@@ -23,10 +23,26 @@
 #include <boost/variant.hpp>
 #include <boost/variant/recursive_wrapper.hpp>
 
+#include "prefix.hpp"
 #include "range.hpp"
 #include "regex.hpp"
+#include "value.hpp"
 
 namespace mtn {
+    struct param_t
+    {
+        param_t() :
+            slot(0)
+        {}
+
+        param_t(
+            size_t slot) :
+            slot(slot)
+        {}
+
+        size_t slot;
+    };
+
     struct op_and;
     struct op_not;
     struct op_or;
@@ -41,25 +57,32 @@ namespace mtn {
                            boost::recursive_wrapper<op_not>,
                            boost::recursive_wrapper<op_and>,
                            boost::recursive_wrapper<op_xor>,
-                           boost::recursive_wrapper<op_group>
+                           boost::recursive_wrapper<op_group>,
+                           mtn::param_t,
+                           mtn::prefix_t,
+                           mtn::value_t
                            > expr;
 
     struct op_group
     {
         op_group() :
-            reverse(false)
+            reverse(false),
+            limit(0)
         {}
 
         op_group(
             const std::string& index,
             expr&              child,
-            bool               reverse) :
-            index(index),
+            bool               reverse,
+            size_t             limit = 0) :
+            reverse(reverse),
+            limit(limit),
             child(child),
-            reverse(reverse)
+            index(index)
         {}
 
         bool        reverse;
+        size_t      limit; // only the top N groups, 0 for all of them
         expr        child;
         std::string index;
     };
@@ -48,19 +48,33 @@ namespace mtn {
             qi::uint_parser<unsigned char, 16, 2, 2> hex2;
             qi::uint_parser<uint128_t, 10, 1, 39> uint;
 
-            expr_ = (search_ | group_ | rgroup_);
-            search_ = ('(' >> (slice_ | or_ | and_ | xor_ | not_)  >> ')');
+            expr_ = (search_ | group_ | rgroup_ | top_);
+            search_ = ('(' >> (slice_ | prefix_slice_ | value_slice_ | or_ | and_ | xor_ | not_)  >> ')');
             byte_string_ = qi::lexeme['#' > +hex2 > '#'];
             quoted_string_ %= qi::lexeme ['"' >> *(qi::char_ - qi::char_('\\') - qi::char_('"') | '\\' >> qi::char_) >> '"'];
             uint_ = boost::spirit::lexeme[qi::no_case["0x"] > qi::hex] | uint;
             group_ = ("(group" > quoted_string_ > search_ > ")") [qi::_val = phx::construct<mtn::op_group>(qi::_1, qi::_2, false)];
-            group_ = ("(rgroup" > quoted_string_ > search_ > ")") [qi::_val = phx::construct<mtn::op_group>(qi::_1, qi::_2, true)];
+            rgroup_ = ("(rgroup" > quoted_string_ > search_ > ")") [qi::_val = phx::construct<mtn::op_group>(qi::_1, qi::_2, true)];
+            top_ = ("(top" > qi::uint_ > quoted_string_ > search_ > ")") [qi::_val = phx::construct<mtn::op_group>(qi::_2, qi::_3, false, qi::_1)];
             range_ = ("(range" > uint_ > uint_ > ")") [qi::_val = phx::construct<mtn::range_t>(qi::_1, qi::_2)];
             regex_ = ("(regex" > quoted_string_  > ")") [phx::bind(&mtn::regex_t::pattern, qi::_val) = qi::_1];
+            param_ = ("(param" > qi::uint_ > ")") [qi::_val = phx::construct<mtn::param_t>(qi::_1)];
+            prefix_ = ("(prefix" > quoted_string_ > ")") [qi::_val = phx::construct<mtn::prefix_t>(qi::_1)];
+            value_ = ("(value" > quoted_string_ > ")") [qi::_val = phx::construct<mtn::value_t>(qi::_1)];
 
             slice_ = "slice"
                 > (quoted_string_) [phx::bind(&op_slice::index, qi::_val) = qi::_1]
-                > *(regex_ | range_) [phx::push_back(phx::bind(&op_slice::values, qi::_val), qi::_1)];
+                > *(regex_ | range_ | param_ | prefix_ | value_) [phx::push_back(phx::bind(&op_slice::values, qi::_val), qi::_1)];
+
+            // (prefix "field" "value") is short for (slice "field" (prefix "value"))
+            prefix_slice_ = "prefix"
+                > (quoted_string_) [phx::bind(&op_slice::index, qi::_val) = qi::_1]
+                > (quoted_string_) [phx::push_back(phx::bind(&op_slice::values, qi::_val), phx::construct<mtn::prefix_t>(qi::_1))];
+
+            // (value "field" "value") is short for (slice "field" (value "value"))
+            value_slice_ = "value"
+                > (quoted_string_) [phx::bind(&op_slice::index, qi::_val) = qi::_1]
+                > (quoted_string_) [phx::push_back(phx::bind(&op_slice::values, qi::_val), phx::construct<mtn::value_t>(qi::_1))];
 
             and_ = "and"
                 > +(search_) [phx::push_back(phx::bind(&op_and::children, qi::_val), qi::_1)];
@@ -80,9 +94,15 @@ namespace mtn {
             BOOST_SPIRIT_DEBUG_NODE(rgroup_);
             BOOST_SPIRIT_DEBUG_NODE(not_);
             BOOST_SPIRIT_DEBUG_NODE(or_);
+            BOOST_SPIRIT_DEBUG_NODE(param_);
+            BOOST_SPIRIT_DEBUG_NODE(prefix_);
+            BOOST_SPIRIT_DEBUG_NODE(prefix_slice_);
             BOOST_SPIRIT_DEBUG_NODE(range_);
             BOOST_SPIRIT_DEBUG_NODE(regex_);
             BOOST_SPIRIT_DEBUG_NODE(search_);
+            BOOST_SPIRIT_DEBUG_NODE(value_);
+            BOOST_SPIRIT_DEBUG_NODE(value_slice_);
+            BOOST_SPIRIT_DEBUG_NODE(top_);
             BOOST_SPIRIT_DEBUG_NODE(uint_);
             BOOST_SPIRIT_DEBUG_NODE(xor_);
         }
@@ -92,13 +112,19 @@ namespace mtn {
         qi::rule<Iterator, expr(), Skipper>         search_;
         qi::rule<Iterator, op_group(), Skipper>     group_;
         qi::rule<Iterator, op_group(), Skipper>     rgroup_;
+        qi::rule<Iterator, op_group(), Skipper>     top_;
         qi::rule<Iterator, uint128_t(), Skipper>    uint_;
         qi::rule<Iterator, op_and(), Skipper>       and_;
         qi::rule<Iterator, op_not(), Skipper>       not_;
         qi::rule<Iterator, op_or(), Skipper>        or_;
         qi::rule<Iterator, mtn::range_t(), Skipper> range_;
         qi::rule<Iterator, mtn::regex_t(), Skipper> regex_;
+        qi::rule<Iterator, mtn::param_t(), Skipper> param_;
+        qi::rule<Iterator, mtn::prefix_t(), Skipper> prefix_;
         qi::rule<Iterator, op_slice(), Skipper>     slice_;
+        qi::rule<Iterator, op_slice(), Skipper>     prefix_slice_;
+        qi::rule<Iterator, mtn::value_t(), Skipper> value_;
+        qi::rule<Iterator, op_slice(), Skipper>     value_slice_;
         qi::rule<Iterator, op_xor(), Skipper>       xor_;
 
         qi::rule<Iterator, boost::spirit::binary_string_type()>              byte_string_;
@@ -20,6 +20,10 @@
 #ifndef __MUTTON_QUERY_PRINTER_HPP_INCLUDED__
 #define __MUTTON_QUERY_PRINTER_HPP_INCLUDED__
 
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/join.hpp>
 
@@ -27,6 +31,7 @@
 
 namespace mtn {
 
+// Print the canonical text form of a query, suitable as a cache key.
 struct query_printer_t :
     boost::static_visitor<std::string>
 {
@@ -65,24 +70,64 @@ struct query_printer_t :
     std::string
     operator()(const mtn::regex_t& o) const
     {
-        return std::string("(regex \"") + o.pattern + "\")";
+        return std::string("(regex ") + quote(o.pattern) + ")";
+    }
+
+    std::string
+    operator()(const mtn::prefix_t& o) const
+    {
+        return std::string("(prefix ") + quote(o.value) + ")";
+    }
+
+    std::string
+    operator()(const mtn::value_t& o) const
+    {
+        return std::string("(value ") + quote(o.value) + ")";
+    }
+
+    std::string
+    operator()(const mtn::param_t& o) const
+    {
+        std::stringstream message;
+        message << "(param " << o.slot << ")";
+        return message.str();
     }
 
     std::string
     operator()(const mtn::op_slice& o) const
     {
         if (o.values.empty()) {
-            return std::string("(slice \"") + o.index + "\")";
+            return std::string("(slice ") + quote(o.index) + ")";
         }
         else {
-            return print("slice \"" + o.index + "\"", o.values.begin(), o.values.end());
+            return print("slice " + quote(o.index), o.values.begin(), o.values.end());
         }
     }
 
     std::string
-    operator()(const mtn::op_or& o) const
+    operator()(const mtn::op_group& o) const
     {
-        return std::string("(group ") + "\"" + o.index + "\" " + boost::apply_visitor(*this, o.child) + ")";
+        if (o.limit > 0) {
+            std::stringstream message;
+            message << "(top " << o.limit << " " << quote(o.index) << " " << boost::apply_visitor(*this, o.child) << ")";
+            return message.str();
+        }
+        return std::string(o.reverse ? "(rgroup " : "(group ") + quote(o.index) + " " + boost::apply_visitor(*this, o.child) + ")";
+    }
+
+    // the string as the parser reads it, with backslashes and quotes
+    // escaped so that no two strings print the same
+    static inline std::string
+    quote(const std::string& value)
+    {
+        std::string output("\"");
+        for (std::string::const_iterator iter = value.begin(); iter != value.end(); ++iter) {
+            if (*iter == '\\' || *iter == '"') {
+                output += '\\';
+            }
+            output += *iter;
+        }
+        return output + "\"";
     }
 
     template<class Iterator>
@@ -91,10 +136,13 @@ struct query_printer_t :
           Iterator it,
           Iterator end) const
     {
-        std::list<std::string> temp;
+        // every operator with more than one operand is commutative, sort
+        // them so that equivalent queries share the same canonical form
+        std::vector<std::string> temp;
         for (; it != end; ++it) {
             temp.push_back(boost::apply_visitor(*this, *it));
         }
+        std::sort(temp.begin(), temp.end());
 
         return std::string("(") + op + " " + boost::algorithm::join(temp, " ") + ")";
     }
@@ -20,7 +20,8 @@
 #ifndef __MUTTON_REGEX_HPP_INCLUDED__
 #define __MUTTON_REGEX_HPP_INCLUDED__
 
-#include <set>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include <re2/filtered_re2.h>
@@ -30,7 +31,6 @@
 #include "base_types.hpp"
 #include "range.hpp"
 #include "status.hpp"
-#include "trigram.hpp"
 
 namespace mtn {
 
@@ -47,16 +47,18 @@ namespace mtn {
             pattern(pattern)
         {}
 
+        // add input to filter, the atoms are the literals the prefilter
+        // of input is built from
         static inline mtn::status_t
-        to_pieces(
+        compile(
             const regex_t&            input,
-            std::vector<std::string>& output)
+            re2::FilteredRE2&         filter,
+            std::vector<std::string>& atoms)
         {
-            re2::FilteredRE2 re2;
             RE2::Options options;
 
             int id = 0;
-            RE2::ErrorCode ec = re2.Add(re2::StringPiece(input.pattern), options, &id);
+            RE2::ErrorCode ec = filter.Add(re2::StringPiece(input.pattern), options, &id);
 
             switch(ec) {
             case RE2::NoError:
@@ -93,23 +95,17 @@ namespace mtn {
                 return mtn::status_t(MTN_ERROR_BAD_REGEX, ss.str());
             }
 
-            re2.Compile(&output);
+            filter.Compile(&atoms);
             return mtn::status_t();
         }
 
         static inline mtn::status_t
-        to_ranges(
-            const regex_t&             input,
-            std::vector<mtn::range_t>& output)
+        to_pieces(
+            const regex_t&            input,
+            std::vector<std::string>& output)
         {
-            std::vector<std::string> pieces;
-            mtn::status_t status = to_pieces(input, pieces);
-            if (status) {
-                for (std::vector<std::string>::iterator iter = pieces.begin(); iter != pieces.end(); ++iter) {
-                    mtn::trigram_t::to_ranges(iter->c_str(), iter->c_str() + iter->size(), output);
-                }
-            }
-            return status;
+            re2::FilteredRE2 filter;
+            return compile(input, filter, output);
         }
     };
 
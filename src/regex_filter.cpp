@@ -0,0 +1,178 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <re2/re2.h>
+
+#include "index.hpp"
+#include "thread_pool.hpp"
+#include "value_store.hpp"
+
+#include "regex_filter.hpp"
+
+#define MTN_REGEX_VERIFY_BATCH_SIZE 64
+
+typedef std::vector<mtn::index_slice_t::iterator> node_container;
+typedef mtn::compiled_regex_container             re2_container;
+
+struct verify_batch_t
+{
+    verify_batch_t(
+        mtn::index_reader_writer_t& rw,
+        const mtn::index_t*         index,
+        const re2_container&        regexes,
+        const node_container&       nodes,
+        size_t                      begin,
+        size_t                      end,
+        mtn::status_t&              status) :
+        rw(&rw),
+        index(index),
+        regexes(&regexes),
+        nodes(&nodes),
+        begin(begin),
+        end(end),
+        status(&status)
+    {}
+
+    inline bool
+    matches(const mtn::value_store_t::values_t& values) const
+    {
+        for (mtn::value_store_t::values_t::const_iterator value = values.begin(); value != values.end(); ++value) {
+            for (re2_container::const_iterator regex = regexes->begin(); regex != regexes->end(); ++regex) {
+                if (RE2::PartialMatch(*value, *regex)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void
+    operator()()
+    {
+        for (size_t n = begin; n < end && *status; ++n) {
+            mtn::index_slice_t::index_node_t& node = *(*nodes)[n];
+            for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH && *status; ++i) {
+                for (uint64_t word = node.segment[i]; word && *status; word &= word - 1) {
+                    int bit = __builtin_ctzll(word);
+                    mtn_index_address_t row = (node.offset << 11) | (i << 6) | bit;
+
+                    mtn::value_store_t::values_t values;
+                    *status = mtn::value_store_t::find(*rw, *index, row, values);
+                    if (*status && values.empty()) {
+                        *status = mtn::status_t(MTN_ERROR_UNVERIFIED, "a candidate row has no stored value to verify it against");
+                    }
+                    else if (*status && !matches(values)) {
+                        node.segment[i] &= ~(1ULL << bit);
+                    }
+                }
+            }
+        }
+    }
+
+    mtn::index_reader_writer_t* rw;
+    const mtn::index_t*         index;
+    const re2_container*        regexes;
+    const node_container*       nodes;
+    size_t                      begin;
+    size_t                      end;
+    mtn::status_t*              status;
+};
+
+mtn::status_t
+mtn::compile_regexes(
+    const std::vector<mtn::regex_t>& regexes,
+    mtn::compiled_regex_container&   output)
+{
+    for (std::vector<mtn::regex_t>::const_iterator iter = regexes.begin(); iter != regexes.end(); ++iter) {
+        output.push_back(new RE2(iter->pattern, RE2::Quiet));
+        if (!output.back().ok()) {
+            return mtn::status_t(MTN_ERROR_BAD_REGEX, output.back().error());
+        }
+    }
+    return mtn::status_t();
+}
+
+mtn::status_t
+mtn::verify_regex(
+    mtn::index_reader_writer_t&      rw,
+    const mtn::index_t*              index,
+    const std::vector<mtn::regex_t>& regexes,
+    mtn::thread_pool_t*              pool,
+    mtn::index_slice_t&              candidates)
+{
+    re2_container compiled;
+    mtn::status_t status = mtn::compile_regexes(regexes, compiled);
+    if (status) {
+        status = mtn::verify_regex(rw, index, compiled, pool, candidates);
+    }
+    return status;
+}
+
+mtn::status_t
+mtn::verify_regex(
+    mtn::index_reader_writer_t&          rw,
+    const mtn::index_t*                  index,
+    const mtn::compiled_regex_container& compiled,
+    mtn::thread_pool_t*                  pool,
+    mtn::index_slice_t&                  candidates)
+{
+    node_container nodes;
+    for (mtn::index_slice_t::iterator iter = candidates.begin(); iter != candidates.end(); ++iter) {
+        nodes.push_back(iter);
+    }
+
+    // every batch has its own status, the batches run concurrently
+    size_t batches = (nodes.size() + MTN_REGEX_VERIFY_BATCH_SIZE - 1) / MTN_REGEX_VERIFY_BATCH_SIZE;
+    std::vector<mtn::status_t> statuses(batches);
+
+    std::vector<mtn::thread_pool_t::task_t> tasks;
+    for (size_t begin = 0; begin < nodes.size(); begin += MTN_REGEX_VERIFY_BATCH_SIZE) {
+        size_t end = std::min(begin + MTN_REGEX_VERIFY_BATCH_SIZE, nodes.size());
+        tasks.push_back(verify_batch_t(rw, index, compiled, nodes, begin, end, statuses[begin / MTN_REGEX_VERIFY_BATCH_SIZE]));
+    }
+
+    if (pool && tasks.size() > 1) {
+        mtn::status_t status = pool->execute(tasks);
+        if (!status) {
+            return status;
+        }
+    }
+    else {
+        for (std::vector<mtn::thread_pool_t::task_t>::iterator iter = tasks.begin(); iter != tasks.end(); ++iter) {
+            (*iter)();
+        }
+    }
+
+    // drop the segments which no longer have a candidate
+    for (mtn::index_slice_t::iterator iter = candidates.begin(); iter != candidates.end();) {
+        bool empty = true;
+        for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH && empty; ++i) {
+            empty = iter->segment[i] == 0;
+        }
+        iter = empty ? candidates.erase(iter) : ++iter;
+    }
+
+    for (size_t i = 0; i < statuses.size(); ++i) {
+        if (!statuses[i]) {
+            return statuses[i];
+        }
+    }
+    return mtn::status_t();
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_REGEX_FILTER_HPP_INCLUDED__
+#define __MUTTON_REGEX_FILTER_HPP_INCLUDED__
+
+#include <vector>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "index_slice.hpp"
+#include "regex.hpp"
+#include "status.hpp"
+
+namespace mtn {
+
+    class index_t;
+    class index_reader_writer_t;
+    class thread_pool_t;
+
+    typedef boost::ptr_vector<RE2> compiled_regex_container;
+
+    // compile every regex for verify_regex, appending to output
+    mtn::status_t
+    compile_regexes(const std::vector<mtn::regex_t>& regexes,
+                    mtn::compiled_regex_container&   output);
+
+    // Drop the trigram false positives from candidates. Every row left
+    // in the slice is checked against the values stored for it in index,
+    // read from rw, and kept only if one of them matches one of the
+    // regexes. A row with no stored value can't be checked and fails the
+    // verification with MTN_ERROR_UNVERIFIED. Candidates are verified in
+    // batches of segments, on the pool when one is given.
+    mtn::status_t
+    verify_regex(mtn::index_reader_writer_t&          rw,
+                 const mtn::index_t*                  index,
+                 const mtn::compiled_regex_container& regexes,
+                 mtn::thread_pool_t*                  pool,
+                 mtn::index_slice_t&                  candidates);
+
+    // compiles the regexes for a single verification
+    mtn::status_t
+    verify_regex(mtn::index_reader_writer_t&      rw,
+                 const mtn::index_t*              index,
+                 const std::vector<mtn::regex_t>& regexes,
+                 mtn::thread_pool_t*              pool,
+                 mtn::index_slice_t&              candidates);
+
+} // namespace mtn
+
+#endif // __MUTTON_REGEX_FILTER_HPP_INCLUDED__
@@ -0,0 +1,259 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "trigram.hpp"
+
+#include "regex_query.hpp"
+
+// past this many optional atoms the alternatives aren't enumerated,
+// they are unioned instead
+#define MTN_REGEX_QUERY_MAX_ALTERNATIVE_ATOMS 8
+
+typedef std::set<uint64_t> trigram_set;
+
+// whether a value containing every atom in atoms would pass the prefilter
+static bool
+passes(
+    const re2::FilteredRE2& filter,
+    std::vector<int>        atoms)
+{
+    std::sort(atoms.begin(), atoms.end());
+    std::vector<int> regexps;
+    filter.AllPotentials(atoms, &regexps);
+    return !regexps.empty();
+}
+
+static void
+add_trigrams(
+    const std::string& field,
+    const trigram_set& trigrams,
+    mtn::op_and&       output)
+{
+    std::vector<mtn::range_t> ranges;
+    mtn::trigram_t::to_ranges(trigrams, ranges);
+    for (std::vector<mtn::range_t>::iterator iter = ranges.begin(); iter != ranges.end(); ++iter) {
+        mtn::op_slice slice;
+        slice.index = field;
+        slice.values.push_back(*iter);
+        output.children.push_back(slice);
+    }
+}
+
+static void
+add_alternatives(
+    const std::string&              field,
+    const std::vector<trigram_set>& alternatives,
+    mtn::op_and&                    output)
+{
+    // alternatives of a single trigram share one slice, a slice is
+    // already the union of its ranges
+    mtn::op_slice single;
+    single.index = field;
+
+    mtn::op_or any;
+    for (std::vector<trigram_set>::const_iterator iter = alternatives.begin(); iter != alternatives.end(); ++iter) {
+        if (iter->size() == 1) {
+            std::vector<mtn::range_t> ranges;
+            mtn::trigram_t::to_ranges(*iter, ranges);
+            single.values.push_back(ranges.front());
+            continue;
+        }
+
+        mtn::op_and every;
+        add_trigrams(field, *iter, every);
+        any.children.push_back(every);
+    }
+
+    if (!single.values.empty()) {
+        any.children.push_back(single);
+    }
+
+    if (any.children.size() == 1) {
+        output.children.push_back(any.children.front());
+    }
+    else if (!any.children.empty()) {
+        output.children.push_back(any);
+    }
+}
+
+// whether no literal of pattern can match upper case text, escapes
+// which could spell out a character and (?i) count as upper case
+static bool
+lower_case_only(
+    const std::string& pattern)
+{
+    std::string::const_iterator iter = pattern.begin();
+    while (iter != pattern.end()) {
+        if (*iter == '\\') {
+            if (++iter == pattern.end()) {
+                break;
+            }
+            if (*iter == 'x' || *iter == 'p' || *iter == 'P' || *iter == 'Q' || (*iter >= '0' && *iter <= '9')) {
+                return false;
+            }
+            ++iter;
+            continue;
+        }
+
+        if (*iter == '(' && iter + 1 != pattern.end() && *(iter + 1) == '?') {
+            std::string::const_iterator flag = iter + 2;
+            for (; flag != pattern.end() && *flag != ':' && *flag != ')'; ++flag) {
+                if (*flag == 'i') {
+                    return false;
+                }
+            }
+        }
+
+        uint32_t c = utf8::next(iter, pattern.end());
+        if (mtn::trigram_t::fold(c, mtn::MTN_TRIGRAM_FOLD_CASE) != c) {
+            return false;
+        }
+    }
+    return true;
+}
+
+mtn::status_t
+mtn::regex_query(
+    const std::string&     field,
+    const mtn::regex_t&    regex,
+    mtn::trigram_fold_enum fold,
+    mtn::expr&             output)
+{
+    re2::FilteredRE2 filter;
+    std::vector<std::string> atoms;
+    mtn::status_t status = mtn::regex_t::compile(regex, filter, atoms);
+    if (!status) {
+        return status;
+    }
+
+    mtn::op_slice all;
+    all.index = field;
+
+    if (fold == mtn::MTN_TRIGRAM_FOLD_NONE && !lower_case_only(regex.pattern)) {
+        output = all;
+        return status;
+    }
+
+    // an atom shorter than a trigram can't be looked up, it is assumed
+    // to be present in every value
+    std::vector<trigram_set> trigrams(atoms.size());
+    std::vector<int> present;
+    std::vector<int> constrained;
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        if (utf8::distance(atoms[i].begin(), atoms[i].end()) < 3) {
+            present.push_back(i);
+            continue;
+        }
+
+        mtn::trigram_container keys;
+        mtn::trigram_t::to_trigrams(atoms[i].data(), atoms[i].data() + atoms[i].size(), keys, fold);
+        trigrams[i].insert(keys.begin(), keys.end());
+        constrained.push_back(i);
+    }
+
+    if (passes(filter, present)) {
+        output = all;
+        return status;
+    }
+
+    // an atom is required when nothing passes without it
+    std::vector<int> required(present);
+    std::vector<int> optional;
+    trigram_set conjunction;
+    for (std::vector<int>::iterator atom = constrained.begin(); atom != constrained.end(); ++atom) {
+        std::vector<int> others(present);
+        for (std::vector<int>::iterator iter = constrained.begin(); iter != constrained.end(); ++iter) {
+            if (iter != atom) {
+                others.push_back(*iter);
+            }
+        }
+
+        if (passes(filter, others)) {
+            optional.push_back(*atom);
+        }
+        else {
+            required.push_back(*atom);
+            conjunction.insert(trigrams[*atom].begin(), trigrams[*atom].end());
+        }
+    }
+
+    std::vector<trigram_set> alternatives;
+    if (!passes(filter, required)) {
+        if (optional.size() <= MTN_REGEX_QUERY_MAX_ALTERNATIVE_ATOMS) {
+            // keep the subsets which pass but stop passing once any one
+            // of their atoms is taken away
+            for (size_t mask = 1; mask < (1U << optional.size()); ++mask) {
+                std::vector<int> subset(required);
+                for (size_t i = 0; i < optional.size(); ++i) {
+                    if (mask & (1U << i)) {
+                        subset.push_back(optional[i]);
+                    }
+                }
+
+                if (!passes(filter, subset)) {
+                    continue;
+                }
+
+                bool minimal = true;
+                for (size_t i = 0; i < optional.size() && minimal; ++i) {
+                    if (mask & (1U << i)) {
+                        std::vector<int> smaller(subset);
+                        smaller.erase(std::find(smaller.begin(), smaller.end(), optional[i]));
+                        minimal = !passes(filter, smaller);
+                    }
+                }
+
+                if (minimal) {
+                    trigram_set alternative;
+                    for (size_t i = 0; i < optional.size(); ++i) {
+                        if (mask & (1U << i)) {
+                            alternative.insert(trigrams[optional[i]].begin(), trigrams[optional[i]].end());
+                        }
+                    }
+                    alternatives.push_back(alternative);
+                }
+            }
+        }
+        else {
+            // every match contains at least one of them
+            for (std::vector<int>::iterator iter = optional.begin(); iter != optional.end(); ++iter) {
+                alternatives.push_back(trigrams[*iter]);
+            }
+        }
+    }
+
+    mtn::op_and every;
+    add_trigrams(field, conjunction, every);
+    add_alternatives(field, alternatives, every);
+
+    if (every.children.empty()) {
+        output = all;
+    }
+    else if (every.children.size() == 1) {
+        output = every.children.front();
+    }
+    else {
+        output = every;
+    }
+    return status;
+}
@@ -0,0 +1,52 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_REGEX_QUERY_HPP_INCLUDED__
+#define __MUTTON_REGEX_QUERY_HPP_INCLUDED__
+
+#include <string>
+
+#include "query_ops.hpp"
+#include "regex.hpp"
+#include "status.hpp"
+#include "trigram.hpp"
+
+namespace mtn {
+
+    // Build the trigram query which every value matched by regex has to
+    // satisfy, as a tree of (& ...) and (| ...) over slices of field. An
+    // atom is a literal which the regex requires, it turns into the
+    // intersection of its trigrams. How atoms combine is read back from
+    // the RE2 prefilter: atoms needed by every match are intersected with
+    // the alternatives, which are the minimal sets of the remaining atoms
+    // that pass the prefilter. A regex which can't be narrowed down by
+    // trigrams produces a slice of the whole field.
+    //
+    // RE2 lowercases atoms, so they are folded the same way as the index
+    // was. Against an index which isn't folded, a pattern which could
+    // match upper case text, (?i) included, isn't narrowed down at all.
+    mtn::status_t
+    regex_query(const std::string&     field,
+                const mtn::regex_t&    regex,
+                mtn::trigram_fold_enum fold,
+                mtn::expr&             output);
+
+} // namespace mtn
+
+#endif // __MUTTON_REGEX_QUERY_HPP_INCLUDED__
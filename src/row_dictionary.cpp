@@ -0,0 +1,79 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits>
+
+#include "row_dictionary.hpp"
+
+mtn::status_t
+mtn::row_dictionary_t::insert(
+    mtn_index_address_t row,
+    id_t&               output,
+    bool*               added)
+{
+    if (added) {
+        *added = false;
+    }
+
+    boost::mutex::scoped_lock lock(_mutex);
+    id_container::const_iterator iter = _ids.find(row);
+    if (iter != _ids.end()) {
+        output = iter->second;
+        return mtn::status_t();
+    }
+
+    if (_rows.size() > std::numeric_limits<id_t>::max()) {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "row dictionary is full");
+    }
+
+    output = static_cast<id_t>(_rows.size());
+    _ids.insert(std::make_pair(row, output));
+    _rows.push_back(row);
+    if (added) {
+        *added = true;
+    }
+    return mtn::status_t();
+}
+
+bool
+mtn::row_dictionary_t::find(
+    mtn_index_address_t row,
+    id_t&               output) const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    id_container::const_iterator iter = _ids.find(row);
+    if (iter == _ids.end()) {
+        return false;
+    }
+    output = iter->second;
+    return true;
+}
+
+bool
+mtn::row_dictionary_t::row(
+    mtn_index_address_t  id,
+    mtn_index_address_t& output) const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    if (id >= _rows.size()) {
+        return false;
+    }
+    output = _rows[(size_t) id];
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_ROW_DICTIONARY_HPP_INCLUDED__
+#define __MUTTON_ROW_DICTIONARY_HPP_INCLUDED__
+
+#include <vector>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "base_types.hpp"
+#include "status.hpp"
+
+namespace mtn {
+
+    // Dense ids for the row ids of a bucket. Row ids are often hashes
+    // spread over the whole 128 bit space, used directly as bit positions
+    // almost every row would get a segment of its own. Mapped rows are
+    // numbered in the order they are first seen, so the bits of a bucket
+    // are packed into as few segments as possible. Every field of the
+    // bucket shares the dictionary, it's locked on its own so that writes
+    // to different fields can map rows at the same time.
+    class row_dictionary_t :
+        boost::noncopyable
+    {
+    public:
+        typedef uint32_t id_t;
+
+        // the id of row, the next id is assigned if the row is new in
+        // which case added is set
+        mtn::status_t
+        insert(mtn_index_address_t row,
+               id_t&               output,
+               bool*               added = NULL);
+
+        bool
+        find(mtn_index_address_t row,
+             id_t&               output) const;
+
+        // the row id an internal id was assigned to
+        bool
+        row(mtn_index_address_t  id,
+            mtn_index_address_t& output) const;
+
+        inline size_t
+        size() const
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            return _rows.size();
+        }
+
+    private:
+        typedef boost::unordered_map<mtn_index_address_t, id_t, mtn::index_address_hash_t> id_container;
+
+        id_container                     _ids;
+        std::vector<mtn_index_address_t> _rows;
+        mutable boost::mutex             _mutex;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_ROW_DICTIONARY_HPP_INCLUDED__
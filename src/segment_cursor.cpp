@@ -0,0 +1,348 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "segment_cursor.hpp"
+
+mtn::slice_cursor_t::slice_cursor_t(
+    const mtn::index_slice_t& slice) :
+    _slice(slice),
+    _iter(slice.cend()),
+    _started(false)
+{}
+
+bool
+mtn::slice_cursor_t::next()
+{
+    if (!_started) {
+        _iter = _slice.cbegin();
+        _started = true;
+    }
+    else if (_iter != _slice.cend()) {
+        ++_iter;
+    }
+    return valid();
+}
+
+bool
+mtn::slice_cursor_t::seek(
+    mtn_index_address_t target)
+{
+    // the slice is ordered, a seek is a lookup rather than a walk over
+    // every segment in between. A cursor already at or past the target
+    // stays where it is.
+    if (!_started || (_iter != _slice.cend() && _iter->offset < target)) {
+        _iter = _slice.lower_bound(target);
+        _started = true;
+    }
+    return valid();
+}
+
+bool
+mtn::slice_cursor_t::valid() const
+{
+    return _started && _iter != _slice.cend();
+}
+
+mtn_index_address_t
+mtn::slice_cursor_t::offset() const
+{
+    return _iter->offset;
+}
+
+const uint64_t*
+mtn::slice_cursor_t::segment() const
+{
+    return _iter->segment;
+}
+
+mtn::composite_cursor_t::composite_cursor_t() :
+    _started(false),
+    _valid(false),
+    _offset(0)
+{}
+
+void
+mtn::composite_cursor_t::add(
+    segment_cursor_t* child)
+{
+    _children.push_back(child);
+}
+
+bool
+mtn::composite_cursor_t::valid() const
+{
+    return _valid;
+}
+
+mtn_index_address_t
+mtn::composite_cursor_t::offset() const
+{
+    return _offset;
+}
+
+const uint64_t*
+mtn::composite_cursor_t::segment() const
+{
+    return _segment;
+}
+
+bool
+mtn::and_cursor_t::next()
+{
+    if (_started && !_valid) {
+        return _valid;
+    }
+
+    // every child is positioned on the current offset, step them all
+    children_container::iterator iter = _children.begin();
+    for (; iter != _children.end(); ++iter) {
+        if (!iter->next()) {
+            _started = true;
+            _valid = false;
+            return _valid;
+        }
+    }
+    _started = true;
+    return align();
+}
+
+bool
+mtn::and_cursor_t::seek(
+    mtn_index_address_t target)
+{
+    if (_started && (!_valid || _offset >= target)) {
+        return _valid;
+    }
+
+    children_container::iterator iter = _children.begin();
+    for (; iter != _children.end(); ++iter) {
+        if (!iter->seek(target)) {
+            _started = true;
+            _valid = false;
+            return _valid;
+        }
+    }
+    _started = true;
+    return align();
+}
+
+bool
+mtn::and_cursor_t::align()
+{
+    _valid = false;
+    if (_children.empty()) {
+        return _valid;
+    }
+
+    // leapfrog, every child skips ahead to the largest offset until they agree
+    for (;;) {
+        mtn_index_address_t target = _children.front().offset();
+        bool aligned = true;
+
+        children_container::iterator iter = _children.begin();
+        for (; iter != _children.end(); ++iter) {
+            if (iter->offset() != target) {
+                aligned = false;
+                if (iter->offset() > target) {
+                    target = iter->offset();
+                }
+            }
+        }
+
+        if (aligned) {
+            break;
+        }
+
+        for (iter = _children.begin(); iter != _children.end(); ++iter) {
+            if (!iter->seek(target)) {
+                return _valid;
+            }
+        }
+    }
+
+    _offset = _children.front().offset();
+    memcpy(_segment, _children.front().segment(), MTN_INDEX_SEGMENT_SIZE);
+
+    children_container::iterator iter = _children.begin();
+    for (++iter; iter != _children.end(); ++iter) {
+        const uint64_t* segment = iter->segment();
+        for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+            _segment[i] &= segment[i];
+        }
+    }
+
+    _valid = true;
+    return _valid;
+}
+
+mtn::merge_cursor_t::merge_cursor_t(
+    mtn::index_operation_enum operation) :
+    _operation(operation)
+{}
+
+bool
+mtn::merge_cursor_t::next()
+{
+    children_container::iterator iter = _children.begin();
+    for (; iter != _children.end(); ++iter) {
+        if (!_started) {
+            iter->next();
+        }
+        else if (_valid && iter->valid() && iter->offset() == _offset) {
+            iter->next();
+        }
+    }
+    _started = true;
+    return merge();
+}
+
+bool
+mtn::merge_cursor_t::seek(
+    mtn_index_address_t target)
+{
+    if (_started && (!_valid || _offset >= target)) {
+        return _valid;
+    }
+
+    children_container::iterator iter = _children.begin();
+    for (; iter != _children.end(); ++iter) {
+        if (!_started || iter->valid()) {
+            iter->seek(target);
+        }
+    }
+    _started = true;
+    return merge();
+}
+
+bool
+mtn::merge_cursor_t::merge()
+{
+    _valid = false;
+
+    children_container::iterator iter = _children.begin();
+    for (; iter != _children.end(); ++iter) {
+        if (iter->valid() && (!_valid || iter->offset() < _offset)) {
+            _offset = iter->offset();
+            _valid = true;
+        }
+    }
+
+    if (!_valid) {
+        return _valid;
+    }
+
+    memset(_segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    for (iter = _children.begin(); iter != _children.end(); ++iter) {
+        if (!iter->valid() || iter->offset() != _offset) {
+            continue;
+        }
+
+        const uint64_t* segment = iter->segment();
+        if (_operation == MTN_INDEX_OP_SYMMETRIC_DIFFERENCE) {
+            for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+                _segment[i] ^= segment[i];
+            }
+        }
+        else {
+            for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+                _segment[i] |= segment[i];
+            }
+        }
+    }
+    return _valid;
+}
+
+mtn::not_cursor_t::not_cursor_t(
+    segment_cursor_t* child) :
+    _child(child)
+{}
+
+bool
+mtn::not_cursor_t::next()
+{
+    if (_child->next()) {
+        invert();
+    }
+    return valid();
+}
+
+bool
+mtn::not_cursor_t::seek(
+    mtn_index_address_t target)
+{
+    if (_child->valid() && _child->offset() >= target) {
+        return true;
+    }
+
+    if (_child->seek(target)) {
+        invert();
+    }
+    return valid();
+}
+
+bool
+mtn::not_cursor_t::valid() const
+{
+    return _child->valid();
+}
+
+mtn_index_address_t
+mtn::not_cursor_t::offset() const
+{
+    return _child->offset();
+}
+
+const uint64_t*
+mtn::not_cursor_t::segment() const
+{
+    return _segment;
+}
+
+void
+mtn::not_cursor_t::invert()
+{
+    const uint64_t* segment = _child->segment();
+    for (int i = 0; i < MTN_INDEX_SEGMENT_LENGTH; ++i) {
+        _segment[i] = ~segment[i];
+    }
+}
+
+void
+mtn::materialize(
+    mtn::segment_cursor_t& cursor,
+    mtn::index_slice_t&    output)
+{
+    for (bool valid = cursor.next(); valid; valid = cursor.next()) {
+        output.insert(output.end(), new mtn::index_slice_t::index_node_t(cursor.offset(), const_cast<mtn::index_segment_ptr>(cursor.segment())));
+    }
+}
+
+void
+mtn::materialize(
+    mtn::segment_cursor_t& cursor,
+    mtn_index_address_t    start,
+    mtn_index_address_t    limit,
+    mtn::index_slice_t&    output)
+{
+    for (bool valid = cursor.seek(start); valid && cursor.offset() < limit; valid = cursor.next()) {
+        output.insert(output.end(), new mtn::index_slice_t::index_node_t(cursor.offset(), const_cast<mtn::index_segment_ptr>(cursor.segment())));
+    }
+}
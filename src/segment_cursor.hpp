@@ -0,0 +1,208 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_SEGMENT_CURSOR_HPP_INCLUDED__
+#define __MUTTON_SEGMENT_CURSOR_HPP_INCLUDED__
+
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "base_types.hpp"
+#include "index_slice.hpp"
+
+namespace mtn {
+
+    // Pull based iterator over the segments of a bitmap expression. Each
+    // cursor yields one 2048 bit segment at a time in ascending offset
+    // order so that a boolean tree can be evaluated in a single pass
+    // without materializing the intermediate results. A cursor is
+    // unpositioned until the first call to next or seek.
+    class segment_cursor_t :
+        boost::noncopyable
+    {
+    public:
+
+        virtual
+        ~segment_cursor_t()
+        {}
+
+        // advance to the next segment, returns false when exhausted
+        virtual bool
+        next() = 0;
+
+        // advance to the first segment with an offset >= target, never moves backwards
+        virtual bool
+        seek(mtn_index_address_t target) = 0;
+
+        virtual bool
+        valid() const = 0;
+
+        virtual mtn_index_address_t
+        offset() const = 0;
+
+        virtual const uint64_t*
+        segment() const = 0;
+    };
+
+    class slice_cursor_t :
+        public segment_cursor_t
+    {
+    public:
+
+        slice_cursor_t(const mtn::index_slice_t& slice);
+
+        bool
+        next();
+
+        bool
+        seek(mtn_index_address_t target);
+
+        bool
+        valid() const;
+
+        mtn_index_address_t
+        offset() const;
+
+        const uint64_t*
+        segment() const;
+
+    private:
+        const mtn::index_slice_t&          _slice;
+        mtn::index_slice_t::const_iterator _iter;
+        bool                               _started;
+    };
+
+    class composite_cursor_t :
+        public segment_cursor_t
+    {
+    public:
+        typedef boost::ptr_vector<segment_cursor_t> children_container;
+
+        composite_cursor_t();
+
+        void
+        add(segment_cursor_t* child);
+
+        inline bool
+        empty() const
+        {
+            return _children.empty();
+        }
+
+        bool
+        valid() const;
+
+        mtn_index_address_t
+        offset() const;
+
+        const uint64_t*
+        segment() const;
+
+    protected:
+        children_container   _children;
+        bool                 _started;
+        bool                 _valid;
+        mtn_index_address_t  _offset;
+        mtn::index_segment_t _segment;
+    };
+
+    class and_cursor_t :
+        public composite_cursor_t
+    {
+    public:
+
+        bool
+        next();
+
+        bool
+        seek(mtn_index_address_t target);
+
+    private:
+        bool
+        align();
+    };
+
+    // union and symmetric difference share the same merge, only the
+    // operation used to combine segments found at the same offset differs
+    class merge_cursor_t :
+        public composite_cursor_t
+    {
+    public:
+
+        merge_cursor_t(mtn::index_operation_enum operation);
+
+        bool
+        next();
+
+        bool
+        seek(mtn_index_address_t target);
+
+    private:
+        bool
+        merge();
+
+        mtn::index_operation_enum _operation;
+    };
+
+    class not_cursor_t :
+        public segment_cursor_t
+    {
+    public:
+
+        not_cursor_t(segment_cursor_t* child);
+
+        bool
+        next();
+
+        bool
+        seek(mtn_index_address_t target);
+
+        bool
+        valid() const;
+
+        mtn_index_address_t
+        offset() const;
+
+        const uint64_t*
+        segment() const;
+
+    private:
+        void
+        invert();
+
+        std::auto_ptr<segment_cursor_t> _child;
+        mtn::index_segment_t            _segment;
+    };
+
+    // drain the cursor appending every segment to the output slice
+    void
+    materialize(segment_cursor_t&   cursor,
+                mtn::index_slice_t& output);
+
+    // append the segments with offsets in [start, limit), the cursor must
+    // not have been advanced past start
+    void
+    materialize(segment_cursor_t&   cursor,
+                mtn_index_address_t start,
+                mtn_index_address_t limit,
+                mtn::index_slice_t& output);
+
+} // namespace mtn
+
+#endif // __MUTTON_SEGMENT_CURSOR_HPP_INCLUDED__
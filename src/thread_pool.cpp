@@ -0,0 +1,211 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <exception>
+#include <string>
+#include <boost/bind.hpp>
+
+#include "libmutton/mutton.h"
+#include "thread_pool.hpp"
+
+mtn::thread_pool_t::thread_pool_t(
+    size_t threads) :
+    _pending(0),
+    _next(0),
+    _stopped(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+        _queues.push_back(new task_queue_t());
+    }
+
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        _threads.create_thread(boost::bind(&mtn::thread_pool_t::run, this, i));
+    }
+}
+
+mtn::thread_pool_t::~thread_pool_t()
+{
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _stopped = true;
+    }
+    _condition.notify_all();
+    _threads.join_all();
+}
+
+void
+mtn::thread_pool_t::submit(
+    const task_t& task)
+{
+    size_t id = 0;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        id = _next++ % _queues.size();
+    }
+
+    {
+        boost::mutex::scoped_lock lock(_queues[id].mutex);
+        _queues[id].tasks.push_back(task);
+    }
+
+    // only count the task once it's queued, a worker that claims it is
+    // sure to find it
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        ++_pending;
+    }
+    _condition.notify_one();
+}
+
+// counts the task down whether it returns or throws, the first thing
+// thrown is kept for execute to report
+struct latch_task_t
+{
+    latch_task_t(
+        const mtn::thread_pool_t::task_t& task,
+        boost::mutex&                     mutex,
+        boost::condition_variable&        condition,
+        size_t&                           remaining,
+        std::string&                      failure) :
+        task(task),
+        mutex(&mutex),
+        condition(&condition),
+        remaining(&remaining),
+        failure(&failure)
+    {}
+
+    void
+    operator()()
+    {
+        std::string message;
+        bool failed = true;
+        try {
+            task();
+            failed = false;
+        }
+        catch (const std::exception& e) {
+            message = e.what();
+        }
+        catch (const char* e) {
+            message = e;
+        }
+        catch (...) {
+            message = "unknown exception";
+        }
+
+        boost::mutex::scoped_lock lock(*mutex);
+        if (failed && failure->empty()) {
+            *failure = "task failed: " + message;
+        }
+
+        if (--*remaining == 0) {
+            condition->notify_all();
+        }
+    }
+
+    mtn::thread_pool_t::task_t task;
+    boost::mutex*              mutex;
+    boost::condition_variable* condition;
+    size_t*                    remaining;
+    std::string*               failure;
+};
+
+mtn::status_t
+mtn::thread_pool_t::execute(
+    const std::vector<task_t>& tasks)
+{
+    boost::mutex mutex;
+    boost::condition_variable condition;
+    size_t remaining = tasks.size();
+    std::string failure;
+
+    for (std::vector<task_t>::const_iterator iter = tasks.begin(); iter != tasks.end(); ++iter) {
+        submit(latch_task_t(*iter, mutex, condition, remaining, failure));
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    while (remaining > 0) {
+        condition.wait(lock);
+    }
+
+    if (!failure.empty()) {
+        return mtn::status_t(MTN_ERROR_UNKOWN, failure);
+    }
+    return mtn::status_t();
+}
+
+bool
+mtn::thread_pool_t::pop(
+    size_t  id,
+    task_t& output)
+{
+    {
+        task_queue_t& own = _queues[id];
+        boost::mutex::scoped_lock lock(own.mutex);
+        if (!own.tasks.empty()) {
+            output = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < _queues.size(); ++i) {
+        task_queue_t& victim = _queues[(id + i) % _queues.size()];
+        boost::mutex::scoped_lock lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            output = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+mtn::thread_pool_t::run(
+    size_t id)
+{
+    for (;;) {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            while (_pending == 0 && !_stopped) {
+                _condition.wait(lock);
+            }
+
+            if (_pending == 0 && _stopped) {
+                return;
+            }
+
+            // claim one of the queued tasks, every claim has its own task
+            // in some queue so the pop below can't come back empty
+            --_pending;
+        }
+
+        // a submitted task that throws has no one to report to, the
+        // worker carries on with the next one
+        task_t task;
+        if (pop(id, task)) {
+            try {
+                task();
+            }
+            catch (...) {
+            }
+        }
+    }
+}
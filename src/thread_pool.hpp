@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_THREAD_POOL_HPP_INCLUDED__
+#define __MUTTON_THREAD_POOL_HPP_INCLUDED__
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "status.hpp"
+
+namespace mtn {
+
+    // Fixed size pool of workers, each with its own task queue. Workers
+    // take work from the back of their own queue and steal from the
+    // front of the other queues once theirs is empty, so a batch of
+    // uneven tasks is balanced across the pool.
+    class thread_pool_t :
+        boost::noncopyable
+    {
+    public:
+        typedef boost::function<void()> task_t;
+
+        thread_pool_t(size_t threads);
+
+        ~thread_pool_t();
+
+        void
+        submit(const task_t& task);
+
+        // submit every task and block until all of them have finished.
+        // Fails if any of them threw, the others still run to the end
+        mtn::status_t
+        execute(const std::vector<task_t>& tasks);
+
+        inline size_t
+        size() const
+        {
+            return _queues.size();
+        }
+
+    private:
+        struct task_queue_t :
+            boost::noncopyable
+        {
+            boost::mutex        mutex;
+            std::deque<task_t>  tasks;
+        };
+
+        void
+        run(size_t id);
+
+        bool
+        pop(size_t  id,
+            task_t& output);
+
+        boost::ptr_vector<task_queue_t> _queues;
+        boost::thread_group             _threads;
+        boost::mutex                    _mutex;
+        boost::condition_variable       _condition;
+        size_t                          _pending;
+        size_t                          _next;
+        bool                            _stopped;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_THREAD_POOL_HPP_INCLUDED__
@@ -20,7 +20,11 @@
 #ifndef __MUTTON_TRIGRAM_HPP_INCLUDED__
 #define __MUTTON_TRIGRAM_HPP_INCLUDED__
 
-#include <set>
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "utf8.h"
 
@@ -28,8 +32,21 @@
 #include "range.hpp"
 #include "status.hpp"
 
+// a code point fits in 21 bits, three of them make up a trigram key
+#define MTN_TRIGRAM_CODE_POINT_BITS 21
+#define MTN_TRIGRAM_KEY_MASK ((1ULL << (3 * MTN_TRIGRAM_CODE_POINT_BITS)) - 1)
+
 namespace mtn {
 
+    // sorted and distinct trigram keys
+    typedef std::vector<uint64_t> trigram_container;
+
+    enum trigram_fold_enum {
+        MTN_TRIGRAM_FOLD_NONE = 0,
+        MTN_TRIGRAM_FOLD_CASE = 1,
+        MTN_TRIGRAM_FOLD_CASE_WIDTH = 2
+    };
+
 #pragma pack(push, 1)
 
     struct trigram_t {
@@ -71,42 +88,156 @@ namespace mtn {
             return input;
         }
 
-        inline mtn_index_address_t
-        hash()
+        // dense key ordered by the first, second and third code point
+        inline uint64_t
+        hash() const
         {
-            return ((uint128_t) one ) << 64 | ((uint128_t) two) << 32 | ((uint128_t) three);
+            return ((uint64_t) one) << (2 * MTN_TRIGRAM_CODE_POINT_BITS)
+                | ((uint64_t) two) << MTN_TRIGRAM_CODE_POINT_BITS
+                | ((uint64_t) three);
         }
 
-        template<class InputIterator>
-        static inline void
-        to_trigrams(InputIterator first,
-                    InputIterator last,
-                    std::set<mtn_index_address_t>& output)
+        // Simple case folding for Latin, Greek and Cyrillic letters, full
+        // width forms are also mapped to ASCII when folding width. Code
+        // points outside of those blocks are left as they are.
+        static inline uint32_t
+        fold(uint32_t          c,
+             trigram_fold_enum mode)
+        {
+            if (mode == MTN_TRIGRAM_FOLD_NONE) {
+                return c;
+            }
+
+            if (mode == MTN_TRIGRAM_FOLD_CASE_WIDTH && c >= 0xFF01 && c <= 0xFF5E) {
+                c -= 0xFF01 - 0x21;
+            }
+
+            if (c < 0x80) {
+                return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+            }
+            else if ((c >= 0xC0 && c <= 0xDE && c != 0xD7)
+                     || (c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+                     || (c >= 0x410 && c <= 0x42F)
+                     || (c >= 0xFF21 && c <= 0xFF3A)) {
+                return c + 0x20;
+            }
+            else if (c >= 0x400 && c <= 0x40F) {
+                return c + 0x50;
+            }
+            else if ((c >= 0x100 && c <= 0x137 && c != 0x130)
+                     || (c >= 0x14A && c <= 0x177)) {
+                return c | 1;
+            }
+            else if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) {
+                return c & 1 ? c + 1 : c;
+            }
+            return c;
+        }
+
+        static inline bool
+        is_ascii(const mtn::byte_t* first,
+                 const mtn::byte_t* last)
         {
-            mtn::trigram_t trigram;
-            for (;;) {
-                first = mtn::trigram_t::init(first, last, trigram);
-                output.insert(trigram.hash());
-                if (first == last) {
-                    break;
+#ifdef __SSE2__
+            for (; last - first >= 16; first += 16) {
+                if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)))) {
+                    return false;
                 }
-                trigram.zero();
             }
+#endif
+            for (; first != last; ++first) {
+                if (*first & 0x80) {
+                    return false;
+                }
+            }
+            return true;
         }
 
+        // every overlapping window of three code points, values shorter
+        // than a trigram are padded with zeros so they are still indexed
+        template<class CodePointIterator>
         static inline void
-        to_ranges(std::set<mtn_index_address_t> trigrams,
-                  std::vector<mtn::range_t>&     output)
+        append_trigrams(CodePointIterator  first,
+                        CodePointIterator  last,
+                        trigram_fold_enum  mode,
+                        trigram_container& output)
         {
-            output.reserve(trigrams.size());
-            std::set<mtn_index_address_t>::iterator iter = trigrams.begin();
-            for (;iter != trigrams.end(); ++iter) {
-                if (((uint32_t) *iter) == 0) {
-                    output.push_back(mtn::range_t(*iter, *iter | (((uint128_t) 0x0000000000000000) << 64 | 0x1111111111111111)));
+            uint64_t key = 0;
+            size_t length = 0;
+            for (; first != last; ++first, ++length) {
+                key = ((key << MTN_TRIGRAM_CODE_POINT_BITS) | fold(*first, mode)) & MTN_TRIGRAM_KEY_MASK;
+                if (length >= 2) {
+                    output.push_back(key);
                 }
-                else {
-                    output.push_back(mtn::range_t(*iter, *iter + 1));
+            }
+
+            if (length < 3) {
+                output.push_back(key << ((3 - length) * MTN_TRIGRAM_CODE_POINT_BITS));
+            }
+        }
+
+        static inline void
+        to_trigrams(const mtn::byte_t* first,
+                    const mtn::byte_t* last,
+                    trigram_container& output,
+                    trigram_fold_enum  mode = MTN_TRIGRAM_FOLD_NONE)
+        {
+            output.reserve(output.size() + std::max<ptrdiff_t>(last - first - 2, 1));
+            if (is_ascii(first, last)) {
+                append_trigrams(first, last, mode, output);
+            }
+            else {
+                std::vector<uint32_t> code_points;
+                code_points.reserve(last - first);
+                while (first != last) {
+                    code_points.push_back(utf8::next(first, last));
                 }
+                append_trigrams(code_points.begin(), code_points.end(), mode, output);
+            }
+
+            std::sort(output.begin(), output.end());
+            output.erase(std::unique(output.begin(), output.end()), output.end());
+        }
+
+        static inline void
+        to_trigrams(mtn::byte_t*       first,
+                    mtn::byte_t*       last,
+                    trigram_container& output,
+                    trigram_fold_enum  mode = MTN_TRIGRAM_FOLD_NONE)
+        {
+            to_trigrams(const_cast<const mtn::byte_t*>(first), const_cast<const mtn::byte_t*>(last), output, mode);
+        }
+
+        static inline void
+        to_trigrams(const char*        first,
+                    const char*        last,
+                    trigram_container& output,
+                    trigram_fold_enum  mode = MTN_TRIGRAM_FOLD_NONE)
+        {
+            to_trigrams(reinterpret_cast<const mtn::byte_t*>(first), reinterpret_cast<const mtn::byte_t*>(last), output, mode);
+        }
+
+        template<class InputIterator>
+        static inline void
+        to_trigrams(InputIterator      first,
+                    InputIterator      last,
+                    trigram_container& output,
+                    trigram_fold_enum  mode = MTN_TRIGRAM_FOLD_NONE)
+        {
+            std::vector<mtn::byte_t> buffer(first, last);
+            const mtn::byte_t* data = buffer.empty() ? NULL : &buffer[0];
+            to_trigrams(data, data + buffer.size(), output, mode);
+        }
+
+        template<class Container>
+        static inline void
+        to_ranges(const Container&           trigrams,
+                  std::vector<mtn::range_t>& output)
+        {
+            output.reserve(output.size() + trigrams.size());
+            typename Container::const_iterator iter = trigrams.begin();
+            for (; iter != trigrams.end(); ++iter) {
+                output.push_back(mtn::range_t(*iter, *iter + 1));
             }
         }
 
@@ -116,7 +247,7 @@ namespace mtn {
                   InputIterator              last,
                   std::vector<mtn::range_t>& output)
         {
-            std::set<mtn_index_address_t> trigrams;
+            trigram_container trigrams;
             to_trigrams(first, last, trigrams);
             to_ranges(trigrams, output);
         }
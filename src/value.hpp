@@ -0,0 +1,46 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_VALUE_HPP_INCLUDED__
+#define __MUTTON_VALUE_HPP_INCLUDED__
+
+#include <string>
+
+namespace mtn {
+
+    // A string value of a field indexed through its value dictionary.
+    // It's resolved to the id the dictionary assigned to it when the
+    // query is executed, a value which was never indexed matches nothing.
+    struct value_t
+    {
+        std::string value;
+
+        value_t() :
+            value("")
+        {}
+
+        value_t(
+            const std::string& value) :
+            value(value)
+        {}
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_VALUE_HPP_INCLUDED__
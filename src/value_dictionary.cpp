@@ -0,0 +1,230 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <boost/functional/hash.hpp>
+
+#include "value_dictionary.hpp"
+
+typedef std::pair<std::string, mtn::value_dictionary_t::id_t> entry_t;
+
+static inline void
+append_varint(size_t                    value,
+              std::vector<mtn::byte_t>& output)
+{
+    while (value >= 0x80) {
+        output.push_back(static_cast<mtn::byte_t>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<mtn::byte_t>(value));
+}
+
+static inline const mtn::byte_t*
+read_varint(const mtn::byte_t* input,
+            size_t&            output)
+{
+    output = 0;
+    for (size_t shift = 0; ; shift += 7) {
+        mtn::byte_t b = *input++;
+        output |= static_cast<size_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return input;
+        }
+    }
+}
+
+static inline size_t
+shared_prefix(const std::string& a,
+              const std::string& b)
+{
+    size_t size = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < size && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+mtn::value_dictionary_t::value_dictionary_t()
+{}
+
+mtn::status_t
+mtn::value_dictionary_t::insert(
+    const std::string& value,
+    id_t&              output,
+    bool*              added)
+{
+    if (added) {
+        *added = false;
+    }
+
+    if (find(value, output)) {
+        return mtn::status_t();
+    }
+
+    if (size() > std::numeric_limits<id_t>::max()) {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "value dictionary is full");
+    }
+
+    output = static_cast<id_t>(size());
+    std::pair<pending_container::iterator, bool> inserted = _pending.insert(std::make_pair(value, output));
+    _pending_values.push_back(&inserted.first->first);
+    if (added) {
+        *added = true;
+    }
+
+    if (_pending_values.size() >= std::max<size_t>(MTN_VALUE_DICTIONARY_MIN_PENDING, _positions.size() / 8)) {
+        seal();
+    }
+    return mtn::status_t();
+}
+
+bool
+mtn::value_dictionary_t::find(
+    const std::string& value,
+    id_t&              output) const
+{
+    pending_container::const_iterator iter = _pending.find(value);
+    if (iter != _pending.end()) {
+        output = iter->second;
+        return true;
+    }
+    return find_sealed(value, output);
+}
+
+bool
+mtn::value_dictionary_t::value(
+    id_t         id,
+    std::string& output) const
+{
+    if (id < _positions.size()) {
+        decode(_positions[id], output);
+        return true;
+    }
+
+    if (id < size()) {
+        output = *_pending_values[id - _positions.size()];
+        return true;
+    }
+    return false;
+}
+
+void
+mtn::value_dictionary_t::seal()
+{
+    if (_pending_values.empty()) {
+        return;
+    }
+
+    std::vector<entry_t> entries;
+    entries.reserve(size());
+    for (size_t position = 0; position < _sorted.size(); ++position) {
+        entries.push_back(entry_t(std::string(), _sorted[position]));
+        decode(position, entries.back().first);
+    }
+    for (size_t i = 0; i < _pending_values.size(); ++i) {
+        entries.push_back(entry_t(*_pending_values[i], static_cast<id_t>(_positions.size() + i)));
+    }
+    std::sort(entries.begin(), entries.end());
+
+    _data.clear();
+    _blocks.clear();
+    _sorted.resize(entries.size());
+    _positions.resize(entries.size());
+
+    for (size_t position = 0; position < entries.size(); ++position) {
+        size_t shared = 0;
+        if (position % MTN_VALUE_DICTIONARY_BLOCK_SIZE == 0) {
+            _blocks.push_back(_data.size());
+        }
+        else {
+            shared = shared_prefix(entries[position - 1].first, entries[position].first);
+        }
+
+        const std::string& value = entries[position].first;
+        append_varint(shared, _data);
+        append_varint(value.size() - shared, _data);
+        _data.insert(_data.end(), value.begin() + shared, value.end());
+
+        _sorted[position] = entries[position].second;
+        _positions[entries[position].second] = static_cast<uint32_t>(position);
+    }
+    std::vector<mtn::byte_t>(_data).swap(_data);
+
+    // keep the table at most half full so probe chains stay short
+    size_t slot_count = 1;
+    while (slot_count < entries.size() * 2) {
+        slot_count <<= 1;
+    }
+    _slots.assign(slot_count, 0);
+
+    boost::hash<std::string> hasher;
+    for (size_t position = 0; position < entries.size(); ++position) {
+        size_t slot = hasher(entries[position].first) & (slot_count - 1);
+        while (_slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        _slots[slot] = static_cast<uint32_t>(position + 1);
+    }
+
+    _pending.clear();
+    _pending_values.clear();
+}
+
+void
+mtn::value_dictionary_t::decode(
+    size_t       position,
+    std::string& output) const
+{
+    const mtn::byte_t* pos = &_data[_blocks[position / MTN_VALUE_DICTIONARY_BLOCK_SIZE]];
+    output.clear();
+
+    for (size_t i = 0; i <= position % MTN_VALUE_DICTIONARY_BLOCK_SIZE; ++i) {
+        size_t shared = 0;
+        size_t suffix = 0;
+        pos = read_varint(read_varint(pos, shared), suffix);
+        output.resize(shared);
+        output.append(reinterpret_cast<const char*>(pos), suffix);
+        pos += suffix;
+    }
+}
+
+bool
+mtn::value_dictionary_t::find_sealed(
+    const std::string& value,
+    id_t&              output) const
+{
+    if (_slots.empty()) {
+        return false;
+    }
+
+    std::string candidate;
+    size_t slot = boost::hash<std::string>()(value) & (_slots.size() - 1);
+    for (; _slots[slot] != 0; slot = (slot + 1) & (_slots.size() - 1)) {
+        size_t position = _slots[slot] - 1;
+        decode(position, candidate);
+        if (candidate == value) {
+            output = _sorted[position];
+            return true;
+        }
+    }
+    return false;
+}
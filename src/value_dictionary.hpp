@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_VALUE_DICTIONARY_HPP_INCLUDED__
+#define __MUTTON_VALUE_DICTIONARY_HPP_INCLUDED__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "base_types.hpp"
+#include "status.hpp"
+
+// number of values in a front coded block, only the first of which is
+// stored in full
+#define MTN_VALUE_DICTIONARY_BLOCK_SIZE 16
+
+// values are held unsealed until there are at least this many of them,
+// or an eighth of the sealed values, whichever is more
+#define MTN_VALUE_DICTIONARY_MIN_PENDING 1024
+
+namespace mtn {
+
+    // Dense ids for the string values of one field. Ids are assigned in
+    // the order the values are first seen and never change, so they are
+    // used directly as index values and a query only has to find the id
+    // of a string to know which slice to read. Unlike hashing, two
+    // values can never share a slice.
+    //
+    // Sealed values are kept sorted and front coded in blocks: a block
+    // starts with a complete value, every other value only stores the
+    // suffix it doesn't share with the one before it. An open addressed
+    // table of sorted positions keyed by the hash of the value finds a
+    // value without searching the blocks, colliding hashes are told apart
+    // by comparing the decoded values. Values added since the last seal
+    // are kept in a hash map until there are enough of them to be worth
+    // merging into the blocks.
+    class value_dictionary_t :
+        boost::noncopyable
+    {
+    public:
+        typedef uint32_t id_t;
+
+        value_dictionary_t();
+
+        // the id of value, the next id is assigned if the value is new
+        // in which case added is set
+        mtn::status_t
+        insert(const std::string& value,
+               id_t&              output,
+               bool*              added = NULL);
+
+        bool
+        find(const std::string& value,
+             id_t&              output) const;
+
+        bool
+        value(id_t         id,
+              std::string& output) const;
+
+        // merge the pending values into the sorted blocks
+        void
+        seal();
+
+        inline size_t
+        size() const
+        {
+            return _positions.size() + _pending_values.size();
+        }
+
+        // bytes used by the front coded blocks
+        inline size_t
+        block_bytes() const
+        {
+            return _data.size();
+        }
+
+    private:
+        typedef boost::unordered_map<std::string, id_t> pending_container;
+
+        void
+        decode(size_t       position,
+               std::string& output) const;
+
+        bool
+        find_sealed(const std::string& value,
+                    id_t&              output) const;
+
+        std::vector<mtn::byte_t>        _data;
+        std::vector<size_t>             _blocks;
+        std::vector<id_t>               _sorted;
+        std::vector<uint32_t>           _positions;
+        std::vector<uint32_t>           _slots;
+        pending_container               _pending;
+        std::vector<const std::string*> _pending_values;
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_VALUE_DICTIONARY_HPP_INCLUDED__
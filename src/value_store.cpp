@@ -0,0 +1,113 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "encode.hpp"
+#include "index.hpp"
+#include "index_reader_writer.hpp"
+
+#include "value_store.hpp"
+
+mtn::status_t
+mtn::value_store_t::update(
+    mtn::index_reader_writer_t& rw,
+    const mtn::index_t&         index,
+    mtn_index_address_t         row,
+    const std::string&          value,
+    bool                        state)
+{
+    values_t values;
+    mtn::status_t status = find(rw, index, row, values);
+    if (!status) {
+        return status;
+    }
+
+    values_t::iterator iter = std::find(values.begin(), values.end(), value);
+    if (state == (iter != values.end())) {
+        return status;
+    }
+
+    if (state) {
+        values.push_back(value);
+    }
+    else {
+        values.erase(iter);
+    }
+
+    std::vector<mtn::byte_t> record;
+    encode(values, record);
+    return rw.write_stored_values(index.partition(), index.bucket(), index.field(), row, record);
+}
+
+mtn::status_t
+mtn::value_store_t::find(
+    mtn::index_reader_writer_t& rw,
+    const mtn::index_t&         index,
+    mtn_index_address_t         row,
+    values_t&                   output)
+{
+    std::vector<mtn::byte_t> record;
+    mtn::status_t status = rw.read_stored_values(index.partition(), index.bucket(), index.field(), row, record);
+    if (status && !decode(record, output)) {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "stored values record is truncated");
+    }
+    return status;
+}
+
+void
+mtn::value_store_t::encode(
+    const values_t&           values,
+    std::vector<mtn::byte_t>& output)
+{
+    size_t size = 0;
+    for (values_t::const_iterator iter = values.begin(); iter != values.end(); ++iter) {
+        size += sizeof(uint32_t) + iter->size();
+    }
+
+    output.resize(size);
+    mtn::byte_t* pos = output.empty() ? NULL : &output[0];
+    for (values_t::const_iterator iter = values.begin(); iter != values.end(); ++iter) {
+        pos = mtn::encode_uint32(iter->size(), pos);
+        pos = std::copy(iter->begin(), iter->end(), pos);
+    }
+}
+
+bool
+mtn::value_store_t::decode(
+    const std::vector<mtn::byte_t>& input,
+    values_t&                       output)
+{
+    size_t pos = 0;
+    while (pos < input.size()) {
+        uint32_t size = 0;
+        if (input.size() - pos < sizeof(uint32_t)) {
+            return false;
+        }
+        mtn::decode_uint32(&input[pos], &size);
+        pos += sizeof(uint32_t);
+
+        if (input.size() - pos < size) {
+            return false;
+        }
+        output.push_back(std::string(input.begin() + pos, input.begin() + pos + size));
+        pos += size;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MUTTON_VALUE_STORE_HPP_INCLUDED__
+#define __MUTTON_VALUE_STORE_HPP_INCLUDED__
+
+#include <string>
+#include <vector>
+
+#include "base_types.hpp"
+#include "status.hpp"
+
+namespace mtn {
+
+    class index_t;
+    class index_reader_writer_t;
+
+    // The raw values written to trigram and prefix indexes, by index and
+    // row. Those indexes only yield candidates for a regex or a long
+    // prefix, the stored values are what a candidate is checked against.
+    // A row may hold several values for the same field, they are kept as
+    // one record per row under MTN_DICTIONARY_PARTITION and read back a
+    // row at a time while candidates are verified, so none of them are
+    // held in memory. Records are the values in order, each prefixed with
+    // its 32 bit size.
+    struct value_store_t
+    {
+        typedef std::vector<std::string> values_t;
+
+        // add the value to the row's record, or remove it if state is
+        // false. The caller holds the index's write lock.
+        static mtn::status_t
+        update(mtn::index_reader_writer_t& rw,
+               const mtn::index_t&         index,
+               mtn_index_address_t         row,
+               const std::string&          value,
+               bool                        state);
+
+        // the values stored for the row, empty if it has none
+        static mtn::status_t
+        find(mtn::index_reader_writer_t& rw,
+             const mtn::index_t&         index,
+             mtn_index_address_t         row,
+             values_t&                   output);
+
+        static void
+        encode(const values_t&           values,
+               std::vector<mtn::byte_t>& output);
+
+        // false if the record is truncated
+        static bool
+        decode(const std::vector<mtn::byte_t>& input,
+               values_t&                       output);
+    };
+
+} // namespace mtn
+
+#endif // __MUTTON_VALUE_STORE_HPP_INCLUDED__
@@ -0,0 +1,393 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "catalog.hpp"
+#include "context.hpp"
+#include "encode.hpp"
+#include "fixtures.hpp"
+#include "index_reader_writer_memory.hpp"
+
+BOOST_AUTO_TEST_SUITE(_catalog)
+
+struct auto_snapshot_t {
+
+    auto_snapshot_t() :
+        path("tmp/testcatalog")
+    {
+        boost::filesystem::create_directories("tmp");
+        boost::filesystem::remove(path);
+    }
+
+    ~auto_snapshot_t()
+    {
+        boost::filesystem::remove(path);
+    }
+
+    std::string path;
+};
+
+// counts the indexes read from the store
+struct counting_reader_writer_t :
+        public mtn::index_reader_writer_memory_t
+{
+    counting_reader_writer_t(size_t& reads) :
+        reads(reads)
+    {}
+
+    mtn::status_t
+    read_index(mtn_index_partition_t           partition,
+               const std::vector<mtn::byte_t>& bucket,
+               const std::vector<mtn::byte_t>& field,
+               mtn::index_t**                  output)
+    {
+        ++reads;
+        return mtn::index_reader_writer_memory_t::read_index(partition, bucket, field, output);
+    }
+
+    size_t& reads;
+};
+
+// holds every index read until it's released
+struct blocking_reader_writer_t :
+        public mtn::index_reader_writer_memory_t
+{
+    blocking_reader_writer_t() :
+        reading(false),
+        released(true)
+    {}
+
+    mtn::status_t
+    read_index(mtn_index_partition_t           partition,
+               const std::vector<mtn::byte_t>& bucket,
+               const std::vector<mtn::byte_t>& field,
+               mtn::index_t**                  output)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            reading = true;
+            condition.notify_all();
+            while (!released) {
+                condition.wait(lock);
+            }
+        }
+        return mtn::index_reader_writer_memory_t::read_index(partition, bucket, field, output);
+    }
+
+    boost::mutex              mutex;
+    boost::condition_variable condition;
+    bool                      reading;
+    bool                      released;
+};
+
+struct get_index_task_t
+{
+    get_index_task_t(mtn::context_t&                 context,
+                     const std::vector<mtn::byte_t>& bucket,
+                     const std::vector<mtn::byte_t>& field,
+                     mtn::index_t**                  output) :
+        context(context),
+        bucket(bucket),
+        field(field),
+        output(output)
+    {}
+
+    void
+    operator()()
+    {
+        context.get_index(1, bucket, field, output);
+    }
+
+    mtn::context_t&          context;
+    std::vector<mtn::byte_t> bucket;
+    std::vector<mtn::byte_t> field;
+    mtn::index_t**           output;
+};
+
+BOOST_AUTO_TEST_CASE(test_encode_decode)
+{
+    mtn::catalog_entry_t entry(1, to_vector("bizbang"), to_vector("visits"));
+    entry.hits = 12;
+    entry.values.push_back(mtn::catalog_value_t(6, 2, 3));
+    entry.values.push_back(mtn::catalog_value_t(((mtn_index_address_t) 1) << 100, 1, 1));
+
+    std::vector<mtn::byte_t> record;
+    mtn::catalog_t::encode(entry, record);
+
+    mtn::catalog_entry_t output;
+    BOOST_CHECK(mtn::catalog_t::decode(record, output));
+    BOOST_CHECK_EQUAL(12, output.hits);
+    BOOST_REQUIRE_EQUAL(2, output.values.size());
+    BOOST_CHECK(output.values[0].value == 6);
+    BOOST_CHECK_EQUAL(2, output.values[0].segments);
+    BOOST_CHECK_EQUAL(3, output.values[0].cardinality);
+    BOOST_CHECK(output.values[1].value == ((mtn_index_address_t) 1) << 100);
+
+    record.pop_back();
+    BOOST_CHECK(!mtn::catalog_t::decode(record, output));
+}
+
+BOOST_AUTO_TEST_CASE(test_key)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> field = to_vector("visits");
+    std::vector<mtn::byte_t> key;
+    mtn::encode_catalog_key(1, &bucket[0], bucket.size(), &field[0], field.size(), key);
+
+    uint16_t     partition   = 0;
+    mtn::byte_t* bucket_out  = NULL;
+    uint16_t     bucket_size = 0;
+    mtn::byte_t* field_out   = NULL;
+    uint16_t     field_size  = 0;
+    BOOST_CHECK(mtn::decode_catalog_key(&key[0], key.size(), &partition, &bucket_out, &bucket_size, &field_out, &field_size));
+    BOOST_CHECK_EQUAL(1, partition);
+    BOOST_CHECK(std::vector<mtn::byte_t>(bucket_out, bucket_out + bucket_size) == bucket);
+    BOOST_CHECK(std::vector<mtn::byte_t>(field_out, field_out + field_size) == field);
+
+    BOOST_CHECK(!mtn::decode_catalog_key(&key[0], key.size() - 1, &partition, &bucket_out, &bucket_size, &field_out, &field_size));
+}
+
+BOOST_AUTO_TEST_CASE(test_reopen)
+{
+    auto_snapshot_t snapshot;
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_memory_t());
+        context.set_opt(MTN_OPT_CATALOG, "1", 1);
+        context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+        BOOST_CHECK(context.init());
+
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 2048, true));
+        BOOST_CHECK(context.index_value(1, bucket, country, 1, 42, true));
+
+        mtn::index_t* index = NULL;
+        BOOST_CHECK(context.query_index(1, bucket, visits, &index));
+        BOOST_CHECK(context.query_index(1, bucket, visits, &index));
+        BOOST_CHECK(context.query_index(1, bucket, country, &index));
+        BOOST_CHECK(context.get_index(1, bucket, country, &index));
+    }
+
+    mtn::context_t context(new mtn::index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_CATALOG, "1", 1);
+    context.set_opt(MTN_OPT_WARM_INDEXES, "1", 1);
+    context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::catalog_t::entries_t entries;
+    BOOST_CHECK(context.index_reader_writer().read_catalog(entries));
+    BOOST_REQUIRE_EQUAL(2, entries.size());
+    for (mtn::catalog_t::entries_t::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+        BOOST_REQUIRE_EQUAL(1, iter->values.size());
+        if (iter->field == visits) {
+            BOOST_CHECK_EQUAL(2, iter->hits);
+            BOOST_CHECK_EQUAL(2, iter->values[0].segments);
+            BOOST_CHECK_EQUAL(2, iter->values[0].cardinality);
+        }
+        else {
+            BOOST_CHECK_EQUAL(1, iter->hits);
+            BOOST_CHECK_EQUAL(1, iter->values[0].cardinality);
+        }
+    }
+
+    // found without being written since the restart
+    mtn::index_t* index = NULL;
+    BOOST_REQUIRE(context.get_index(1, bucket, visits, &index));
+    mtn::index_t::iterator slice = index->find(6);
+    BOOST_REQUIRE(slice != index->end());
+    BOOST_CHECK(slice->second->bit(42));
+    BOOST_CHECK(slice->second->bit(2048));
+
+    BOOST_REQUIRE(context.get_index(1, bucket, country, &index));
+    BOOST_CHECK(index->find(1) != index->end());
+}
+
+BOOST_AUTO_TEST_CASE(test_create_without_read)
+{
+    auto_snapshot_t snapshot;
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+
+    size_t reads = 0;
+    {
+        mtn::context_t context(new counting_reader_writer_t(reads));
+        context.set_opt(MTN_OPT_CATALOG, "1", 1);
+        context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+        BOOST_CHECK(context.init());
+
+        // a new index has nothing stored to read
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+        BOOST_CHECK_EQUAL(0, reads);
+    }
+
+    mtn::context_t context(new counting_reader_writer_t(reads));
+    context.set_opt(MTN_OPT_CATALOG, "1", 1);
+    context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+    BOOST_CHECK(context.init());
+
+    // a cataloged one is read the first time it's used
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 43, true));
+    BOOST_CHECK_EQUAL(1, reads);
+
+    mtn::index_t* index = NULL;
+    BOOST_REQUIRE(context.get_index(1, bucket, visits, &index));
+    BOOST_CHECK(index->find(6)->second->bit(42));
+    BOOST_CHECK(index->find(6)->second->bit(43));
+}
+
+// fails every catalog write after the first
+struct failing_catalog_reader_writer_t :
+        public mtn::index_reader_writer_memory_t
+{
+    failing_catalog_reader_writer_t() :
+        writes(0)
+    {}
+
+    mtn::status_t
+    write_catalog(const mtn::catalog_entry_t& entry)
+    {
+        if (writes++ > 0) {
+            return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "catalog write failed");
+        }
+        return mtn::index_reader_writer_memory_t::write_catalog(entry);
+    }
+
+    size_t writes;
+};
+
+BOOST_AUTO_TEST_CASE(test_compact_saves)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+
+    mtn::context_t context(new mtn::index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_CATALOG, "1", 1);
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+
+    // a new index is cataloged without values
+    mtn::catalog_t::entries_t entries;
+    BOOST_CHECK(context.index_reader_writer().read_catalog(entries));
+    BOOST_REQUIRE_EQUAL(1, entries.size());
+    BOOST_CHECK(entries[0].values.empty());
+
+    BOOST_CHECK(context.compact(NULL));
+    entries.clear();
+    BOOST_CHECK(context.index_reader_writer().read_catalog(entries));
+    BOOST_REQUIRE_EQUAL(1, entries.size());
+    BOOST_REQUIRE_EQUAL(1, entries[0].values.size());
+    BOOST_CHECK_EQUAL(1, entries[0].values[0].cardinality);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_save_error)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+
+    mtn::context_t context(new failing_catalog_reader_writer_t());
+    context.set_opt(MTN_OPT_CATALOG, "1", 1);
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+
+    mtn::status_t status = context.compact(NULL);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_INDEX_OPERATION, status.code);
+}
+
+BOOST_AUTO_TEST_CASE(test_load_unlocked)
+{
+    auto_snapshot_t snapshot;
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_memory_t());
+        context.set_opt(MTN_OPT_CATALOG, "1", 1);
+        context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+        BOOST_CHECK(context.init());
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+        BOOST_CHECK(context.index_value(1, bucket, country, 1, 42, true));
+    }
+
+    blocking_reader_writer_t* rw = new blocking_reader_writer_t();
+    mtn::context_t context(rw);
+    context.set_opt(MTN_OPT_CATALOG, "1", 1);
+    context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::index_t* loaded = NULL;
+    BOOST_REQUIRE(context.get_index(1, bucket, country, &loaded));
+
+    rw->released = false;
+    rw->reading = false;
+    mtn::index_t* first = NULL;
+    mtn::index_t* second = NULL;
+    boost::thread first_thread(get_index_task_t(context, bucket, visits, &first));
+    {
+        boost::mutex::scoped_lock lock(rw->mutex);
+        while (!rw->reading) {
+            rw->condition.wait(lock);
+        }
+    }
+
+    // the read of visits doesn't hold up a loaded index, or a second
+    // read of visits
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.get_index(1, bucket, country, &index));
+    BOOST_CHECK_EQUAL(loaded, index);
+    boost::thread second_thread(get_index_task_t(context, bucket, visits, &second));
+
+    {
+        boost::mutex::scoped_lock lock(rw->mutex);
+        rw->released = true;
+        rw->condition.notify_all();
+    }
+    first_thread.join();
+    second_thread.join();
+
+    // both reads end up with the one index kept by the context
+    BOOST_REQUIRE(first);
+    BOOST_CHECK_EQUAL(first, second);
+    BOOST_CHECK(context.get_index(1, bucket, visits, &index));
+    BOOST_CHECK_EQUAL(first, index);
+    BOOST_CHECK(first->find(6)->second->bit(42));
+}
+
+BOOST_AUTO_TEST_CASE(test_disabled)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+
+    mtn::context_t context(new mtn::index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+
+    mtn::catalog_t::entries_t entries;
+    BOOST_CHECK(context.index_reader_writer().read_catalog(entries));
+    BOOST_CHECK(entries.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <boost/test/unit_test.hpp>
+
+#include "context.hpp"
+#include "fixtures.hpp"
+#include "prepared_query.hpp"
+
+BOOST_AUTO_TEST_SUITE(_drop)
+
+BOOST_AUTO_TEST_CASE(test_drop_partition)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+    std::vector<mtn::byte_t> region = to_vector("region");
+    std::string us("US");
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_ROW_DICTIONARY, "1", 1);
+    context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+    BOOST_CHECK(context.init());
+
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+    BOOST_CHECK(context.index_value_string(1, bucket, country, us.begin(), us.end(), 42, true));
+    BOOST_CHECK(context.index_value(2, bucket, region, 6, 43, true));
+
+    BOOST_CHECK(context.drop_partition(1));
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(!context.get_index(1, bucket, visits, &index));
+
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    mtn::index_slice_t slice;
+    BOOST_CHECK(rw.read_index_slice(1, bucket, visits, 6, slice));
+    BOOST_CHECK_EQUAL(0, slice.size());
+
+    mtn::value_dictionary_t dictionary;
+    BOOST_CHECK(rw.read_value_dictionary(1, bucket, country, dictionary));
+    BOOST_CHECK_EQUAL(0, dictionary.size());
+
+    mtn::forward_index_t::entries_t values;
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_CHECK(values.empty());
+
+    // other partitions keep their indexes, partition 1 can be written again
+    BOOST_CHECK(context.get_index(2, bucket, region, &index));
+    BOOST_CHECK(index->find(6) != index->end());
+    BOOST_CHECK(context.index_value(1, bucket, visits, 7, 44, true));
+    BOOST_CHECK(context.get_index(1, bucket, visits, &index));
+    BOOST_CHECK(index->find(6) == index->end());
+    BOOST_CHECK(index->find(7) != index->end());
+}
+
+BOOST_AUTO_TEST_CASE(test_drop_fields)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> may = to_vector("visit_2013_05");
+    std::vector<mtn::byte_t> june = to_vector("visit_2013_06");
+    std::vector<mtn::byte_t> total = to_vector("visits");
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+
+    BOOST_CHECK(context.index_value(1, bucket, may, 6, 42, true));
+    BOOST_CHECK(context.index_value(1, bucket, june, 6, 42, true));
+    BOOST_CHECK(context.index_value(1, bucket, total, 6, 42, true));
+
+    BOOST_CHECK(context.drop_fields(1, bucket, to_vector("visit_2013_05")));
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(!context.get_index(1, bucket, may, &index));
+    BOOST_CHECK(context.get_index(1, bucket, june, &index));
+    BOOST_CHECK(context.get_index(1, bucket, total, &index));
+
+    mtn::index_slice_t slice;
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, may, 6, slice));
+    BOOST_CHECK_EQUAL(0, slice.size());
+
+    // an empty prefix isn't a way to drop the whole bucket
+    BOOST_CHECK(!context.drop_fields(1, bucket, std::vector<mtn::byte_t>()));
+    BOOST_CHECK(context.get_index(1, bucket, june, &index));
+
+    // a prefix shared by fields of different lengths
+    BOOST_CHECK(context.drop_fields(1, bucket, to_vector("visit")));
+    BOOST_CHECK(!context.get_index(1, bucket, june, &index));
+    BOOST_CHECK(!context.get_index(1, bucket, total, &index));
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, total, 6, slice));
+    BOOST_CHECK_EQUAL(0, slice.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_prepared_after_drop)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+    std::string us("US");
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+    BOOST_CHECK(context.index_value_string(1, bucket, country, us.begin(), us.end(), 42, true));
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_REQUIRE(mtn::prepared_query_t::prepare(1, context, bucket, "(and (slice \"visits\" (param 0)) (slice \"country\" (value \"US\")))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::range_t six(6, 7);
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(&six, 1, result));
+    BOOST_CHECK(result.bit(42));
+
+    // the plan's indexes are gone with the partition and read as empty
+    BOOST_CHECK(context.drop_partition(1));
+    result.clear();
+    BOOST_CHECK(prepared->execute(&six, 1, result));
+    BOOST_CHECK_EQUAL(0, result.size());
+
+    // and resolved again once they're written
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 43, true));
+    BOOST_CHECK(context.index_value_string(1, bucket, country, us.begin(), us.end(), 43, true));
+    result.clear();
+    BOOST_CHECK(prepared->execute(&six, 1, result));
+    BOOST_CHECK(!result.bit(42));
+    BOOST_CHECK(result.bit(43));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
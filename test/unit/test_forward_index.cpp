@@ -0,0 +1,193 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "context.hpp"
+#include "fixtures.hpp"
+#include "forward_index.hpp"
+
+BOOST_AUTO_TEST_SUITE(_forward_index)
+
+struct write_task_t
+{
+    write_task_t(
+        mtn::context_t&                 context,
+        const std::vector<mtn::byte_t>& bucket,
+        mtn::byte_t                     field) :
+        context(&context),
+        bucket(bucket),
+        field(1, field)
+    {}
+
+    void
+    operator()()
+    {
+        for (mtn_index_address_t row = 0; row < 200; ++row) {
+            context->index_value(1, bucket, field, 7, row, true);
+        }
+    }
+
+    mtn::context_t*          context;
+    std::vector<mtn::byte_t> bucket;
+    std::vector<mtn::byte_t> field;
+};
+
+// a backend that fails every bit write
+class read_only_reader_writer_t :
+    public index_reader_writer_memory_t
+{
+public:
+
+    mtn::status_t
+    write_bit(mtn_index_partition_t,
+              const std::vector<mtn::byte_t>&,
+              const std::vector<mtn::byte_t>&,
+              mtn_index_address_t,
+              mtn_index_address_t,
+              uint16_t,
+              bool,
+              mtn::index_segment_ptr)
+    {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "read only");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_encode_decode)
+{
+    std::string country("country");
+    std::string visits("visits");
+
+    mtn::forward_index_t::entries_t entries;
+    entries.insert(mtn::forward_entry_t(country.begin(), country.end(), 3));
+    entries.insert(mtn::forward_entry_t(visits.begin(), visits.end(), ((mtn_index_address_t) 1) << 100));
+
+    std::vector<mtn::byte_t> record;
+    mtn::forward_index_t::encode(entries, record);
+    BOOST_CHECK_EQUAL(2 * (sizeof(uint16_t) + sizeof(mtn_index_address_t)) + country.size() + visits.size(), record.size());
+
+    mtn::forward_index_t::entries_t output;
+    BOOST_CHECK(mtn::forward_index_t::decode(record, output));
+    BOOST_CHECK(entries == output);
+
+    record.pop_back();
+    output.clear();
+    BOOST_CHECK(!mtn::forward_index_t::decode(record, output));
+}
+
+BOOST_AUTO_TEST_CASE(test_row_values)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+    BOOST_CHECK(context.init());
+
+    std::string us("US");
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+    BOOST_CHECK(context.index_value(1, bucket, visits, 7, 42, true));
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 43, true));
+    BOOST_CHECK(context.index_value_string(1, bucket, country, us.begin(), us.end(), 42, true));
+
+    mtn::forward_index_t::entries_t values;
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_REQUIRE_EQUAL(3, values.size());
+
+    // ordered by field, then value
+    mtn::forward_index_t::entries_t::iterator iter = values.begin();
+    BOOST_CHECK(iter->field == country);
+    BOOST_CHECK(iter->value == 0);
+    ++iter;
+    BOOST_CHECK(iter->field == visits);
+    BOOST_CHECK(iter->value == 6);
+    ++iter;
+    BOOST_CHECK(iter->value == 7);
+
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, false));
+    values.clear();
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_CHECK_EQUAL(2, values.size());
+
+    values.clear();
+    BOOST_CHECK(context.row_values(1, bucket, 44, values));
+    BOOST_CHECK(values.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_failed_write)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+    std::vector<mtn::byte_t> path = to_vector("path");
+
+    mtn::context_t context(new read_only_reader_writer_t());
+    context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+    BOOST_CHECK(context.init());
+
+    // a value whose bit wasn't written isn't recorded for the row
+    std::string us("US");
+    std::string home("/home/index.html");
+    BOOST_CHECK(!context.index_value(1, bucket, visits, 6, 42, true));
+    BOOST_CHECK(!context.index_value_string(1, bucket, country, us.begin(), us.end(), 42, true));
+    BOOST_CHECK(!context.index_value_prefix(1, bucket, path, home.begin(), home.end(), 42, true));
+
+    mtn::forward_index_t::entries_t values;
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_CHECK(values.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_disabled)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+
+    mtn::forward_index_t::entries_t values;
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_CHECK(values.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_fields)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+    BOOST_CHECK(context.init());
+
+    // every field writes the same rows, none of them may lose a pair
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.create_thread(write_task_t(context, bucket, 'a' + i));
+    }
+    threads.join_all();
+
+    for (mtn_index_address_t row = 0; row < 200; ++row) {
+        mtn::forward_index_t::entries_t values;
+        BOOST_CHECK(context.row_values(1, bucket, row, values));
+        BOOST_CHECK_EQUAL(4, values.size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
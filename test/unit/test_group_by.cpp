@@ -0,0 +1,159 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "fixtures.hpp"
+#include "group_by.hpp"
+#include "index.hpp"
+
+BOOST_AUTO_TEST_SUITE(_group_by)
+
+struct top_k_task_t
+{
+    top_k_task_t(mtn::index_t&             index,
+                 const mtn::index_slice_t& filter,
+                 mtn::group_result_t&      output) :
+        index(&index),
+        filter(&filter),
+        output(&output)
+    {}
+
+    void
+    operator()()
+    {
+        for (int i = 0; i < 50; ++i) {
+            output->clear();
+            mtn::top_k(*index, *filter, 5, *output);
+        }
+    }
+
+    mtn::index_t*             index;
+    const mtn::index_slice_t* filter;
+    mtn::group_result_t*      output;
+};
+
+BOOST_AUTO_TEST_CASE(test_order)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>());
+    index.index_value(reader_writer, 3, 1, true);
+    index.index_value(reader_writer, 1, 2, true);
+    index.index_value(reader_writer, 1, 3, true);
+    index.index_value(reader_writer, 2, 4, true);
+    index.index_value(reader_writer, 2, 5, true);
+    index.index_value(reader_writer, 4, 4096, true);
+
+    mtn::index_slice_t filter;
+    for (int i = 1; i <= 5; ++i) {
+        filter.bit(reader_writer, i, true);
+    }
+
+    mtn::group_result_t output;
+    mtn::group_by(index, filter, false, output);
+    BOOST_CHECK_EQUAL(3, output.size());
+    BOOST_CHECK(1 == output[0].first);
+    BOOST_CHECK(2 == output[1].first);
+    BOOST_CHECK(3 == output[2].first);
+    BOOST_CHECK_EQUAL(2, output[0].second);
+    BOOST_CHECK_EQUAL(2, output[1].second);
+    BOOST_CHECK_EQUAL(1, output[2].second);
+
+    output.clear();
+    mtn::group_by(index, filter, true, output);
+    BOOST_CHECK_EQUAL(3, output.size());
+    BOOST_CHECK(3 == output[0].first);
+    BOOST_CHECK(1 == output[1].first);
+    BOOST_CHECK(2 == output[2].first);
+}
+
+BOOST_AUTO_TEST_CASE(test_top_k)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>());
+    mtn::index_slice_t filter;
+
+    // value v holds rows [0, v * 10), every third row matches the filter
+    for (int value = 1; value <= 20; ++value) {
+        for (int row = 0; row < value * 10; ++row) {
+            index.index_value(reader_writer, value, row * 1000, true);
+        }
+    }
+    for (int row = 0; row < 200; row += 3) {
+        filter.bit(reader_writer, row * 1000, true);
+    }
+
+    mtn::group_result_t all;
+    mtn::group_by(index, filter, false, all);
+
+    mtn::group_result_t top;
+    mtn::top_k(index, filter, 5, top);
+    BOOST_CHECK_EQUAL(5, top.size());
+    for (size_t i = 0; i < top.size(); ++i) {
+        BOOST_CHECK(all[i].first == top[i].first);
+        BOOST_CHECK_EQUAL(all[i].second, top[i].second);
+    }
+
+    top.clear();
+    mtn::top_k(index, filter, 100, top);
+    BOOST_CHECK_EQUAL(all.size(), top.size());
+
+    top.clear();
+    mtn::top_k(index, filter, 0, top);
+    BOOST_CHECK(top.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_top_k_concurrent)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>());
+    mtn::index_slice_t filter;
+
+    for (int value = 1; value <= 50; ++value) {
+        for (int row = 0; row < value; ++row) {
+            index.index_value(reader_writer, value, row * 1000, true);
+        }
+    }
+    for (int row = 0; row < 50; row += 2) {
+        filter.bit(reader_writer, row * 1000, true);
+    }
+
+    mtn::group_result_t expected;
+    mtn::group_by(index, filter, false, expected);
+    expected.resize(5);
+
+    // the cardinality bounds are cached by whichever query gets there first
+    std::vector<mtn::group_result_t> results(4);
+    boost::thread_group threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.create_thread(top_k_task_t(index, filter, results[i]));
+    }
+    threads.join_all();
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(expected.size(), results[i].size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            BOOST_CHECK(expected[j].first == results[i][j].first);
+            BOOST_CHECK_EQUAL(expected[j].second, results[i][j].second);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
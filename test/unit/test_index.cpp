@@ -18,6 +18,8 @@
 */
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include "context.hpp"
 #include "fixtures.hpp"
 #include "index.hpp"
 #include "range.hpp"
@@ -74,6 +76,36 @@ BOOST_AUTO_TEST_CASE(index_slice_norange)
     BOOST_CHECK(3 == o.begin()->segment[0]);
 }
 
+// a backend that fails every bit write
+class read_only_reader_writer_t :
+    public index_reader_writer_memory_t
+{
+public:
+
+    mtn::status_t
+    write_bit(mtn_index_partition_t,
+              const std::vector<mtn::byte_t>&,
+              const std::vector<mtn::byte_t>&,
+              mtn_index_address_t,
+              mtn_index_address_t,
+              uint16_t,
+              bool,
+              mtn::index_segment_ptr)
+    {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "read only");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(index_value_write_error)
+{
+    read_only_reader_writer_t reader_writer;
+
+    mtn::index_t index(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6);
+    mtn::status_t status = index.index_value(reader_writer, 1, 2048, true);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_INDEX_OPERATION, status.code);
+}
+
 BOOST_AUTO_TEST_CASE(index_slice_single_range)
 {
     index_reader_writer_memory_t reader_writer;
@@ -114,6 +146,88 @@ BOOST_AUTO_TEST_CASE(index_slice_multiple_ranges)
     BOOST_CHECK(3 == o.begin()->segment[0]);
 }
 
+BOOST_AUTO_TEST_CASE(index_cardinality)
+{
+    index_reader_writer_memory_t reader_writer;
+
+    mtn::index_t index(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6);
+    index.index_value(reader_writer, 1, 1, true);
+    index.index_value(reader_writer, 1, 4096, true);
+    BOOST_CHECK_EQUAL(2, index.cardinality(index.find(1)));
+
+    // writes invalidate the cached value
+    index.index_value(reader_writer, 1, 2, true);
+    BOOST_CHECK_EQUAL(3, index.cardinality(index.find(1)));
+}
+
+BOOST_AUTO_TEST_CASE(index_compact)
+{
+    index_reader_writer_memory_t reader_writer;
+
+    mtn::index_t index(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6);
+    index.index_value(reader_writer, 1, 1, true);
+    index.index_value(reader_writer, 1, 1, false);
+    index.index_value(reader_writer, 2, 1, true);
+    index.index_value(reader_writer, 2, 4096, true);
+    index.index_value(reader_writer, 2, 4096, false);
+
+    uint64_t reclaimed = 0;
+    BOOST_CHECK(index.compact(reader_writer, reclaimed));
+    BOOST_CHECK_EQUAL(2 * MTN_INDEX_SEGMENT_SIZE, reclaimed);
+    BOOST_CHECK(index.find(1) == index.end());
+    BOOST_REQUIRE(index.find(2) != index.end());
+    BOOST_CHECK_EQUAL(1, index.find(2)->second->size());
+    BOOST_CHECK_EQUAL(1, index.cardinality(index.find(2)));
+}
+
+BOOST_AUTO_TEST_CASE(index_compact_clears)
+{
+    std::vector<mtn::byte_t> bucket(7, 'b');
+    std::vector<mtn::byte_t> field(6, 'f');
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_COMPACT_CLEARS, "2", 1);
+    BOOST_CHECK(context.init());
+
+    BOOST_CHECK(context.index_value(1, bucket, field, 6, 1, true));
+    BOOST_CHECK(context.index_value(1, bucket, field, 7, 1, true));
+    BOOST_CHECK(context.index_value(1, bucket, field, 6, 1, false));
+    BOOST_CHECK_EQUAL(0, context.reclaimed());
+
+    // the second clear compacts both, in the background
+    BOOST_CHECK(context.index_value(1, bucket, field, 7, 1, false));
+    for (int i = 0; i < 100 && context.reclaimed() == 0; ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    BOOST_CHECK_EQUAL(2 * MTN_INDEX_SEGMENT_SIZE, context.reclaimed());
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.get_index(1, bucket, field, &index));
+    BOOST_CHECK(index->begin() == index->end());
+
+    uint64_t reclaimed = 1;
+    BOOST_CHECK(context.compact(&reclaimed));
+    BOOST_CHECK_EQUAL(0, reclaimed);
+}
+
+BOOST_AUTO_TEST_CASE(index_reserved_partition)
+{
+    std::vector<mtn::byte_t> bucket(7, 'b');
+    std::vector<mtn::byte_t> field(6, 'f');
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+
+    mtn::status_t status = context.index_value(MTN_DICTIONARY_PARTITION, bucket, field, 6, 1, true);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_BAD_PARAM, status.code);
+
+    mtn::index_t* index = NULL;
+    status = context.create_index(MTN_DICTIONARY_PARTITION, bucket, field, &index);
+    BOOST_CHECK(!status);
+    BOOST_CHECK(!index);
+}
+
 // BOOST_AUTO_TEST_CASE(index_index_hash)
 // {
 //     index_reader_writer_memory_t reader_writer;
@@ -24,6 +24,7 @@
 
 #include "fixtures.hpp"
 #include "context.hpp"
+#include "encode.hpp"
 #include "index_reader_writer_leveldb.hpp"
 
 
@@ -107,6 +108,46 @@ BOOST_AUTO_TEST_CASE(index_field)
     BOOST_CHECK(std::equal(index->field().begin(), index->field().end(), field.begin()));
 }
 
+BOOST_AUTO_TEST_CASE(index_field_neighbours)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+    mtn::byte_t other_name_array[] = "aaaaaa";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+    std::vector<mtn::byte_t> other(other_name_array, other_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+    BOOST_CHECK(context.index_reader_writer().write_segment(1, bucket, other, 2, 0, segment));
+    BOOST_CHECK(context.index_reader_writer().write_segment(1, bucket, field, 3, 0, segment));
+
+    // only the field asked for, not the fields after it
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.index_reader_writer().read_index(1, bucket, other, &index));
+    BOOST_REQUIRE(NULL != index);
+    BOOST_CHECK(index->field() == other);
+    BOOST_CHECK(index->find(2) != index->end());
+    BOOST_CHECK(index->find(3) == index->end());
+    delete index;
+
+    std::vector<mtn::byte_t> missing(other_name_array, other_name_array + 5);
+    missing.push_back('b');
+    index = NULL;
+    BOOST_CHECK(context.index_reader_writer().read_index(1, bucket, missing, &index));
+    BOOST_REQUIRE(NULL != index);
+    BOOST_CHECK(index->field() == missing);
+    BOOST_CHECK(index->begin() == index->end());
+    delete index;
+}
+
 BOOST_AUTO_TEST_CASE(read_write_segment)
 {
     auto_path_t path;
@@ -241,4 +282,437 @@ BOOST_AUTO_TEST_CASE(slice_set_bit_larger_user)
     BOOST_CHECK(slice_two.bit(4096));
 }
 
+BOOST_AUTO_TEST_CASE(delta_log)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 1, true, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 65, true, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 66, true, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 66, false, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 1, 0, true, segment));
+
+    // deltas are applied by scans without a segment to start from
+    mtn::index_slice_t slice_one;
+    BOOST_CHECK(rw.read_index_slice(1, bucket, field, 2, slice_one));
+    BOOST_CHECK_EQUAL(2, slice_one.size());
+    BOOST_CHECK(slice_one.bit(1));
+    BOOST_CHECK(slice_one.bit(65));
+    BOOST_CHECK(!slice_one.bit(66));
+    BOOST_CHECK(slice_one.bit(2048));
+
+    // reading the segment folds its deltas
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(2, segment[0]);
+    BOOST_CHECK_EQUAL(2, segment[1]);
+
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 1, false, segment));
+    mtn::index_slice_t slice_two;
+    BOOST_CHECK(rw.read_index_slice(1, bucket, field, 2, slice_two));
+    BOOST_CHECK_EQUAL(2, slice_two.size());
+    BOOST_CHECK(!slice_two.bit(1));
+    BOOST_CHECK(slice_two.bit(65));
+
+    // a whole segment replaces the deltas before it
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(0, segment[0]);
+    BOOST_CHECK_EQUAL(0, segment[1]);
+}
+
+BOOST_AUTO_TEST_CASE(fold_deltas)
+{
+    auto_path_t path;
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+    std::vector<mtn::byte_t> other(field_name_array, field_name_array + 3);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    segment[0] = 1;
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+        context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+        context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+        BOOST_CHECK(context.init());
+
+        mtn::index_reader_writer_t& rw = context.index_reader_writer();
+        BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+        BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 65, true, segment));
+        BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 1, 0, true, segment));
+        BOOST_CHECK(rw.write_bit(1, bucket, field, 3, 0, 2, true, segment));
+        BOOST_CHECK(rw.write_bit(1, bucket, other, 2, 0, 3, true, segment));
+
+        // folds deltas that were never read back, only those of the index
+        BOOST_CHECK(rw.fold_deltas(1, bucket, field));
+    }
+
+    // without the delta log only the segments themselves are read
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(1, segment[0]);
+    BOOST_CHECK_EQUAL(2, segment[1]);
+
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 1, segment));
+    BOOST_CHECK_EQUAL(1, segment[0]);
+
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 3, 0, segment));
+    BOOST_CHECK_EQUAL(4, segment[0]);
+
+    // the other field's delta was left in the log
+    BOOST_CHECK(rw.read_segment(1, bucket, other, 2, 0, segment));
+    BOOST_CHECK_EQUAL(0, segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(read_segments)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    segment[0] = 8;
+
+    // keys of other offsets lie between the ones read
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 1, segment));
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 2, segment));
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 5, 0, segment));
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 5, 1, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 5, 1, 0, true, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 9, 1, 1, true, segment));
+
+    std::vector<mtn_index_address_t> values;
+    values.push_back(2);
+    values.push_back(3);
+    values.push_back(5);
+    values.push_back(9);
+
+    mtn::index_segment_t output[4];
+    std::vector<mtn::index_segment_ptr> segments;
+    for (size_t i = 0; i < 4; ++i) {
+        memset(output[i], 0xFF, MTN_INDEX_SEGMENT_SIZE);
+        segments.push_back(output[i]);
+    }
+
+    BOOST_CHECK(rw.read_segments(1, bucket, field, values, 1, segments));
+    BOOST_CHECK_EQUAL(8, output[0][0]);
+    BOOST_CHECK_EQUAL(0, output[1][0]);
+    BOOST_CHECK_EQUAL(9, output[2][0]);
+    BOOST_CHECK_EQUAL(2, output[3][0]);
+    BOOST_CHECK_EQUAL(0, output[3][1]);
+}
+
+BOOST_AUTO_TEST_CASE(trigram_segments_read_together)
+{
+    auto_path_t path;
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+    std::string value = "foobar";
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+        context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+        BOOST_CHECK(context.init());
+        BOOST_CHECK(context.index_value_trigram(1, bucket, field, value.begin(), value.end(), 1, true));
+    }
+
+    // a fresh index has none of the segments, they're all read before
+    // the new row is set
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::index_t index(1, bucket, field);
+    BOOST_CHECK(index.index_value_trigram(context.index_reader_writer(), value.begin(), value.end(), 2, true));
+    BOOST_CHECK_EQUAL(4, index.size());
+    for (mtn::index_t::iterator iter = index.begin(); iter != index.end(); ++iter) {
+        BOOST_CHECK(iter->second->bit(1));
+        BOOST_CHECK(iter->second->bit(2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(delta_sequence_after_reopen)
+{
+    auto_path_t path;
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    for (int i = 0; i < 2; ++i) {
+        mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+        context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+        context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+        BOOST_CHECK(context.init());
+
+        // the clear written after reopening has to sort after the set
+        BOOST_CHECK(context.index_reader_writer().write_bit(1, bucket, field, 2, 0, 1, i == 0, segment));
+    }
+
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::index_slice_t slice;
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, field, 2, slice));
+    BOOST_CHECK(!slice.bit(1));
+}
+
+BOOST_AUTO_TEST_CASE(delete_segment)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 0, 1, false, segment));
+    BOOST_CHECK(rw.write_bit(1, bucket, field, 2, 1, 0, true, segment));
+
+    // the deltas go with the segment, the next segment stays
+    BOOST_CHECK(rw.delete_segment(1, bucket, field, 2, 0));
+    mtn::index_slice_t slice;
+    BOOST_CHECK(rw.read_index_slice(1, bucket, field, 2, slice));
+    BOOST_CHECK_EQUAL(1, slice.size());
+    BOOST_CHECK(slice.bit(2048));
+
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(0, segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(drop_partition_and_fields)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    const char* fields[] = { "visit_2013_05", "visit_2013_06", "visits" };
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    for (mtn_index_partition_t partition = 1; partition <= 2; ++partition) {
+        for (size_t f = 0; f < 3; ++f) {
+            std::vector<mtn::byte_t> field(fields[f], fields[f] + strlen(fields[f]));
+            BOOST_CHECK(rw.write_segment(partition, bucket, field, 2, 0, segment));
+            BOOST_CHECK(rw.write_value_dictionary(partition, bucket, field, 0, "US"));
+        }
+    }
+
+    std::vector<mtn::byte_t> may(fields[0], fields[0] + strlen(fields[0]));
+    std::vector<mtn::byte_t> june(fields[1], fields[1] + strlen(fields[1]));
+    std::vector<mtn::byte_t> total(fields[2], fields[2] + strlen(fields[2]));
+    BOOST_CHECK(rw.drop_fields(1, bucket, std::vector<mtn::byte_t>(may.begin(), may.end() - 1)));
+
+    mtn::index_reader_writer_t::index_container output;
+    BOOST_CHECK(rw.read_indexes(1, bucket, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_CHECK_EQUAL(1, output.size());
+    BOOST_CHECK(output.find(total) != output.end());
+
+    mtn::value_dictionary_t dictionary;
+    BOOST_CHECK(rw.read_value_dictionary(1, bucket, june, dictionary));
+    BOOST_CHECK_EQUAL(0, dictionary.size());
+    BOOST_CHECK(rw.read_value_dictionary(1, bucket, total, dictionary));
+    BOOST_CHECK_EQUAL(1, dictionary.size());
+
+    BOOST_CHECK(rw.drop_partition(1));
+    output.clear();
+    BOOST_CHECK(rw.read_indexes(1, bucket, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_CHECK(output.empty());
+
+    // partition 2 is untouched
+    BOOST_CHECK(rw.read_indexes(2, bucket, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_CHECK_EQUAL(3, output.size());
+
+    BOOST_CHECK(!rw.drop_partition(MTN_DICTIONARY_PARTITION));
+}
+
+BOOST_AUTO_TEST_CASE(tuned_options)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_LEVELDB_CACHE_SIZE, "1048576", 7);
+    context.set_opt(MTN_OPT_LEVELDB_BLOOM_BITS, "10", 2);
+    context.set_opt(MTN_OPT_LEVELDB_WRITE_BUFFER_SIZE, "65536", 5);
+    context.set_opt(MTN_OPT_LEVELDB_BLOCK_SIZE, "16384", 5);
+    context.set_opt(MTN_OPT_LEVELDB_COMPRESSION, "0", 1);
+    context.set_opt(MTN_OPT_LEVELDB_SCAN_FILL_CACHE, "0", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+    BOOST_CHECK(context.index_reader_writer().write_segment(1, bucket, field, 2, 0, segment));
+
+    // scans that skip the cache still see every segment
+    mtn::index_slice_t slice;
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, field, 2, slice));
+    BOOST_CHECK_EQUAL(1, slice.size());
+    BOOST_CHECK(slice.bit(2047));
+
+    // slices that were never written are filtered out
+    mtn::index_slice_t missing;
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, field, 3, missing));
+    BOOST_CHECK_EQUAL(0, missing.size());
+}
+
+BOOST_AUTO_TEST_CASE(snapshot)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    mtn::byte_t field_name_array[] = "foobar";
+
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    segment[0] = 1;
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+
+    std::auto_ptr<mtn::index_reader_writer_t> snapshot(rw.snapshot());
+    BOOST_REQUIRE(snapshot.get());
+
+    segment[0] = 2;
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 3, 0, segment));
+
+    // the snapshot still reads what was there when it was taken
+    BOOST_CHECK(snapshot->read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(1, segment[0]);
+
+    mtn::index_reader_writer_t::index_container output;
+    BOOST_CHECK(snapshot->read_indexes(1, bucket, field, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_REQUIRE_EQUAL(1, output.size());
+    BOOST_CHECK_EQUAL(1, output.begin()->second->size());
+
+    BOOST_CHECK(!snapshot->write_segment(1, bucket, field, 2, 0, segment));
+
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK_EQUAL(2, segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_read_indexes)
+{
+    auto_path_t path;
+    mtn::context_t context(new mtn::index_reader_writer_leveldb_t());
+
+    context.set_opt(MTN_OPT_DB_PATH, static_cast<const void*>(path.path.c_str()), path.path.size());
+    context.set_opt(MTN_OPT_DELTA_LOG, "1", 1);
+    context.set_opt(MTN_OPT_SCAN_THREADS, "4", 1);
+    BOOST_CHECK(context.init());
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::index_segment_t segment;
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    // enough segments and deltas that the scan is split in many ranges
+    mtn::index_reader_writer_t& rw = context.index_reader_writer();
+    const char* fields[] = { "alpha", "beta", "gamma" };
+    for (size_t f = 0; f < 3; ++f) {
+        std::vector<mtn::byte_t> field(fields[f], fields[f] + strlen(fields[f]));
+        for (mtn_index_address_t value = 0; value < 16; ++value) {
+            for (mtn_index_address_t offset = 0; offset < 16; ++offset) {
+                segment[0] = (uint64_t) (value * 16 + offset);
+                BOOST_CHECK(rw.write_segment(1, bucket, field, value, offset, segment));
+                BOOST_CHECK(rw.write_bit(1, bucket, field, value, offset, 64, true, segment));
+            }
+        }
+    }
+
+    mtn::index_reader_writer_t::index_container output;
+    BOOST_CHECK(rw.read_indexes(1, bucket, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_REQUIRE_EQUAL(3, output.size());
+
+    for (mtn::index_reader_writer_t::index_container::iterator index = output.begin(); index != output.end(); ++index) {
+        BOOST_REQUIRE_EQUAL(16, index->second->size());
+        for (mtn::index_t::iterator slice = index->second->begin(); slice != index->second->end(); ++slice) {
+            BOOST_REQUIRE_EQUAL(16, slice->second->size());
+
+            mtn_index_address_t offset = 0;
+            for (mtn::index_slice_t::iterator node = slice->second->begin(); node != slice->second->end(); ++node, ++offset) {
+                BOOST_CHECK(offset == node->offset);
+                BOOST_CHECK_EQUAL((uint64_t) (slice->first * 16 + offset), node->segment[0]);
+                BOOST_CHECK_EQUAL(1, node->segment[1]);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
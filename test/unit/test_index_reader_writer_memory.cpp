@@ -0,0 +1,202 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "context.hpp"
+#include "fixtures.hpp"
+#include "index_reader_writer_memory.hpp"
+#include "value_store.hpp"
+
+BOOST_AUTO_TEST_SUITE(_index_reader_writer_memory)
+
+struct auto_snapshot_t {
+
+    auto_snapshot_t() :
+        path("tmp/testsnapshot")
+    {
+        boost::filesystem::create_directories("tmp");
+        boost::filesystem::remove(path);
+    }
+
+    ~auto_snapshot_t()
+    {
+        boost::filesystem::remove(path);
+    }
+
+    std::string path;
+};
+
+BOOST_AUTO_TEST_CASE(read_write_segment)
+{
+    mtn::index_reader_writer_memory_t rw(4);
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> field = to_vector("foobar");
+
+    mtn::index_segment_t segment_one;
+    mtn::index_segment_t segment_two;
+    memset(segment_one, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+    memset(segment_two, 0, MTN_INDEX_SEGMENT_SIZE);
+
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 3, segment_one));
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 3, segment_two));
+    BOOST_CHECK_EQUAL(0, memcmp(segment_one, segment_two, MTN_INDEX_SEGMENT_SIZE));
+
+    // missing segments read as zeros
+    BOOST_CHECK(rw.read_segment(1, bucket, field, 2, 4, segment_two));
+    BOOST_CHECK_EQUAL(0, segment_two[0]);
+
+    uint64_t size = 0;
+    BOOST_CHECK(rw.estimateSize(1, bucket, field, 2, &size));
+    BOOST_CHECK_EQUAL(MTN_INDEX_SEGMENT_SIZE, size);
+}
+
+BOOST_AUTO_TEST_CASE(read_index_copies_slices)
+{
+    mtn::index_reader_writer_memory_t rw(4);
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> field = to_vector("foobar");
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(rw.read_index(1, bucket, field, &index));
+    std::auto_ptr<mtn::index_t> guard(index);
+    BOOST_REQUIRE_EQUAL(1, index->size());
+
+    // later writes to the backend don't reach the index read before them
+    memset(segment, 0, MTN_INDEX_SEGMENT_SIZE);
+    BOOST_CHECK(rw.write_segment(1, bucket, field, 2, 0, segment));
+    BOOST_CHECK(index->begin()->second->bit(0));
+
+    // and a slice left empty is gone from the backend
+    BOOST_CHECK(rw.delete_segment(1, bucket, field, 2, 0));
+    mtn::index_t* empty = NULL;
+    BOOST_CHECK(rw.read_index(1, bucket, field, &empty));
+    std::auto_ptr<mtn::index_t> empty_guard(empty);
+    BOOST_CHECK_EQUAL(0, empty->size());
+}
+
+BOOST_AUTO_TEST_CASE(read_indexes_across_shards)
+{
+    mtn::index_reader_writer_memory_t rw(4);
+    std::vector<mtn::byte_t> field = to_vector("foobar");
+
+    mtn::index_segment_t segment;
+    memset(segment, 0xFF, MTN_INDEX_SEGMENT_SIZE);
+
+    const char* buckets[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    for (size_t i = 0; i < 8; ++i) {
+        std::vector<mtn::byte_t> bucket = to_vector(buckets[i]);
+        BOOST_CHECK(rw.write_segment(1, bucket, field, i, 0, segment));
+    }
+    BOOST_CHECK(rw.write_segment(2, to_vector("a"), field, 100, 0, segment));
+
+    // every bucket of the partition lands in the one index of the field
+    mtn::index_reader_writer_t::index_container output;
+    BOOST_CHECK(rw.read_indexes(1, to_vector("a"), field, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>(), output));
+    BOOST_REQUIRE_EQUAL(1, output.size());
+    BOOST_CHECK_EQUAL(8, output.begin()->second->size());
+
+    output.clear();
+    BOOST_CHECK(rw.read_indexes(1, to_vector("b"), field, to_vector("c"), field, output));
+    BOOST_REQUIRE_EQUAL(1, output.size());
+    BOOST_CHECK_EQUAL(2, output.begin()->second->size());
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_round_trip)
+{
+    auto_snapshot_t snapshot;
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    std::vector<mtn::byte_t> visits = to_vector("visits");
+    std::vector<mtn::byte_t> country = to_vector("country");
+    std::vector<mtn::byte_t> name = to_vector("name");
+    std::string us("US");
+    std::string foobar("foobar");
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_memory_t());
+        context.set_opt(MTN_OPT_BACKEND, "memory", 6);
+        context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+        context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+        BOOST_CHECK(context.init());
+
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 42, true));
+        BOOST_CHECK(context.index_value(1, bucket, visits, 6, 2048, true));
+        BOOST_CHECK(context.index_value_string(1, bucket, country, us.begin(), us.end(), 42, true));
+        BOOST_CHECK(context.index_value_trigram(1, bucket, name, foobar.begin(), foobar.end(), 42, true));
+    }
+    BOOST_CHECK(boost::filesystem::exists(snapshot.path));
+
+    mtn::context_t context(new mtn::index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_FORWARD_INDEX, "1", 1);
+    context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+    BOOST_CHECK(context.init());
+
+    mtn::index_slice_t slice;
+    BOOST_CHECK(context.index_reader_writer().read_index_slice(1, bucket, visits, 6, slice));
+    BOOST_CHECK_EQUAL(2, slice.size());
+    BOOST_CHECK(slice.bit(42));
+    BOOST_CHECK(slice.bit(2048));
+
+    mtn::value_dictionary_t dictionary;
+    BOOST_CHECK(context.index_reader_writer().read_value_dictionary(1, bucket, country, dictionary));
+    mtn::value_dictionary_t::id_t id = 1;
+    BOOST_CHECK(dictionary.find(us, id));
+    BOOST_CHECK_EQUAL(0, id);
+
+    mtn::forward_index_t::entries_t values;
+    BOOST_CHECK(context.row_values(1, bucket, 42, values));
+    BOOST_CHECK_EQUAL(2, values.size());
+
+    // the stored trigram values come back with the snapshot
+    mtn::value_store_t::values_t stored;
+    BOOST_CHECK(mtn::value_store_t::find(context.index_reader_writer(), mtn::index_t(1, bucket, name), 42, stored));
+    BOOST_REQUIRE_EQUAL(1, stored.size());
+    BOOST_CHECK_EQUAL(foobar, stored.front());
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_not_overwritten)
+{
+    auto_snapshot_t snapshot;
+    {
+        std::ofstream stream(snapshot.path.c_str());
+        stream << "garbage";
+    }
+
+    {
+        mtn::context_t context(new mtn::index_reader_writer_memory_t());
+        context.set_opt(MTN_OPT_DB_PATH, snapshot.path.c_str(), snapshot.path.size());
+        BOOST_CHECK(!context.init());
+    }
+    BOOST_CHECK_EQUAL(7, boost::filesystem::file_size(snapshot.path));
+}
+
+BOOST_AUTO_TEST_CASE(unknown_backend)
+{
+    mtn::context_t context(new mtn::index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_BACKEND, "floppy", 6);
+    BOOST_CHECK(!context.init());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -104,6 +104,20 @@ BOOST_AUTO_TEST_CASE(slice_union_disjoint)
     BOOST_CHECK_EQUAL(0, memcmp((++o.begin())->segment, SEGMENT_EVERY_OTHER_ODD, MTN_INDEX_SEGMENT_SIZE));
 }
 
+BOOST_AUTO_TEST_CASE(slice_symmetric_difference)
+{
+    mtn::index_slice_t a(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 2);
+    mtn::index_slice_t b(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 3);
+    mtn::index_slice_t o(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 3);
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(0, SEGMENT_EVERY));
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(1, SEGMENT_EVERY_OTHER_EVEN));
+    b.insert(b.end(), new mtn::index_slice_t::index_node_t(0, SEGMENT_EVERY_OTHER_ODD));
+    BOOST_CHECK(mtn::index_slice_t::execute(mtn::MTN_INDEX_OP_SYMMETRIC_DIFFERENCE, a, b, o));
+    BOOST_CHECK_EQUAL(2, o.size());
+    BOOST_CHECK_EQUAL(0, memcmp(o.begin()->segment, SEGMENT_EVERY_OTHER_EVEN, MTN_INDEX_SEGMENT_SIZE));
+    BOOST_CHECK_EQUAL(0, memcmp((++o.begin())->segment, SEGMENT_EVERY_OTHER_EVEN, MTN_INDEX_SEGMENT_SIZE));
+}
+
 BOOST_AUTO_TEST_CASE(slice_intersection_joint_nomatch)
 {
     mtn::index_slice_t a(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 2);
@@ -211,6 +225,80 @@ BOOST_AUTO_TEST_CASE(slice_set_bit)
     BOOST_CHECK(1 == o.begin()->offset);
 }
 
+BOOST_AUTO_TEST_CASE(slice_clear_bit_neighbours)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_slice_t o(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 2);
+
+    o.bit(reader_writer, 2048, true);
+    o.bit(reader_writer, 2049, true);
+    o.bit(reader_writer, 2111, true);
+    o.bit(reader_writer, 2049, false);
+    BOOST_CHECK(o.bit(2048));
+    BOOST_CHECK(!o.bit(2049));
+    BOOST_CHECK(o.bit(2111));
+    BOOST_CHECK_EQUAL(2, o.count());
+}
+
+BOOST_AUTO_TEST_CASE(slice_compact)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_slice_t o(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 2);
+
+    o.bit(reader_writer, 1, true);
+    o.bit(reader_writer, 2048, true);
+    o.bit(reader_writer, 2048, false);
+    BOOST_CHECK_EQUAL(2, o.size());
+
+    uint64_t reclaimed = 0;
+    BOOST_CHECK(o.compact(reader_writer, reclaimed));
+    BOOST_CHECK_EQUAL(MTN_INDEX_SEGMENT_SIZE, reclaimed);
+    BOOST_CHECK_EQUAL(1, o.size());
+    BOOST_CHECK(0 == o.begin()->offset);
+    BOOST_CHECK(o.bit(1));
+
+    // gone from the store as well
+    mtn::index_slice_t stored;
+    BOOST_CHECK(reader_writer.read_index_slice(1, o.bucket(), o.field(), 2, stored));
+    BOOST_CHECK_EQUAL(1, stored.size());
+
+    reclaimed = 0;
+    BOOST_CHECK(o.compact(reader_writer, reclaimed));
+    BOOST_CHECK_EQUAL(0, reclaimed);
+}
+
+// fails every segment delete
+class undeletable_reader_writer_t :
+    public index_reader_writer_memory_t
+{
+public:
+
+    mtn::status_t
+    delete_segment(mtn_index_partition_t,
+                   const std::vector<mtn::byte_t>&,
+                   const std::vector<mtn::byte_t>&,
+                   mtn_index_address_t,
+                   mtn_index_address_t)
+    {
+        return mtn::status_t(MTN_ERROR_INDEX_OPERATION, "delete failed");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(slice_compact_delete_error)
+{
+    undeletable_reader_writer_t reader_writer;
+    mtn::index_slice_t o(1, reinterpret_cast<const mtn::byte_t*>("bizbang"), 7, reinterpret_cast<const mtn::byte_t*>("foobar"), 6, 2);
+
+    o.bit(reader_writer, 2048, true);
+    o.bit(reader_writer, 2048, false);
+
+    // the empty segment is kept for the next compaction to retry
+    uint64_t reclaimed = 0;
+    BOOST_CHECK(!o.compact(reader_writer, reclaimed));
+    BOOST_CHECK_EQUAL(0, reclaimed);
+    BOOST_CHECK_EQUAL(1, o.size());
+}
+
 BOOST_AUTO_TEST_CASE(slice_check_bit_32)
 {
     index_reader_writer_memory_t reader_writer;
@@ -231,4 +319,50 @@ BOOST_AUTO_TEST_CASE(slice_set_bit_32)
     BOOST_CHECK(o.bit(32));
 }
 
+BOOST_AUTO_TEST_CASE(slice_count)
+{
+    mtn::index_slice_t a;
+    BOOST_CHECK_EQUAL(0, a.count());
+
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(1, SEGMENT_ONE));
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(2, SEGMENT_EVERY_OTHER_EVEN));
+    BOOST_CHECK_EQUAL(1 + 16 * 64, a.count());
+}
+
+BOOST_AUTO_TEST_CASE(slice_rows_from)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_slice_t a;
+    a.bit(reader_writer, 1, true);
+    a.bit(reader_writer, 64, true);
+    a.bit(reader_writer, 2048, true);
+    a.bit(reader_writer, 5000, true);
+
+    mtn_index_address_t rows[2];
+    BOOST_CHECK_EQUAL(2, a.rows(0, rows, 2));
+    BOOST_CHECK(rows[0] == 1);
+    BOOST_CHECK(rows[1] == 64);
+
+    // page on from just past the last row
+    BOOST_CHECK_EQUAL(2, a.rows(rows[1] + 1, rows, 2));
+    BOOST_CHECK(rows[0] == 2048);
+    BOOST_CHECK(rows[1] == 5000);
+    BOOST_CHECK_EQUAL(0, a.rows(5001, rows, 2));
+}
+
+BOOST_AUTO_TEST_CASE(slice_intersection_count)
+{
+    mtn::index_slice_t a;
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(1, SEGMENT_EVERY));
+    a.insert(a.end(), new mtn::index_slice_t::index_node_t(2, SEGMENT_EVERY_OTHER_EVEN));
+
+    mtn::index_slice_t b;
+    b.insert(b.end(), new mtn::index_slice_t::index_node_t(2, SEGMENT_EVERY));
+    b.insert(b.end(), new mtn::index_slice_t::index_node_t(3, SEGMENT_EVERY));
+
+    BOOST_CHECK_EQUAL(16 * 64, mtn::index_slice_t::intersection_count(a, b));
+    BOOST_CHECK_EQUAL(16 * 64, mtn::index_slice_t::intersection_count(b, a));
+    BOOST_CHECK_EQUAL(0, mtn::index_slice_t::intersection_count(a, mtn::index_slice_t()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -141,4 +141,175 @@ BOOST_AUTO_TEST_CASE(test_slice_regex_partial_trigram)
 }
 
 
+BOOST_AUTO_TEST_CASE(test_slice_regex_verify)
+{
+    std::string input = "(slice \"foobar\" (regex \"foo.*bar\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr query;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, query));
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    // both values contain every trigram of the pattern, only one matches
+    std::string match = "foobar";
+    std::string miss = "barfoo";
+    context.index_value_trigram(1, bucket, field, match.begin(), match.end(), 1, true);
+    context.index_value_trigram(1, bucket, field, miss.begin(), miss.end(), 2, true);
+
+    mtn::naive_query_planner_t planner(1, context, bucket);
+    mtn::index_slice_t result = boost::apply_visitor(planner, query);
+    BOOST_CHECK(planner.status());
+    BOOST_CHECK_EQUAL(1, result.size());
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(!result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_and)
+{
+    std::string input = "(and (slice \"foobar\" (range 1 2)) (slice \"bizbang\" (range 1 2)))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr query;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, query));
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_one_array[] = "foobar";
+    std::vector<mtn::byte_t> field_one(field_one_array, field_one_array + 6);
+
+    mtn::byte_t field_two_array[] = "bizbang";
+    std::vector<mtn::byte_t> field_two(field_two_array, field_two_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, field_one, 1, 1, true);
+    context.index_value(1, bucket, field_one, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 3, true);
+
+    mtn::naive_query_planner_t planner(1, context, bucket);
+    mtn::index_slice_t result = boost::apply_visitor(planner, query);
+    BOOST_CHECK(planner.status());
+    BOOST_CHECK_EQUAL(1, result.count());
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_prefix)
+{
+    std::string input = "(or (prefix \"url\" \"/api/users/123/pr\") (prefix \"url\" \"/static/\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr query;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, query));
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "url";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 3);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    const char* urls[] = {"/api/users", "/static/app.js", "/api/users/123/orders", "/api/users/123/profile"};
+    for (size_t i = 0; i < 4; ++i) {
+        std::string url(urls[i]);
+        context.index_value_prefix(1, bucket, field, url.begin(), url.end(), i, true);
+    }
+
+    mtn::naive_query_planner_t planner(1, context, bucket);
+    mtn::index_slice_t result = boost::apply_visitor(planner, query);
+    BOOST_CHECK(planner.status());
+    BOOST_CHECK_EQUAL(2, result.count());
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_value)
+{
+    std::string input = "(or (value \"country\" \"DE\") (value \"country\" \"IT\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr query;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, query));
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "country";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    const char* countries[] = {"US", "DE", "US", "DE"};
+    for (size_t i = 0; i < 4; ++i) {
+        std::string country(countries[i]);
+        context.index_value_string(1, bucket, field, country.begin(), country.end(), i, true);
+    }
+
+    mtn::naive_query_planner_t planner(1, context, bucket);
+    mtn::index_slice_t result = boost::apply_visitor(planner, query);
+    BOOST_CHECK(planner.status());
+    BOOST_CHECK_EQUAL(2, result.count());
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_group)
+{
+    std::string input = "(group \"country\" (slice \"foobar\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr query;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, query));
+
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::byte_t group_name_array[] = "country";
+    std::vector<mtn::byte_t> group(group_name_array, group_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    for (int i = 1; i <= 4; ++i) {
+        context.index_value(1, bucket, field, 1, i, true);
+    }
+    context.index_value(1, bucket, field, 1, 5000, true);
+    context.index_value(1, bucket, group, 10, 1, true);
+    context.index_value(1, bucket, group, 20, 2, true);
+    context.index_value(1, bucket, group, 20, 3, true);
+    context.index_value(1, bucket, group, 20, 5000, true);
+    context.index_value(1, bucket, group, 30, 6, true);
+
+    mtn::naive_query_planner_t planner(1, context, bucket);
+    mtn::index_slice_t result = boost::apply_visitor(planner, query);
+    BOOST_CHECK(planner.status());
+    BOOST_CHECK(result.bit(4));
+
+    const mtn::group_result_t& groups = planner.groups();
+    BOOST_CHECK_EQUAL(2, groups.size());
+    BOOST_CHECK(20 == groups[0].first);
+    BOOST_CHECK_EQUAL(3, groups[0].second);
+    BOOST_CHECK(10 == groups[1].first);
+    BOOST_CHECK_EQUAL(1, groups[1].second);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
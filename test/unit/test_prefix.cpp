@@ -0,0 +1,77 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+
+#include "prefix.hpp"
+
+BOOST_AUTO_TEST_SUITE(_prefix)
+
+static mtn_index_address_t
+key(const std::string& value)
+{
+    return mtn::prefix_t::to_key(value.begin(), value.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_key_order)
+{
+    BOOST_CHECK(key("") < key("a"));
+    BOOST_CHECK(key("a") < key("ab"));
+    BOOST_CHECK(key("ab") < key("b"));
+    BOOST_CHECK(key("abcdefghijklmnop") == key("abcdefghijklmnopq"));
+    BOOST_CHECK_EQUAL('a', (int) (key("a") >> 120));
+}
+
+BOOST_AUTO_TEST_CASE(test_range)
+{
+    mtn::prefix_t prefix("ab");
+    BOOST_CHECK(prefix.exact());
+
+    mtn::range_t range = prefix.to_range();
+    BOOST_CHECK(range.start == key("ab"));
+    BOOST_CHECK(range.start <= key("abzzz") && key("abzzz") < range.limit);
+    BOOST_CHECK(range.start <= key("ab\xff\xff") && key("ab\xff\xff") < range.limit);
+    BOOST_CHECK(!(key("ac") < range.limit));
+    BOOST_CHECK(key("aa") < range.start);
+}
+
+BOOST_AUTO_TEST_CASE(test_range_overflow)
+{
+    mtn::range_t range = mtn::prefix_t("\xff").to_range();
+    BOOST_CHECK(range.start < range.limit);
+    BOOST_CHECK(key("\xff\xfe") < range.limit);
+
+    range = mtn::prefix_t("").to_range();
+    BOOST_CHECK(range.start == 0);
+    BOOST_CHECK(key("zzz") < range.limit);
+}
+
+BOOST_AUTO_TEST_CASE(test_long)
+{
+    mtn::prefix_t prefix("abcdefghijklmnopq");
+    BOOST_CHECK(!prefix.exact());
+
+    mtn::range_t range = prefix.to_range();
+    BOOST_CHECK(range.start == key("abcdefghijklmnop"));
+    BOOST_CHECK(range.limit == range.start + 1);
+    BOOST_CHECK_EQUAL("^abcdefghijklmnopq", prefix.to_regex().pattern);
+    BOOST_CHECK_EQUAL("^a\\.b", mtn::prefix_t("a.b").to_regex().pattern);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,983 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "fixtures.hpp"
+#include "context.hpp"
+#include "prepared_query.hpp"
+
+BOOST_AUTO_TEST_SUITE(_prepared_query)
+
+// executes the same prepared query over and over, counting the
+// executions that failed
+struct repeat_task_t
+{
+    repeat_task_t(
+        mtn::prepared_query_t& query,
+        size_t&                failed) :
+        query(&query),
+        failed(&failed)
+    {}
+
+    void
+    operator()()
+    {
+        for (int i = 0; i < 200; ++i) {
+            mtn::index_slice_t result;
+            if (!query->execute(NULL, 0, result) || !result.bit(1)) {
+                ++*failed;
+            }
+        }
+    }
+
+    mtn::prepared_query_t* query;
+    size_t*                failed;
+};
+
+struct execute_task_t
+{
+    execute_task_t(
+        mtn::prepared_query_t& query,
+        mtn::index_slice_t&    output) :
+        query(&query),
+        output(&output)
+    {}
+
+    void
+    operator()()
+    {
+        query->execute(NULL, 0, *output);
+    }
+
+    mtn::prepared_query_t* query;
+    mtn::index_slice_t*    output;
+};
+
+BOOST_AUTO_TEST_CASE(test_slice)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, field, 1, 2, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\")", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK_EQUAL(0, prepared->param_count());
+    BOOST_CHECK(prepared->root()->index != NULL);
+
+    for (int i = 0; i < 2; ++i) {
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(NULL, 0, result));
+        BOOST_CHECK_EQUAL(1, result.size());
+        BOOST_CHECK(result.bit(2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_late_index_resolution)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\")", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(prepared->root()->index == NULL);
+
+    context.index_value(1, bucket, field, 1, 2, true);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(prepared->root()->index != NULL);
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_param)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, field, 1, 1, true);
+    context.index_value(1, bucket, field, 100, 2, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (param 0))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK_EQUAL(1, prepared->param_count());
+
+    {
+        mtn::index_slice_t result;
+        BOOST_CHECK(!prepared->execute(NULL, 0, result));
+    }
+
+    {
+        mtn::range_t param(100, 200);
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(&param, 1, result));
+        BOOST_CHECK(!result.bit(1));
+        BOOST_CHECK(result.bit(2));
+    }
+
+    {
+        mtn::range_t param(0, 2);
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(&param, 1, result));
+        BOOST_CHECK(result.bit(1));
+        BOOST_CHECK(!result.bit(2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_and)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_one_array[] = "foobar";
+    std::vector<mtn::byte_t> field_one(field_one_array, field_one_array + 6);
+
+    mtn::byte_t field_two_array[] = "bizbar";
+    std::vector<mtn::byte_t> field_two(field_two_array, field_two_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, field_one, 1, 1, true);
+    context.index_value(1, bucket, field_one, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 3, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(and (slice \"foobar\") (slice \"bizbar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(!result.bit(1));
+    BOOST_CHECK(result.bit(2));
+    BOOST_CHECK(!result.bit(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_xor_not)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_one_array[] = "foobar";
+    std::vector<mtn::byte_t> field_one(field_one_array, field_one_array + 6);
+
+    mtn::byte_t field_two_array[] = "bizbar";
+    std::vector<mtn::byte_t> field_two(field_two_array, field_two_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, field_one, 1, 1, true);
+    context.index_value(1, bucket, field_one, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 2, true);
+    context.index_value(1, bucket, field_two, 1, 3, true);
+    context.index_value(1, bucket, field_two, 1, 5000, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(xor (slice \"foobar\") (not (slice \"bizbar\")))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(2, result.size());
+    BOOST_CHECK(!result.bit(1));
+    BOOST_CHECK(result.bit(2));
+    BOOST_CHECK(!result.bit(3));
+    BOOST_CHECK(result.bit(4));
+    BOOST_CHECK(!result.bit(5000));
+}
+
+BOOST_AUTO_TEST_CASE(test_regex)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    std::string value = "foobar";
+    context.index_value_trigram(1, bucket, field, value.begin(), value.end(), 1, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foo.*\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(!prepared->root()->ranges.empty());
+    BOOST_CHECK_EQUAL(1, prepared->root()->regexes.size());
+    BOOST_CHECK_EQUAL(1, prepared->root()->compiled.size());
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(result.bit(1));
+}
+
+BOOST_AUTO_TEST_CASE(test_regex_unaligned)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    // every trigram of the value is indexed, not just those at multiples of three
+    std::string value = "xxfoobar";
+    context.index_value_trigram(1, bucket, field, value.begin(), value.end(), 1, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foob\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(result.bit(1));
+}
+
+BOOST_AUTO_TEST_CASE(test_regex_verify)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+
+    std::string match = "foobar";
+    std::string miss = "barfoo";
+    context.index_value_trigram(1, bucket, field, match.begin(), match.end(), 1, true);
+    context.index_value_trigram(1, bucket, field, miss.begin(), miss.end(), 2, true);
+    context.index_value_trigram(1, bucket, field, miss.begin(), miss.end(), 5000, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foo.*bar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(prepared->root()->verify);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(1, result.size());
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(!result.bit(2));
+
+    // a regex without any trigrams is checked against every row
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"^ba\"))", &prepared));
+    guard.reset(prepared);
+    BOOST_CHECK(prepared->root()->ranges.empty());
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(2, result.count());
+    BOOST_CHECK(result.bit(2));
+    BOOST_CHECK(result.bit(5000));
+}
+
+BOOST_AUTO_TEST_CASE(test_regex_trigram_tree)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+
+    std::string both = "foobar";
+    std::string foo = "fooxyz";
+    std::string bar = "xyzbar";
+    context.index_value_trigram(1, bucket, field, both.begin(), both.end(), 1, true);
+    context.index_value_trigram(1, bucket, field, foo.begin(), foo.end(), 2, true);
+    context.index_value_trigram(1, bucket, field, bar.begin(), bar.end(), 3, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foo.*bar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK_EQUAL(mtn::prepared_query_t::MTN_PLAN_AND, prepared->root()->type);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(1, result.count());
+    BOOST_CHECK(result.bit(1));
+
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foo|bar\"))", &prepared));
+    guard.reset(prepared);
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(3, result.count());
+}
+
+BOOST_AUTO_TEST_CASE(test_regex_unverified)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    // without stored values the candidates can't be checked
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_TRIGRAM_VALUES, "0", 1);
+    BOOST_CHECK(context.init());
+
+    std::string value = "barfoo";
+    context.index_value_trigram(1, bucket, field, value.begin(), value.end(), 1, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"foo.*bar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    mtn::status_t status = prepared->execute(NULL, 0, result);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_UNVERIFIED, status.code);
+}
+
+BOOST_AUTO_TEST_CASE(test_regex_fold)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_TRIGRAM_FOLD, "1", 1);
+    BOOST_CHECK(context.init());
+
+    std::string upper = "FooBar";
+    std::string lower = "foobar";
+    context.index_value_trigram(1, bucket, field, upper.begin(), upper.end(), 1, true);
+    context.index_value_trigram(1, bucket, field, lower.begin(), lower.end(), 2, true);
+
+    // case insensitive patterns are narrowed down by the folded trigrams
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"(?i)fOObar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(!prepared->root()->all);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(2, result.count());
+
+    // case sensitive patterns are still verified against the raw value
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (regex \"FooB\"))", &prepared));
+    guard.reset(prepared);
+    BOOST_CHECK(!prepared->root()->all);
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(1, result.count());
+    BOOST_CHECK(result.bit(1));
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_fold)
+{
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_TRIGRAM_FOLD, "3", 1);
+    BOOST_CHECK(!context.init());
+}
+
+BOOST_AUTO_TEST_CASE(test_prefix)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "url";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 3);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    const char* urls[] = {"/api/users", "/api/orders", "/static/app.js", "/api/users/123/orders", "/api/users/123/profile"};
+    for (size_t i = 0; i < 5; ++i) {
+        std::string url(urls[i]);
+        context.index_value_prefix(1, bucket, field, url.begin(), url.end(), i, true);
+    }
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(prefix \"url\" \"/api/\")", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(!prepared->root()->verify);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(4, result.count());
+    BOOST_CHECK(!result.bit(2));
+
+    // longer than the key, the two values sharing the first 16 bytes are verified
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(prefix \"url\" \"/api/users/123/pr\")", &prepared));
+    guard.reset(prepared);
+    BOOST_CHECK(prepared->root()->verify);
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(1, result.count());
+    BOOST_CHECK(result.bit(4));
+}
+
+BOOST_AUTO_TEST_CASE(test_value)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "country";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    const char* countries[] = {"US", "DE", "US", "FR"};
+    for (size_t i = 0; i < 4; ++i) {
+        std::string country(countries[i]);
+        BOOST_CHECK(context.index_value_string(1, bucket, field, country.begin(), country.end(), i, true));
+    }
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"country\" (value \"US\") (value \"IT\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(2, result.count());
+    BOOST_CHECK(result.bit(0));
+    BOOST_CHECK(result.bit(2));
+
+    // values are resolved on every execution
+    std::string country("IT");
+    BOOST_CHECK(context.index_value_string(1, bucket, field, country.begin(), country.end(), 5, true));
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(3, result.count());
+    BOOST_CHECK(result.bit(5));
+
+    BOOST_CHECK(context.index_value_string(1, bucket, field, country.begin(), country.end(), 5, false));
+
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(2, result.count());
+    BOOST_CHECK(!result.bit(5));
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_query)
+{
+    std::vector<mtn::byte_t> bucket;
+    mtn::context_t context(new index_reader_writer_memory_t());
+
+    mtn::prepared_query_t* prepared = NULL;
+    mtn::status_t status = mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\"", &prepared);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_BAD_QUERY, status.code);
+    BOOST_CHECK(prepared == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_one_array[] = "foobar";
+    std::vector<mtn::byte_t> field_one(field_one_array, field_one_array + 6);
+
+    mtn::byte_t field_two_array[] = "bizbar";
+    std::vector<mtn::byte_t> field_two(field_two_array, field_two_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_QUERY_THREADS, "3", 1);
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.query_pool() != NULL);
+
+    // one bit per segment so the offset space is split into many ranges
+    for (int i = 0; i < 100; ++i) {
+        context.index_value(1, bucket, field_one, 1, i * 2048, true);
+        if (i % 3 == 0) {
+            context.index_value(1, bucket, field_two, 1, i * 2048, true);
+        }
+    }
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(and (slice \"foobar\") (slice \"bizbar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(34, result.size());
+
+    mtn_index_address_t previous = 0;
+    mtn::index_slice_t::const_iterator iter = result.cbegin();
+    for (; iter != result.cend(); ++iter) {
+        BOOST_CHECK(iter == result.cbegin() || iter->offset > previous);
+        previous = iter->offset;
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(i % 3 == 0, result.bit(i * 2048));
+    }
+
+    mtn::index_slice_t range;
+    BOOST_CHECK(prepared->execute(NULL, 0, 10, 20, range));
+    BOOST_CHECK_EQUAL(3, range.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_cache)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_QUERY_CACHE_SIZE, "8", 1);
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.query_cache() != NULL);
+    context.index_value(1, bucket, field, 1, 1, true);
+    context.index_value(1, bucket, field, 2, 2, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\" (param 0))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::range_t one(1, 2);
+    mtn::range_t two(2, 3);
+    for (int i = 0; i < 2; ++i) {
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(&one, 1, result));
+        BOOST_CHECK(result.bit(1));
+        BOOST_CHECK(!result.bit(2));
+    }
+    BOOST_CHECK_EQUAL(1, context.query_cache()->size());
+
+    // bound params are part of the key
+    {
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(&two, 1, result));
+        BOOST_CHECK(!result.bit(1));
+        BOOST_CHECK(result.bit(2));
+    }
+    BOOST_CHECK_EQUAL(2, context.query_cache()->size());
+
+    // a write to the index invalidates the cached result
+    context.index_value(1, bucket, field, 1, 3, true);
+    {
+        mtn::index_slice_t result;
+        BOOST_CHECK(prepared->execute(&one, 1, result));
+        BOOST_CHECK(result.bit(1));
+        BOOST_CHECK(result.bit(3));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_escaped)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "f";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 1);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_QUERY_CACHE_SIZE, "8", 1);
+    BOOST_CHECK(context.init());
+
+    const char* values[] = {"a", "b", "a\") (value \"b"};
+    for (size_t i = 0; i < 3; ++i) {
+        std::string value(values[i]);
+        BOOST_CHECK(context.index_value_string(1, bucket, field, value.begin(), value.end(), i, true));
+    }
+
+    // one value holding quotes, and two values, must not share a cache entry
+    mtn::prepared_query_t* prepared_one = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"f\" (value \"a\\\") (value \\\"b\"))", &prepared_one));
+    std::auto_ptr<mtn::prepared_query_t> guard_one(prepared_one);
+
+    mtn::prepared_query_t* prepared_two = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"f\" (value \"a\") (value \"b\"))", &prepared_two));
+    std::auto_ptr<mtn::prepared_query_t> guard_two(prepared_two);
+
+    BOOST_CHECK(prepared_one->canonical() != prepared_two->canonical());
+
+    mtn::index_slice_t result_one;
+    BOOST_CHECK(prepared_one->execute(NULL, 0, result_one));
+    BOOST_CHECK_EQUAL(1, result_one.count());
+    BOOST_CHECK(result_one.bit(2));
+
+    mtn::index_slice_t result_two;
+    BOOST_CHECK(prepared_two->execute(NULL, 0, result_two));
+    BOOST_CHECK_EQUAL(2, result_two.count());
+    BOOST_CHECK(result_two.bit(0));
+    BOOST_CHECK(result_two.bit(1));
+    BOOST_CHECK_EQUAL(2, context.query_cache()->size());
+}
+
+BOOST_AUTO_TEST_CASE(test_write_versions)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, field, 1, 1, true));
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.get_index(1, bucket, field, &index));
+    BOOST_REQUIRE(index);
+
+    uint64_t version = context.index_version(index);
+    BOOST_CHECK(context.index_value(1, bucket, field, 1, 2, false));
+    BOOST_CHECK_EQUAL(version + 1, context.index_version(index));
+
+    // the write released the index
+    BOOST_CHECK(index->mutex().try_lock());
+    index->mutex().unlock();
+}
+
+BOOST_AUTO_TEST_CASE(test_query_waits_for_write)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, field, 1, 1, true));
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.get_index(1, bucket, field, &index));
+    BOOST_REQUIRE(index);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_REQUIRE(mtn::prepared_query_t::prepare(1, context, bucket, "(slice \"foobar\")", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    // a write in progress holds the index exclusively
+    index->mutex().lock();
+    mtn::index_slice_t result;
+    boost::thread thread(execute_task_t(*prepared, result));
+    BOOST_CHECK(!thread.timed_join(boost::posix_time::milliseconds(50)));
+
+    index->index_value(context.index_reader_writer(), 1, 2, true);
+    index->mutex().unlock();
+    thread.join();
+
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_missing_index)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 1, true));
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_REQUIRE(mtn::prepared_query_t::prepare(1, context, bucket, "(or (slice \"a\") (slice \"b\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    // nothing has been written to b yet, it reads as empty
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(!result.bit(2));
+
+    // and is found once it has been
+    BOOST_CHECK(context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 2, true));
+    result.clear();
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_execute)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    BOOST_CHECK(context.init());
+    BOOST_CHECK(context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 1, true));
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_REQUIRE(mtn::prepared_query_t::prepare(1, context, bucket, "(or (slice \"a\") (slice \"b\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    // b is resolved again by every execution until it's written, while
+    // the other threads are evaluating the plan
+    size_t failed[4] = { 0, 0, 0, 0 };
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.create_thread(repeat_task_t(*prepared, failed[i]));
+    }
+    BOOST_CHECK(context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 2, true));
+    threads.join_all();
+
+    for (int i = 0; i < 4; ++i) {
+        BOOST_CHECK_EQUAL(0, failed[i]);
+    }
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_common_subexpression)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 1, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 3, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'c'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'c'), 1, 4, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket,
+                                               "(or (and (slice \"a\") (slice \"b\")) (xor (and (slice \"b\") (slice \"a\")) (slice \"c\")))",
+                                               &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    const mtn::prepared_query_t::plan_node_t* root = prepared->root();
+    BOOST_CHECK(!root->shared);
+    BOOST_CHECK(root->children[0].shared);
+    BOOST_CHECK(root->children[1].children[0].shared);
+    BOOST_CHECK(!root->children[1].children[1].shared);
+    // slices are read directly, even the ones repeated under the shared and
+    BOOST_CHECK(!root->children[0].children[0].shared);
+    BOOST_CHECK(!root->children[0].children[1].shared);
+    BOOST_CHECK(!root->children[1].children[0].children[0].shared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK(!result.bit(1));
+    BOOST_CHECK(result.bit(2));
+    BOOST_CHECK(!result.bit(3));
+    BOOST_CHECK(result.bit(4));
+}
+
+BOOST_AUTO_TEST_CASE(test_common_subexpression_escaped)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "f";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 1);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    const char* values[] = {"a", "b", "a\") (value \"b"};
+    for (size_t i = 0; i < 3; ++i) {
+        std::string value(values[i]);
+        BOOST_CHECK(context.index_value_string(1, bucket, field, value.begin(), value.end(), i, true));
+        BOOST_CHECK(context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 's'), 1, i, true));
+    }
+
+    // the two ands differ only in how their values are quoted, neither
+    // may be evaluated as the other
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket,
+                                               "(xor (and (slice \"f\" (value \"a\\\") (value \\\"b\")) (slice \"s\"))"
+                                               " (and (slice \"f\" (value \"a\") (value \"b\")) (slice \"s\")))",
+                                               &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    const mtn::prepared_query_t::plan_node_t* root = prepared->root();
+    BOOST_CHECK(!root->children[0].shared);
+    BOOST_CHECK(!root->children[1].shared);
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(prepared->execute(NULL, 0, result));
+    BOOST_CHECK_EQUAL(3, result.count());
+    BOOST_CHECK(result.bit(0));
+    BOOST_CHECK(result.bit(1));
+    BOOST_CHECK(result.bit(2));
+}
+
+BOOST_AUTO_TEST_CASE(test_subexpression_cache)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_SUBEXPRESSION_CACHE_SIZE, "8", 1);
+    BOOST_CHECK(context.init());
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 1, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'c'), 1, 3, true);
+
+    mtn::prepared_query_t* prepared_one = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(or (and (slice \"a\") (slice \"b\")) (slice \"c\"))", &prepared_one));
+    std::auto_ptr<mtn::prepared_query_t> guard_one(prepared_one);
+
+    mtn::prepared_query_t* prepared_two = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(xor (and (slice \"b\") (slice \"a\")) (slice \"c\"))", &prepared_two));
+    std::auto_ptr<mtn::prepared_query_t> guard_two(prepared_two);
+
+    mtn::index_slice_t result_one;
+    BOOST_CHECK(prepared_one->execute(NULL, 0, result_one));
+    BOOST_CHECK_EQUAL(1, context.subexpression_cache()->size());
+
+    // the shared and is served from the cache rather than stored again
+    mtn::index_slice_t result_two;
+    BOOST_CHECK(prepared_two->execute(NULL, 0, result_two));
+    BOOST_CHECK_EQUAL(1, context.subexpression_cache()->size());
+    BOOST_CHECK(!result_two.bit(1));
+    BOOST_CHECK(result_two.bit(2));
+    BOOST_CHECK(result_two.bit(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_subexpression_cache_params)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_SUBEXPRESSION_CACHE_SIZE, "8", 1);
+    BOOST_CHECK(context.init());
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 1, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'a'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'b'), 1, 2, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'c'), 1, 3, true);
+    context.index_value(1, bucket, std::vector<mtn::byte_t>(1, 'c'), 5, 4, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(or (and (slice \"a\" (param 0)) (slice \"b\")) (slice \"c\" (param 1)))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::range_t params[] = { mtn::range_t(0, 2), mtn::range_t(0, 2) };
+    mtn::index_slice_t result_one;
+    BOOST_CHECK(prepared->execute(params, 2, result_one));
+    BOOST_CHECK_EQUAL(1, context.subexpression_cache()->size());
+
+    // the and doesn't read param 1, it's served from the cache
+    params[1] = mtn::range_t(4, 6);
+    mtn::index_slice_t result_two;
+    BOOST_CHECK(prepared->execute(params, 2, result_two));
+    BOOST_CHECK_EQUAL(1, context.subexpression_cache()->size());
+    BOOST_CHECK(!result_two.bit(1));
+    BOOST_CHECK(result_two.bit(2));
+    BOOST_CHECK(!result_two.bit(3));
+    BOOST_CHECK(result_two.bit(4));
+
+    // but not for another value of the param it does read
+    params[0] = mtn::range_t(4, 6);
+    mtn::index_slice_t result_three;
+    BOOST_CHECK(prepared->execute(params, 2, result_three));
+    BOOST_CHECK_EQUAL(2, context.subexpression_cache()->size());
+    BOOST_CHECK(!result_three.bit(2));
+    BOOST_CHECK(result_three.bit(4));
+}
+
+BOOST_AUTO_TEST_CASE(test_group)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::byte_t group_name_array[] = "country";
+    std::vector<mtn::byte_t> group(group_name_array, group_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    for (int i = 1; i <= 4; ++i) {
+        context.index_value(1, bucket, field, 1, i, true);
+    }
+    context.index_value(1, bucket, group, 10, 1, true);
+    context.index_value(1, bucket, group, 20, 2, true);
+    context.index_value(1, bucket, group, 20, 3, true);
+    context.index_value(1, bucket, group, 30, 9, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(rgroup \"country\" (slice \"foobar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+    BOOST_CHECK(prepared->grouped());
+
+    mtn::group_result_t groups;
+    BOOST_CHECK(prepared->execute_group(NULL, 0, groups));
+    BOOST_CHECK_EQUAL(2, groups.size());
+    BOOST_CHECK(10 == groups[0].first);
+    BOOST_CHECK_EQUAL(1, groups[0].second);
+    BOOST_CHECK(20 == groups[1].first);
+    BOOST_CHECK_EQUAL(2, groups[1].second);
+
+    mtn::prepared_query_t* nested = NULL;
+    BOOST_CHECK(!mtn::prepared_query_t::prepare(1, context, bucket, "(group \"country\" (not (group \"country\" (slice \"foobar\"))))", &nested));
+}
+
+BOOST_AUTO_TEST_CASE(test_top)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    mtn::byte_t group_name_array[] = "country";
+    std::vector<mtn::byte_t> group(group_name_array, group_name_array + 7);
+
+    mtn::context_t context(new index_reader_writer_memory_t());
+    for (int i = 1; i <= 4; ++i) {
+        context.index_value(1, bucket, field, 1, i, true);
+    }
+    context.index_value(1, bucket, group, 10, 1, true);
+    context.index_value(1, bucket, group, 20, 2, true);
+    context.index_value(1, bucket, group, 20, 3, true);
+    context.index_value(1, bucket, group, 30, 9, true);
+
+    mtn::prepared_query_t* prepared = NULL;
+    BOOST_CHECK(mtn::prepared_query_t::prepare(1, context, bucket, "(top 1 \"country\" (slice \"foobar\"))", &prepared));
+    std::auto_ptr<mtn::prepared_query_t> guard(prepared);
+
+    mtn::group_result_t groups;
+    BOOST_CHECK(prepared->execute_group(NULL, 0, groups));
+    BOOST_CHECK_EQUAL(1, groups.size());
+    BOOST_CHECK(20 == groups[0].first);
+    BOOST_CHECK_EQUAL(2, groups[0].second);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "fixtures.hpp"
+#include "index.hpp"
+#include "query_cache.hpp"
+
+BOOST_AUTO_TEST_SUITE(_query_cache)
+
+BOOST_AUTO_TEST_CASE(test_lookup)
+{
+    mtn::index_t index(1, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>());
+    mtn::query_cache_t::versions_t versions;
+    versions.push_back(mtn::query_cache_t::version_t(&index, 1));
+
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_slice_t slice;
+    slice.bit(reader_writer, 5, true);
+
+    mtn::query_cache_t cache(4);
+    mtn::index_slice_t result;
+    BOOST_CHECK(!cache.lookup("foo", versions, result));
+
+    cache.insert("foo", versions, slice);
+    BOOST_CHECK(cache.lookup("foo", versions, result));
+    BOOST_CHECK_EQUAL(1, result.size());
+    BOOST_CHECK(result.bit(5));
+}
+
+BOOST_AUTO_TEST_CASE(test_stale_version)
+{
+    mtn::index_t index(1, std::vector<mtn::byte_t>(), std::vector<mtn::byte_t>());
+    mtn::query_cache_t::versions_t versions;
+    versions.push_back(mtn::query_cache_t::version_t(&index, 1));
+
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_slice_t slice;
+    slice.bit(reader_writer, 5, true);
+
+    mtn::query_cache_t cache(4);
+    cache.insert("foo", versions, slice);
+
+    versions[0].second = 2;
+    mtn::index_slice_t result;
+    BOOST_CHECK(!cache.lookup("foo", versions, result));
+    BOOST_CHECK_EQUAL(0, result.size());
+    BOOST_CHECK_EQUAL(0, cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_eviction)
+{
+    mtn::query_cache_t::versions_t versions;
+    mtn::index_slice_t slice;
+
+    mtn::query_cache_t cache(2);
+    cache.insert("one", versions, slice);
+    cache.insert("two", versions, slice);
+
+    // touch one so that two is the least recently used
+    mtn::index_slice_t result;
+    BOOST_CHECK(cache.lookup("one", versions, result));
+
+    cache.insert("three", versions, slice);
+    BOOST_CHECK_EQUAL(2, cache.size());
+    BOOST_CHECK(cache.lookup("one", versions, result));
+    BOOST_CHECK(!cache.lookup("two", versions, result));
+    BOOST_CHECK(cache.lookup("three", versions, result));
+}
+
+BOOST_AUTO_TEST_CASE(test_max_age)
+{
+    mtn::query_cache_t::versions_t versions;
+    mtn::index_slice_t slice;
+
+    mtn::query_cache_t cache(2, 1);
+    cache.insert("one", versions, slice);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+    mtn::index_slice_t result;
+    BOOST_CHECK(!cache.lookup("one", versions, result));
+    BOOST_CHECK_EQUAL(0, cache.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
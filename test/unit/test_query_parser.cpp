@@ -21,6 +21,7 @@
 
 #include "fixtures.hpp"
 #include "query_parser.hpp"
+#include "query_printer.hpp"
 
 BOOST_AUTO_TEST_SUITE(_query_parser)
 
@@ -102,6 +103,29 @@ BOOST_AUTO_TEST_CASE(test_slice_range_randint)
     BOOST_CHECK(184467440737095516 == range_one.limit);
 }
 
+BOOST_AUTO_TEST_CASE(test_slice_param)
+{
+    std::string input = "(slice \"foobar\" (range 1 2) (param 0))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    mtn::expr result;
+    BOOST_CHECK_EQUAL(0, result.which());
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+    BOOST_CHECK_EQUAL(2, result.which());
+
+    mtn::op_slice slice = boost::get<mtn::op_slice>(result);
+    BOOST_CHECK_EQUAL("foobar", slice.index);
+    BOOST_CHECK_EQUAL(2, slice.values.size());
+
+    mtn::op_slice::iterator iter = slice.values.begin();
+    BOOST_CHECK_EQUAL(0, iter->which());
+    ++iter;
+    BOOST_CHECK_EQUAL(8, iter->which());
+    BOOST_CHECK_EQUAL(0, boost::get<mtn::param_t>(*iter).slot);
+}
+
 BOOST_AUTO_TEST_CASE(test_slice_range_big64uint)
 {
     std::string input = "(slice \"foobar\" (range 1 18446744073709551615))";
@@ -466,4 +490,136 @@ BOOST_AUTO_TEST_CASE(test_not_and_or_slices)
 
 }
 
+BOOST_AUTO_TEST_CASE(test_canonical_form)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    std::string input_one = "(and (slice \"foobar\" (range 2 3) (range 1 2)) (slice \"bizbang\"))";
+    std::string::const_iterator f(input_one.begin());
+    std::string::const_iterator l(input_one.end());
+    mtn::expr result_one;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result_one));
+
+    std::string input_two = "(and (slice \"bizbang\") (slice \"foobar\" (range 1 2) (range 2 3)))";
+    f = input_two.begin();
+    l = input_two.end();
+    mtn::expr result_two;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result_two));
+
+    std::string canonical = boost::apply_visitor(mtn::query_printer_t(), result_one);
+    BOOST_CHECK_EQUAL(canonical, boost::apply_visitor(mtn::query_printer_t(), result_two));
+    BOOST_CHECK(canonical.find("(slice \"bizbang\")") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_canonical_form_escaped)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    // one value holding a quote against two values
+    std::string input_one = "(slice \"f\" (value \"a\\\") (value \\\"b\"))";
+    std::string::const_iterator f(input_one.begin());
+    std::string::const_iterator l(input_one.end());
+    mtn::expr result_one;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result_one));
+    BOOST_REQUIRE_EQUAL(1, boost::get<mtn::op_slice>(result_one).values.size());
+
+    std::string input_two = "(slice \"f\" (value \"a\") (value \"b\"))";
+    f = input_two.begin();
+    l = input_two.end();
+    mtn::expr result_two;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result_two));
+
+    std::string canonical = boost::apply_visitor(mtn::query_printer_t(), result_one);
+    BOOST_CHECK(canonical != boost::apply_visitor(mtn::query_printer_t(), result_two));
+
+    // the canonical form parses back to the same query
+    f = canonical.begin();
+    l = canonical.end();
+    mtn::expr result_three;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result_three));
+    BOOST_CHECK_EQUAL(canonical, boost::apply_visitor(mtn::query_printer_t(), result_three));
+    BOOST_CHECK_EQUAL("a\") (value \"b", boost::get<mtn::value_t>(boost::get<mtn::op_slice>(result_three).values[0]).value);
+}
+
+BOOST_AUTO_TEST_CASE(test_group)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    std::string input = "(group \"country\" (slice \"foobar\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::expr result;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+    BOOST_CHECK_EQUAL(7, result.which());
+    BOOST_CHECK_EQUAL("country", boost::get<mtn::op_group>(result).index);
+    BOOST_CHECK(!boost::get<mtn::op_group>(result).reverse);
+    BOOST_CHECK_EQUAL(2, boost::get<mtn::op_group>(result).child.which());
+
+    input = "(rgroup \"country\" (slice \"foobar\"))";
+    f = input.begin();
+    l = input.end();
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+    BOOST_CHECK_EQUAL(7, result.which());
+    BOOST_CHECK(boost::get<mtn::op_group>(result).reverse);
+}
+
+BOOST_AUTO_TEST_CASE(test_top)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    std::string input = "(top 10 \"country\" (slice \"foobar\"))";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::expr result;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+    BOOST_CHECK_EQUAL(7, result.which());
+    BOOST_CHECK_EQUAL("country", boost::get<mtn::op_group>(result).index);
+    BOOST_CHECK_EQUAL(10, boost::get<mtn::op_group>(result).limit);
+    BOOST_CHECK_EQUAL("(top 10 \"country\" (slice \"foobar\"))", boost::apply_visitor(mtn::query_printer_t(), result));
+}
+
+BOOST_AUTO_TEST_CASE(test_prefix)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    std::string input = "(prefix \"url\" \"/api/\")";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::expr result;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+    BOOST_CHECK_EQUAL(2, result.which());
+
+    mtn::op_slice& slice = boost::get<mtn::op_slice>(result);
+    BOOST_CHECK_EQUAL("url", slice.index);
+    BOOST_REQUIRE_EQUAL(1, slice.values.size());
+    BOOST_CHECK_EQUAL("/api/", boost::get<mtn::prefix_t>(slice.values[0]).value);
+
+    // the long form prints and parses the same
+    std::string printed = boost::apply_visitor(mtn::query_printer_t(), result);
+    BOOST_CHECK_EQUAL("(slice \"url\" (prefix \"/api/\"))", printed);
+
+    f = printed.begin();
+    l = printed.end();
+    mtn::expr reparsed;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, reparsed));
+    BOOST_CHECK_EQUAL(printed, boost::apply_visitor(mtn::query_printer_t(), reparsed));
+}
+
+BOOST_AUTO_TEST_CASE(test_value)
+{
+    mtn::query_parser_t<std::string::const_iterator> p;
+
+    std::string input = "(value \"country\" \"US\")";
+    std::string::const_iterator f(input.begin());
+    std::string::const_iterator l(input.end());
+    mtn::expr result;
+    BOOST_CHECK(qi::phrase_parse(f, l, p, qi::space, result));
+
+    mtn::op_slice& slice = boost::get<mtn::op_slice>(result);
+    BOOST_CHECK_EQUAL("country", slice.index);
+    BOOST_REQUIRE_EQUAL(1, slice.values.size());
+    BOOST_CHECK_EQUAL("US", boost::get<mtn::value_t>(slice.values[0]).value);
+    BOOST_CHECK_EQUAL("(slice \"country\" (value \"US\"))", boost::apply_visitor(mtn::query_printer_t(), result));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
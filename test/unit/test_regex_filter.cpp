@@ -0,0 +1,145 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+
+#include "fixtures.hpp"
+#include "index.hpp"
+#include "regex_filter.hpp"
+#include "thread_pool.hpp"
+#include "value_store.hpp"
+
+BOOST_AUTO_TEST_SUITE(_regex_filter)
+
+BOOST_AUTO_TEST_CASE(test_value_store)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, to_vector("bizbang"), to_vector("foobar"));
+    mtn::value_store_t::values_t values;
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, index, 1, values));
+    BOOST_CHECK(values.empty());
+
+    BOOST_CHECK(mtn::value_store_t::update(reader_writer, index, 1, "foobar", true));
+    BOOST_CHECK(mtn::value_store_t::update(reader_writer, index, 1, "foobar", true));
+    BOOST_CHECK(mtn::value_store_t::update(reader_writer, index, 1, "bizbang", true));
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, index, 2, values));
+    BOOST_CHECK(values.empty());
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, index, 1, values));
+    BOOST_CHECK_EQUAL(2, values.size());
+
+    // other indexes of the bucket keep their own values
+    mtn::index_t other(1, to_vector("bizbang"), to_vector("bizbang"));
+    values.clear();
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, other, 1, values));
+    BOOST_CHECK(values.empty());
+
+    BOOST_CHECK(mtn::value_store_t::update(reader_writer, index, 1, "foobar", false));
+    values.clear();
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, index, 1, values));
+    BOOST_REQUIRE_EQUAL(1, values.size());
+    BOOST_CHECK_EQUAL("bizbang", values.front());
+
+    BOOST_CHECK(mtn::value_store_t::update(reader_writer, index, 1, "bizbang", false));
+    values.clear();
+    BOOST_CHECK(mtn::value_store_t::find(reader_writer, index, 1, values));
+    BOOST_CHECK(values.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_value_store_encode)
+{
+    mtn::value_store_t::values_t values;
+    values.push_back("foobar");
+    values.push_back("");
+    values.push_back(std::string("biz\0bang", 8));
+
+    std::vector<mtn::byte_t> record;
+    mtn::value_store_t::encode(values, record);
+    BOOST_CHECK_EQUAL(3 * 4 + 14, record.size());
+
+    mtn::value_store_t::values_t output;
+    BOOST_CHECK(mtn::value_store_t::decode(record, output));
+    BOOST_CHECK(values == output);
+
+    record.pop_back();
+    output.clear();
+    BOOST_CHECK(!mtn::value_store_t::decode(record, output));
+}
+
+BOOST_AUTO_TEST_CASE(test_verify)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, to_vector("bizbang"), to_vector("foobar"));
+    mtn::value_store_t::update(reader_writer, index, 1, "foobar", true);
+    mtn::value_store_t::update(reader_writer, index, 2, "barfoo", true);
+    mtn::value_store_t::update(reader_writer, index, 5000, "barfoo", true);
+
+    mtn::index_slice_t candidates;
+    candidates.bit(reader_writer, 1, true);
+    candidates.bit(reader_writer, 2, true);
+    candidates.bit(reader_writer, 5000, true);
+    BOOST_CHECK_EQUAL(2, candidates.size());
+
+    std::vector<mtn::regex_t> regexes(1, mtn::regex_t("foo.*bar"));
+    BOOST_CHECK(mtn::verify_regex(reader_writer, &index, regexes, NULL, candidates));
+    BOOST_CHECK_EQUAL(1, candidates.count());
+    BOOST_CHECK(candidates.bit(1));
+    BOOST_CHECK(!candidates.bit(2));
+    BOOST_CHECK_EQUAL(1, candidates.size());
+
+    // row 3 has no stored value and can't be verified
+    candidates.bit(reader_writer, 3, true);
+    mtn::status_t status = mtn::verify_regex(reader_writer, &index, regexes, NULL, candidates);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_UNVERIFIED, status.code);
+}
+
+BOOST_AUTO_TEST_CASE(test_verify_parallel)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, to_vector("bizbang"), to_vector("foobar"));
+    mtn::index_slice_t candidates;
+
+    // enough segments for several batches
+    for (mtn_index_address_t row = 0; row < 512 * 2048; row += 1024) {
+        mtn::value_store_t::update(reader_writer, index, row, row % 2048 == 0 ? "foobar" : "barfoo", true);
+        candidates.bit(reader_writer, row, true);
+    }
+
+    mtn::thread_pool_t pool(4);
+    std::vector<mtn::regex_t> regexes(1, mtn::regex_t("^foo"));
+    BOOST_CHECK(mtn::verify_regex(reader_writer, &index, regexes, &pool, candidates));
+    BOOST_CHECK_EQUAL(512, candidates.count());
+    BOOST_CHECK_EQUAL(512, candidates.size());
+    BOOST_CHECK(candidates.bit(2048));
+    BOOST_CHECK(!candidates.bit(1024));
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_regex)
+{
+    index_reader_writer_memory_t reader_writer;
+    mtn::index_t index(1, to_vector("bizbang"), to_vector("foobar"));
+    mtn::index_slice_t candidates;
+
+    std::vector<mtn::regex_t> regexes(1, mtn::regex_t("foo("));
+    mtn::status_t status = mtn::verify_regex(reader_writer, &index, regexes, NULL, candidates);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_BAD_REGEX, status.code);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
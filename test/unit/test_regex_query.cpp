@@ -0,0 +1,145 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+
+#include "query_printer.hpp"
+#include "regex_query.hpp"
+#include "trigram.hpp"
+
+BOOST_AUTO_TEST_SUITE(_regex_query)
+
+static mtn::range_t
+trigram_range(const std::string& trigram)
+{
+    std::vector<mtn::range_t> ranges;
+    mtn::trigram_t::to_ranges(trigram.begin(), trigram.end(), ranges);
+    return ranges.front();
+}
+
+BOOST_AUTO_TEST_CASE(test_unconstrained)
+{
+    mtn::expr query;
+    BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t("a.b"), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+    const mtn::op_slice* slice = boost::get<mtn::op_slice>(&query);
+    BOOST_REQUIRE(slice != NULL);
+    BOOST_CHECK_EQUAL("foobar", slice->index);
+    BOOST_CHECK(slice->values.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_single_trigram)
+{
+    mtn::expr query;
+    BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t("foo.*"), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+    mtn::op_slice expected;
+    expected.index = "foobar";
+    expected.values.push_back(trigram_range("foo"));
+    BOOST_CHECK_EQUAL(mtn::query_printer_t()(expected), boost::apply_visitor(mtn::query_printer_t(), query));
+}
+
+BOOST_AUTO_TEST_CASE(test_and)
+{
+    mtn::expr query;
+    BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t("foo.*bar"), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+    mtn::op_and expected;
+    mtn::op_slice foo;
+    foo.index = "foobar";
+    foo.values.push_back(trigram_range("foo"));
+    expected.children.push_back(foo);
+
+    mtn::op_slice bar;
+    bar.index = "foobar";
+    bar.values.push_back(trigram_range("bar"));
+    expected.children.push_back(bar);
+
+    BOOST_CHECK_EQUAL(mtn::query_printer_t()(expected), boost::apply_visitor(mtn::query_printer_t(), query));
+}
+
+BOOST_AUTO_TEST_CASE(test_or)
+{
+    mtn::expr query;
+    BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t("foo|bar"), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+    mtn::op_slice expected;
+    expected.index = "foobar";
+    expected.values.push_back(trigram_range("foo"));
+    expected.values.push_back(trigram_range("bar"));
+    BOOST_CHECK_EQUAL(mtn::query_printer_t()(expected), boost::apply_visitor(mtn::query_printer_t(), query));
+}
+
+BOOST_AUTO_TEST_CASE(test_and_or)
+{
+    mtn::expr query;
+    BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t("abc.*(xyz|uvw)"), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+    mtn::op_slice abc;
+    abc.index = "foobar";
+    abc.values.push_back(trigram_range("abc"));
+
+    mtn::op_slice alternatives;
+    alternatives.index = "foobar";
+    alternatives.values.push_back(trigram_range("xyz"));
+    alternatives.values.push_back(trigram_range("uvw"));
+
+    mtn::op_and expected;
+    expected.children.push_back(abc);
+    expected.children.push_back(alternatives);
+    BOOST_CHECK_EQUAL(mtn::query_printer_t()(expected), boost::apply_visitor(mtn::query_printer_t(), query));
+}
+
+BOOST_AUTO_TEST_CASE(test_upper_case)
+{
+    // atoms are lower case and can't be looked up in an unfolded index
+    const char* patterns[] = {"Foo.*", "(?i)foo.*", "\\x46oo"};
+    for (size_t i = 0; i < 3; ++i) {
+        mtn::expr query;
+        BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t(patterns[i]), mtn::MTN_TRIGRAM_FOLD_NONE, query));
+
+        const mtn::op_slice* slice = boost::get<mtn::op_slice>(&query);
+        BOOST_REQUIRE(slice != NULL);
+        BOOST_CHECK(slice->values.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fold)
+{
+    mtn::op_slice expected;
+    expected.index = "foobar";
+    expected.values.push_back(trigram_range("foo"));
+
+    const char* patterns[] = {"Foo.*", "(?i)fOO.*", "foo.*"};
+    for (size_t i = 0; i < 3; ++i) {
+        mtn::expr query;
+        BOOST_CHECK(mtn::regex_query("foobar", mtn::regex_t(patterns[i]), mtn::MTN_TRIGRAM_FOLD_CASE, query));
+        BOOST_CHECK_EQUAL(mtn::query_printer_t()(expected), boost::apply_visitor(mtn::query_printer_t(), query));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_regex)
+{
+    mtn::expr query;
+    mtn::status_t status = mtn::regex_query("foobar", mtn::regex_t("foo("), mtn::MTN_TRIGRAM_FOLD_NONE, query);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(MTN_ERROR_BAD_REGEX, status.code);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
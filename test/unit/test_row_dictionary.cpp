@@ -0,0 +1,176 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "context.hpp"
+#include "fixtures.hpp"
+#include "row_dictionary.hpp"
+
+BOOST_AUTO_TEST_SUITE(_row_dictionary)
+
+struct write_task_t
+{
+    write_task_t(
+        mtn::context_t&                 context,
+        const std::vector<mtn::byte_t>& bucket,
+        mtn::byte_t                     field,
+        uint64_t                        first) :
+        context(&context),
+        bucket(bucket),
+        field(1, field),
+        first(first)
+    {}
+
+    void
+    operator()()
+    {
+        for (uint64_t i = first; i < first + 500; ++i) {
+            context->index_value(1, bucket, field, 5, ((mtn_index_address_t) i) << 64, true);
+        }
+    }
+
+    mtn::context_t*          context;
+    std::vector<mtn::byte_t> bucket;
+    std::vector<mtn::byte_t> field;
+    uint64_t                 first;
+};
+
+BOOST_AUTO_TEST_CASE(test_insert)
+{
+    mtn_index_address_t high = ((mtn_index_address_t) 0xDEADBEEF) << 96;
+
+    mtn::row_dictionary_t dictionary;
+    mtn::row_dictionary_t::id_t id = 0;
+    bool added = false;
+
+    BOOST_CHECK(dictionary.insert(high | 7, id, &added));
+    BOOST_CHECK(added);
+    BOOST_CHECK_EQUAL(0, id);
+
+    // rows differing only in the high bits are distinct
+    BOOST_CHECK(dictionary.insert(7, id, &added));
+    BOOST_CHECK(added);
+    BOOST_CHECK_EQUAL(1, id);
+
+    BOOST_CHECK(dictionary.insert(high | 7, id, &added));
+    BOOST_CHECK(!added);
+    BOOST_CHECK_EQUAL(0, id);
+    BOOST_CHECK_EQUAL(2, dictionary.size());
+
+    BOOST_CHECK(dictionary.find(7, id));
+    BOOST_CHECK_EQUAL(1, id);
+    BOOST_CHECK(!dictionary.find(high, id));
+
+    mtn_index_address_t row = 0;
+    BOOST_CHECK(dictionary.row(0, row));
+    BOOST_CHECK(row == (high | 7));
+    BOOST_CHECK(!dictionary.row(2, row));
+}
+
+BOOST_AUTO_TEST_CASE(test_dense_rows)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "foobar";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 6);
+
+    index_reader_writer_memory_t* rw = new index_reader_writer_memory_t();
+    mtn::context_t context(rw);
+    context.set_opt(MTN_OPT_ROW_DICTIONARY, "1", 1);
+    BOOST_CHECK(context.init());
+
+    // hashed row ids, far apart in the 128 bit space
+    std::vector<mtn_index_address_t> rows;
+    for (uint64_t i = 1; i <= 100; ++i) {
+        rows.push_back((((mtn_index_address_t) (i * 0x9E3779B97F4A7C15ULL)) << 64) | i);
+        BOOST_CHECK(context.index_value(1, bucket, field, 5, rows.back(), true));
+    }
+
+    mtn::index_t* index = NULL;
+    BOOST_CHECK(context.get_index(1, bucket, field, &index));
+
+    mtn::index_slice_t result;
+    mtn::range_t range(5, 6);
+    BOOST_CHECK(index->slice(&range, 1, result));
+    BOOST_CHECK_EQUAL(1, result.size());
+    BOOST_CHECK_EQUAL(100, result.count());
+
+    std::vector<mtn_index_address_t> output;
+    BOOST_CHECK(context.rows(1, bucket, result, output));
+    BOOST_REQUIRE_EQUAL(100, output.size());
+    BOOST_CHECK(std::equal(rows.begin(), rows.end(), output.begin()));
+
+    // clearing a row which was never indexed doesn't map it
+    BOOST_CHECK(context.index_value(1, bucket, field, 5, 12345, false));
+
+    mtn::row_dictionary_t* dictionary = NULL;
+    BOOST_CHECK(context.row_dictionary(1, bucket, &dictionary));
+    BOOST_CHECK_EQUAL(100, dictionary->size());
+
+    // the mapping was written through the backend
+    mtn::row_dictionary_t persisted;
+    BOOST_CHECK(rw->read_row_dictionary(1, bucket, persisted));
+    BOOST_CHECK_EQUAL(100, persisted.size());
+
+    mtn::row_dictionary_t::id_t id = 0;
+    BOOST_CHECK(persisted.find(rows[42], id));
+    BOOST_CHECK_EQUAL(42, id);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_fields)
+{
+    std::vector<mtn::byte_t> bucket = to_vector("bizbang");
+    mtn::context_t context(new index_reader_writer_memory_t());
+    context.set_opt(MTN_OPT_ROW_DICTIONARY, "1", 1);
+    BOOST_CHECK(context.init());
+
+    // every field of the bucket maps its rows through one dictionary
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.create_thread(write_task_t(context, bucket, 'a' + i, i * 500));
+    }
+    threads.join_all();
+
+    mtn::row_dictionary_t* dictionary = NULL;
+    BOOST_CHECK(context.row_dictionary(1, bucket, &dictionary));
+    BOOST_CHECK_EQUAL(2000, dictionary->size());
+
+    for (int i = 0; i < 4; ++i) {
+        mtn::index_t* index = NULL;
+        BOOST_REQUIRE(context.get_index(1, bucket, std::vector<mtn::byte_t>(1, 'a' + i), &index));
+
+        mtn::index_slice_t result;
+        mtn::range_t range(5, 6);
+        BOOST_CHECK(index->slice(&range, 1, result));
+        BOOST_CHECK_EQUAL(500, result.count());
+
+        std::vector<mtn_index_address_t> rows;
+        BOOST_CHECK(context.rows(1, bucket, result, rows));
+        BOOST_REQUIRE_EQUAL(500, rows.size());
+        std::sort(rows.begin(), rows.end(), mtn::index_address_comparator_t());
+        for (uint64_t j = 0; j < 500; ++j) {
+            BOOST_CHECK(rows[j] == ((mtn_index_address_t) (i * 500 + j)) << 64);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,176 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include "index_slice.hpp"
+#include "segment_cursor.hpp"
+
+inline void
+set_bits(mtn::index_slice_t& slice,
+         mtn_index_address_t offset,
+         uint64_t            word)
+{
+    mtn::index_slice_t::index_node_t* node = new mtn::index_slice_t::index_node_t(offset);
+    node->zero();
+    node->segment[0] = word;
+    slice.insert(slice.end(), node);
+}
+
+BOOST_AUTO_TEST_SUITE(_segment_cursor)
+
+BOOST_AUTO_TEST_CASE(slice_cursor)
+{
+    mtn::index_slice_t a;
+    set_bits(a, 1, 1);
+    set_bits(a, 3, 2);
+    set_bits(a, 7, 4);
+
+    mtn::slice_cursor_t cursor(a);
+    BOOST_CHECK(!cursor.valid());
+    BOOST_CHECK(cursor.next());
+    BOOST_CHECK(1 == cursor.offset());
+    BOOST_CHECK(cursor.seek(4));
+    BOOST_CHECK(7 == cursor.offset());
+    BOOST_CHECK_EQUAL(4, cursor.segment()[0]);
+    BOOST_CHECK(!cursor.next());
+}
+
+BOOST_AUTO_TEST_CASE(slice_cursor_seek)
+{
+    mtn::index_slice_t a;
+    for (mtn_index_address_t offset = 0; offset < 64; offset += 2) {
+        set_bits(a, offset, 1);
+    }
+
+    mtn::slice_cursor_t cursor(a);
+    BOOST_CHECK(cursor.seek(31));
+    BOOST_CHECK(32 == cursor.offset());
+
+    // a seek behind the cursor leaves it where it is
+    BOOST_CHECK(cursor.seek(4));
+    BOOST_CHECK(32 == cursor.offset());
+    BOOST_CHECK(cursor.seek(62));
+    BOOST_CHECK(62 == cursor.offset());
+    BOOST_CHECK(!cursor.seek(63));
+}
+
+BOOST_AUTO_TEST_CASE(and_cursor)
+{
+    mtn::index_slice_t a;
+    set_bits(a, 1, 3);
+    set_bits(a, 3, 3);
+    set_bits(a, 9, 3);
+
+    mtn::index_slice_t b;
+    set_bits(b, 2, 1);
+    set_bits(b, 3, 1);
+    set_bits(b, 8, 1);
+    set_bits(b, 9, 2);
+
+    mtn::and_cursor_t cursor;
+    cursor.add(new mtn::slice_cursor_t(a));
+    cursor.add(new mtn::slice_cursor_t(b));
+
+    mtn::index_slice_t o;
+    mtn::materialize(cursor, o);
+    BOOST_CHECK_EQUAL(2, o.size());
+    BOOST_CHECK(3 == o.begin()->offset);
+    BOOST_CHECK_EQUAL(1, o.begin()->segment[0]);
+    BOOST_CHECK(9 == (++o.begin())->offset);
+    BOOST_CHECK_EQUAL(2, (++o.begin())->segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(or_cursor)
+{
+    mtn::index_slice_t a;
+    set_bits(a, 1, 1);
+    set_bits(a, 3, 1);
+
+    mtn::index_slice_t b;
+    set_bits(b, 2, 2);
+    set_bits(b, 3, 2);
+
+    mtn::merge_cursor_t cursor(mtn::MTN_INDEX_OP_UNION);
+    cursor.add(new mtn::slice_cursor_t(a));
+    cursor.add(new mtn::slice_cursor_t(b));
+
+    mtn::index_slice_t o;
+    mtn::materialize(cursor, o);
+    BOOST_CHECK_EQUAL(3, o.size());
+
+    mtn::index_slice_t::iterator iter = o.begin();
+    BOOST_CHECK(1 == iter->offset);
+    BOOST_CHECK_EQUAL(1, iter->segment[0]);
+    ++iter;
+    BOOST_CHECK(2 == iter->offset);
+    BOOST_CHECK_EQUAL(2, iter->segment[0]);
+    ++iter;
+    BOOST_CHECK(3 == iter->offset);
+    BOOST_CHECK_EQUAL(3, iter->segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(xor_cursor)
+{
+    mtn::index_slice_t a;
+    set_bits(a, 1, 1);
+    set_bits(a, 3, 3);
+
+    mtn::index_slice_t b;
+    set_bits(b, 3, 2);
+
+    mtn::merge_cursor_t cursor(mtn::MTN_INDEX_OP_SYMMETRIC_DIFFERENCE);
+    cursor.add(new mtn::slice_cursor_t(a));
+    cursor.add(new mtn::slice_cursor_t(b));
+
+    mtn::index_slice_t o;
+    mtn::materialize(cursor, o);
+    BOOST_CHECK_EQUAL(2, o.size());
+    BOOST_CHECK_EQUAL(1, o.begin()->segment[0]);
+    BOOST_CHECK_EQUAL(1, (++o.begin())->segment[0]);
+}
+
+BOOST_AUTO_TEST_CASE(not_and_or_cursor)
+{
+    mtn::index_slice_t a;
+    set_bits(a, 1, 1);
+    set_bits(a, 5, 1);
+
+    mtn::index_slice_t b;
+    set_bits(b, 5, 2);
+
+    mtn::index_slice_t c;
+    set_bits(c, 1, 1);
+    set_bits(c, 5, 1);
+
+    mtn::merge_cursor_t* either = new mtn::merge_cursor_t(mtn::MTN_INDEX_OP_UNION);
+    either->add(new mtn::slice_cursor_t(a));
+    either->add(new mtn::slice_cursor_t(b));
+
+    mtn::and_cursor_t cursor;
+    cursor.add(either);
+    cursor.add(new mtn::not_cursor_t(new mtn::slice_cursor_t(c)));
+
+    mtn::index_slice_t o;
+    mtn::materialize(cursor, o);
+    BOOST_CHECK_EQUAL(2, o.size());
+    BOOST_CHECK_EQUAL(0, o.begin()->segment[0]);
+    BOOST_CHECK_EQUAL(2, (++o.begin())->segment[0]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
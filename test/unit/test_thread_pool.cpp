@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "thread_pool.hpp"
+
+struct counter_t
+{
+    counter_t() :
+        count(0)
+    {}
+
+    void
+    increment()
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        ++count;
+        condition.notify_all();
+    }
+
+    void
+    wait(int expected)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        while (count < expected) {
+            condition.wait(lock);
+        }
+    }
+
+    boost::mutex              mutex;
+    boost::condition_variable condition;
+    int                       count;
+};
+
+void
+throw_task()
+{
+    throw "shouldn't happen";
+}
+
+BOOST_AUTO_TEST_SUITE(_thread_pool)
+
+BOOST_AUTO_TEST_CASE(test_size)
+{
+    mtn::thread_pool_t pool(3);
+    BOOST_CHECK_EQUAL(3, pool.size());
+
+    mtn::thread_pool_t empty(0);
+    BOOST_CHECK_EQUAL(1, empty.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_submit)
+{
+    counter_t counter;
+    {
+        mtn::thread_pool_t pool(4);
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit(boost::bind(&counter_t::increment, &counter));
+        }
+        counter.wait(1000);
+    }
+    BOOST_CHECK_EQUAL(1000, counter.count);
+}
+
+BOOST_AUTO_TEST_CASE(test_drain_on_destruction)
+{
+    counter_t counter;
+    {
+        mtn::thread_pool_t pool(2);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit(boost::bind(&counter_t::increment, &counter));
+        }
+    }
+    BOOST_CHECK_EQUAL(100, counter.count);
+}
+
+BOOST_AUTO_TEST_CASE(test_execute_throw)
+{
+    counter_t counter;
+    mtn::thread_pool_t pool(2);
+
+    std::vector<mtn::thread_pool_t::task_t> tasks;
+    for (int i = 0; i < 10; ++i) {
+        tasks.push_back(boost::bind(&counter_t::increment, &counter));
+    }
+    tasks.push_back(&throw_task);
+
+    mtn::status_t status = pool.execute(tasks);
+    BOOST_CHECK(!status);
+    BOOST_CHECK_EQUAL(10, counter.count);
+
+    // the workers are still there for the next batch
+    tasks.pop_back();
+    BOOST_CHECK(pool.execute(tasks));
+    BOOST_CHECK_EQUAL(20, counter.count);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
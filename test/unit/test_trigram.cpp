@@ -17,6 +17,7 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include "trigram.hpp"
 
@@ -34,9 +35,9 @@ BOOST_AUTO_TEST_CASE(simple)
     BOOST_CHECK_EQUAL(111, output.two);
     BOOST_CHECK_EQUAL(111, output.three);
 
-    BOOST_CHECK_EQUAL(102, (uint32_t) (output.hash() >> 64));
-    BOOST_CHECK_EQUAL(111, (uint32_t) (output.hash() >> 32));
-    BOOST_CHECK_EQUAL(111, (uint32_t) output.hash());
+    BOOST_CHECK_EQUAL(102, output.hash() >> 42);
+    BOOST_CHECK_EQUAL(111, (output.hash() >> 21) & 0x1FFFFF);
+    BOOST_CHECK_EQUAL(111, output.hash() & 0x1FFFFF);
 }
 
 BOOST_AUTO_TEST_CASE(small)
@@ -51,9 +52,9 @@ BOOST_AUTO_TEST_CASE(small)
     BOOST_CHECK_EQUAL(111, output.two);
     BOOST_CHECK_EQUAL(0, output.three);
 
-    BOOST_CHECK_EQUAL(102, (uint32_t) (output.hash() >> 64));
-    BOOST_CHECK_EQUAL(111, (uint32_t) (output.hash() >> 32));
-    BOOST_CHECK_EQUAL(0, (uint32_t) output.hash());
+    BOOST_CHECK_EQUAL(102, output.hash() >> 42);
+    BOOST_CHECK_EQUAL(111, (output.hash() >> 21) & 0x1FFFFF);
+    BOOST_CHECK_EQUAL(0, output.hash() & 0x1FFFFF);
 }
 
 BOOST_AUTO_TEST_CASE(order)
@@ -89,4 +90,100 @@ BOOST_AUTO_TEST_CASE(loop)
     BOOST_CHECK_EQUAL(3, counter);
 }
 
+BOOST_AUTO_TEST_CASE(sliding_window)
+{
+    std::string input = "foobar";
+    mtn::trigram_container output;
+    mtn::trigram_t::to_trigrams(input.begin(), input.end(), output);
+    BOOST_CHECK_EQUAL(4, output.size());
+
+    const char* expected[] = {"bar", "foo", "oba", "oob"};
+    for (size_t i = 0; i < 4; ++i) {
+        mtn::trigram_t trigram;
+        mtn::trigram_t::init(expected[i], expected[i] + 3, trigram);
+        BOOST_CHECK_EQUAL(trigram.hash(), output[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(distinct)
+{
+    std::string input = "fooooooo";
+    mtn::trigram_container output;
+    mtn::trigram_t::to_trigrams(input.begin(), input.end(), output);
+    BOOST_CHECK_EQUAL(2, output.size());
+    BOOST_CHECK(output[0] < output[1]);
+}
+
+BOOST_AUTO_TEST_CASE(padded)
+{
+    std::string input = "fo";
+    mtn::trigram_container output;
+    mtn::trigram_t::to_trigrams(input.begin(), input.end(), output);
+    BOOST_REQUIRE_EQUAL(1, output.size());
+
+    mtn::trigram_t trigram;
+    mtn::trigram_t::init(input.begin(), input.end(), trigram);
+    BOOST_CHECK_EQUAL(trigram.hash(), output[0]);
+}
+
+BOOST_AUTO_TEST_CASE(multibyte)
+{
+    // the same text with and without the ascii fast path
+    std::string ascii = "abcdefghijklmnopqrstuvwxyz";
+    std::string utf8 = ascii + "\xc3\xa9";
+
+    mtn::trigram_container ascii_output;
+    mtn::trigram_t::to_trigrams(ascii.begin(), ascii.end(), ascii_output);
+    BOOST_CHECK_EQUAL(24, ascii_output.size());
+
+    mtn::trigram_container utf8_output;
+    mtn::trigram_t::to_trigrams(utf8.begin(), utf8.end(), utf8_output);
+    BOOST_CHECK_EQUAL(25, utf8_output.size());
+    BOOST_CHECK(std::includes(utf8_output.begin(), utf8_output.end(), ascii_output.begin(), ascii_output.end()));
+
+    mtn::trigram_t trigram;
+    std::string last = "yz\xc3\xa9";
+    mtn::trigram_t::init(last.begin(), last.end(), trigram);
+    BOOST_CHECK_EQUAL(0xE9, trigram.three);
+    BOOST_CHECK(std::binary_search(utf8_output.begin(), utf8_output.end(), trigram.hash()));
+}
+
+BOOST_AUTO_TEST_CASE(fold)
+{
+    BOOST_CHECK_EQUAL('a', mtn::trigram_t::fold('A', mtn::MTN_TRIGRAM_FOLD_CASE));
+    BOOST_CHECK_EQUAL('a', mtn::trigram_t::fold('a', mtn::MTN_TRIGRAM_FOLD_CASE));
+    BOOST_CHECK_EQUAL('A', mtn::trigram_t::fold('A', mtn::MTN_TRIGRAM_FOLD_NONE));
+    BOOST_CHECK_EQUAL(0xE9, mtn::trigram_t::fold(0xC9, mtn::MTN_TRIGRAM_FOLD_CASE));       // E acute
+    BOOST_CHECK_EQUAL(0xD7, mtn::trigram_t::fold(0xD7, mtn::MTN_TRIGRAM_FOLD_CASE));       // multiplication sign
+    BOOST_CHECK_EQUAL(0x17A, mtn::trigram_t::fold(0x179, mtn::MTN_TRIGRAM_FOLD_CASE));     // Z acute
+    BOOST_CHECK_EQUAL(0x3B1, mtn::trigram_t::fold(0x391, mtn::MTN_TRIGRAM_FOLD_CASE));     // alpha
+    BOOST_CHECK_EQUAL(0x430, mtn::trigram_t::fold(0x410, mtn::MTN_TRIGRAM_FOLD_CASE));     // cyrillic a
+    BOOST_CHECK_EQUAL(0x450, mtn::trigram_t::fold(0x400, mtn::MTN_TRIGRAM_FOLD_CASE));     // cyrillic ie grave
+    BOOST_CHECK_EQUAL(0xFF41, mtn::trigram_t::fold(0xFF21, mtn::MTN_TRIGRAM_FOLD_CASE));   // full width a
+    BOOST_CHECK_EQUAL('a', mtn::trigram_t::fold(0xFF21, mtn::MTN_TRIGRAM_FOLD_CASE_WIDTH));
+    BOOST_CHECK_EQUAL('1', mtn::trigram_t::fold(0xFF11, mtn::MTN_TRIGRAM_FOLD_CASE_WIDTH));
+}
+
+BOOST_AUTO_TEST_CASE(fold_trigrams)
+{
+    std::string lower = "foobar";
+    std::string upper = "FooBAR";
+    std::string wide = "\xef\xbc\xa6oobar"; // full width F
+
+    mtn::trigram_container expected;
+    mtn::trigram_t::to_trigrams(lower.begin(), lower.end(), expected);
+
+    mtn::trigram_container output;
+    mtn::trigram_t::to_trigrams(upper.begin(), upper.end(), output, mtn::MTN_TRIGRAM_FOLD_CASE);
+    BOOST_CHECK(expected == output);
+
+    output.clear();
+    mtn::trigram_t::to_trigrams(wide.begin(), wide.end(), output, mtn::MTN_TRIGRAM_FOLD_CASE);
+    BOOST_CHECK(expected != output);
+
+    output.clear();
+    mtn::trigram_t::to_trigrams(wide.begin(), wide.end(), output, mtn::MTN_TRIGRAM_FOLD_CASE_WIDTH);
+    BOOST_CHECK(expected == output);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+/*
+  Copyright (c) 2013 Matthew Stump
+
+  This file is part of libmutton.
+
+  libmutton is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  libmutton is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "fixtures.hpp"
+#include "value_dictionary.hpp"
+
+BOOST_AUTO_TEST_SUITE(_value_dictionary)
+
+BOOST_AUTO_TEST_CASE(test_insert)
+{
+    mtn::value_dictionary_t dictionary;
+    mtn::value_dictionary_t::id_t id = 0;
+    bool added = false;
+
+    BOOST_CHECK(dictionary.insert("US", id, &added));
+    BOOST_CHECK(added);
+    BOOST_CHECK_EQUAL(0, id);
+
+    BOOST_CHECK(dictionary.insert("DE", id, &added));
+    BOOST_CHECK(added);
+    BOOST_CHECK_EQUAL(1, id);
+
+    BOOST_CHECK(dictionary.insert("US", id, &added));
+    BOOST_CHECK(!added);
+    BOOST_CHECK_EQUAL(0, id);
+    BOOST_CHECK_EQUAL(2, dictionary.size());
+
+    BOOST_CHECK(dictionary.find("DE", id));
+    BOOST_CHECK_EQUAL(1, id);
+    BOOST_CHECK(!dictionary.find("FR", id));
+
+    std::string value;
+    BOOST_CHECK(dictionary.value(1, value));
+    BOOST_CHECK_EQUAL("DE", value);
+    BOOST_CHECK(!dictionary.value(2, value));
+}
+
+BOOST_AUTO_TEST_CASE(test_seal)
+{
+    mtn::value_dictionary_t dictionary;
+    mtn::value_dictionary_t::id_t id = 0;
+
+    // enough values to be sealed more than once, inserted out of order
+    size_t count = MTN_VALUE_DICTIONARY_MIN_PENDING * 3 + 7;
+    for (size_t i = 0; i < count; ++i) {
+        std::string value = "/api/users/" + boost::lexical_cast<std::string>((i * 7919) % count);
+        BOOST_CHECK(dictionary.insert(value, id));
+        BOOST_CHECK_EQUAL(i, id);
+    }
+    dictionary.seal();
+    BOOST_CHECK_EQUAL(count, dictionary.size());
+
+    // the shared leading bytes are only stored once per block
+    BOOST_CHECK(dictionary.block_bytes() < count * 8);
+
+    for (size_t i = 0; i < count; ++i) {
+        std::string value = "/api/users/" + boost::lexical_cast<std::string>((i * 7919) % count);
+        BOOST_CHECK(dictionary.find(value, id));
+        BOOST_CHECK_EQUAL(i, id);
+
+        std::string output;
+        BOOST_CHECK(dictionary.value(i, output));
+        BOOST_CHECK_EQUAL(value, output);
+    }
+
+    BOOST_CHECK(!dictionary.find("/api/users/", id));
+    BOOST_CHECK(!dictionary.find("/api/users/1x", id));
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_value)
+{
+    mtn::value_dictionary_t dictionary;
+    mtn::value_dictionary_t::id_t id = 0;
+
+    BOOST_CHECK(dictionary.insert("a", id));
+    BOOST_CHECK(dictionary.insert("", id));
+    BOOST_CHECK_EQUAL(1, id);
+    dictionary.seal();
+
+    BOOST_CHECK(dictionary.find("", id));
+    BOOST_CHECK_EQUAL(1, id);
+
+    std::string value("x");
+    BOOST_CHECK(dictionary.value(1, value));
+    BOOST_CHECK(value.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_persisted)
+{
+    mtn::byte_t bucket_name_array[] = "bizbang";
+    std::vector<mtn::byte_t> bucket(bucket_name_array, bucket_name_array + 7);
+
+    mtn::byte_t field_name_array[] = "country";
+    std::vector<mtn::byte_t> field(field_name_array, field_name_array + 7);
+
+    index_reader_writer_memory_t rw;
+    BOOST_CHECK(rw.write_value_dictionary(1, bucket, field, 0, "US"));
+    BOOST_CHECK(rw.write_value_dictionary(1, bucket, field, 1, "DE"));
+
+    mtn::value_dictionary_t dictionary;
+    BOOST_CHECK(rw.read_value_dictionary(1, bucket, field, dictionary));
+    BOOST_CHECK_EQUAL(2, dictionary.size());
+
+    mtn::value_dictionary_t::id_t id = 0;
+    BOOST_CHECK(dictionary.find("DE", id));
+    BOOST_CHECK_EQUAL(1, id);
+
+    // the next value continues where the persisted ids left off
+    BOOST_CHECK(dictionary.insert("FR", id));
+    BOOST_CHECK_EQUAL(2, id);
+
+    mtn::value_dictionary_t other;
+    BOOST_CHECK(rw.read_value_dictionary(2, bucket, field, other));
+    BOOST_CHECK_EQUAL(0, other.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()